@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi;
+
+import java.util.concurrent.CompletionStage;
+import uk.ac.lancs.fastcgi.context.AsyncResponderContext;
+import uk.ac.lancs.fastcgi.context.SessionException;
+
+/**
+ * Responds to complete FastCGI requests without occupying a thread
+ * while waiting on other services. The session remains open until the
+ * returned stage completes. Failure of the stage has the same
+ * outcome as the corresponding exception thrown by a
+ * {@link Responder}.
+ * 
+ * @author simpsons
+ * 
+ * @see <a href=
+ * "https://fastcgi-archives.github.io/FastCGI_Specification.html#S6.2">FastCGI
+ * Specification &mdash; Responder</a>
+ */
+public interface AsyncResponder {
+    /**
+     * Start responding to a complete request. The stage may fail with
+     * {@link InterruptedException} or
+     * {@link java.util.concurrent.CancellationException} if the
+     * session is aborted, or with {@link SessionException} if the
+     * application is temporarily unable to respond.
+     * 
+     * @param session the FastCGI session context
+     * 
+     * @return a stage that completes when the response is complete
+     * 
+     * @throws Exception if something goes wrong before the stage could
+     * be created, to be treated as if the stage had failed with it
+     */
+    CompletionStage<?> respond(AsyncResponderContext session)
+        throws Exception;
+}
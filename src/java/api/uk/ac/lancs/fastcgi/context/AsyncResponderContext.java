@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.context;
+
+import java.nio.ByteBuffer;
+import java.util.concurrent.CompletionStage;
+
+/**
+ * Presents the context of a FastCGI session to an asynchronous
+ * application in the Responder role. In addition to the blocking
+ * streams of {@link ResponderContext}, standard output can be written
+ * without blocking the caller. Such operations are performed in the
+ * order they are requested, after any earlier operations requested in
+ * the same way. The blocking and non-blocking forms should not be
+ * mixed without waiting for outstanding non-blocking operations to
+ * complete.
+ * 
+ * @author simpsons
+ */
+public interface AsyncResponderContext extends ResponderContext {
+    /**
+     * Write bytes to standard output without blocking. The response
+     * header is transmitted first, if not already. The buffer must not
+     * be modified until the returned stage has completed, at which
+     * point its position will have reached its limit.
+     * 
+     * @param src the bytes to write
+     * 
+     * @return a stage that completes when the bytes have been written,
+     * or fails with {@link java.io.IOException} if an I/O error occurs
+     */
+    CompletionStage<Void> write(ByteBuffer src);
+
+    /**
+     * Flush standard output without blocking.
+     * 
+     * @return a stage that completes when all bytes written so far have
+     * been transmitted, or fails with {@link java.io.IOException} if
+     * an I/O error occurs
+     */
+    CompletionStage<Void> flush();
+
+    /**
+     * Close standard output without blocking.
+     * 
+     * @return a stage that completes when the end of standard output
+     * has been signalled, or fails with {@link java.io.IOException} if
+     * an I/O error occurs
+     */
+    CompletionStage<Void> closeOutput();
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.context;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.WritableByteChannel;
+
+/**
+ * Delivers content as buffers over the implementation's own storage,
+ * rather than copying it into the caller's array. A stream returned by
+ * {@link RequestableContext#in()} or {@link FilterContext#data()} may
+ * implement this interface, in which case the two forms of access may
+ * be interleaved.
+ * 
+ * <p>
+ * Each buffer remains valid until it is released, which happens
+ * implicitly on the next operation on the stream, or explicitly with
+ * {@link #release()}. A buffer must not be used after release, as its
+ * storage may then be re-used for other content.
+ * 
+ * @author simpsons
+ */
+public interface BufferReader {
+    /**
+     * Get the next portion of content. The previous buffer is released.
+     * This call blocks until content is available, the end of the
+     * content is reached, or an error occurs.
+     * 
+     * @return a read-only buffer of at least one byte, positioned at
+     * its start; or {@code null} at the end of the content
+     * 
+     * @throws StreamAbortedException if the content has been withdrawn
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    ByteBuffer nextBuffer() throws IOException;
+
+    /**
+     * Release the last buffer returned by {@link #nextBuffer()}, so
+     * that its storage may be re-used. Releasing twice has no effect.
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    void release() throws IOException;
+
+    /**
+     * Write all remaining content to a channel.
+     * 
+     * @param out the destination channel, which should be in blocking
+     * mode
+     * 
+     * @return the number of bytes transferred
+     * 
+     * @throws StreamAbortedException if the content has been withdrawn
+     * 
+     * @throws IOException if an I/O error occurs
+     * 
+     * @default Each buffer from {@link #nextBuffer()} is written fully
+     * to the channel, and the last is released.
+     */
+    default long transferTo(WritableByteChannel out) throws IOException {
+        long total = 0;
+        try {
+            for (ByteBuffer buf; (buf = nextBuffer()) != null;)
+                while (buf.hasRemaining())
+                    total += out.write(buf);
+        } finally {
+            release();
+        }
+        return total;
+    }
+}
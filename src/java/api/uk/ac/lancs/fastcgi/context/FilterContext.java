@@ -50,7 +50,11 @@ import java.io.InputStream;
  */
 public interface FilterContext extends RequestableContext {
     /**
-     * Get the stream for reading the file data.
+     * Get the stream for reading the file data. The stream may
+     * also implement {@link BufferReader}, to deliver content without
+     * copying. Closing the stream before end-of-file declares the rest
+     * of the file data unwanted, so the engine discards it as it arrives,
+     * instead of storing it.
      * 
      * @return the input stream providing the file data
      */
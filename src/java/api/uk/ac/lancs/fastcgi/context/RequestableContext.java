@@ -46,7 +46,11 @@ import java.io.InputStream;
  */
 public interface RequestableContext {
     /**
-     * Get the stream for reading the request body.
+     * Get the stream for reading the request body. The stream may
+     * also implement {@link BufferReader}, to deliver content without
+     * copying. Closing the stream before end-of-file declares the rest
+     * of the request body unwanted, so the engine discards it as it arrives,
+     * instead of storing it.
      * 
      * @return the input stream providing the request body
      */
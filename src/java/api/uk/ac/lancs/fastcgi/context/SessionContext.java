@@ -36,8 +36,14 @@
 
 package uk.ac.lancs.fastcgi.context;
 
+import java.io.EOFException;
+import java.io.IOException;
 import java.io.OutputStream;
 import java.io.PrintStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+import java.nio.file.Path;
 import java.util.Map;
 
 /**
@@ -122,6 +128,70 @@ public interface SessionContext {
      */
     OutputStream out();
 
+    /**
+     * Send a region of a file as the response body, or as the next
+     * part of it. The response header is transmitted first if it has
+     * not been already, and anything already written to
+     * {@link #out()} is flushed. The implementation may pass the file's
+     * bytes to the server without copying them through the
+     * application. The response stream remains open, so more may be
+     * written after the region.
+     * 
+     * @default The file is opened, and the region is copied to
+     * {@link #out()}.
+     * 
+     * @param path the file to send
+     * 
+     * @param position the offset into the file of the first byte to
+     * send
+     * 
+     * @param length the number of bytes to send
+     * 
+     * @throws IllegalArgumentException if the region does not lie
+     * within the file
+     * 
+     * @throws IOException if an I/O error occurs in reading the file or
+     * sending its content
+     */
+    default void transmit(Path path, long position, long length)
+        throws IOException {
+        if (position < 0 || length < 0)
+            throw new IllegalArgumentException("-ve region " + position
+                + "+" + length);
+        try (FileChannel ch = FileChannel.open(path)) {
+            if (position + length > ch.size())
+                throw new IllegalArgumentException("region " + position
+                    + "+" + length + " beyond " + ch.size());
+            OutputStream out = out();
+            ByteBuffer buf = ByteBuffer.allocate(8192);
+            while (length > 0) {
+                buf.clear();
+                if (length < buf.capacity()) buf.limit((int) length);
+                int got = ch.read(buf, position);
+                if (got < 0) throw new EOFException(path.toString());
+                out.write(buf.array(), 0, got);
+                position += got;
+                length -= got;
+            }
+        }
+    }
+
+    /**
+     * Send an entire file as the response body, or as the next part of
+     * it.
+     * 
+     * @default {@link #transmit(Path, long, long)} is invoked with the
+     * file's current size.
+     * 
+     * @param path the file to send
+     * 
+     * @throws IOException if an I/O error occurs in reading the file or
+     * sending its content
+     */
+    default void transmit(Path path) throws IOException {
+        transmit(path, 0, Files.size(path));
+    }
+
     /**
      * Try to set the buffer size for writing the response. This cannot
      * be set once output has started to be written. It might also be
@@ -37,20 +37,60 @@
 package uk.ac.lancs.fastcgi.util;
 
 import java.lang.ref.Cleaner;
+import java.lang.ref.WeakReference;
+import java.lang.reflect.InvocationHandler;
+import java.lang.reflect.InvocationTargetException;
+import java.lang.reflect.Method;
+import java.lang.reflect.Proxy;
 import java.sql.Connection;
+import java.sql.PreparedStatement;
 import java.sql.SQLException;
-import java.util.ArrayList;
-import java.util.List;
-import java.util.function.Consumer;
+import java.sql.SQLTransientConnectionException;
+import java.time.Duration;
+import java.util.Deque;
+import java.util.LinkedHashMap;
+import java.util.Map;
+import java.util.Objects;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentLinkedDeque;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.ScheduledFuture;
+import java.util.concurrent.Semaphore;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicInteger;
 import java.util.logging.Level;
 import java.util.logging.Logger;
 
 /**
- * Retains open database connections.
+ * Retains open database connections. Connections are borrowed and
+ * returned without locking. A thread is preferentially given the
+ * connection it last returned, and otherwise the most recently
+ * returned one. The number of connections may be bounded, in which
+ * case callers wait a limited time for one to be returned. Idle
+ * connections are periodically checked in the background, and closed
+ * if they are broken or have been idle too long. Prepared statements
+ * may be cached per connection.
+ * 
+ * <p>
+ * A pool may be created using {@link #SQLConnectionPool(Factory)},
+ * which behaves as pools always have: it is unbounded, and never checks
+ * or closes idle connections. Otherwise, it may be configured using
+ * {@link #start()}, whose defaults include background checks:
+ * 
+ * <pre>
+ * SQLConnectionPool pool = SQLConnectionPool.start()
+ *     .factory(() -&gt; DriverManager.getConnection(url, props))
+ *     .maxSize(20)
+ *     .statementCacheSize(50)
+ *     .create();
+ * </pre>
  * 
  * @author simpsons
  */
-public class SQLConnectionPool {
+public class SQLConnectionPool implements AutoCloseable {
     /**
      * Creates new database connections.
      *
@@ -67,76 +107,886 @@ public class SQLConnectionPool {
         Connection newConnection() throws SQLException;
     }
 
-    private final Factory factory;
+    /**
+     * The default maximum number of connections, namely {@value},
+     * meaning unlimited, overridden by {@link Builder#maxSize(int)}
+     */
+    public static final int MAX_SIZE = 0;
+
+    /**
+     * The default time to wait for a connection when the pool is at
+     * its maximum size, namely 30 seconds, overridden by
+     * {@link Builder#maxWait(Duration)}
+     */
+    public static final Duration MAX_WAIT = Duration.ofSeconds(30);
+
+    /**
+     * The default time after which an idle connection is closed,
+     * namely 10 minutes, overridden by
+     * {@link Builder#idleTimeout(Duration)}
+     */
+    public static final Duration IDLE_TIMEOUT = Duration.ofMinutes(10);
+
+    /**
+     * The default interval between background checks of idle
+     * connections, namely 30 seconds, overridden by
+     * {@link Builder#checkInterval(Duration)}
+     */
+    public static final Duration CHECK_INTERVAL = Duration.ofSeconds(30);
+
+    /**
+     * The default time in seconds allowed for an idle connection to be
+     * validated, namely {@value}, overridden by
+     * {@link Builder#validationTimeout(int)}
+     */
+    public static final int VALIDATION_TIMEOUT = 5;
+
+    /**
+     * The default number of prepared statements cached per connection,
+     * namely {@value}, meaning none, overridden by
+     * {@link Builder#statementCacheSize(int)}
+     */
+    public static final int STATEMENT_CACHE_SIZE = 0;
+
+    /**
+     * Start building a pool.
+     * 
+     * @return the new builder
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    /**
+     * Collects the parameters for building a connection pool.
+     */
+    public static class Builder {
+        private Factory factory;
+
+        private int maxSize = MAX_SIZE;
+
+        private Duration maxWait = MAX_WAIT;
+
+        private Duration idleTimeout = IDLE_TIMEOUT;
+
+        private Duration checkInterval = CHECK_INTERVAL;
+
+        private int validationTimeout = VALIDATION_TIMEOUT;
+
+        private int statementCacheSize = STATEMENT_CACHE_SIZE;
+
+        Builder() {}
+
+        /**
+         * Set the means to create fresh connections. This must be
+         * called before {@link #create()}.
+         * 
+         * @param factory the connection factory
+         * 
+         * @return this builder
+         * 
+         * @throws NullPointerException if the argument is {@code null}
+         */
+        public Builder factory(Factory factory) {
+            Objects.requireNonNull(factory, "factory");
+            this.factory = factory;
+            return this;
+        }
+
+        /**
+         * Set the maximum number of connections, whether idle or in
+         * use. The default is given by {@link #MAX_SIZE}.
+         * 
+         * @param maxSize the maximum number of connections; or zero if
+         * unlimited
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder maxSize(int maxSize) {
+            if (maxSize < 0)
+                throw new IllegalArgumentException("-ve max size " + maxSize);
+            this.maxSize = maxSize;
+            return this;
+        }
+
+        /**
+         * Set how long to wait for a connection when the maximum number
+         * are in use. The default is given by {@link #MAX_WAIT}.
+         * 
+         * @param maxWait the maximum time to wait
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder maxWait(Duration maxWait) {
+            if (maxWait.isNegative())
+                throw new IllegalArgumentException("-ve max wait " + maxWait);
+            this.maxWait = maxWait;
+            return this;
+        }
+
+        /**
+         * Set how long a connection may remain idle before it is
+         * closed. The default is given by {@link #IDLE_TIMEOUT}.
+         * 
+         * @param idleTimeout the maximum idle time; or zero if idle
+         * connections are not to be closed
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder idleTimeout(Duration idleTimeout) {
+            if (idleTimeout.isNegative())
+                throw new IllegalArgumentException("-ve idle timeout "
+                    + idleTimeout);
+            this.idleTimeout = idleTimeout;
+            return this;
+        }
+
+        /**
+         * Set the interval between background checks of idle
+         * connections. Each check closes connections that have been
+         * idle too long, or which fail validation. The default is
+         * given by {@link #CHECK_INTERVAL}.
+         * 
+         * @param checkInterval the interval between checks; or zero if
+         * no checks are to be made
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder checkInterval(Duration checkInterval) {
+            if (checkInterval.isNegative())
+                throw new IllegalArgumentException("-ve check interval "
+                    + checkInterval);
+            this.checkInterval = checkInterval;
+            return this;
+        }
+
+        /**
+         * Set the time allowed to validate an idle connection. The
+         * default is given by {@link #VALIDATION_TIMEOUT}.
+         * 
+         * @param validationTimeout the timeout in seconds, as passed to
+         * {@link Connection#isValid(int)}; or zero if unlimited
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder validationTimeout(int validationTimeout) {
+            if (validationTimeout < 0)
+                throw new IllegalArgumentException("-ve validation timeout "
+                    + validationTimeout);
+            this.validationTimeout = validationTimeout;
+            return this;
+        }
+
+        /**
+         * Set the number of prepared statements to cache per
+         * connection. Statements are cached by their SQL, and only
+         * those prepared with {@link Connection#prepareStatement(String)}
+         * are cached. Closing a cached statement clears its parameters,
+         * and keeps it for re-use. The least recently used statement is
+         * closed when the cache is full. The default is given by
+         * {@link #STATEMENT_CACHE_SIZE}.
+         * 
+         * @param statementCacheSize the number of statements to cache
+         * per connection; or zero to disable caching
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder statementCacheSize(int statementCacheSize) {
+            if (statementCacheSize < 0)
+                throw new IllegalArgumentException("-ve statement cache size "
+                    + statementCacheSize);
+            this.statementCacheSize = statementCacheSize;
+            return this;
+        }
+
+        /**
+         * Create a pool with the current configuration.
+         * 
+         * @return a pool with the required configuration
+         * 
+         * @throws IllegalStateException if no factory has been set
+         */
+        public SQLConnectionPool create() {
+            if (factory == null) throw new IllegalStateException("no factory");
+            return new SQLConnectionPool(new State(factory, maxSize,
+                                                   idleTimeout,
+                                                   validationTimeout,
+                                                   statementCacheSize),
+                                         maxWait, checkInterval);
+        }
+    }
+
+    private final State state;
 
-    private final AutoCloseableProxifier<Connection,
-                                         Consumer<Connection>> proxifier;
+    private final long maxWaitNanos;
 
     /**
-     * Create a pool.
+     * Create an unbounded pool that keeps idle connections
+     * indefinitely. No background checks are made, and no statements
+     * are cached. Use {@link #start()} to configure a pool otherwise.
      * 
      * @param factory the means to create a fresh connection
      */
     public SQLConnectionPool(Factory factory) {
-        proxifier =
-            new AutoCloseableProxifier<>(Connection.class, this::recover);
-        this.factory = factory;
-        this.state = new State();
+        this(new State(Objects.requireNonNull(factory, "factory"), MAX_SIZE,
+                       Duration.ZERO, VALIDATION_TIMEOUT,
+                       STATEMENT_CACHE_SIZE),
+             MAX_WAIT, Duration.ZERO);
+    }
+
+    private SQLConnectionPool(State state, Duration maxWait,
+                              Duration checkInterval) {
+        this.state = state;
+        this.maxWaitNanos = maxWait.toNanos();
         this.cleanable = cleaner.register(this, state);
+        if (!checkInterval.isZero()) {
+            final long millis = Long.max(1, checkInterval.toMillis());
+            state.checks =
+                checker().scheduleWithFixedDelay(state::check, millis, millis,
+                                                 TimeUnit.MILLISECONDS);
+        }
     }
 
-    private static class State implements Runnable {
-        private final List<Connection> bases = new ArrayList<>();
+    /**
+     * Tracks the use of a pooled connection.
+     */
+    private static final class Entry {
+        static final int IDLE = 0;
 
-        @Override
-        public void run() {
-            bases.forEach(base -> {
+        static final int IN_USE = 1;
+
+        static final int CHECKING = 2;
+
+        static final int REMOVED = 3;
+
+        final Connection base;
+
+        /**
+         * Holds {@link #IDLE}, {@link #IN_USE}, {@link #CHECKING} or
+         * {@link #REMOVED}. Only the thread that moves the entry out
+         * of {@link #IDLE} may use the connection.
+         */
+        final AtomicInteger status = new AtomicInteger(IN_USE);
+
+        /**
+         * Indicates whether the entry is in the idle queue. It may
+         * also be there while not idle, in which case it is discarded
+         * from the queue when found.
+         */
+        final AtomicBoolean queued = new AtomicBoolean(false);
+
+        /**
+         * Holds the {@link System#nanoTime()} at which the connection
+         * was last returned.
+         */
+        volatile long idleSince;
+
+        /**
+         * Holds cached statements in least-recently-used order; or
+         * {@code null} if caching is disabled
+         */
+        final Map<String, CachedStatement> statements;
+
+        Entry(Connection base, final int cacheSize) {
+            this.base = base;
+            this.statements = cacheSize == 0 ? null :
+                new LinkedHashMap<>(16, 0.75f, true) {
+                    @Override
+                    protected boolean
+                        removeEldestEntry(Map.Entry<String,
+                                                    CachedStatement> eldest) {
+                        if (size() <= cacheSize) return false;
+                        eldest.getValue().evict();
+                        return true;
+                    }
+                };
+        }
+
+        /**
+         * Prepare the connection for its next user. Any transaction is
+         * rolled back, auto-commit is enabled, and cached statements
+         * are made available.
+         * 
+         * @throws SQLException if the connection could not be reset
+         */
+        void reset() throws SQLException {
+            if (!base.getAutoCommit()) {
+                base.rollback();
+                base.setAutoCommit(true);
+            }
+            if (statements == null) return;
+            for (CachedStatement cs : statements.values())
+                cs.reclaim();
+        }
+
+        /**
+         * Close the connection and its cached statements, ignoring
+         * errors.
+         */
+        void close() {
+            if (statements != null) {
+                for (CachedStatement cs : statements.values())
+                    cs.evict();
+                statements.clear();
+            }
+            try {
+                base.close();
+            } catch (SQLException ex) {
+                logger.log(Level.WARNING, "release", ex);
+            }
+        }
+    }
+
+    /**
+     * Holds the pool's connections. This is separate from the pool, so
+     * that the connections can be closed once the pool is unreachable.
+     */
+    private static final class State implements Runnable {
+        final Factory factory;
+
+        /**
+         * Limits the number of open connections, whether idle or in
+         * use; or {@code null} if unlimited. Each entry in {@link #all}
+         * holds a permit until discarded.
+         */
+        final Semaphore permits;
+
+        /**
+         * Counts callers of {@link SQLConnectionPool#open()} waiting
+         * for a connection to be returned or discarded. They wait on
+         * this object's monitor.
+         */
+        final AtomicInteger waiting = new AtomicInteger(0);
+
+        final long idleNanos;
+
+        final int validationTimeout;
+
+        final int cacheSize;
+
+        /**
+         * Holds idle connections, most recently returned first.
+         */
+        final Deque<Entry> idle = new ConcurrentLinkedDeque<>();
+
+        /**
+         * Holds all open connections.
+         */
+        final Set<Entry> all = ConcurrentHashMap.newKeySet();
+
+        /**
+         * Remembers the connection each thread last used.
+         */
+        final ThreadLocal<WeakReference<Entry>> affinity =
+            new ThreadLocal<>();
+
+        volatile boolean closed;
+
+        /**
+         * Holds the periodic check of idle connections; or {@code null}
+         * if there is none
+         */
+        volatile ScheduledFuture<?> checks;
+
+        State(Factory factory, int maxSize, Duration idleTimeout,
+              int validationTimeout, int cacheSize) {
+            this.factory = factory;
+            this.permits = maxSize > 0 ? new Semaphore(maxSize) : null;
+            this.idleNanos = idleTimeout.toNanos();
+            this.validationTimeout = validationTimeout;
+            this.cacheSize = cacheSize;
+        }
+
+        /**
+         * Take an idle connection, preferring the one most recently
+         * used by the calling thread.
+         * 
+         * @return the connection, now in use; or {@code null} if none
+         * is idle
+         */
+        Entry take() {
+            WeakReference<Entry> ref = affinity.get();
+            Entry last = ref == null ? null : ref.get();
+            if (last != null && last.status.compareAndSet(Entry.IDLE,
+                                                          Entry.IN_USE))
+                return last;
+            for (Entry e; (e = idle.pollFirst()) != null;) {
+                if (e.status.compareAndSet(Entry.IDLE, Entry.IN_USE)) {
+                    /* No-one else can enqueue it until we release it. */
+                    e.queued.set(false);
+                    affinity.set(new WeakReference<>(e));
+                    return e;
+                }
+
+                /* The entry is in use or being checked, and we have
+                 * removed it from the queue. If it became idle again
+                 * while still marked as queued, whoever made it so
+                 * will not have enqueued it, so we must. */
+                e.queued.set(false);
+                if (e.status.get() == Entry.IDLE) enqueue(e, false);
+            }
+            return null;
+        }
+
+        /**
+         * Create a connection, already in use.
+         * 
+         * @return the new connection
+         * 
+         * @throws SQLException if the factory fails, or auto-commit
+         * cannot be enabled
+         */
+        Entry create() throws SQLException {
+            Connection base = factory.newConnection();
+            try {
+                base.setAutoCommit(true);
+            } catch (SQLException | RuntimeException ex) {
                 try {
                     base.close();
-                } catch (SQLException ex) {
-                    logger.log(Level.WARNING, "release", ex);
+                } catch (SQLException ex2) {
+                    ex.addSuppressed(ex2);
                 }
-            });
+                throw ex;
+            }
+            Entry e = new Entry(base, cacheSize);
+            all.add(e);
+            affinity.set(new WeakReference<>(e));
+            return e;
         }
-    }
 
-    private final State state;
+        /**
+         * Make an idle connection available to be taken.
+         * 
+         * @param e the connection
+         * 
+         * @param recent {@code true} if the connection is to be taken
+         * before others
+         */
+        private void enqueue(Entry e, boolean recent) {
+            if (!e.queued.compareAndSet(false, true)) return;
+            if (recent)
+                idle.addFirst(e);
+            else
+                idle.addLast(e);
+        }
 
-    private void recover(Connection base) {
-        try {
-            if (!base.getAutoCommit()) base.rollback();
+        /**
+         * Accept a connection that is no longer in use.
+         * 
+         * @param e the connection
+         */
+        void release(Entry e) {
+            try {
+                e.reset();
+            } catch (SQLException | RuntimeException ex) {
+                logger.log(Level.WARNING, "reset", ex);
+                discard(e);
+                return;
+            }
+            e.idleSince = System.nanoTime();
+            e.status.set(Entry.IDLE);
+            enqueue(e, true);
+            signal();
+
+            /* The pool might have been closed while this connection
+             * was in use. */
+            if (closed && e.status.compareAndSet(Entry.IDLE, Entry.REMOVED))
+                discard(e);
+        }
+
+        /**
+         * Close a connection and forget it, allowing another to be
+         * created. The caller must have exclusive use of it.
+         * 
+         * @param e the connection
+         */
+        void discard(Entry e) {
+            e.status.set(Entry.REMOVED);
+            all.remove(e);
+            e.close();
+            if (permits != null) permits.release();
+            signal();
+        }
+
+        /**
+         * Wake callers waiting for a connection, if there are any.
+         */
+        void signal() {
+            if (waiting.get() == 0) return;
             synchronized (this) {
-                state.bases.add(base);
+                notifyAll();
+            }
+        }
+
+        /**
+         * Wait for a connection to be returned or discarded, unless one
+         * already is idle or could be created.
+         * 
+         * @param nanos the maximum time to wait
+         * 
+         * @throws InterruptedException if the caller was interrupted
+         */
+        void await(long nanos) throws InterruptedException {
+            waiting.incrementAndGet();
+            try {
+                synchronized (this) {
+                    /* Check again now that we've declared ourselves, so
+                     * we don't miss a signal. */
+                    if (closed || !idle.isEmpty() ||
+                        permits.availablePermits() > 0) return;
+                    TimeUnit.NANOSECONDS.timedWait(this, nanos);
+                }
+            } finally {
+                waiting.decrementAndGet();
+            }
+        }
+
+        /**
+         * Close idle connections that have been idle too long, or that
+         * fail validation.
+         */
+        void check() {
+            final long now = System.nanoTime();
+            for (Entry e : all) {
+                if (!e.status.compareAndSet(Entry.IDLE, Entry.CHECKING))
+                    continue;
+                boolean keep;
+                if (idleNanos > 0 && now - e.idleSince > idleNanos) {
+                    keep = false;
+                } else {
+                    try {
+                        keep = e.base.isValid(validationTimeout);
+                    } catch (SQLException ex) {
+                        keep = false;
+                    }
+                }
+                if (!keep) {
+                    discard(e);
+                    continue;
+                }
+                e.status.set(Entry.IDLE);
+                enqueue(e, false);
+            }
+        }
+
+        /**
+         * Close all idle connections, and stop checking them.
+         * Connections in use are closed when returned.
+         */
+        @Override
+        public void run() {
+            closed = true;
+            ScheduledFuture<?> checks = this.checks;
+            if (checks != null) checks.cancel(false);
+            for (Entry e : all)
+                if (e.status.compareAndSet(Entry.IDLE, Entry.REMOVED))
+                    discard(e);
+            idle.clear();
+            synchronized (this) {
+                notifyAll();
             }
-        } catch (SQLException ex) {
-            logger.log(Level.WARNING, "reset", ex);
         }
     }
 
     /**
-     * Get a connection. One is taken from the pool if available.
-     * Otherwise, the factory will be invoked. The returned object, when
-     * closed, will automatically return to the pool. The returned
-     * connection will be fresh (if not actually new), with auto-commit
-     * enabled, and nothing to roll back to.
+     * Get a connection. An idle one is taken from the pool if
+     * available, preferring the one last used by the calling thread.
+     * Otherwise, the factory will be invoked, unless the pool already
+     * has its maximum number of connections open, in which case the
+     * caller waits for one to be returned or closed. The returned
+     * object, when closed, will
+     * automatically return to the pool. The returned connection will be
+     * fresh (if not actually new), with auto-commit enabled, and
+     * nothing to roll back to.
      * 
      * @return the fresh connection
      * 
+     * @throws SQLTransientConnectionException if no connection became
+     * available in time, or the caller was interrupted while waiting
+     * 
      * @throws SQLException if a database error occurs in creating a
-     * fresh connection, or in enabling auto-commit
+     * fresh connection, or in enabling auto-commit, or if the pool has
+     * been closed
      */
-    public synchronized Connection open() throws SQLException {
-        final Connection base;
-        if (state.bases.isEmpty()) {
-            base = factory.newConnection();
-        } else {
-            base = state.bases.remove(0);
+    public Connection open() throws SQLException {
+        final Semaphore permits = state.permits;
+        long deadline = 0;
+        for (boolean first = true;; first = false) {
+            if (state.closed) throw new SQLException("pool closed");
+            Entry e = state.take();
+            if (e != null) return new Lease(state, e).proxy;
+            if (permits == null || permits.tryAcquire()) {
+                try {
+                    e = state.create();
+                } catch (SQLException | RuntimeException | Error ex) {
+                    if (permits != null) {
+                        permits.release();
+                        state.signal();
+                    }
+                    throw ex;
+                }
+                return new Lease(state, e).proxy;
+            }
+
+            /* Wait for a connection to be returned, or for room to
+             * create one. */
+            if (first) deadline = System.nanoTime() + maxWaitNanos;
+            final long rem = deadline - System.nanoTime();
+            if (rem <= 0)
+                throw new SQLTransientConnectionException("no connection"
+                    + " available");
+            try {
+                state.await(rem);
+            } catch (InterruptedException ex) {
+                Thread.currentThread().interrupt();
+                throw new SQLTransientConnectionException("interrupted", ex);
+            }
         }
-        base.setAutoCommit(true);
+    }
 
-        return proxifier.proxy(base);
+    /**
+     * Close the pool. Idle connections are closed immediately, and
+     * those in use are closed as they are returned. Subsequent calls
+     * to {@link #open()} fail.
+     */
+    @Override
+    public void close() {
+        cleanable.clean();
+    }
+
+    private static final Method CLOSE_METHOD, IS_CLOSED_METHOD,
+        PREPARE_METHOD, STMT_CLOSE_METHOD, STMT_IS_CLOSED_METHOD,
+        GET_CONNECTION_METHOD, TO_STRING_METHOD, EQUALS_METHOD,
+        HASH_CODE_METHOD;
+
+    static {
+        try {
+            CLOSE_METHOD = Connection.class.getMethod("close");
+            IS_CLOSED_METHOD = Connection.class.getMethod("isClosed");
+            PREPARE_METHOD = Connection.class
+                .getMethod("prepareStatement", String.class);
+            STMT_CLOSE_METHOD = PreparedStatement.class.getMethod("close");
+            STMT_IS_CLOSED_METHOD =
+                PreparedStatement.class.getMethod("isClosed");
+            GET_CONNECTION_METHOD =
+                PreparedStatement.class.getMethod("getConnection");
+            TO_STRING_METHOD = Object.class.getMethod("toString");
+            EQUALS_METHOD = Object.class.getMethod("equals", Object.class);
+            HASH_CODE_METHOD = Object.class.getMethod("hashCode");
+        } catch (NoSuchMethodException ex) {
+            throw new AssertionError("unreachable", ex);
+        }
     }
 
+    /**
+     * Invoke a method on the real object behind a proxy, unwrapping
+     * any exception it throws.
+     * 
+     * @param base the real object
+     * 
+     * @param method the method to invoke
+     * 
+     * @param args the arguments
+     * 
+     * @return the method's result
+     * 
+     * @throws Throwable the exception thrown by the method
+     */
+    private static Object pass(Object base, Method method, Object[] args)
+        throws Throwable {
+        try {
+            return method.invoke(base, args);
+        } catch (InvocationTargetException ex) {
+            throw ex.getCause();
+        }
+    }
+
+    /**
+     * Presents a pooled connection to a single user, returning it to
+     * the pool when closed.
+     */
+    private static final class Lease implements InvocationHandler {
+        final State state;
+
+        final Entry entry;
+
+        final Connection proxy;
+
+        final AtomicBoolean released = new AtomicBoolean(false);
+
+        Lease(State state, Entry entry) {
+            this.state = state;
+            this.entry = entry;
+            this.proxy = (Connection) Proxy
+                .newProxyInstance(Connection.class.getClassLoader(),
+                                  new Class<?>[] { Connection.class }, this);
+        }
+
+        @Override
+        public Object invoke(Object proxy, Method method, Object[] args)
+            throws Throwable {
+            if (method.equals(CLOSE_METHOD)) {
+                if (released.compareAndSet(false, true)) state.release(entry);
+                return null;
+            } else if (method.equals(TO_STRING_METHOD)) {
+                return entry.base.toString();
+            } else if (method.equals(EQUALS_METHOD)) {
+                return args[0] == proxy;
+            } else if (method.equals(HASH_CODE_METHOD)) {
+                return System.identityHashCode(proxy);
+            } else if (method.equals(IS_CLOSED_METHOD)) {
+                return released.get() || entry.base.isClosed();
+            }
+            if (released.get()) throw new SQLException("connection closed");
+            if (entry.statements != null && method.equals(PREPARE_METHOD))
+                return prepare((String) args[0]);
+            return pass(entry.base, method, args);
+        }
+
+        /**
+         * Get a prepared statement from the cache, or prepare and cache
+         * a new one. If the cached statement is already in use, an
+         * uncached one is prepared.
+         * 
+         * @param sql the statement's SQL
+         * 
+         * @return the prepared statement
+         * 
+         * @throws SQLException if preparation fails
+         */
+        private PreparedStatement prepare(String sql) throws SQLException {
+            CachedStatement cs = entry.statements.get(sql);
+            if (cs == null) {
+                cs = new CachedStatement(entry.base.prepareStatement(sql));
+                entry.statements.put(sql, cs);
+            } else if (cs.inUse) {
+                return entry.base.prepareStatement(sql);
+            }
+            return cs.lend(this);
+        }
+    }
+
+    /**
+     * Holds a prepared statement for re-use on the same connection.
+     */
+    private static final class CachedStatement {
+        final PreparedStatement base;
+
+        /**
+         * Indicates whether a user holds the statement.
+         */
+        boolean inUse;
+
+        /**
+         * Indicates whether the statement has been dropped from the
+         * cache. It is closed as soon as it is not in use.
+         */
+        boolean evicted;
+
+        CachedStatement(PreparedStatement base) {
+            this.base = base;
+        }
+
+        /**
+         * Present the statement to a user.
+         * 
+         * @param lease the connection's current lease
+         * 
+         * @return a proxy for the statement, which it returns to the
+         * cache when closed
+         */
+        PreparedStatement lend(Lease lease) {
+            inUse = true;
+            final AtomicBoolean closed = new AtomicBoolean(false);
+            InvocationHandler handler = (proxy, method, args) -> {
+                if (method.equals(STMT_CLOSE_METHOD)) {
+                    if (closed.compareAndSet(false, true)) reclaim();
+                    return null;
+                } else if (method.equals(TO_STRING_METHOD)) {
+                    return base.toString();
+                } else if (method.equals(EQUALS_METHOD)) {
+                    return args[0] == proxy;
+                } else if (method.equals(HASH_CODE_METHOD)) {
+                    return System.identityHashCode(proxy);
+                } else if (method.equals(STMT_IS_CLOSED_METHOD)) {
+                    return closed.get() || lease.released.get();
+                }
+                if (closed.get() || lease.released.get())
+                    throw new SQLException("statement closed");
+                if (method.equals(GET_CONNECTION_METHOD)) return lease.proxy;
+                return pass(base, method, args);
+            };
+            return (PreparedStatement) Proxy
+                .newProxyInstance(PreparedStatement.class.getClassLoader(),
+                                  new Class<?>[] { PreparedStatement.class },
+                                  handler);
+        }
+
+        /**
+         * Take the statement back from its user.
+         */
+        void reclaim() {
+            if (!inUse) return;
+            inUse = false;
+            if (evicted) {
+                close();
+                return;
+            }
+            try {
+                base.clearParameters();
+            } catch (SQLException ex) {
+                logger.log(Level.FINE, "clearing statement", ex);
+            }
+        }
+
+        /**
+         * Drop the statement from the cache, closing it if not in use.
+         */
+        void evict() {
+            evicted = true;
+            if (!inUse) close();
+        }
+
+        private void close() {
+            try {
+                base.close();
+            } catch (SQLException ex) {
+                logger.log(Level.FINE, "closing statement", ex);
+            }
+        }
+    }
+
+    /**
+     * Get the executor for periodic checks of idle connections, which
+     * is shared by all pools.
+     * 
+     * @return the shared executor
+     */
+    private static synchronized ScheduledExecutorService checker() {
+        if (checker == null) {
+            checker = Executors.newSingleThreadScheduledExecutor(r -> {
+                Thread t = new Thread(r, "sql-pool-check");
+                t.setDaemon(true);
+                return t;
+            });
+        }
+        return checker;
+    }
+
+    private static ScheduledExecutorService checker;
+
     private final Cleaner.Cleanable cleanable;
 
     private static final Cleaner cleaner = Cleaner.create();
@@ -41,6 +41,7 @@ import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.lang.reflect.InvocationTargetException;
+import java.nio.file.Paths;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
@@ -50,10 +51,16 @@ import java.util.regex.Matcher;
 import java.util.regex.Pattern;
 import uk.ac.lancs.fastcgi.engine.Attribute;
 import uk.ac.lancs.fastcgi.engine.Engine;
+import uk.ac.lancs.fastcgi.engine.Scheduling;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.AsyncResponder;
 import uk.ac.lancs.fastcgi.Authorizer;
 import uk.ac.lancs.fastcgi.Filter;
 import uk.ac.lancs.fastcgi.Responder;
 import uk.ac.lancs.scc.jardeps.Application;
+import uk.ac.lancs.fastcgi.transport.CaptureRecorder;
+import uk.ac.lancs.fastcgi.transport.CapturingTransport;
+import uk.ac.lancs.fastcgi.transport.ReplayTransport;
 import uk.ac.lancs.fastcgi.transport.Transport;
 
 /**
@@ -95,6 +102,33 @@ public class FastCGIApplication {
 
     private static final String BUFFER_PROP = "uk.ac.lancs.fastcgi.buffer";
 
+    private static final String SCHED_PROP = "uk.ac.lancs.fastcgi.sched";
+
+    private static final String QUEUE_PROP = "uk.ac.lancs.fastcgi.queue";
+
+    private static final String BUDGET_PROP = "uk.ac.lancs.fastcgi.budget";
+
+    private static final String PIPES_PROP = "uk.ac.lancs.fastcgi.pipes";
+
+    private static final String SESSIN_PROP = "uk.ac.lancs.fastcgi.sessin";
+
+    private static final String CONNIN_PROP = "uk.ac.lancs.fastcgi.connin";
+
+    private static final String INPUT_PROP = "uk.ac.lancs.fastcgi.input";
+
+    private static final String SHED_PROP = "uk.ac.lancs.fastcgi.shed";
+
+    private static final String METRICS_PROP = "uk.ac.lancs.fastcgi.metrics";
+
+    private static final String CAPTURE_PROP = "uk.ac.lancs.fastcgi.capture";
+
+    private static final String CAPTURE_RATIO_PROP =
+        "uk.ac.lancs.fastcgi.capture.ratio";
+
+    private static final String WARMUP_PROP = "uk.ac.lancs.fastcgi.warmup";
+
+    private static final String DRAIN_PROP = "uk.ac.lancs.fastcgi.drain";
+
     /**
      * Start and run a FastCGI application, using command-line arguments
      * as configuration.
@@ -132,7 +166,10 @@ public class FastCGIApplication {
      * <dt><kbd>+s</kbd> (to reset)
      * 
      * <dd>Limit the number of concurrent sessions. The equivalent
-     * property is <samp>uk.ac.lancs.fastcgi.nsess</samp>.
+     * property is <samp>uk.ac.lancs.fastcgi.nsess</samp>. The number of
+     * sessions that may then wait for admission is set by the property
+     * <samp>uk.ac.lancs.fastcgi.queue</samp>, and the longest wait in
+     * milliseconds by <samp>uk.ac.lancs.fastcgi.budget</samp>.
      * 
      * <dt><kbd>-p <var>num</var></kbd>
      * <dt><kbd>+p</kbd> (to reset)
@@ -149,6 +186,14 @@ public class FastCGIApplication {
      * <samp>kKmMgG</samp>, e.g., <samp>100k</samp>. The equivalent
      * property is <samp>uk.ac.lancs.fastcgi.buffer</samp>.
      * 
+     * <dt><kbd>-t <var>mode</var></kbd>
+     * <dt><kbd>+t</kbd> (to reset)
+     * 
+     * <dd>Set how sessions are scheduled, one of <samp>pooled</samp>,
+     * <samp>shared</samp> or <samp>virtual</samp>; see
+     * {@link Scheduling}. The equivalent property is
+     * <samp>uk.ac.lancs.fastcgi.sched</samp>.
+     * 
      * <dt><kbd>-D<var>name</var>=<var>value</var></kbd>
      * 
      * <dd>Override the configuration property <var>name</var> to have
@@ -168,6 +213,52 @@ public class FastCGIApplication {
      * 
      * </dl>
      * 
+     * <p>
+     * The property <samp>uk.ac.lancs.fastcgi.pipes</samp> selects how
+     * request content is passed to the application, either
+     * <samp>cache</samp> (the default) or <samp>ring</samp>; see
+     * {@link Attribute#PIPES}.
+     * 
+     * <p>
+     * The properties <samp>uk.ac.lancs.fastcgi.sessin</samp>,
+     * <samp>uk.ac.lancs.fastcgi.connin</samp> and
+     * <samp>uk.ac.lancs.fastcgi.input</samp> limit how much request
+     * content may be held unconsumed per session, per connection and in
+     * total, using the same format as <kbd>-b</kbd>. Setting
+     * <samp>uk.ac.lancs.fastcgi.shed</samp> to <samp>true</samp> aborts
+     * a session over its limit, instead of pausing its connection.
+     * 
+     * <p>
+     * The property <samp>uk.ac.lancs.fastcgi.metrics</samp> gives a port
+     * or <samp><var>host</var>:<var>port</var></samp> on which to serve
+     * the engine's metrics in the Prometheus text format; see
+     * {@link Attribute#METRICS_ADDRESS}.
+     * 
+     * <p>
+     * The property <samp>uk.ac.lancs.fastcgi.capture</samp> names a file
+     * to which connection traffic is written for later replay, and
+     * <samp>uk.ac.lancs.fastcgi.capture.ratio</samp> gives the
+     * proportion of connections captured, defaulting to
+     * <samp>1</samp>; see {@link CaptureRecorder}. The file must not
+     * already exist. A capture contains request parameters, cookies,
+     * authorization headers and bodies in full, so it holds whatever
+     * credentials the captured requests carried, and should be kept
+     * and disposed of accordingly.
+     * 
+     * <p>
+     * The property <samp>uk.ac.lancs.fastcgi.warmup</samp> names a
+     * capture file to be replayed through the application before the
+     * transport is obtained, so that a process taking over from another
+     * starts with its code already compiled; see
+     * {@link ReplayTransport}. When the transport has no more
+     * connections, such as after the listening socket has been passed
+     * to a successor (see the system property
+     * <samp>uk.ac.lancs.fastcgi.transport.fork.handover</samp>), the
+     * engine stops accepting requests, and sessions in progress are
+     * given up to <samp>uk.ac.lancs.fastcgi.drain</samp> milliseconds
+     * to complete, defaulting to <samp>30000</samp>, before the
+     * application is terminated.
+     * 
      * @throws Exception if an error occurs, duh
      */
     public static void main(String[] args) throws Exception {
@@ -178,13 +269,24 @@ public class FastCGIApplication {
 
             Responder responder;
 
+            AsyncResponder asyncResponder;
+
             Authorizer authorizer;
 
+            DecisionCache decisions;
+
             Filter filter;
 
             @Override
             public void setResponder(Responder app) {
                 this.responder = app;
+                this.asyncResponder = null;
+            }
+
+            @Override
+            public void setAsyncResponder(AsyncResponder app) {
+                this.asyncResponder = app;
+                this.responder = null;
             }
 
             @Override
@@ -192,6 +294,11 @@ public class FastCGIApplication {
                 this.authorizer = app;
             }
 
+            @Override
+            public void setAuthorizerCache(DecisionCache cache) {
+                this.decisions = cache;
+            }
+
             @Override
             public void setFilter(Filter app) {
                 this.filter = app;
@@ -200,10 +307,14 @@ public class FastCGIApplication {
             Engine.Builder applyHandlers(Engine.Builder builder) {
                 if (responder != null)
                     builder = builder.with(Attribute.RESPONDER, responder);
+                if (asyncResponder != null) builder =
+                    builder.with(Attribute.ASYNC_RESPONDER, asyncResponder);
                 if (filter != null)
                     builder = builder.with(Attribute.FILTER, filter);
                 if (authorizer != null)
                     builder = builder.with(Attribute.AUTHORIZER, authorizer);
+                if (decisions != null) builder =
+                    builder.with(Attribute.AUTHORIZER_CACHE, decisions);
                 return builder;
             }
 
@@ -213,7 +324,8 @@ public class FastCGIApplication {
                     InvocationTargetException,
                     ClassNotFoundException,
                     NoSuchMethodException,
-                    IOException {
+                    IOException,
+                    InterruptedException {
                 /* Process arguments using these defaults. */
                 String className = null;
                 List<String> appArgs = new ArrayList<>();
@@ -295,6 +407,16 @@ public class FastCGIApplication {
                         continue;
                     }
 
+                    if ("-t".equals(arg)) {
+                        props.setProperty(SCHED_PROP, args[++i]);
+                        continue;
+                    }
+
+                    if ("+t".equals(arg)) {
+                        props.remove(SCHED_PROP);
+                        continue;
+                    }
+
                     if (arg.startsWith("-") || arg.startsWith("+")) {
                         System.err.printf("unknown switch: %s%n", arg);
                         System.exit(1);
@@ -334,40 +456,88 @@ public class FastCGIApplication {
                 app.init(this, appArgs.toArray(n -> new String[n]));
 
                 /* Allow the application to implement roles directly. */
-                if (responder == null && app instanceof Responder)
-                    responder = (Responder) app;
+                if (responder == null && asyncResponder == null) {
+                    if (app instanceof AsyncResponder)
+                        asyncResponder = (AsyncResponder) app;
+                    else if (app instanceof Responder)
+                        responder = (Responder) app;
+                }
                 if (filter == null && app instanceof Filter)
                     filter = (Filter) app;
                 if (authorizer == null && app instanceof Authorizer)
                     authorizer = (Authorizer) app;
 
-                /* Prepare to receive connections, and build the
-                 * engine. */
-                Transport conns = Transport.get();
+                /* Prepare to build the engine. */
                 var builder = Engine.start();
 
                 /* Indicate which roles the application supports. */
                 if (responder != null)
                     builder = builder.with(Attribute.RESPONDER, responder);
+                if (asyncResponder != null) builder =
+                    builder.with(Attribute.ASYNC_RESPONDER, asyncResponder);
                 if (filter != null)
                     builder = builder.with(Attribute.FILTER, filter);
                 if (authorizer != null)
                     builder = builder.with(Attribute.AUTHORIZER, authorizer);
+                if (decisions != null) builder =
+                    builder.with(Attribute.AUTHORIZER_CACHE, decisions);
 
                 /* Apply configuration from command-line arguments. */
                 builder = builder.using(props)
                     .withProperty(Attribute.MAX_CONN, NCONN_PROP)
                     .withProperty(Attribute.MAX_SESS, NSESS_PROP)
                     .withProperty(Attribute.MAX_SESS_PER_CONN, NSPC_PROP)
-                    .tryingProperty(Attribute.BUFFER_SIZE, BUFFER_PROP);
+                    .tryingProperty(Attribute.BUFFER_SIZE, BUFFER_PROP)
+                    .tryingProperty(Attribute.SCHEDULING, SCHED_PROP)
+                    .tryingProperty(Attribute.ADMISSION_QUEUE, QUEUE_PROP)
+                    .tryingProperty(Attribute.ADMISSION_BUDGET, BUDGET_PROP)
+                    .tryingProperty(Attribute.PIPES, PIPES_PROP)
+                    .tryingProperty(Attribute.SESSION_INPUT_LIMIT, SESSIN_PROP)
+                    .tryingProperty(Attribute.CONN_INPUT_LIMIT, CONNIN_PROP)
+                    .tryingProperty(Attribute.INPUT_LIMIT, INPUT_PROP)
+                    .tryingProperty(Attribute.INPUT_SHEDDING, SHED_PROP);
+
+                /* Exercise the application and a throwaway engine with
+                 * captured traffic before taking on real connections,
+                 * which may be taken over from a predecessor. */
+                final long drainMillis =
+                    Long.parseLong(props.getProperty(DRAIN_PROP, "30000"));
+                final String warmupPath = props.getProperty(WARMUP_PROP);
+                if (warmupPath != null) {
+                    try (Engine warm = builder.build()
+                        .apply(new ReplayTransport(Paths.get(warmupPath)))) {
+                        while (warm.process())
+                            ;
+                        warm.drain(drainMillis);
+                    }
+                }
 
-                /* Build the engine and start it. */
-                Engine engine = builder.build().apply(conns);
+                /* Prepare to receive connections. */
+                Transport conns = Transport.get();
+                final String capturePath = props.getProperty(CAPTURE_PROP);
+                final CaptureRecorder capture = capturePath == null ? null :
+                    CaptureRecorder.start().file(Paths.get(capturePath))
+                        .ratio(Double.parseDouble(props
+                            .getProperty(CAPTURE_RATIO_PROP, "1")))
+                        .create();
+                if (capture != null)
+                    conns = new CapturingTransport(conns, capture);
+
+                /* Build the engine and start it. Only this one serves
+                 * metrics. */
+                Engine engine = builder
+                    .tryingProperty(Attribute.METRICS_ADDRESS, METRICS_PROP)
+                    .build().apply(conns);
                 try {
                     while (engine.process())
                         ;
+
+                    /* Let sessions in progress finish. */
+                    engine.drain(drainMillis);
                 } finally {
+                    engine.close();
                     app.term();
+                    if (capture != null) capture.close();
                 }
             }
         }
@@ -36,9 +36,11 @@
 
 package uk.ac.lancs.fastcgi.app;
 
+import uk.ac.lancs.fastcgi.AsyncResponder;
 import uk.ac.lancs.fastcgi.Authorizer;
 import uk.ac.lancs.fastcgi.Filter;
 import uk.ac.lancs.fastcgi.Responder;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
 
 /**
  * Allows a FastCGI application to declare its capabilities.
@@ -51,12 +53,24 @@ public interface FastCGIConfiguration {
      * implement {@link Responder} itself. Calling this method after
      * returning from
      * {@link FastCGIApplication#init(FastCGIConfiguration, String[])}
-     * has no effect.
+     * has no effect. Any asynchronous Responder behaviour is
+     * discarded.
      * 
      * @param app the Responder behaviour
      */
     void setResponder(Responder app);
 
+    /**
+     * Set the Responder behaviour, to be completed asynchronously. If
+     * not set, the application may implement {@link AsyncResponder}
+     * itself. Calling this method after returning from
+     * {@link FastCGIApplication#init(FastCGIConfiguration, String[])}
+     * has no effect. Any synchronous Responder behaviour is discarded.
+     * 
+     * @param app the asynchronous Responder behaviour
+     */
+    void setAsyncResponder(AsyncResponder app);
+
     /**
      * Set the Authorizer behaviour. If not set, the application may
      * implement {@link Authorizer} itself. Calling this method after
@@ -68,6 +82,18 @@ public interface FastCGIConfiguration {
      */
     void setAuthorizer(Authorizer app);
 
+    /**
+     * Set a cache of Authorizer decisions, so that requests matching a
+     * recent decision are answered without invoking the Authorizer
+     * behaviour. Calling this method after returning from
+     * {@link FastCGIApplication#init(FastCGIConfiguration, String[])}
+     * has no effect.
+     * 
+     * @param cache the decision cache; or {@code null} to disable
+     * caching
+     */
+    void setAuthorizerCache(DecisionCache cache);
+
     /**
      * Set the Filter behaviour. If not set, the application may
      * implement {@link Filter} itself. Calling this method after
@@ -36,15 +36,23 @@
 
 package uk.ac.lancs.fastcgi.engine;
 
+import java.net.InetAddress;
+import java.net.InetSocketAddress;
+import java.util.Locale;
 import java.util.Map;
 import java.util.Properties;
 import java.util.function.Function;
 import java.util.function.Supplier;
 import java.util.regex.Matcher;
 import java.util.regex.Pattern;
+import uk.ac.lancs.fastcgi.AsyncResponder;
 import uk.ac.lancs.fastcgi.Authorizer;
 import uk.ac.lancs.fastcgi.Filter;
 import uk.ac.lancs.fastcgi.Responder;
+import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.engine.util.PipePool;
+import uk.ac.lancs.fastcgi.engine.util.RingPipePool;
 
 /**
  * Identifies a typed attribute that an engine is required or preferred
@@ -227,12 +235,84 @@ public final class Attribute<V> {
      */
     public static final Attribute<Integer> MAX_SESS = ofInt().define();
 
+    /**
+     * Indicates how many sessions may wait for admission while the
+     * number set by {@link #MAX_SESS} are running. Further sessions are
+     * refused with <code>FCGI_OVERLOADED</code>. The default is zero,
+     * so no sessions wait.
+     */
+    public static final Attribute<Integer> ADMISSION_QUEUE =
+        ofInt().withDefault(0).define();
+
+    /**
+     * Indicates the longest time in milliseconds that a session may
+     * wait for admission. A session is refused immediately if its
+     * projected wait exceeds this, and is refused with
+     * <code>FCGI_OVERLOADED</code> if it has not been admitted by then.
+     * The default is 1000.
+     */
+    public static final Attribute<Integer> ADMISSION_BUDGET =
+        ofInt().withDefault(1000).define();
+
+    /**
+     * Indicates how many bytes of request content may be held for a
+     * single session before the application consumes them. Excess
+     * content causes the session's connection to stop reading, or
+     * causes the session to be aborted if {@link #INPUT_SHEDDING} is
+     * set. The value may be suffixed by one of <samp>kKmMgG</samp>.
+     * The default is zero, meaning unlimited.
+     */
+    public static final Attribute<Integer> SESSION_INPUT_LIMIT =
+        of(Integer.class).withParser(Attribute::parseMemCap).withDefault(0)
+            .define();
+
+    /**
+     * Indicates how many bytes of request content may be held for all
+     * sessions of a connection before their applications consume them.
+     * Excess content causes the connection to stop reading until they
+     * catch up, so the server is held back by flow control. The value
+     * may be suffixed by one of <samp>kKmMgG</samp>. The default is
+     * zero, meaning unlimited.
+     */
+    public static final Attribute<Integer> CONN_INPUT_LIMIT =
+        of(Integer.class).withParser(Attribute::parseMemCap).withDefault(0)
+            .define();
+
+    /**
+     * Indicates how many bytes of request content may be held for all
+     * sessions across all connections before their applications
+     * consume them. Excess content causes every connection to stop
+     * reading until they catch up. The value may be suffixed by one of
+     * <samp>kKmMgG</samp>. The default is zero, meaning unlimited.
+     */
+    public static final Attribute<Integer> INPUT_LIMIT =
+        of(Integer.class).withParser(Attribute::parseMemCap).withDefault(0)
+            .define();
+
+    /**
+     * Indicates whether a session exceeding
+     * {@link #SESSION_INPUT_LIMIT} is aborted with
+     * <code>FCGI_OVERLOADED</code>, rather than holding up its
+     * connection. The default is {@code false}.
+     */
+    public static final Attribute<Boolean> INPUT_SHEDDING =
+        of(Boolean.class).withParser(Boolean::parseBoolean)
+            .withDefault(false).define();
+
     /**
      * Specifies the implementation that handles full requests.
      */
     public static final Attribute<Responder> RESPONDER =
         of(Responder.class).define();
 
+    /**
+     * Specifies the implementation that handles full requests without
+     * occupying a thread while it waits. An engine supporting this
+     * prefers it over {@link #RESPONDER}.
+     */
+    public static final Attribute<AsyncResponder> ASYNC_RESPONDER =
+        of(AsyncResponder.class).define();
+
     /**
      * Specifies the implementation that authorizes requests, or
      * provides responses indicating why not.
@@ -240,6 +320,15 @@ public final class Attribute<V> {
     public static final Attribute<Authorizer> AUTHORIZER =
         of(Authorizer.class).define();
 
+    /**
+     * Specifies a cache of Authorizer decisions. When a request's key
+     * parameters match a live decision, the engine replays it without
+     * invoking {@link #AUTHORIZER}, and without waiting for admission
+     * under {@link #MAX_SESS}. There is no cache by default.
+     */
+    public static final Attribute<DecisionCache> AUTHORIZER_CACHE =
+        of(DecisionCache.class).define();
+
     /**
      * Specifies the implementation that post-processes responses.
      */
@@ -251,6 +340,63 @@ public final class Attribute<V> {
     public static final Attribute<Integer> BUFFER_SIZE = of(Integer.class)
         .withParser(Attribute::parseMemCap).withDefault(1024).define();
 
+    /**
+     * Specifies how sessions are scheduled. The default is
+     * {@link Scheduling#POOLED}.
+     */
+    public static final Attribute<Scheduling> SCHEDULING =
+        of(Scheduling.class).withParser(Scheduling::parse)
+            .withDefault(Scheduling.POOLED).define();
+
+    /**
+     * Specifies the source of pipes that carry request content to
+     * applications. When parsed, <samp>cache</samp> selects a
+     * {@link CachePipePool}, and <samp>ring</samp> selects a
+     * {@link RingPipePool} that overflows into one. Each has its
+     * default configuration. The default is a {@link CachePipePool}.
+     */
+    public static final Attribute<PipePool> PIPES =
+        of(PipePool.class).withParser(Attribute::parsePipes)
+            .withDefault(() -> CachePipePool.start().create()).define();
+
+    /**
+     * Specifies an address on which the engine serves its metrics over
+     * HTTP at <samp>/metrics</samp>, in the Prometheus text format.
+     * When parsed, a bare port number binds to the loopback address,
+     * and <samp><var>host</var>:<var>port</var></samp> binds to the
+     * given host. Metrics are always available through JMX. There is
+     * no HTTP endpoint by default.
+     */
+    public static final Attribute<InetSocketAddress> METRICS_ADDRESS =
+        of(InetSocketAddress.class).withParser(Attribute::parseSocketAddress)
+            .define();
+
+    private static InetSocketAddress parseSocketAddress(String text) {
+        text = text.trim();
+        final int colon = text.lastIndexOf(':');
+        final int port = Integer.parseInt(text.substring(colon + 1));
+        if (colon < 0)
+            return new InetSocketAddress(InetAddress.getLoopbackAddress(),
+                                         port);
+        String host = text.substring(0, colon);
+        if (host.startsWith("[") && host.endsWith("]"))
+            host = host.substring(1, host.length() - 1);
+        return new InetSocketAddress(host, port);
+    }
+
+    private static PipePool parsePipes(String text) {
+        switch (text.trim().toLowerCase(Locale.ROOT)) {
+        case "cache":
+            return CachePipePool.start().create();
+
+        case "ring":
+            return RingPipePool.start().create();
+
+        default:
+            throw new IllegalArgumentException("unknown pipe pool: " + text);
+        }
+    }
+
     private static final Pattern MEMCAP_PATTERN =
         Pattern.compile("^([0-9]+)([kKmMgG])?");
 
@@ -53,7 +53,7 @@ import uk.ac.lancs.fastcgi.transport.Transport;
  * 
  * @author simpsons
  */
-public interface Engine {
+public interface Engine extends AutoCloseable {
     /**
      * Create a builder with no attributes.
      * 
@@ -304,4 +304,36 @@ public interface Engine {
      * @throws IOException if an I/O error occurs
      */
     boolean process() throws IOException;
+
+    /**
+     * Stop accepting requests on open connections, and wait for those
+     * in progress to complete. Idle connections are closed at once,
+     * and others as their last sessions end. This is intended to be
+     * called once {@link #process()} has returned {@code false}, such
+     * as when the transport has passed its listening socket to a
+     * successor process.
+     * 
+     * @param timeoutMillis the longest time to wait, in milliseconds
+     * 
+     * @return {@code true} if all connections were closed in time;
+     * {@code false} otherwise
+     * 
+     * @throws InterruptedException if interrupted while waiting
+     * 
+     * @default This method returns {@code true} immediately.
+     */
+    default boolean drain(long timeoutMillis) throws InterruptedException {
+        return true;
+    }
+
+    /**
+     * Release resources held by the engine beyond its connections, such
+     * as monitoring endpoints and registrations. This is intended to be
+     * called once the engine has been drained, and no further calls
+     * should be made on it.
+     * 
+     * @default Nothing happens by default.
+     */
+    @Override
+    default void close() {}
 }
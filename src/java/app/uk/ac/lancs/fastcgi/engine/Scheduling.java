@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine;
+
+import java.util.Locale;
+
+/**
+ * Identifies how an engine schedules the execution of sessions.
+ * 
+ * @see Attribute#SCHEDULING
+ * 
+ * @author simpsons
+ */
+public enum Scheduling {
+    /**
+     * Each connection has its own pool of platform threads for its
+     * sessions, bounded by the per-connection session limit if set.
+     */
+    POOLED,
+
+    /**
+     * All sessions of all connections are run on a single
+     * work-stealing pool of platform threads, so that idle capacity is
+     * shared between connections. Sessions of blocking applications
+     * are run as managed blocking operations, so the pool starts extra
+     * workers rather than let them starve other sessions.
+     */
+    SHARED,
+
+    /**
+     * Each session runs in its own virtual thread. This suits
+     * applications that block on back-end services, and requires a
+     * Java runtime that supports virtual threads. Each connection also
+     * gets a virtual thread, but the maximum number of connections
+     * still limits how many are served at once.
+     */
+    VIRTUAL;
+
+    /**
+     * Parse a scheduling mode, ignoring case.
+     * 
+     * @param text the text to parse
+     * 
+     * @return the identified mode
+     * 
+     * @throws IllegalArgumentException if the text does not identify a
+     * mode
+     */
+    public static Scheduling parse(String text) {
+        return valueOf(text.trim().toUpperCase(Locale.ROOT));
+    }
+}
@@ -39,25 +39,22 @@ package uk.ac.lancs.fastcgi.engine.util;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
-import java.io.RandomAccessFile;
-import java.lang.ref.Cleaner;
-import java.nio.file.Files;
 import java.nio.file.Path;
 import java.nio.file.Paths;
 import java.util.Objects;
 import java.util.concurrent.atomic.AtomicLong;
-import java.util.logging.Level;
-import java.util.logging.Logger;
+import java.util.concurrent.atomic.LongAdder;
 
 /**
  * Generates pipes that store small amounts in RAM and the rest to the
- * file system.
+ * file system. RAM chunks grow in size as a pipe's content does, and
+ * their arrays are recycled once their content has been consumed.
+ * Chunk files are unlinked as soon as they are created, and are also
+ * recycled.
  *
  * @author simpsons
  */
 public final class CachePipePool implements PipePool {
-    private static final Cleaner cleaner = Cleaner.create();
-
     private final Path dir;
 
     private final String prefix;
@@ -68,8 +65,17 @@ public final class CachePipePool implements PipePool {
 
     private final int memChunkSize;
 
+    private final SlabAllocator slabs;
+
+    private final SpillPool spills;
+
     private final AtomicLong memoryUsage = new AtomicLong(0);
 
+    /**
+     * Counts bytes written to chunk files since creation.
+     */
+    private final LongAdder spilled = new LongAdder();
+
     private final int ramThreshold;
 
     /**
@@ -103,6 +109,18 @@ public final class CachePipePool implements PipePool {
      */
     public static final int MEM_CHUNK_SIZE = 1024;
 
+    /**
+     * The default maximum size in bytes of each memory chunk, namely
+     * {@value}, overridden by {@link Builder#maxMemChunkSize(int)}
+     */
+    public static final int MAX_MEM_CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * The default number of idle chunk files retained for re-use,
+     * namely {@value}, overridden by {@link Builder#spillPoolSize(int)}
+     */
+    public static final int SPILL_POOL_SIZE = 4;
+
     /**
      * The {@linkplain System#getProperties() system property} whose
      * value is the default directory for chunk files
@@ -132,8 +150,12 @@ public final class CachePipePool implements PipePool {
 
         private int memChunkSize = MEM_CHUNK_SIZE;
 
+        private int maxMemChunkSize = MAX_MEM_CHUNK_SIZE;
+
         private long maxFileSize = MAX_FILE_SIZE;
 
+        private int spillPoolSize = SPILL_POOL_SIZE;
+
         Builder() {}
 
         /**
@@ -230,6 +252,45 @@ public final class CachePipePool implements PipePool {
             return this;
         }
 
+        /**
+         * Set the maximum size of RAM chunks. Each pipe's first RAM
+         * chunk has the size set by {@link #memChunkSize(int)}, and
+         * each subsequent one has double the size of its predecessor,
+         * up to this limit. The default is given by
+         * {@link #MAX_MEM_CHUNK_SIZE}.
+         * 
+         * @param maxMemChunkSize the maximum RAM chunk size
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder maxMemChunkSize(int maxMemChunkSize) {
+            if (maxMemChunkSize < 0)
+                throw new IllegalArgumentException("-ve max RAM chunk size");
+            this.maxMemChunkSize = maxMemChunkSize;
+            return this;
+        }
+
+        /**
+         * Set the number of idle chunk files to retain. A chunk file
+         * whose content has been consumed is kept open for use by
+         * another pipe, unless this many are already idle. The default
+         * is given by {@link #SPILL_POOL_SIZE}.
+         * 
+         * @param spillPoolSize the number of idle files to retain
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder spillPoolSize(int spillPoolSize) {
+            if (spillPoolSize < 0)
+                throw new IllegalArgumentException("-ve spill pool size");
+            this.spillPoolSize = spillPoolSize;
+            return this;
+        }
+
         /**
          * Create a pool with the current configuration.
          * 
@@ -237,7 +298,8 @@ public final class CachePipePool implements PipePool {
          */
         public CachePipePool create() {
             return new CachePipePool(dir, prefix, suffix, maxFileSize,
-                                     memChunkSize, ramThreshold);
+                                     memChunkSize, maxMemChunkSize,
+                                     ramThreshold, spillPoolSize);
         }
     }
 
@@ -252,16 +314,30 @@ public final class CachePipePool implements PipePool {
      * 
      * @param maxFileSize the maximum size of a chunk file
      * 
-     * @param memChunkSize the size of an internal chunk
+     * @param memChunkSize the size of a pipe's first internal chunk
+     * 
+     * @param maxMemChunkSize the maximum size of an internal chunk
+     * 
+     * @param ramThreshold the amount of RAM in use beyond which chunk
+     * files are created, which also limits the RAM retained for
+     * recycling
+     * 
+     * @param spillPoolSize the maximum number of idle chunk files to
+     * retain
      */
     CachePipePool(Path dir, String prefix, String suffix, long maxFileSize,
-                  int memChunkSize, int ramThreshold) {
+                  int memChunkSize, int maxMemChunkSize, int ramThreshold,
+                  int spillPoolSize) {
         this.dir = dir;
         this.prefix = prefix;
         this.suffix = suffix;
         this.maxFileSize = maxFileSize;
         this.memChunkSize = memChunkSize;
         this.ramThreshold = ramThreshold;
+        this.slabs = memChunkSize > 0 ?
+            new SlabAllocator(memChunkSize, maxMemChunkSize, ramThreshold) :
+            null;
+        this.spills = new SpillPool(dir, prefix, suffix, spillPoolSize);
     }
 
     @Override
@@ -269,6 +345,25 @@ public final class CachePipePool implements PipePool {
         return new MyPipe();
     }
 
+    /**
+     * Get the amount of RAM currently holding pipe content.
+     * 
+     * @return the number of bytes held in memory chunks
+     */
+    public long memoryUsage() {
+        return memoryUsage.get();
+    }
+
+    /**
+     * Get the amount of pipe content that has been written to chunk
+     * files, because RAM usage had reached its threshold.
+     * 
+     * @return the total number of bytes spilled to files
+     */
+    public long spilledBytes() {
+        return spilled.sum();
+    }
+
     private class MyPipe implements Pipe {
         // final BlockingEnumeration<InputStream> queue;
 
@@ -287,6 +382,12 @@ public final class CachePipePool implements PipePool {
 
         private Chunk lastChunk;
 
+        /**
+         * Holds the size of the next RAM chunk, which grows as the
+         * pipe's content does.
+         */
+        private int nextMemChunkSize = memChunkSize;
+
         private Throwable abortedReason;
 
         private boolean closed;
@@ -294,26 +395,20 @@ public final class CachePipePool implements PipePool {
         private Chunk getLastChunk() throws IOException {
             if (lastChunk != null) return lastChunk;
             if (memoryUsage.get() >= ramThreshold) {
-                /* Create a temporary random-access file. */
-                Path path = Files.createTempFile(dir, prefix, suffix);
-                RandomAccessFile file =
-                    new RandomAccessFile(path.toFile(), "rw");
-
-                /* When the file handle is garbage-collected, delete the
-                 * file. */
-                path.toFile().deleteOnExit();
-                cleaner.register(file, () -> {
-                    try {
-                        Files.deleteIfExists(path);
-                    } catch (IOException ex) {
-                        Logger.getLogger(CachePipePool.class.getName())
-                            .log(Level.SEVERE, null, ex);
-                    }
-                });
-
-                lastChunk = new FileChunk(file, maxFileSize);
-            } else {
+                /* Use an idle spill file if there is one. It has no
+                 * name, so nothing needs to be deleted later. */
+                lastChunk =
+                    new FileChunk(spills.acquire(), spills, maxFileSize);
+            } else if (slabs == null) {
                 lastChunk = new MemoryChunk(memChunkSize, memoryUsage);
+            } else {
+                /* Take a recycled array, and make the next one bigger,
+                 * so that a long stream needs few chunks. */
+                byte[] array = slabs.allocate(nextMemChunkSize);
+                nextMemChunkSize =
+                    slabs.sizeFor((int) Long.min(2L * array.length,
+                                                 slabs.maxSize()));
+                lastChunk = new MemoryChunk(array, slabs, memoryUsage);
             }
             sequence.submit(lastChunk.getStream());
             return lastChunk;
@@ -346,10 +441,14 @@ public final class CachePipePool implements PipePool {
                 if (abortedReason != null)
                     throw new IOException("stream aborted", abortedReason);
                 if (closed) throw new IOException("closed");
+
+                /* Don't store content that the reader has declined. */
+                if (sequence.isClosed()) return;
                 while (len > 0) {
                     Chunk chunk = getLastChunk();
                     int done = chunk.write(b, off, len);
                     if (done == 0) clearLastChunk();
+                    else if (chunk instanceof FileChunk) spilled.add(done);
                     off += done;
                     len -= done;
                 }
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import java.time.Duration;
+import java.util.Arrays;
+import java.util.Collection;
+import java.util.List;
+import java.util.Map;
+import java.util.Objects;
+import java.util.Queue;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * Remembers the outcomes of Authorizer requests, so that repeated
+ * requests can be answered without invoking the application. A
+ * decision is identified by the values of a fixed set of request
+ * parameters, and consists of the complete standard output (the
+ * response header and body) and the exit status. Decisions expire
+ * after a fixed time, and the oldest are discarded to keep the number
+ * within a limit.
+ * 
+ * <p>
+ * The application must only declare a cache whose key parameters
+ * fully determine its decisions.
+ * 
+ * @author simpsons
+ */
+public final class DecisionCache {
+    /**
+     * The default time for which a decision is retained, namely 60
+     * seconds, overridden by {@link Builder#ttl(Duration)}
+     */
+    public static final Duration TTL = Duration.ofSeconds(60);
+
+    /**
+     * The default maximum number of decisions retained, namely
+     * {@value}, overridden by {@link Builder#capacity(int)}
+     */
+    public static final int CAPACITY = 10000;
+
+    /**
+     * The default maximum size in bytes of a decision's output, namely
+     * {@value}, overridden by {@link Builder#outputLimit(int)}
+     */
+    public static final int OUTPUT_LIMIT = 4096;
+
+    /**
+     * Start building a cache.
+     * 
+     * @return the new builder
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    /**
+     * Collects the parameters for building a decision cache.
+     */
+    public static class Builder {
+        private String[] names;
+
+        private Duration ttl = TTL;
+
+        private int capacity = CAPACITY;
+
+        private int outputLimit = OUTPUT_LIMIT;
+
+        Builder() {}
+
+        /**
+         * Set the names of the request parameters that determine a
+         * decision. This must be called before {@link #create()}.
+         * 
+         * @param names the parameter names, such as
+         * <samp>REMOTE_USER</samp> or <samp>HTTP_COOKIE</samp>
+         * 
+         * @return this builder
+         * 
+         * @throws NullPointerException if any name is {@code null}
+         */
+        public Builder key(Collection<? extends String> names) {
+            String[] made = names.toArray(n -> new String[n]);
+            for (String name : made)
+                Objects.requireNonNull(name, "name");
+            this.names = made;
+            return this;
+        }
+
+        /**
+         * Set the names of the request parameters that determine a
+         * decision. This must be called before {@link #create()}.
+         * 
+         * @param names the parameter names
+         * 
+         * @return this builder
+         * 
+         * @throws NullPointerException if any name is {@code null}
+         */
+        public Builder key(String... names) {
+            return key(Arrays.asList(names));
+        }
+
+        /**
+         * Set the time for which a decision is retained. The default
+         * is given by {@link #TTL}.
+         * 
+         * @param ttl the retention time
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is not
+         * positive
+         */
+        public Builder ttl(Duration ttl) {
+            if (ttl.isNegative() || ttl.isZero())
+                throw new IllegalArgumentException("non-positive TTL " + ttl);
+            this.ttl = ttl;
+            return this;
+        }
+
+        /**
+         * Set the maximum number of decisions to retain. The default
+         * is given by {@link #CAPACITY}.
+         * 
+         * @param capacity the maximum number of decisions
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is not
+         * positive
+         */
+        public Builder capacity(int capacity) {
+            if (capacity < 1)
+                throw new IllegalArgumentException("non-positive capacity "
+                    + capacity);
+            this.capacity = capacity;
+            return this;
+        }
+
+        /**
+         * Set the maximum size of a decision's output. Decisions with
+         * more output are not cached. The default is given by
+         * {@link #OUTPUT_LIMIT}.
+         * 
+         * @param outputLimit the maximum size in bytes
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is negative
+         */
+        public Builder outputLimit(int outputLimit) {
+            if (outputLimit < 0)
+                throw new IllegalArgumentException("-ve output limit "
+                    + outputLimit);
+            this.outputLimit = outputLimit;
+            return this;
+        }
+
+        /**
+         * Create a cache with the current configuration.
+         * 
+         * @return a cache with the required configuration
+         * 
+         * @throws IllegalStateException if no key has been set
+         */
+        public DecisionCache create() {
+            if (names == null) throw new IllegalStateException("no key");
+            return new DecisionCache(names, ttl.toNanos(), capacity,
+                                     outputLimit);
+        }
+    }
+
+    /**
+     * Holds a cached decision.
+     */
+    public static final class Decision {
+        final List<String> key;
+
+        private final byte[] output;
+
+        private final int exitStatus;
+
+        private final long expiry;
+
+        Decision(List<String> key, byte[] output, int exitStatus,
+                 long expiry) {
+            this.key = key;
+            this.output = output;
+            this.exitStatus = exitStatus;
+            this.expiry = expiry;
+        }
+
+        /**
+         * Get the standard output of the decision, including the
+         * response header. The array must not be modified.
+         * 
+         * @return the output
+         */
+        public byte[] output() {
+            return output;
+        }
+
+        /**
+         * Get the exit status of the decision.
+         * 
+         * @return the exit status
+         */
+        public int exitStatus() {
+            return exitStatus;
+        }
+    }
+
+    private final String[] names;
+
+    private final long ttlNanos;
+
+    private final int capacity;
+
+    private final int outputLimit;
+
+    private final Map<List<String>, Decision> decisions =
+        new ConcurrentHashMap<>();
+
+    /**
+     * Holds decisions, oldest first. A decision may remain here after it
+     * has expired or been replaced.
+     */
+    private final Queue<Decision> order = new ConcurrentLinkedQueue<>();
+
+    /**
+     * Counts the elements of {@link #order}, whose own size is costly
+     * to compute.
+     */
+    private final AtomicInteger orderSize = new AtomicInteger();
+
+    private DecisionCache(String[] names, long ttlNanos, int capacity,
+                          int outputLimit) {
+        this.names = names;
+        this.ttlNanos = ttlNanos;
+        this.capacity = capacity;
+        this.outputLimit = outputLimit;
+    }
+
+    /**
+     * Get the maximum size of a decision's output.
+     * 
+     * @return the maximum size in bytes
+     */
+    public int outputLimit() {
+        return outputLimit;
+    }
+
+    private List<String> keyOf(Map<String, String> params) {
+        String[] values = new String[names.length];
+        for (int i = 0; i < values.length; i++)
+            values[i] = params.get(names[i]);
+        return Arrays.asList(values);
+    }
+
+    /**
+     * Get the current decision for a request.
+     * 
+     * @param params the request parameters
+     * 
+     * @return the decision; or {@code null} if there is none, or it
+     * has expired
+     */
+    public Decision get(Map<String, String> params) {
+        List<String> key = keyOf(params);
+        Decision decision = decisions.get(key);
+        if (decision == null) return null;
+        if (System.nanoTime() - decision.expiry < 0) return decision;
+        decisions.remove(key, decision);
+        return null;
+    }
+
+    /**
+     * Record the decision for a request. If the cache is then over
+     * capacity, the oldest decisions are discarded.
+     * 
+     * @param params the request parameters
+     * 
+     * @param output the complete standard output, which must not be
+     * modified subsequently
+     * 
+     * @param exitStatus the exit status
+     */
+    public void put(Map<String, String> params, byte[] output,
+                    int exitStatus) {
+        if (output.length > outputLimit) return;
+        List<String> key = keyOf(params);
+        Decision decision = new Decision(key, output, exitStatus,
+                                         System.nanoTime() + ttlNanos);
+        decisions.put(key, decision);
+        order.add(decision);
+        orderSize.incrementAndGet();
+
+        /* Discard the oldest decisions, until the cache is within its
+         * capacity, and the queue is not dominated by decisions that
+         * have already gone. A decision that has been replaced remains
+         * in the map. */
+        while (decisions.size() > capacity
+            || orderSize.get() > 2 * capacity) {
+            Decision old = order.poll();
+            if (old == null) break;
+            orderSize.decrementAndGet();
+            decisions.remove(old.key, old);
+        }
+    }
+}
@@ -39,17 +39,27 @@ package uk.ac.lancs.fastcgi.engine.util;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.channels.WritableByteChannel;
+import uk.ac.lancs.fastcgi.context.BufferReader;
 import uk.ac.lancs.fastcgi.context.StreamAbortedException;
 
 /**
- * Stores content in a file.
+ * Stores content in a file. Bytes are written and read at explicit
+ * positions, so the file's own position is not used. The file may come
+ * from a pool, to which it is returned when no longer needed. Buffered
+ * reads are served from a single buffer owned by the chunk, and
+ * transfers to channels are delegated to the file.
  *
  * @author simpsons
  */
 final class FileChunk implements Chunk {
     private final long maxFileSize;
 
-    private RandomAccessFile file;
+    private final SpillPool spills;
+
+    private FileChannel file;
 
     private long readPos = 0;
 
@@ -59,6 +69,16 @@ final class FileChunk implements Chunk {
 
     private Throwable reason = null;
 
+    /**
+     * The maximum number of bytes presented in one buffer
+     */
+    private static final int BUFFER_LIMIT = 64 * 1024;
+
+    /**
+     * Holds content presented as a buffer, allocated on first use.
+     */
+    private ByteBuffer buffer;
+
     /**
      * Create a chunk stored in a file.
      * 
@@ -69,15 +89,65 @@ final class FileChunk implements Chunk {
      * written
      */
     public FileChunk(RandomAccessFile file, long maxFileSize) {
+        this(file.getChannel(), null, maxFileSize);
+    }
+
+    /**
+     * Create a chunk stored in a pooled file. The file is returned to
+     * the pool when the chunk's stream is closed, or when all of its
+     * content has been read.
+     * 
+     * @param file the channel for reading and writing to and from the
+     * stream
+     * 
+     * @param spills the pool to return the file to; or {@code null} if
+     * it is to be closed instead
+     * 
+     * @param maxFileSize the maximum number of bytes to allow to be
+     * written
+     */
+    FileChunk(FileChannel file, SpillPool spills, long maxFileSize) {
         this.file = file;
+        this.spills = spills;
         this.maxFileSize = maxFileSize;
     }
 
+    /**
+     * Indicates that the file has been given up because all content
+     * has been delivered.
+     */
+    private boolean drained = false;
+
+    /**
+     * Give up the file.
+     * 
+     * @throws IOException if closing the file fails
+     */
+    private void relinquish() throws IOException {
+        if (spills != null)
+            spills.release(file);
+        else
+            file.close();
+    }
+
+    /**
+     * Give up the file if all content has been delivered. The caller
+     * must hold this object's monitor.
+     * 
+     * @throws IOException if closing the file fails
+     */
+    private void relinquishIfDrained() throws IOException {
+        if (!complete || readPos != writePos) return;
+        if (file == null || drained) return;
+        drained = true;
+        relinquish();
+    }
+
     /**
      * {@inheritDoc}
      * 
-     * This method claims the monitor, seeks to the end of the file, and
-     * writes up to the requested amount, ensuring that the configured
+     * This method claims the monitor, and writes up to the requested
+     * amount at the end of the content, ensuring that the configured
      * maximum size is not exceeded.
      * 
      * @throws IllegalStateException if the chunk has been completed
@@ -104,8 +174,9 @@ final class FileChunk implements Chunk {
 
         /* Decide how much to actually accept, and copy to the file. */
         int amount = (int) Long.min(remaining, len);
-        file.seek(writePos);
-        file.write(buf, off, amount);
+        ByteBuffer src = ByteBuffer.wrap(buf, off, amount);
+        while (src.hasRemaining())
+            file.write(src, writePos + src.position() - off);
 
         /* Remember our new file position. */
         writePos += amount;
@@ -122,9 +193,10 @@ final class FileChunk implements Chunk {
      * The content is marked as complete.
      */
     @Override
-    public synchronized void complete() {
+    public synchronized void complete() throws IOException {
         complete = true;
         notify();
+        relinquishIfDrained();
     }
 
     /**
@@ -163,12 +235,13 @@ final class FileChunk implements Chunk {
         if (reason != null) throw new StreamAbortedException(reason);
         if (readPos == writePos) return -1;
 
-        /* At least one byte is available, so seek and provide it. */
-        file.seek(readPos);
-        int r = file.read();
-        assert r >= 0;
+        /* At least one byte is available, so provide it. */
+        ByteBuffer dst = ByteBuffer.allocate(1);
+        int got = file.read(dst, readPos);
+        assert got == 1;
         readPos++;
-        return r;
+        relinquishIfDrained();
+        return dst.get(0) & 0xff;
     }
 
     /**
@@ -178,8 +251,9 @@ final class FileChunk implements Chunk {
      * @throws IOException if closing the underlying file fails
      */
     synchronized void close() throws IOException {
+        if (file == null) return;
         try {
-            file.close();
+            if (!drained) relinquish();
         } finally {
             file = null;
         }
@@ -237,24 +311,127 @@ final class FileChunk implements Chunk {
         /* At least one byte is available. Work out how much to provide,
          * transfer it, and report how much was moved. */
         int amount = (int) Long.min(len, writePos - readPos);
-        file.seek(readPos);
-        int got = file.read(b, off, amount);
+        int got = file.read(ByteBuffer.wrap(b, off, amount), readPos);
         assert got >= 0;
         readPos += got;
+        relinquishIfDrained();
         return got;
     }
 
+    /**
+     * Wait until some bytes are available, the input stream has been
+     * closed, the content has been marked as complete, or a reason for
+     * abortion has been specified. The caller must hold this object's
+     * monitor.
+     * 
+     * @return {@code true} on end-of-file
+     * 
+     * @throws StreamAbortedException if the stream has been aborted
+     * with {@link #abort(Throwable)}
+     * 
+     * @throws IOException if the input stream has been closed
+     */
+    private boolean await() throws IOException {
+        /* Wait until there's no reason to block. */
+        boolean interrupted = false;
+        while (file != null && !complete && reason == null &&
+            readPos == writePos) {
+            try {
+                wait();
+            } catch (InterruptedException ex) {
+                interrupted = true;
+            }
+        }
+
+        /* Re-transmit the interruption. */
+        if (interrupted) Thread.currentThread().interrupt();
+
+        /* Detect errors and end-of-file. */
+        if (file == null) throw new IOException("closed");
+        if (reason != null) throw new StreamAbortedException(reason);
+        return readPos == writePos;
+    }
+
+    /**
+     * Read available bytes into this chunk's buffer, and present them.
+     * The previous contents of the buffer are overwritten.
+     * 
+     * @return a read-only view of the read bytes; or {@code null} on
+     * end-of-file
+     * 
+     * @throws StreamAbortedException if the stream has been aborted
+     * with {@link #abort(Throwable)}
+     * 
+     * @throws IOException if the input stream has been closed
+     */
+    synchronized ByteBuffer nextBuffer() throws IOException {
+        if (await()) return null;
+        final int amount = (int) Long.min(BUFFER_LIMIT, writePos - readPos);
+        if (buffer == null || buffer.capacity() < amount)
+            buffer = ByteBuffer.allocate(BUFFER_LIMIT);
+        buffer.clear().limit(amount);
+        while (buffer.hasRemaining()) {
+            int got = file.read(buffer, readPos + buffer.position());
+            assert got >= 0;
+        }
+        readPos += amount;
+        relinquishIfDrained();
+        return buffer.flip().asReadOnlyBuffer();
+    }
+
+    /**
+     * Transfer all remaining content to a channel, without passing it
+     * through user space where possible.
+     * 
+     * @param out the destination channel
+     * 
+     * @return the number of bytes transferred
+     * 
+     * @throws StreamAbortedException if the stream has been aborted
+     * with {@link #abort(Throwable)}
+     * 
+     * @throws IOException if the input stream has been closed, or an
+     * I/O error occurs
+     */
+    synchronized long transferTo(WritableByteChannel out) throws IOException {
+        long total = 0;
+        while (!await()) {
+            long done = file.transferTo(readPos, writePos - readPos, out);
+            readPos += done;
+            total += done;
+            relinquishIfDrained();
+        }
+        return total;
+    }
+
     @Override
     public InputStream getStream() {
         return stream;
     }
 
-    private final InputStream stream = new InputStream() {
+    private final InputStream stream = new Stream();
+
+    private class Stream extends InputStream implements BufferReader {
         @Override
         public int read() throws IOException {
             return FileChunk.this.read();
         }
 
+        @Override
+        public ByteBuffer nextBuffer() throws IOException {
+            return FileChunk.this.nextBuffer();
+        }
+
+        @Override
+        public void release() {
+            /* The buffer is simply overwritten by the next call. */
+        }
+
+        @Override
+        public long transferTo(WritableByteChannel out) throws IOException {
+            return FileChunk.this.transferTo(out);
+        }
+
         @Override
         public void close() throws IOException {
             FileChunk.this.close();
@@ -269,7 +446,7 @@ final class FileChunk implements Chunk {
         public int read(byte[] b, int off, int len) throws IOException {
             return FileChunk.this.read(b, off, len);
         }
-    };
+    }
 
     @Override
     public synchronized void abort(Throwable reason) {
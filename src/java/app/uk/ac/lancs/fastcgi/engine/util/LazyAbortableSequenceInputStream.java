@@ -38,20 +38,29 @@ package uk.ac.lancs.fastcgi.engine.util;
 
 import java.io.IOException;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.Channels;
+import java.nio.channels.WritableByteChannel;
 import java.util.ArrayList;
 import java.util.List;
 import java.util.Objects;
+import uk.ac.lancs.fastcgi.context.BufferReader;
 import uk.ac.lancs.fastcgi.context.StreamAbortedException;
 
 /**
  * Presents the contents of a sequence of source streams as its own
  * content. The sequence is defined later through calls to
  * {@link #submit(InputStream)}, and finally a call to
- * {@link #complete()} or {@link #abort(Throwable)}.
+ * {@link #complete()} or {@link #abort(Throwable)}. Buffers are taken
+ * directly from source streams that implement {@link BufferReader},
+ * and copied from those that don't. Closing the stream closes all
+ * source streams, including those submitted later, without waiting for
+ * the sequence to be completed.
  * 
  * @author simpsons
  */
-class LazyAbortableSequenceInputStream extends InputStream {
+class LazyAbortableSequenceInputStream extends InputStream
+    implements BufferReader {
     private final List<InputStream> sequence = new ArrayList<>();
 
     private final boolean closeOnError;
@@ -62,6 +71,17 @@ class LazyAbortableSequenceInputStream extends InputStream {
 
     private Throwable abortedReason;
 
+    /**
+     * Records whether the reader has closed the stream.
+     */
+    private volatile boolean closed;
+
+    /**
+     * Holds content copied from a source stream that does not provide
+     * buffers, allocated on first use.
+     */
+    private byte[] spare;
+
     /**
      * Create a sequence input stream. This constructor does not invoke
      * the argument, so it will not block.
@@ -76,25 +96,41 @@ class LazyAbortableSequenceInputStream extends InputStream {
     }
 
     /**
-     * Submit a new stream to the sequence.
+     * Submit a new stream to the sequence. If the reader has already
+     * closed this stream, the submitted stream is closed immediately.
      * 
      * @param stream the stream to be appended to the sequence
      * 
      * @throws IllegalStateException if the sequence has already been
      * completed or aborted
+     * 
+     * @throws IOException if an I/O error occurs in closing the
+     * submitted stream
      */
-    public void submit(InputStream stream) {
+    public void submit(InputStream stream) throws IOException {
         Objects.requireNonNull(stream, "stream");
-        submitInternal(stream);
+        if (!submitInternal(stream)) stream.close();
     }
 
-    private synchronized void submitInternal(InputStream stream) {
+    private synchronized boolean submitInternal(InputStream stream) {
         assert Thread.holdsLock(this);
         if (abortedReason != null)
             throw new IllegalStateException("aborted", abortedReason);
         if (completed) throw new IllegalStateException("closed");
+        if (closed) return false;
         sequence.add(stream);
         notify();
+        return true;
+    }
+
+    /**
+     * Determine whether the reader has closed the stream. Further
+     * content will not be read, so it need not be submitted.
+     * 
+     * @return {@code true} if the stream has been closed
+     */
+    public boolean isClosed() {
+        return closed;
     }
 
     /**
@@ -136,12 +172,12 @@ class LazyAbortableSequenceInputStream extends InputStream {
      * @return {@code false} if a source stream is ready; {@code true}
      * if there are no more source streams
      */
-    private boolean ensure(boolean throwAbort) throws StreamAbortedException {
+    private boolean ensure(boolean throwAbort) throws IOException {
         if (current != null) return false;
         boolean interrupted = false;
         synchronized (this) {
             boolean r;
-            while ((r = sequence.isEmpty()) && !completed &&
+            while ((r = sequence.isEmpty()) && !completed && !closed &&
                 abortedReason == null) {
                 try {
                     wait();
@@ -150,6 +186,10 @@ class LazyAbortableSequenceInputStream extends InputStream {
                 }
             }
             if (interrupted) Thread.currentThread().interrupt();
+            if (closed) {
+                if (throwAbort) throw new IOException("closed");
+                return true;
+            }
             if (throwAbort && abortedReason != null)
                 throw new StreamAbortedException(abortedReason);
             if (r) return true;
@@ -234,16 +274,37 @@ class LazyAbortableSequenceInputStream extends InputStream {
     }
 
     /**
-     * Close the stream. Each base stream is closed. This call may block
-     * while the source enumeration blocks. If a source stream throws an
-     * exception, it will be thrown, and exceptions from subsequent
-     * streams are suppressed.
+     * Close the stream. Each base stream submitted so far is closed,
+     * and later ones will be closed on submission, so this call does
+     * not block. If a source stream throws an exception, it will be
+     * thrown, and exceptions from subsequent streams are suppressed.
      * 
      * @throws IOException if an I/O error occurred
      */
     @Override
     public void close() throws IOException {
-        cleanUp(null);
+        final List<InputStream> rest;
+        synchronized (this) {
+            if (closed) return;
+            closed = true;
+            rest = new ArrayList<>(sequence);
+            sequence.clear();
+            notifyAll();
+        }
+        if (current != null) rest.add(0, current);
+        current = null;
+        IOException suppressor = null;
+        for (InputStream stream : rest) {
+            try {
+                stream.close();
+            } catch (IOException ex) {
+                if (suppressor == null)
+                    suppressor = ex;
+                else
+                    suppressor.addSuppressed(ex);
+            }
+        }
+        if (suppressor != null) throw suppressor;
     }
 
     /**
@@ -334,4 +395,67 @@ class LazyAbortableSequenceInputStream extends InputStream {
             throw new AssertionError("unreachable");
         }
     }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * This call may block while the source enumeration blocks. If the
+     * source stream throws an exception, and close-on-error is set,
+     * all remaining streams are closed, and subsequent exceptions are
+     * suppressed.
+     */
+    @Override
+    public ByteBuffer nextBuffer() throws IOException {
+        try {
+            do {
+                if (ensure(true)) return null;
+                if (current instanceof BufferReader) {
+                    ByteBuffer buf = ((BufferReader) current).nextBuffer();
+                    if (buf != null) return buf;
+                } else {
+                    if (spare == null) spare = new byte[8192];
+                    int rc = current.read(spare);
+                    if (rc >= 0) return ByteBuffer.wrap(spare, 0, rc)
+                        .asReadOnlyBuffer();
+                }
+                clear();
+            } while (true);
+        } catch (IOException | Error | RuntimeException ex) {
+            optionalCleanUp(ex);
+            throw new AssertionError("unreachable");
+        }
+    }
+
+    @Override
+    public void release() throws IOException {
+        if (current instanceof BufferReader)
+            ((BufferReader) current).release();
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * Each source stream that implements {@link BufferReader} is asked
+     * to transfer its own content. This call may block while the
+     * source enumeration blocks. If the source stream throws an
+     * exception, and close-on-error is set, all remaining streams are
+     * closed, and subsequent exceptions are suppressed.
+     */
+    @Override
+    public long transferTo(WritableByteChannel out) throws IOException {
+        try {
+            long total = 0;
+            while (!ensure(true)) {
+                if (current instanceof BufferReader)
+                    total += ((BufferReader) current).transferTo(out);
+                else
+                    total += current.transferTo(Channels.newOutputStream(out));
+                clear();
+            }
+            return total;
+        } catch (IOException | Error | RuntimeException ex) {
+            optionalCleanUp(ex);
+            throw new AssertionError("unreachable");
+        }
+    }
 }
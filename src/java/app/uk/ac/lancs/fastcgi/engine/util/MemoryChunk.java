@@ -38,7 +38,9 @@ package uk.ac.lancs.fastcgi.engine.util;
 
 import java.io.IOException;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
 import java.util.concurrent.atomic.AtomicLong;
+import uk.ac.lancs.fastcgi.context.BufferReader;
 import uk.ac.lancs.fastcgi.context.StreamAbortedException;
 
 /**
@@ -48,15 +50,26 @@ import uk.ac.lancs.fastcgi.context.StreamAbortedException;
  * read operations, the contents are shifted to the start of the array
  * for re-use of the space. Changes to the amount of space used are
  * recorded in an atomic counter, allowing the user to decide when to
- * switch to backing store for new chunks.
+ * switch to backing store for new chunks. The array may come from an
+ * allocator, to which it is returned when no longer needed. Content
+ * may also be read as a view of the array, during which the array
+ * contents are not shifted.
  * 
  * @author simpsons
  */
 final class MemoryChunk implements Chunk {
     private final AtomicLong memoryUsage;
 
+    private final SlabAllocator slabs;
+
     private byte[] array;
 
+    /**
+     * Replaces the array once it has been recycled because all content
+     * has been delivered.
+     */
+    private static final byte[] DRAINED = new byte[0];
+
     /**
      * Create a chunk storing content in a byte array.
      * 
@@ -67,20 +80,56 @@ final class MemoryChunk implements Chunk {
      * removed
      */
     public MemoryChunk(int memChunkSize, AtomicLong memoryUsage) {
+        this(new byte[memChunkSize], null, memoryUsage);
+    }
+
+    /**
+     * Create a chunk storing content in an array from an allocator. The
+     * array is returned to the allocator when the chunk's stream is
+     * closed, or when all of its content has been read.
+     * 
+     * @param array the array to store content in
+     * 
+     * @param slabs the allocator to return the array to; or
+     * {@code null} if it is not to be recycled
+     * 
+     * @param memoryUsage a counter to be updated as bytes are added and
+     * removed
+     */
+    MemoryChunk(byte[] array, SlabAllocator slabs, AtomicLong memoryUsage) {
         this.memoryUsage = memoryUsage;
-        this.array = new byte[memChunkSize];
+        this.slabs = slabs;
+        this.array = array;
+    }
+
+    /**
+     * Give the array back to the allocator if all content has been
+     * delivered. The caller must hold this object's monitor.
+     */
+    private void recycleIfDrained() {
+        if (!complete || readPos != writePos) return;
+        if (array == null || array == DRAINED) return;
+        if (slabs != null) slabs.release(array);
+        array = DRAINED;
+        readPos = writePos = 0;
     }
 
     private int readPos = 0;
 
     private int writePos = 0;
 
+    /**
+     * Holds the number of bytes from {@link #readPos} presented to the
+     * reader as a buffer view, and not yet released.
+     */
+    private int lent = 0;
+
     private boolean complete = false;
 
     private Throwable reason = null;
 
     private void check() {
-        assert readPos <= writePos;
+        assert readPos + lent <= writePos;
         assert readPos >= 0;
         assert writePos <= array.length;
     }
@@ -114,7 +163,7 @@ final class MemoryChunk implements Chunk {
             /* How much space is at the end of the array? */
             final int rem = array.length - writePos;
             final int amount;
-            if (len > rem) {
+            if (len > rem && lent == 0) {
                 /* We don't have enough space in our buffer. Try
                  * shifting the current content to the start of the
                  * buffer. */
@@ -141,6 +190,7 @@ final class MemoryChunk implements Chunk {
     @Override
     public synchronized void complete() {
         complete = true;
+        recycleIfDrained();
         notify();
     }
 
@@ -149,12 +199,79 @@ final class MemoryChunk implements Chunk {
      * mark this. Closing twice is not an error.
      */
     synchronized void close() {
+        if (array != null && array != DRAINED && slabs != null)
+            slabs.release(array);
         array = null;
 
         /* The memory is no longer in use, so account for it as if it
          * had been delivered. */
         memoryUsage.addAndGet(readPos - writePos);
         readPos = writePos;
+        lent = 0;
+    }
+
+    /**
+     * Release the bytes presented as a buffer view, so that they count
+     * as read. The caller must hold this object's monitor.
+     */
+    private void settle() {
+        if (lent == 0) return;
+        readPos += lent;
+        memoryUsage.addAndGet(-lent);
+        lent = 0;
+        recycleIfDrained();
+    }
+
+    /**
+     * Release the last buffer view.
+     */
+    synchronized void release() {
+        settle();
+    }
+
+    /**
+     * Present all available bytes as a read-only view of the array.
+     * The previous view is released first. The thread's monitor is
+     * claimed until the input stream has been closed, or the content
+     * has been marked as complete, or a reason for abortion has been
+     * specified, or some bytes are available. Until the view is
+     * released, the array contents are not shifted, so the writer may
+     * have to start a new chunk sooner.
+     * 
+     * @return the view; or {@code null} on end-of-file
+     * 
+     * @throws StreamAbortedException if the stream has been aborted
+     * with {@link #abort(Throwable)}
+     * 
+     * @throws IOException if the input stream has been closed
+     */
+    synchronized ByteBuffer nextBuffer() throws IOException {
+        settle();
+        check();
+
+        /* Wait until there's no reason to block. */
+        boolean interrupted = false;
+        while (array != null && !complete && reason == null &&
+            readPos == writePos) {
+            try {
+                wait();
+            } catch (InterruptedException ex) {
+                interrupted = true;
+            }
+        }
+
+        /* Re-transmit the interruption. */
+        if (interrupted) Thread.currentThread().interrupt();
+
+        /* Detect errors and end-of-file. */
+        if (array == null) throw new IOException("closed");
+        if (reason != null) throw new StreamAbortedException(reason);
+        if (readPos == writePos) return null;
+
+        /* Lend out everything available. */
+        lent = writePos - readPos;
+        return ByteBuffer.wrap(array, readPos, lent).slice()
+            .asReadOnlyBuffer();
     }
 
     /**
@@ -164,7 +281,7 @@ final class MemoryChunk implements Chunk {
      * between the read and write positions
      */
     synchronized int available() {
-        return writePos - readPos;
+        return writePos - readPos - lent;
     }
 
     /**
@@ -184,6 +301,7 @@ final class MemoryChunk implements Chunk {
      * @throws IOException if the input stream has been closed
      */
     synchronized int read() throws IOException {
+        settle();
         check();
         try {
             /* Wait until there's no reason to block. */
@@ -207,7 +325,9 @@ final class MemoryChunk implements Chunk {
 
             /* At least one byte is available, so provide it. */
             memoryUsage.addAndGet(-1);
-            return array[readPos++] & 0xff;
+            final int b = array[readPos++] & 0xff;
+            recycleIfDrained();
+            return b;
         } finally {
             check();
         }
@@ -239,6 +359,7 @@ final class MemoryChunk implements Chunk {
         /* Short-circuit the no-op. */
         if (len == 0) return 0;
 
+        settle();
         check();
         try {
             /* Wait until there's no reason to block. */
@@ -268,6 +389,7 @@ final class MemoryChunk implements Chunk {
             System.arraycopy(array, readPos, b, off, amount);
             readPos += amount;
             memoryUsage.addAndGet(-amount);
+            recycleIfDrained();
             return amount;
         } finally {
             check();
@@ -279,12 +401,24 @@ final class MemoryChunk implements Chunk {
         return stream;
     }
 
-    private final InputStream stream = new InputStream() {
+    private final InputStream stream = new Stream();
+
+    private class Stream extends InputStream implements BufferReader {
         @Override
         public int read() throws IOException {
             return MemoryChunk.this.read();
         }
 
+        @Override
+        public ByteBuffer nextBuffer() throws IOException {
+            return MemoryChunk.this.nextBuffer();
+        }
+
+        @Override
+        public void release() {
+            MemoryChunk.this.release();
+        }
+
         @Override
         public void close() throws IOException {
             MemoryChunk.this.close();
@@ -299,7 +433,7 @@ final class MemoryChunk implements Chunk {
         public int read(byte[] b, int off, int len) throws IOException {
             return MemoryChunk.this.read(b, off, len);
         }
-    };
+    }
 
     @Override
     public synchronized void abort(Throwable reason) {
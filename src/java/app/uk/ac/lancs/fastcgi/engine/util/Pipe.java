@@ -63,7 +63,9 @@ public interface Pipe {
     void abort(Throwable reason);
 
     /**
-     * Get the input stream.
+     * Get the input stream. Closing it before end-of-file discards the
+     * remaining content, and further content written to the pipe is
+     * not stored. Closing does not wait for the writer.
      * 
      * @return the input stream
      */
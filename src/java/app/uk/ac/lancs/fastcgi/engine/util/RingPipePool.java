@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.Objects;
+import java.util.concurrent.locks.LockSupport;
+import uk.ac.lancs.fastcgi.context.StreamAbortedException;
+
+/**
+ * Generates pipes that pass content through a fixed-size ring buffer
+ * without locking. Each pipe must have one writing thread and one
+ * reading thread. The reader parks only while the ring is empty. The
+ * writer never waits; if the ring is full, it moves the rest of the
+ * content to a pipe from an overflow pool, which the reader turns to
+ * once the ring is drained.
+ *
+ * @author simpsons
+ */
+public final class RingPipePool implements PipePool {
+    private final int ringSize;
+
+    private final PipePool overflow;
+
+    /**
+     * The default ring size in bytes, namely {@value}, overridden by
+     * {@link Builder#ringSize(int)}
+     */
+    public static final int RING_SIZE = 16 * 1024;
+
+    /**
+     * Start building a pool.
+     * 
+     * @return the new builder
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    /**
+     * Collects the parameters for building a ring pipe pool.
+     */
+    public static class Builder {
+        private int ringSize = RING_SIZE;
+
+        private PipePool overflow;
+
+        Builder() {}
+
+        /**
+         * Set the ring size. It is rounded up to a power of two. The
+         * default is given by {@link #RING_SIZE}.
+         * 
+         * @param ringSize the ring size in bytes
+         * 
+         * @return this builder
+         * 
+         * @throws IllegalArgumentException if the argument is not
+         * positive, or too large to be rounded up
+         */
+        public Builder ringSize(int ringSize) {
+            if (ringSize <= 0 || ringSize > 1 << 30)
+                throw new IllegalArgumentException("bad ring size "
+                    + ringSize);
+            this.ringSize = ringSize;
+            return this;
+        }
+
+        /**
+         * Set the pool providing pipes for content that does not fit
+         * in the ring. The default is a {@link CachePipePool} with its
+         * default configuration.
+         * 
+         * @param overflow the overflow pool
+         * 
+         * @return this builder
+         * 
+         * @throws NullPointerException if the argument is {@code null}
+         */
+        public Builder overflow(PipePool overflow) {
+            Objects.requireNonNull(overflow, "overflow");
+            this.overflow = overflow;
+            return this;
+        }
+
+        /**
+         * Create a pool with the current configuration.
+         * 
+         * @return a pool with the required configuration
+         */
+        public RingPipePool create() {
+            PipePool of =
+                overflow != null ? overflow : CachePipePool.start().create();
+            int size = Integer.highestOneBit(ringSize);
+            if (size < ringSize) size <<= 1;
+            return new RingPipePool(size, of);
+        }
+    }
+
+    RingPipePool(int ringSize, PipePool overflow) {
+        assert Integer.bitCount(ringSize) == 1;
+        this.ringSize = ringSize;
+        this.overflow = overflow;
+    }
+
+    @Override
+    public Pipe newPipe() {
+        return new RingPipe();
+    }
+
+    private final class RingPipe implements Pipe {
+        /**
+         * Holds the ring, allocated by the writer on first use. The
+         * reader only accesses it after seeing {@link #tail} advance.
+         */
+        private byte[] ring;
+
+        private final int mask = ringSize - 1;
+
+        /**
+         * Counts bytes consumed. Only the reader writes this.
+         */
+        private volatile long head = 0;
+
+        /**
+         * Counts bytes produced into the ring. Only the writer writes
+         * this.
+         */
+        private volatile long tail = 0;
+
+        /**
+         * Holds the pipe taking content that did not fit in the ring.
+         * It is set only after the last write to {@link #tail}.
+         */
+        private volatile Pipe spill;
+
+        private volatile boolean closed;
+
+        private volatile Throwable abortedReason;
+
+        /**
+         * Indicates that the reader has closed its stream, so further
+         * content can be discarded.
+         */
+        private volatile boolean released;
+
+        /**
+         * Identifies the reading thread while it is parked.
+         */
+        private volatile Thread waiter;
+
+        private void wake() {
+            Thread w = waiter;
+            if (w != null) LockSupport.unpark(w);
+        }
+
+        private void checkWritable() throws IOException {
+            if (abortedReason != null)
+                throw new IOException("stream aborted", abortedReason);
+            if (closed) throw new IOException("closed");
+        }
+
+        private void produce(byte[] b, int off, int len) throws IOException {
+            checkWritable();
+            if (len == 0 || released) return;
+
+            Pipe sp = spill;
+            if (sp != null) {
+                sp.getOutputStream().write(b, off, len);
+                return;
+            }
+
+            /* Copy as much as fits, in up to two pieces, and then
+             * publish it. */
+            if (ring == null) ring = new byte[ringSize];
+            final long t = tail;
+            final int amount = (int) Long.min(len, ringSize - (t - head));
+            final int start = (int) t & mask;
+            final int first = Integer.min(amount, ringSize - start);
+            System.arraycopy(b, off, ring, start, first);
+            System.arraycopy(b, off + first, ring, 0, amount - first);
+            tail = t + amount;
+            wake();
+            if (amount == len) return;
+
+            /* The ring is full, so divert this and all further content
+             * to a pipe that can grow. */
+            sp = overflow.newPipe();
+            spill = sp;
+            wake();
+            sp.getOutputStream().write(b, off + amount, len - amount);
+        }
+
+        private final OutputStream outputStream = new OutputStream() {
+            private final byte[] buf = new byte[1];
+
+            @Override
+            public void write(int b) throws IOException {
+                buf[0] = (byte) b;
+                produce(buf, 0, 1);
+            }
+
+            @Override
+            public void write(byte[] b, int off, int len) throws IOException {
+                Objects.checkFromIndexSize(off, len, b.length);
+                produce(b, off, len);
+            }
+
+            @Override
+            public void flush() throws IOException {
+                checkWritable();
+            }
+
+            @Override
+            public void close() throws IOException {
+                if (abortedReason != null) return;
+                if (closed) return;
+                Pipe sp = spill;
+                if (sp != null) sp.getOutputStream().close();
+                closed = true;
+                wake();
+            }
+        };
+
+        @Override
+        public OutputStream getOutputStream() {
+            return outputStream;
+        }
+
+        @Override
+        public void abort(Throwable reason) {
+            if (closed) return;
+            if (abortedReason != null) return;
+            abortedReason = reason;
+            Pipe sp = spill;
+            if (sp != null) sp.abort(reason);
+            wake();
+        }
+
+        /**
+         * Read bytes, parking while none are available. If interrupted
+         * while parked, this method continues waiting, but will
+         * re-interrupt the thread before returning.
+         * 
+         * @param b the array to store the bytes
+         * 
+         * @param off the index into the array of the first byte
+         * 
+         * @param len the maximum number of bytes to read
+         * 
+         * @return the number of bytes read; or {@code -1} on
+         * end-of-file
+         * 
+         * @throws StreamAbortedException if the pipe has been aborted
+         * 
+         * @throws IOException if the input stream has been closed
+         */
+        private int consume(byte[] b, int off, int len) throws IOException {
+            if (len == 0) return 0;
+            boolean interrupted = false;
+            try {
+                while (true) {
+                    Throwable reason = abortedReason;
+                    if (reason != null)
+                        throw new StreamAbortedException(reason);
+                    if (released) throw new IOException("closed");
+
+                    /* Deliver from the ring while it has content. */
+                    final long h = head;
+                    final long t = tail;
+                    if (h < t) {
+                        final int amount = (int) Long.min(len, t - h);
+                        final int start = (int) h & mask;
+                        final int first = Integer.min(amount, ringSize - start);
+                        System.arraycopy(ring, start, b, off, first);
+                        System.arraycopy(ring, 0, b, off + first,
+                                         amount - first);
+                        head = h + amount;
+                        return amount;
+                    }
+
+                    /* The overflow is set after the last ring update,
+                     * so if we see it, the ring really is empty. */
+                    Pipe sp = spill;
+                    if (sp != null) {
+                        if (tail != h) continue;
+                        return sp.getInputStream().read(b, off, len);
+                    }
+                    if (closed) {
+                        if (tail != h) continue;
+                        return -1;
+                    }
+
+                    /* Nothing is available, so wait to be woken. */
+                    waiter = Thread.currentThread();
+                    try {
+                        if (tail == h && spill == null && !closed &&
+                            abortedReason == null)
+                            LockSupport.park(this);
+                    } finally {
+                        waiter = null;
+                    }
+                    if (Thread.interrupted()) interrupted = true;
+                }
+            } finally {
+                if (interrupted) Thread.currentThread().interrupt();
+            }
+        }
+
+        private final InputStream inputStream = new InputStream() {
+            private final byte[] buf = new byte[1];
+
+            @Override
+            public int read() throws IOException {
+                int got = consume(buf, 0, 1);
+                if (got < 0) return -1;
+                return buf[0] & 0xff;
+            }
+
+            @Override
+            public int read(byte[] b, int off, int len) throws IOException {
+                Objects.checkFromIndexSize(off, len, b.length);
+                return consume(b, off, len);
+            }
+
+            @Override
+            public int available() throws IOException {
+                final int inRing = (int) (tail - head);
+                if (inRing > 0) return inRing;
+                Pipe sp = spill;
+                return sp == null ? 0 : sp.getInputStream().available();
+            }
+
+            @Override
+            public void close() throws IOException {
+                if (released) return;
+                released = true;
+                Pipe sp = spill;
+                if (sp != null) sp.getInputStream().close();
+            }
+        };
+
+        @Override
+        public InputStream getInputStream() {
+            return inputStream;
+        }
+    }
+}
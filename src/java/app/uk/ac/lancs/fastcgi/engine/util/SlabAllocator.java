@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
+
+/**
+ * Recycles byte arrays of a small number of fixed sizes. Sizes are the
+ * minimum size doubled zero or more times, up to a maximum. Unlike a
+ * plain {@link BufferPool}, which it uses to hold released arrays, a
+ * request larger than the maximum is met with an array of the maximum
+ * size.
+ * 
+ * @author simpsons
+ */
+final class SlabAllocator {
+    private final int minSize;
+
+    private final int classes;
+
+    private final BufferPool pool;
+
+    /**
+     * Create an allocator.
+     * 
+     * @param minSize the smallest array size, which must be positive
+     * 
+     * @param maxSize the largest array size, which is rounded down to
+     * the minimum doubled a whole number of times
+     * 
+     * @param depotLimit the maximum number of bytes in arrays held for
+     * re-use
+     * 
+     * @throws IllegalArgumentException if the minimum size is not
+     * positive
+     */
+    SlabAllocator(int minSize, int maxSize, long depotLimit) {
+        if (minSize <= 0)
+            throw new IllegalArgumentException("non-positive size "
+                + minSize);
+        this.minSize = minSize;
+        int n = 1;
+        while ((long) minSize << n <= maxSize)
+            n++;
+        this.classes = n;
+        int[] sizes = new int[n];
+        for (int i = 0; i < n; i++)
+            sizes[i] = minSize << i;
+        this.pool =
+            BufferPool.start().sizes(sizes).depotLimit(depotLimit).create();
+    }
+
+    /**
+     * Get the largest array size.
+     * 
+     * @return the largest size
+     */
+    int maxSize() {
+        return minSize << (classes - 1);
+    }
+
+    /**
+     * Get the array size to be used for a requested size.
+     * 
+     * @param size the requested size
+     * 
+     * @return the smallest available size no less than the requested
+     * size; or the largest size if none is big enough
+     */
+    int sizeFor(int size) {
+        int c = 0;
+        while (c < classes - 1 && minSize << c < size)
+            c++;
+        return minSize << c;
+    }
+
+    /**
+     * Obtain an array.
+     * 
+     * @param size the requested size
+     * 
+     * @return an array of length {@link #sizeFor(int)} applied to the
+     * requested size, possibly containing old data
+     */
+    byte[] allocate(int size) {
+        return pool.allocate(sizeFor(size));
+    }
+
+    /**
+     * Return an array for re-use. Arrays not of a recognized size are
+     * ignored.
+     * 
+     * @param array the array to be recycled
+     */
+    void release(byte[] array) {
+        pool.release(array);
+    }
+}
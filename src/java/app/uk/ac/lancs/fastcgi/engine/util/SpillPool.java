@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import java.io.IOException;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.StandardOpenOption;
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+
+/**
+ * Keeps spill files for re-use by file chunks. Each file is removed
+ * from the directory as soon as it is opened, where the platform
+ * permits, so it never needs to be deleted later, and vanishes if the
+ * process dies. Otherwise, it is deleted when closed. Released files
+ * are kept open for re-use, up to a limit.
+ * 
+ * @author simpsons
+ */
+final class SpillPool {
+    private final Path dir;
+
+    private final String prefix;
+
+    private final String suffix;
+
+    private final int capacity;
+
+    private final Queue<FileChannel> idle = new ConcurrentLinkedQueue<>();
+
+    private final AtomicInteger idleCount = new AtomicInteger(0);
+
+    /**
+     * Create a pool of spill files.
+     * 
+     * @param dir the directory in which to create files
+     * 
+     * @param prefix the prefix of filenames
+     * 
+     * @param suffix the suffix of filenames
+     * 
+     * @param capacity the maximum number of idle files to retain
+     */
+    SpillPool(Path dir, String prefix, String suffix, int capacity) {
+        this.dir = dir;
+        this.prefix = prefix;
+        this.suffix = suffix;
+        this.capacity = capacity;
+    }
+
+    /**
+     * Obtain a spill file, either an idle one or a new one. Its
+     * content is undefined.
+     * 
+     * @return a channel open for reading and writing
+     * 
+     * @throws IOException if a new file could not be created
+     */
+    FileChannel acquire() throws IOException {
+        FileChannel ch = idle.poll();
+        if (ch != null) {
+            idleCount.decrementAndGet();
+            return ch;
+        }
+
+        Path path = Files.createTempFile(dir, prefix, suffix);
+        ch = FileChannel.open(path, StandardOpenOption.READ,
+                              StandardOpenOption.WRITE,
+                              StandardOpenOption.DELETE_ON_CLOSE);
+        try {
+            /* On most platforms, the file can be unlinked while it is
+             * open. */
+            Files.deleteIfExists(path);
+        } catch (IOException ex) {
+            /* It will be deleted on close instead. */
+        }
+        return ch;
+    }
+
+    /**
+     * Return a spill file for re-use. If the pool is full, or the file
+     * is unusable, it is closed.
+     * 
+     * @param ch the channel of the spill file
+     */
+    void release(FileChannel ch) {
+        if (ch.isOpen()) {
+            if (idleCount.incrementAndGet() <= capacity) {
+                idle.add(ch);
+                return;
+            }
+            idleCount.decrementAndGet();
+        }
+        try {
+            ch.close();
+        } catch (IOException ex) {
+            logger.log(Level.WARNING, "closing spill file", ex);
+        }
+    }
+
+    private static final Logger logger =
+        Logger.getLogger(SpillPool.class.getName());
+}
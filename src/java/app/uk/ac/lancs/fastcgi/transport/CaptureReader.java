@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.BufferedInputStream;
+import java.io.DataInputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.io.InputStream;
+import java.util.Arrays;
+
+/**
+ * Reads events from a file written by {@link CaptureRecorder}. After
+ * {@link #next()} returns {@code true}, the accessors describe the
+ * event just read.
+ *
+ * @author simpsons
+ */
+public final class CaptureReader implements AutoCloseable {
+    private final DataInputStream in;
+
+    private final long startMillis;
+
+    private int kind;
+
+    private int connection;
+
+    private long micros;
+
+    private byte[] data;
+
+    /**
+     * Prepare to read events from a stream.
+     * 
+     * @param in the stream of the capture file
+     * 
+     * @throws IOException if the stream does not begin as a capture
+     * file, or an I/O error occurs
+     */
+    public CaptureReader(InputStream in) throws IOException {
+        this.in = new DataInputStream(new BufferedInputStream(in));
+        byte[] magic = new byte[CaptureRecorder.MAGIC.length];
+        this.in.readFully(magic);
+        if (!Arrays.equals(magic, CaptureRecorder.MAGIC))
+            throw new IOException("not a capture file");
+        this.startMillis = readVarLong();
+    }
+
+    /**
+     * Get the wall-clock time at which capturing started.
+     * 
+     * @return the start time in milliseconds since the epoch
+     */
+    public long startMillis() {
+        return startMillis;
+    }
+
+    /**
+     * Read the next event.
+     * 
+     * @return {@code true} if an event was read; {@code false} at the
+     * end of the capture
+     * 
+     * @throws IOException if an I/O error occurs, or the capture is
+     * malformed
+     */
+    public boolean next() throws IOException {
+        final int k = in.read();
+        if (k < 0) return false;
+        kind = k;
+        connection = (int) readVarLong();
+        micros = readVarLong();
+        switch (kind) {
+        case CaptureRecorder.INPUT:
+        case CaptureRecorder.OUTPUT:
+            final long len = readVarLong();
+            if (len > Integer.MAX_VALUE)
+                throw new IOException("bad event length " + len);
+            data = new byte[(int) len];
+            in.readFully(data);
+            break;
+
+        case CaptureRecorder.OPEN:
+        case CaptureRecorder.CLOSE:
+        case CaptureRecorder.TRUNCATED:
+            data = null;
+            break;
+
+        default:
+            throw new IOException("bad event kind " + kind);
+        }
+        return true;
+    }
+
+    /**
+     * Get the kind of the current event.
+     * 
+     * @return the event kind, such as {@link CaptureRecorder#INPUT}
+     */
+    public int kind() {
+        return kind;
+    }
+
+    /**
+     * Get the connection of the current event.
+     * 
+     * @return the connection number
+     */
+    public int connection() {
+        return connection;
+    }
+
+    /**
+     * Get the time of the current event.
+     * 
+     * @return the time in microseconds since capturing started
+     */
+    public long micros() {
+        return micros;
+    }
+
+    /**
+     * Get the data of the current event.
+     * 
+     * @return the bytes carried by the event; or {@code null} if it is
+     * not a data event
+     */
+    public byte[] data() {
+        return data;
+    }
+
+    private long readVarLong() throws IOException {
+        long value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            final int b = in.read();
+            if (b < 0) throw new EOFException("truncated integer");
+            value |= (long) (b & 0x7f) << shift;
+            if ((b & 0x80) == 0) return value;
+        }
+        throw new IOException("bad integer");
+    }
+
+    /**
+     * Close the underlying stream.
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    @Override
+    public void close() throws IOException {
+        in.close();
+    }
+}
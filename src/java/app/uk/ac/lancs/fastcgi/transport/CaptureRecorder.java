@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.BufferedOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.channels.Channels;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.OpenOption;
+import java.nio.file.Path;
+import java.nio.file.StandardOpenOption;
+import java.nio.file.attribute.FileAttribute;
+import java.nio.file.attribute.PosixFilePermissions;
+import java.util.EnumSet;
+import java.util.Set;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.ThreadLocalRandom;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.LongAdder;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+
+/**
+ * Writes timestamped connection traffic to a file, for later replay.
+ * Events are queued by the connection threads and written by a single
+ * daemon thread through a buffer, which is flushed whenever the queue
+ * empties. If the queue is full, the event is dropped rather than
+ * delaying the connection, and the connection's capture ends with a
+ * {@link #TRUNCATED} event. That final event is itself dropped if the
+ * queue is still full, so a capture may simply stop.
+ * 
+ * <p>
+ * The file begins with the eight bytes {@link #MAGIC}, followed by the
+ * wall-clock time of creation in milliseconds since the epoch as an
+ * unsigned variable-length integer. Each event then consists of a kind
+ * byte, the connection number and the time in microseconds since
+ * creation, both as unsigned variable-length integers. Data events
+ * then have the length of the data in the same form, followed by the
+ * data. A variable-length integer is written seven bits at a time,
+ * least significant first, with the top bit set on all but the last
+ * byte.
+ * 
+ * <p>
+ * A capture holds the complete traffic of each captured connection,
+ * including request parameters, cookies, authorization headers and
+ * request bodies, so it must be protected as the credentials it
+ * contains would be. The file must not already exist, and is created
+ * readable and writable only by its owner where the file system
+ * supports POSIX permissions.
+ *
+ * @see CapturingTransport
+ * 
+ * @see CaptureReader
+ * 
+ * @author simpsons
+ */
+public final class CaptureRecorder implements AutoCloseable {
+    /**
+     * The bytes that begin every capture file
+     */
+    static final byte[] MAGIC = "FCGICAP1".getBytes(StandardCharsets.US_ASCII);
+
+    /**
+     * Identifies an event marking the acceptance of a connection.
+     */
+    public static final int OPEN = 1;
+
+    /**
+     * Identifies an event carrying bytes received from the server.
+     */
+    public static final int INPUT = 2;
+
+    /**
+     * Identifies an event carrying bytes sent to the server.
+     */
+    public static final int OUTPUT = 3;
+
+    /**
+     * Identifies an event marking the closure of a connection.
+     */
+    public static final int CLOSE = 4;
+
+    /**
+     * Identifies an event marking the end of a connection's capture
+     * because events had to be dropped.
+     */
+    public static final int TRUNCATED = 5;
+
+    /**
+     * The default proportion of connections captured, namely
+     * {@value}, overridden by {@link Builder#ratio(double)}
+     */
+    public static final double RATIO = 1.0;
+
+    /**
+     * The default number of events that may be queued for writing,
+     * namely {@value}, overridden by {@link Builder#queueCapacity(int)}
+     */
+    public static final int QUEUE_CAPACITY = 4096;
+
+    /**
+     * The size of the file buffer, namely {@value}
+     */
+    private static final int BUFFER_SIZE = 64 * 1024;
+
+    private final double ratio;
+
+    private final OutputStream out;
+
+    private final BlockingQueue<Event> queue;
+
+    private final long startNanos = System.nanoTime();
+
+    private final AtomicInteger connIds = new AtomicInteger(0);
+
+    private final LongAdder dropped = new LongAdder();
+
+    private final Thread writer;
+
+    private volatile boolean closed = false;
+
+    private IOException failure;
+
+    private static final class Event {
+        final int kind;
+
+        final int conn;
+
+        final long micros;
+
+        final byte[] data;
+
+        Event(int kind, int conn, long micros, byte[] data) {
+            this.kind = kind;
+            this.conn = conn;
+            this.micros = micros;
+            this.data = data;
+        }
+    }
+
+    /**
+     * Marks the end of the queue.
+     */
+    private static final Event END = new Event(0, 0, 0, null);
+
+    private CaptureRecorder(Path file, double ratio, int queueCapacity)
+        throws IOException {
+        this.ratio = ratio;
+        this.queue = new ArrayBlockingQueue<>(queueCapacity);
+        this.out =
+            new BufferedOutputStream(createPrivate(file), BUFFER_SIZE);
+        out.write(MAGIC);
+        writeVarLong(out, System.currentTimeMillis());
+        this.writer = new Thread(this::drain, "capture-" + file);
+        this.writer.setDaemon(true);
+        this.writer.start();
+    }
+
+    /**
+     * Create a new file accessible only to its owner, if the file
+     * system supports that.
+     * 
+     * @param file the file to create
+     * 
+     * @return a stream writing to the file
+     * 
+     * @throws java.nio.file.FileAlreadyExistsException if the file
+     * already exists
+     * 
+     * @throws IOException if the file could not be created
+     */
+    private static OutputStream createPrivate(Path file) throws IOException {
+        if (!file.getFileSystem().supportedFileAttributeViews()
+            .contains("posix"))
+            return Files.newOutputStream(file, StandardOpenOption.CREATE_NEW,
+                                         StandardOpenOption.WRITE);
+        Set<OpenOption> opts = EnumSet.of(StandardOpenOption.CREATE_NEW,
+                                          StandardOpenOption.WRITE);
+        FileAttribute<?> perms = PosixFilePermissions
+            .asFileAttribute(PosixFilePermissions.fromString("rw-------"));
+        return Channels.newOutputStream(Files.newByteChannel(file, opts,
+                                                             perms));
+    }
+
+    /**
+     * Start building a recorder.
+     * 
+     * @return the new builder
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    /**
+     * Collects the parameters for building a recorder.
+     */
+    public static final class Builder {
+        private Path file;
+
+        private double ratio = RATIO;
+
+        private int queueCapacity = QUEUE_CAPACITY;
+
+        private Builder() {}
+
+        /**
+         * Set the file to write to. This must be set.
+         * 
+         * @param file the capture file, which must not already exist
+         * 
+         * @return this builder
+         */
+        public Builder file(Path file) {
+            this.file = file;
+            return this;
+        }
+
+        /**
+         * Set the proportion of connections to capture. Each connection
+         * is chosen or not as it is accepted, so its traffic is either
+         * captured completely or not at all.
+         * 
+         * @param ratio the probability of capturing a connection,
+         * between 0 and 1
+         * 
+         * @return this builder
+         */
+        public Builder ratio(double ratio) {
+            if (ratio < 0.0 || ratio > 1.0)
+                throw new IllegalArgumentException("bad ratio " + ratio);
+            this.ratio = ratio;
+            return this;
+        }
+
+        /**
+         * Set the number of events that may wait to be written.
+         * 
+         * @param queueCapacity the event capacity
+         * 
+         * @return this builder
+         */
+        public Builder queueCapacity(int queueCapacity) {
+            if (queueCapacity < 1)
+                throw new IllegalArgumentException("bad capacity "
+                    + queueCapacity);
+            this.queueCapacity = queueCapacity;
+            return this;
+        }
+
+        /**
+         * Create the recorder, and start its writing thread.
+         * 
+         * @return the new recorder
+         * 
+         * @throws IOException if the file already exists, or could not
+         * be created
+         * 
+         * @throws IllegalStateException if no file has been set
+         */
+        public CaptureRecorder create() throws IOException {
+            if (file == null) throw new IllegalStateException("no file");
+            return new CaptureRecorder(file, ratio, queueCapacity);
+        }
+    }
+
+    /**
+     * Decide whether to capture a new connection, and if so, record
+     * that it has opened.
+     * 
+     * @return the connection number to pass to other methods; or -1 if
+     * the connection is not to be captured
+     */
+    int open() {
+        if (closed) return -1;
+        if (ratio < 1.0 && ThreadLocalRandom.current().nextDouble() >= ratio)
+            return -1;
+        final int conn = connIds.getAndIncrement();
+        return submit(OPEN, conn, null) ? conn : -1;
+    }
+
+    /**
+     * Queue some of a captured connection's traffic.
+     * 
+     * @param kind {@link #INPUT} or {@link #OUTPUT}
+     * 
+     * @param conn the connection number
+     * 
+     * @param buf an array containing the bytes
+     * 
+     * @param off the offset of the first byte
+     * 
+     * @param len the number of bytes
+     * 
+     * @return {@code true} if the event was queued; {@code false} if it
+     * was dropped, and no further events should be submitted for the
+     * connection except {@link #end(int, boolean)}
+     */
+    boolean data(int kind, int conn, byte[] buf, int off, int len) {
+        byte[] copy = new byte[len];
+        System.arraycopy(buf, off, copy, 0, len);
+        return submit(kind, conn, copy);
+    }
+
+    /**
+     * Record the end of a captured connection. Like other events, this
+     * is dropped if the queue is full, so that closing a connection is
+     * never delayed by the file. A capture without an end is treated as
+     * truncated.
+     * 
+     * @param conn the connection number
+     * 
+     * @param truncated {@code true} if events of the connection have
+     * been dropped
+     * 
+     * @return {@code true} if the event was queued; {@code false} if it
+     * was dropped
+     */
+    boolean end(int conn, boolean truncated) {
+        return submit(truncated ? TRUNCATED : CLOSE, conn, null);
+    }
+
+    private long now() {
+        return (System.nanoTime() - startNanos) / 1000;
+    }
+
+    private boolean submit(int kind, int conn, byte[] data) {
+        if (closed) return false;
+        if (queue.offer(new Event(kind, conn, now(), data))) return true;
+        dropped.increment();
+        return false;
+    }
+
+    /**
+     * Get the number of events dropped because the queue was full.
+     * 
+     * @return the number of dropped events
+     */
+    public long dropped() {
+        return dropped.sum();
+    }
+
+    private void drain() {
+        try {
+            while (true) {
+                Event ev = queue.poll();
+                if (ev == null) {
+                    out.flush();
+                    ev = queue.take();
+                }
+                if (ev == END) break;
+                out.write(ev.kind);
+                writeVarLong(out, ev.conn);
+                writeVarLong(out, ev.micros);
+                if (ev.data != null) {
+                    writeVarLong(out, ev.data.length);
+                    out.write(ev.data);
+                }
+            }
+            out.close();
+        } catch (IOException ex) {
+            logger.log(Level.WARNING, "capture failed", ex);
+            closed = true;
+            synchronized (this) {
+                failure = ex;
+            }
+            queue.clear();
+        } catch (InterruptedException ex) {
+            /* Just stop. */
+        }
+    }
+
+    /**
+     * Stop capturing, write all queued events, and close the file.
+     * 
+     * @throws IOException if an I/O error occurred in writing the file
+     */
+    @Override
+    public void close() throws IOException {
+        if (closed) return;
+        closed = true;
+        try {
+            queue.put(END);
+            writer.join();
+        } catch (InterruptedException ex) {
+            Thread.currentThread().interrupt();
+            throw new IOException("interrupted", ex);
+        }
+        synchronized (this) {
+            if (failure != null) throw new IOException("capture", failure);
+        }
+    }
+
+    static void writeVarLong(OutputStream out, long value)
+        throws IOException {
+        while ((value & ~0x7fL) != 0) {
+            out.write((int) (value & 0x7f) | 0x80);
+            value >>>= 7;
+        }
+        out.write((int) value);
+    }
+
+    private static final Logger logger =
+        Logger.getLogger(CaptureRecorder.class.getPackageName());
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.FilterInputStream;
+import java.io.FilterOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.List;
+
+/**
+ * Records the traffic of a sample of another transport's connections.
+ * A captured connection offers only its streams, so the engine reads
+ * and writes it without channels; other connections are passed through
+ * unchanged.
+ * 
+ * @author simpsons
+ */
+public final class CapturingTransport implements Transport {
+    private final Transport base;
+
+    private final CaptureRecorder recorder;
+
+    private final List<? extends Transport> listeners;
+
+    /**
+     * Capture connections from another transport.
+     * 
+     * @param base the transport whose connections are to be captured
+     * 
+     * @param recorder the destination for captured traffic
+     */
+    public CapturingTransport(Transport base, CaptureRecorder recorder) {
+        this.base = base;
+        this.recorder = recorder;
+        List<? extends Transport> baseListeners = base.listeners();
+        this.listeners = baseListeners.size() == 1 &&
+            baseListeners.get(0) == base ? List.of(this) :
+                baseListeners.stream()
+                    .map(t -> new CapturingTransport(t, recorder)).toList();
+    }
+
+    @Override
+    public List<? extends Transport> listeners() {
+        return listeners;
+    }
+
+    @Override
+    public Connection nextConnection() throws IOException {
+        Connection conn = base.nextConnection();
+        if (conn == null) return null;
+        final int id = recorder.open();
+        if (id < 0) return conn;
+        return new CapturedConnection(conn, id);
+    }
+
+    /**
+     * The largest number of bytes read at once to implement a skip
+     */
+    private static final int SKIP_SIZE = 8192;
+
+    private final class CapturedConnection implements Connection {
+        private final Connection base;
+
+        private final int id;
+
+        private final InputStream in;
+
+        private final OutputStream out;
+
+        /**
+         * Records whether events have been dropped.
+         */
+        private volatile boolean truncated = false;
+
+        /**
+         * Records whether the connection has been closed. Changes are
+         * guarded by {@code this}.
+         */
+        private volatile boolean closed = false;
+
+        CapturedConnection(Connection base, int id) throws IOException {
+            this.base = base;
+            this.id = id;
+            this.in = new FilterInputStream(base.input()) {
+                private final byte[] one = new byte[1];
+
+                @Override
+                public synchronized int read() throws IOException {
+                    final int got = read(one, 0, 1);
+                    return got < 0 ? -1 : one[0] & 0xff;
+                }
+
+                @Override
+                public int read(byte[] b, int off, int len)
+                    throws IOException {
+                    final int got = super.in.read(b, off, len);
+                    if (got > 0) record(CaptureRecorder.INPUT, b, off, got);
+                    return got;
+                }
+
+                @Override
+                public long skip(long n) throws IOException {
+                    /* Read the bytes rather than skip them in the base
+                     * stream, so that they are recorded. */
+                    if (n <= 0) return 0;
+                    byte[] buf = new byte[(int) Long.min(n, SKIP_SIZE)];
+                    final int got = read(buf, 0, buf.length);
+                    return got < 0 ? 0 : got;
+                }
+            };
+            this.out = new FilterOutputStream(base.output()) {
+                private final byte[] one = new byte[1];
+
+                @Override
+                public synchronized void write(int b) throws IOException {
+                    one[0] = (byte) b;
+                    write(one, 0, 1);
+                }
+
+                @Override
+                public void write(byte[] b, int off, int len)
+                    throws IOException {
+                    super.out.write(b, off, len);
+                    record(CaptureRecorder.OUTPUT, b, off, len);
+                }
+            };
+        }
+
+        private void record(int kind, byte[] buf, int off, int len) {
+            if (truncated || closed) return;
+            if (!recorder.data(kind, id, buf, off, len)) truncated = true;
+        }
+
+        @Override
+        public InputStream input() {
+            return in;
+        }
+
+        @Override
+        public OutputStream output() {
+            return out;
+        }
+
+        @Override
+        public void close() throws IOException {
+            synchronized (this) {
+                if (!closed && !recorder.end(id, truncated)) truncated = true;
+                closed = true;
+            }
+            base.close();
+        }
+
+        @Override
+        public void shutdownInput() throws IOException {
+            base.shutdownInput();
+        }
+
+        @Override
+        public String description() {
+            return base.description();
+        }
+
+        @Override
+        public String internalDescription() {
+            return base.internalDescription();
+        }
+
+        @Override
+        public Package implementation() {
+            return base.implementation();
+        }
+    }
+}
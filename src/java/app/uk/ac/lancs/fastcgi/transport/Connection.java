@@ -39,6 +39,7 @@ package uk.ac.lancs.fastcgi.transport;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
+import java.nio.channels.GatheringByteChannel;
 
 /**
  * Provides bidirectional byte-stream communication with the server.
@@ -64,6 +65,24 @@ public interface Connection {
      */
     OutputStream output() throws IOException;
 
+    /**
+     * Get a channel for gathering writes to the server, if the
+     * implementation can pass several buffers to the underlying
+     * transport in a single operation. Bytes written to the channel
+     * are interleaved with those written to {@link #output()} only at
+     * call boundaries.
+     * 
+     * @return the channel of bytes to the server; or {@code null} if
+     * not supported
+     * 
+     * @throws IOException if an I/O error occurs
+     * 
+     * @default By default, {@code null} is returned.
+     */
+    default GatheringByteChannel outputChannel() throws IOException {
+        return null;
+    }
+
     /**
      * Close the connection.
      * 
@@ -71,6 +90,19 @@ public interface Connection {
      */
     void close() throws IOException;
 
+    /**
+     * Stop receiving from the server, so that a thread blocked reading
+     * {@link #input()} sees end-of-file. Bytes may still be sent to the
+     * server until the connection is closed. An engine uses this to
+     * close an idle connection while it drains.
+     * 
+     * @throws IOException if an I/O error occurs
+     * 
+     * @default Nothing happens by default, so a blocked reader is only
+     * released when the server sends more or closes its end.
+     */
+    default void shutdownInput() throws IOException {}
+
     /**
      * Get a diagnostic description of this connection.
      * 
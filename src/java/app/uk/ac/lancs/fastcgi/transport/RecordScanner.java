@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.util.Arrays;
+
+/**
+ * Splits a byte stream into FastCGI records as it arrives in arbitrary
+ * pieces, in either direction. Replay of captured traffic uses this to
+ * track which requests are still outstanding.
+ *
+ * @author simpsons
+ */
+public final class RecordScanner {
+    /**
+     * Receives each complete record.
+     */
+    public interface Listener {
+        /**
+         * Receive a record.
+         * 
+         * @param type the record type
+         * 
+         * @param id the request id
+         * 
+         * @param buf an array holding the content, valid only during
+         * the call
+         * 
+         * @param off the offset of the content
+         * 
+         * @param len the content length
+         */
+        void record(int type, int id, byte[] buf, int off, int len);
+    }
+
+    private final Listener listener;
+
+    private byte[] buf = new byte[8 + 0xffff + 0xff];
+
+    private int end = 0;
+
+    /**
+     * Prepare to scan a stream.
+     * 
+     * @param listener the recipient of complete records
+     */
+    public RecordScanner(Listener listener) {
+        this.listener = listener;
+    }
+
+    /**
+     * Scan more of the stream, reporting every record that it
+     * completes.
+     * 
+     * @param b an array holding the bytes
+     * 
+     * @param off the offset of the first byte
+     * 
+     * @param len the number of bytes
+     */
+    public void feed(byte[] b, int off, int len) {
+        if (end + len > buf.length)
+            buf = Arrays.copyOf(buf, Integer.max(2 * buf.length, end + len));
+        System.arraycopy(b, off, buf, end, len);
+        end += len;
+
+        int pos = 0;
+        while (end - pos >= 8) {
+            final int type = buf[pos + 1] & 0xff;
+            final int id = (buf[pos + 2] & 0xff) << 8 | buf[pos + 3] & 0xff;
+            final int clen = (buf[pos + 4] & 0xff) << 8 | buf[pos + 5] & 0xff;
+            final int plen = buf[pos + 6] & 0xff;
+            if (end - pos < 8 + clen + plen) break;
+            listener.record(type, id, buf, pos + 8, clen);
+            pos += 8 + clen + plen;
+        }
+        System.arraycopy(buf, pos, buf, 0, end - pos);
+        end -= pos;
+    }
+}
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashSet;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Supplies connections whose input is replayed from a file written by
+ * {@link CaptureRecorder}, as fast as it is consumed. Output is
+ * discarded. Each connection reaches end-of-file only once every
+ * request begun on it has ended, or a timeout expires, so that its
+ * sessions are not cut short. This is suitable for warming up an
+ * application and its engine before it takes on real traffic.
+ * 
+ * @author simpsons
+ */
+public final class ReplayTransport implements Transport {
+    /**
+     * The longest time to wait for outstanding responses after a
+     * connection's captured input is exhausted, in milliseconds
+     */
+    private static final long DRAIN_TIMEOUT = 30_000;
+
+    /**
+     * The record type <code>FCGI_BEGIN_REQUEST</code>, repeated here
+     * as this package does not depend on the protocol definitions
+     */
+    private static final int BEGIN_REQUEST = 1;
+
+    /**
+     * The record type <code>FCGI_END_REQUEST</code>
+     */
+    private static final int END_REQUEST = 3;
+
+    private final Iterator<List<byte[]>> captures;
+
+    /**
+     * Load a capture file.
+     * 
+     * @param file the capture file
+     * 
+     * @throws IOException if an I/O error occurs in reading the file,
+     * or it is not a capture
+     */
+    public ReplayTransport(Path file) throws IOException {
+        Map<Integer, List<byte[]>> open = new LinkedHashMap<>();
+        Collection<List<byte[]>> loaded = new ArrayList<>();
+        try (CaptureReader reader =
+            new CaptureReader(Files.newInputStream(file))) {
+            while (reader.next()) {
+                switch (reader.kind()) {
+                case CaptureRecorder.OPEN: {
+                    List<byte[]> input = new ArrayList<>();
+                    open.put(reader.connection(), input);
+                    loaded.add(input);
+                    break;
+                }
+
+                case CaptureRecorder.INPUT: {
+                    List<byte[]> input = open.get(reader.connection());
+                    if (input != null) input.add(reader.data());
+                    break;
+                }
+
+                case CaptureRecorder.OUTPUT:
+                    break;
+
+                default:
+                    open.remove(reader.connection());
+                    break;
+                }
+            }
+        }
+        this.captures = loaded.iterator();
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * Connections are returned immediately in the order in which they
+     * were opened in the capture.
+     */
+    @Override
+    public synchronized Connection nextConnection() {
+        if (!captures.hasNext()) return null;
+        return new ReplayConnection(captures.next());
+    }
+
+    private static final class ReplayConnection implements Connection {
+        private final Iterator<byte[]> chunks;
+
+        /**
+         * Holds the ids of requests begun but not yet ended. Guarded by
+         * {@code this}.
+         */
+        private final Collection<Integer> outstanding = new HashSet<>();
+
+        private final RecordScanner inScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type == BEGIN_REQUEST) outstanding.add(id);
+            });
+
+        private final RecordScanner outScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type == END_REQUEST &&
+                    outstanding.remove(id)) notifyAll();
+            });
+
+        private boolean inputClosed = false;
+
+        ReplayConnection(List<byte[]> chunks) {
+            this.chunks = chunks.iterator();
+        }
+
+        private final InputStream in = new InputStream() {
+            private byte[] current;
+
+            private int pos;
+
+            @Override
+            public int read() throws IOException {
+                byte[] buf = new byte[1];
+                final int got = read(buf, 0, 1);
+                return got < 0 ? -1 : buf[0] & 0xff;
+            }
+
+            @Override
+            public int read(byte[] b, int off, int len) throws IOException {
+                if (len == 0) return 0;
+                if (current == null || pos == current.length) {
+                    if (!chunks.hasNext()) {
+                        awaitResponses();
+                        return -1;
+                    }
+                    current = chunks.next();
+                    pos = 0;
+                    synchronized (ReplayConnection.this) {
+                        inScan.feed(current, 0, current.length);
+                    }
+                }
+                final int amount = Integer.min(len, current.length - pos);
+                System.arraycopy(current, pos, b, off, amount);
+                pos += amount;
+                return amount;
+            }
+        };
+
+        private final OutputStream out = new OutputStream() {
+            @Override
+            public void write(int b) {
+                write(new byte[] { (byte) b }, 0, 1);
+            }
+
+            @Override
+            public void write(byte[] b, int off, int len) {
+                synchronized (ReplayConnection.this) {
+                    outScan.feed(b, off, len);
+                }
+            }
+        };
+
+        /**
+         * Wait until every request begun on this connection has ended,
+         * as a server would before closing it.
+         * 
+         * @throws InterruptedIOException if interrupted while waiting
+         */
+        private synchronized void awaitResponses()
+            throws InterruptedIOException {
+            final long deadline = System.currentTimeMillis() + DRAIN_TIMEOUT;
+            long rem;
+            while (!inputClosed && !outstanding.isEmpty() &&
+                (rem = deadline - System.currentTimeMillis()) > 0) {
+                try {
+                    wait(rem);
+                } catch (InterruptedException ex) {
+                    Thread.currentThread().interrupt();
+                    throw new InterruptedIOException("awaiting responses");
+                }
+            }
+        }
+
+        @Override
+        public InputStream input() {
+            return in;
+        }
+
+        @Override
+        public OutputStream output() {
+            return out;
+        }
+
+        @Override
+        public synchronized void close() {
+            inputClosed = true;
+            notifyAll();
+        }
+
+        @Override
+        public synchronized void shutdownInput() {
+            inputClosed = true;
+            notifyAll();
+        }
+
+        @Override
+        public String description() {
+            return "replay";
+        }
+
+        @Override
+        public String internalDescription() {
+            return "";
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.IOException;
+import java.nio.channels.ReadableByteChannel;
+
+/**
+ * Provides bidirectional communication with the server, with
+ * notification of when bytes can be read without blocking. An engine
+ * can use this to serve many connections from a few threads, rather
+ * than dedicating a thread to each connection.
+ * 
+ * @author simpsons
+ */
+public interface SelectableConnection extends Connection {
+    /**
+     * Get a channel of bytes from the server whose reads do not block.
+     * A read yields zero bytes if none are available yet, and
+     * {@code -1} on end-of-stream. Bytes already buffered for
+     * {@link #input()} are delivered first.
+     * 
+     * @return the channel of bytes from the server
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    ReadableByteChannel inputChannel() throws IOException;
+
+    /**
+     * Invoke an action once, when bytes next become available from
+     * {@link #inputChannel()}, or when end-of-stream or an error is
+     * detected. The action is invoked on a thread shared with other
+     * connections, so it should not block. To be informed again, the
+     * action must call this method again.
+     * 
+     * @param action the action to invoke
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    void whenReadable(Runnable action) throws IOException;
+}
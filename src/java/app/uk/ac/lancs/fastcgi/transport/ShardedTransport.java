@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.IOException;
+import java.util.Collection;
+import java.util.List;
+
+/**
+ * Combines several sources of connections into one transport. Callers
+ * aware of {@link #listeners()} can accept from each source on its own
+ * thread. Otherwise, {@link #nextConnection()} starts a thread per
+ * source, and delivers their connections in order of arrival.
+ * 
+ * @author simpsons
+ */
+public final class ShardedTransport implements Transport {
+    private final List<Transport> listeners;
+
+    /**
+     * Create a transport from several sources.
+     * 
+     * @param listeners the sources of connections
+     * 
+     * @throws IllegalArgumentException if no sources are provided
+     */
+    public ShardedTransport(Collection<? extends Transport> listeners) {
+        this.listeners = List.copyOf(listeners);
+        if (this.listeners.isEmpty())
+            throw new IllegalArgumentException("no listeners");
+    }
+
+    @Override
+    public List<? extends Transport> listeners() {
+        return listeners;
+    }
+
+    /**
+     * Holds each connection or exception handed over by an acceptor
+     * thread, until a caller of {@link #nextConnection()} takes it; or
+     * {@code null} if there is none. Guarded by itself.
+     */
+    private final Object[] handover = new Object[1];
+
+    /**
+     * Counts the sources whose acceptor threads are still running.
+     * Guarded by {@link #handover}.
+     */
+    private int running = -1;
+
+    private void accept(Transport source) {
+        try {
+            Object item;
+            do {
+                try {
+                    item = source.nextConnection();
+                } catch (IOException ex) {
+                    item = ex;
+                }
+                if (item == null) break;
+                synchronized (handover) {
+                    while (handover[0] != null)
+                        handover.wait();
+                    handover[0] = item;
+                    handover.notifyAll();
+                }
+            } while (item instanceof Connection);
+        } catch (InterruptedException ex) {
+            /* Just stop. */
+        } finally {
+            /* Waiters recheck the count under the same lock, so none
+             * can miss the exhaustion of the last source. */
+            synchronized (handover) {
+                running--;
+                handover.notifyAll();
+            }
+        }
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * <p>
+     * On first use, a daemon thread is started for each source to
+     * accept connections from it. An I/O error in one source stops
+     * that source's thread, and is reported by this call.
+     * 
+     * @return the next connection from any source; or {@code null} if
+     * all sources are exhausted
+     */
+    @Override
+    public Connection nextConnection() throws IOException {
+        synchronized (handover) {
+            if (running < 0) {
+                running = listeners.size();
+                int i = 0;
+                for (Transport source : listeners) {
+                    Thread t = new Thread(() -> accept(source),
+                                          "acceptor-" + i++);
+                    t.setDaemon(true);
+                    t.start();
+                }
+            }
+            while (handover[0] == null) {
+                if (running == 0) return null;
+                try {
+                    handover.wait();
+                } catch (InterruptedException ex) {
+                    Thread.currentThread().interrupt();
+                    throw new IOException("interrupted", ex);
+                }
+            }
+            final Object item = handover[0];
+            handover[0] = null;
+            handover.notifyAll();
+            if (item instanceof IOException ex) throw ex;
+            return (Connection) item;
+        }
+    }
+}
@@ -106,6 +106,17 @@ public class SocketConnection implements Connection {
         socket.close();
     }
 
+    /**
+     * {@inheritDoc}
+     * 
+     * @default {@link Socket#shutdownInput()} is invoked on the
+     * supplied socket.
+     */
+    @Override
+    public void shutdownInput() throws IOException {
+        socket.shutdownInput();
+    }
+
     /**
      * {@inheritDoc}
      * 
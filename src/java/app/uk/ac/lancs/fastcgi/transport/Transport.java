@@ -37,6 +37,7 @@
 package uk.ac.lancs.fastcgi.transport;
 
 import java.io.IOException;
+import java.util.List;
 import java.util.ServiceLoader;
 
 /**
@@ -56,6 +57,20 @@ public interface Transport {
      */
     Connection nextConnection() throws IOException;
 
+    /**
+     * Get the independent sources of connections that make up this
+     * transport. Each may be accepted from by its own thread, rather
+     * than funnelling all connections through
+     * {@link #nextConnection()}.
+     * 
+     * @default A list containing only this transport is returned.
+     * 
+     * @return an immutable list of the transport's sources
+     */
+    default List<? extends Transport> listeners() {
+        return List.of(this);
+    }
+
     /**
      * Get the connection supply using a given class loader. This method
      * will yield the same result for the same argument.
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.concurrent.TimeUnit;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.util.Pipe;
+
+/**
+ * Measures the time to pass content through a {@link CachePipePool}
+ * pipe, writing all of it before reading it back, as an engine does
+ * when a request body arrives faster than the application consumes it.
+ * Larger lengths exceed the RAM threshold, and so include spilling to
+ * files.
+ *
+ * @author simpsons
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+public class CachePipePoolBenchmark {
+    /**
+     * Specifies the amount of content passed through each pipe.
+     */
+    @Param({ "1024", "65536", "4194304" })
+    public int length;
+
+    private CachePipePool pool;
+
+    private final byte[] buf = new byte[8192];
+
+    /**
+     * Create the pool.
+     */
+    @Setup
+    public void setUp() {
+        pool = CachePipePool.start().create();
+    }
+
+    /**
+     * Write content into a new pipe, and read it back.
+     * 
+     * @return the number of bytes read
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    @Benchmark
+    public long passThrough() throws IOException {
+        Pipe pipe = pool.newPipe();
+        try (OutputStream out = pipe.getOutputStream()) {
+            for (int rem = length; rem > 0; rem -= buf.length)
+                out.write(buf, 0, Integer.min(rem, buf.length));
+        }
+        long total = 0;
+        try (InputStream in = pipe.getInputStream()) {
+            int got;
+            while ((got = in.read(buf)) >= 0)
+                total += got;
+        }
+        return total;
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.PrintStream;
+import java.util.Arrays;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * Collects request latencies from several threads, and reports their
+ * percentiles.
+ *
+ * @author simpsons
+ */
+final class Latencies {
+    private final long[] samples;
+
+    private final AtomicInteger count = new AtomicInteger(0);
+
+    /**
+     * Create an empty collection.
+     * 
+     * @param capacity the maximum number of latencies recorded
+     */
+    Latencies(int capacity) {
+        this.samples = new long[capacity];
+    }
+
+    /**
+     * Record a latency. Latencies beyond the capacity are ignored.
+     * 
+     * @param nanos the latency in nanoseconds
+     */
+    void record(long nanos) {
+        final int slot = count.getAndIncrement();
+        if (slot < samples.length) samples[slot] = nanos;
+    }
+
+    /**
+     * Get the number of latencies recorded.
+     * 
+     * @return the number of latencies kept
+     */
+    int count() {
+        return Integer.min(count.get(), samples.length);
+    }
+
+    /**
+     * Print the median, other percentiles and maximum.
+     * 
+     * @param out the destination
+     * 
+     * @param label a prefix for each line
+     */
+    void report(PrintStream out, String label) {
+        final int n = count();
+        if (n == 0) return;
+        long[] sorted = Arrays.copyOf(samples, n);
+        Arrays.sort(sorted);
+        final String[] names = { "p50", "p90", "p99", "p99.9" };
+        final double[] fractions = { 0.5, 0.9, 0.99, 0.999 };
+        for (int p = 0; p < names.length; p++) {
+            final int i =
+                Integer.max(0, (int) Math.ceil(fractions[p] * n) - 1);
+            out.printf("%s %s: %.3f ms%n", label, names[p], sorted[i] / 1e6);
+        }
+        out.printf("%s max: %.3f ms%n", label, sorted[n - 1] / 1e6);
+    }
+}
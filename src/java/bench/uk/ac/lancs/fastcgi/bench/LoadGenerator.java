@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.net.InetSocketAddress;
+import java.net.SocketAddress;
+import java.net.UnixDomainSocketAddress;
+import java.nio.ByteBuffer;
+import java.nio.channels.SocketChannel;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLongArray;
+import java.util.concurrent.atomic.LongAdder;
+import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
+import uk.ac.lancs.fastcgi.proto.RecordTypes;
+import uk.ac.lancs.fastcgi.proto.RequestFlags;
+import uk.ac.lancs.fastcgi.proto.RoleTypes;
+
+/**
+ * Drives a stand-alone FastCGI application with Responder requests
+ * over several connections, keeping several requests in progress on
+ * each, and reports throughput and latency percentiles. Latency is
+ * measured from sending a request to receiving its request-ending
+ * record.
+ * 
+ * <p>
+ * For example, start a demo with
+ * <samp>FASTCGI4J_INET_BIND=localhost:9000</samp> in its environment,
+ * and then run:
+ * 
+ * <pre>
+ * java uk.ac.lancs.fastcgi.bench.LoadGenerator -c 4 -m 16 -n 100000 \
+ *      -b 4096 localhost:9000
+ * </pre>
+ * 
+ * <p>
+ * The target is <samp><var>host</var>:<var>port</var></samp>, or the
+ * path of a Unix-domain socket if it contains a slash. The options
+ * are:
+ * 
+ * <dl>
+ * <dt><kbd>-c <var>num</var></kbd>
+ * <dd>Open <var>num</var> connections. The default is 4.
+ * 
+ * <dt><kbd>-m <var>num</var></kbd>
+ * <dd>Keep up to <var>num</var> requests in progress per connection.
+ * The default is 8. Use 1 against an application that does not
+ * multiplex.
+ * 
+ * <dt><kbd>-n <var>num</var></kbd>
+ * <dd>Send <var>num</var> requests in total. The default is 10000.
+ * 
+ * <dt><kbd>-b <var>num</var></kbd>
+ * <dd>Send <var>num</var> bytes of request body with each request. The
+ * default is 1024.
+ * 
+ * <dt><kbd>-u <var>path</var></kbd>
+ * <dd>Use <var>path</var> as the request URI. The default is
+ * <samp>/</samp>.
+ * </dl>
+ *
+ * @author simpsons
+ */
+public final class LoadGenerator {
+    private final SocketAddress target;
+
+    private final int depth;
+
+    private final int total;
+
+    private final byte[] params;
+
+    private final byte[] body;
+
+    private final AtomicInteger issued = new AtomicInteger(0);
+
+    private final Latencies latencies;
+
+    private final LongAdder failures = new LongAdder();
+
+    private final LongAdder responseBytes = new LongAdder();
+
+    private LoadGenerator(SocketAddress target, int depth, int total,
+                          int bodyLength, String uri) {
+        this.target = target;
+        this.depth = depth;
+        this.total = total;
+        this.latencies = new Latencies(total);
+        this.params = Records.encode(Records.typicalParams(uri, bodyLength),
+                                     StandardCharsets.UTF_8);
+        this.body = new byte[bodyLength];
+    }
+
+    /**
+     * Serialize a complete request.
+     * 
+     * @param id the request id
+     * 
+     * @return the request's records
+     */
+    private byte[] request(int id) {
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        Records.begin(out, id, RoleTypes.RESPONDER, RequestFlags.KEEP_CONN);
+        Records.stream(out, RecordTypes.PARAMS, id, params, 0,
+                       params.length);
+        Records.stream(out, RecordTypes.STDIN, id, body, 0, body.length);
+        return out.toByteArray();
+    }
+
+    /**
+     * Issues requests on one connection, and collects their responses
+     * on another thread.
+     */
+    private final class Client implements Runnable {
+        private final SocketChannel channel;
+
+        private final BlockingQueue<Integer> freeIds =
+            new ArrayBlockingQueue<>(depth);
+
+        private final AtomicLongArray starts = new AtomicLongArray(depth + 1);
+
+        private final byte[][] requests = new byte[depth + 1][];
+
+        private volatile IOException failure;
+
+        Client() throws IOException {
+            channel = SocketChannel.open(target);
+            for (int id = 1; id <= depth; id++) {
+                requests[id] = request(id);
+                freeIds.add(id);
+            }
+        }
+
+        @Override
+        public void run() {
+            Thread reader = new Thread(this::receive, "receiver");
+            reader.setDaemon(true);
+            reader.start();
+            try {
+                while (issued.getAndIncrement() < total) {
+                    final int id = freeIds.take();
+                    if (failure != null) throw failure;
+                    ByteBuffer buf = ByteBuffer.wrap(requests[id]);
+                    starts.set(id, System.nanoTime());
+                    while (buf.hasRemaining())
+                        channel.write(buf);
+                }
+
+                /* Wait for all outstanding responses. */
+                for (int i = 0; i < depth; i++) {
+                    freeIds.take();
+                    if (failure != null) throw failure;
+                }
+            } catch (IOException ex) {
+                System.err.printf("connection failed: %s%n", ex);
+            } catch (InterruptedException ex) {
+                Thread.currentThread().interrupt();
+            } finally {
+                try {
+                    channel.close();
+                } catch (IOException ex) {
+                    /* Ignore. */
+                }
+            }
+        }
+
+        private void receive() {
+            ByteBuffer buf = ByteBuffer.allocate(2 * (8 + 0xffff + 0xff));
+            try {
+                while (channel.read(buf) >= 0) {
+                    buf.flip();
+                    while (buf.remaining() >= 8) {
+                        final int p = buf.position();
+                        final int type = buf.get(p + 1) & 0xff;
+                        final int id = buf.getShort(p + 2) & 0xffff;
+                        final int clen = buf.getShort(p + 4) & 0xffff;
+                        final int plen = buf.get(p + 6) & 0xff;
+                        if (buf.remaining() < 8 + clen + plen) break;
+                        if (type == RecordTypes.STDOUT) {
+                            responseBytes.add(clen);
+                        } else if (type == RecordTypes.END_REQUEST) {
+                            final int appStatus = buf.getInt(p + 8);
+                            final int protoStatus = buf.get(p + 12);
+                            complete(id, appStatus, protoStatus);
+                        }
+                        buf.position(p + 8 + clen + plen);
+                    }
+                    buf.compact();
+                }
+            } catch (IOException ex) {
+                if (!channel.isOpen()) return;
+                failure = ex;
+            }
+            /* Release the issuing thread, whatever happened. */
+            if (failure == null) failure = new IOException("closed by peer");
+            for (int id = 1; id <= depth; id++)
+                freeIds.offer(id);
+        }
+
+        private void complete(int id, int appStatus, int protoStatus) {
+            final long latency = System.nanoTime() - starts.get(id);
+            if (protoStatus != ProtocolStatuses.REQUEST_COMPLETE ||
+                appStatus != 0) failures.increment();
+            latencies.record(latency);
+            freeIds.add(id);
+        }
+    }
+
+    private void run(int conns) throws IOException, InterruptedException {
+        List<Client> clients = new ArrayList<>();
+        for (int i = 0; i < conns; i++)
+            clients.add(new Client());
+        List<Thread> threads = new ArrayList<>();
+        final long start = System.nanoTime();
+        for (int i = 0; i < conns; i++) {
+            Thread t = new Thread(clients.get(i), "client-" + i);
+            threads.add(t);
+            t.start();
+        }
+        for (Thread t : threads)
+            t.join();
+        final long elapsed = System.nanoTime() - start;
+        report(elapsed);
+    }
+
+    private void report(long elapsed) {
+        final int n = latencies.count();
+        final double secs = elapsed / 1e9;
+        System.out.printf("requests: %d completed, %d failed, in %.3f s%n",
+                          n, failures.sum(), secs);
+        System.out.printf("throughput: %.1f req/s, %.2f MiB/s of stdout%n",
+                          n / secs, responseBytes.sum() / secs / 1048576.0);
+        latencies.report(System.out, "latency");
+    }
+
+    private static SocketAddress parseTarget(String text) {
+        if (text.indexOf('/') >= 0) return UnixDomainSocketAddress.of(text);
+        final int colon = text.lastIndexOf(':');
+        if (colon < 0)
+            throw new IllegalArgumentException("no port in " + text);
+        return new InetSocketAddress(text.substring(0, colon),
+                                     Integer.parseInt(text
+                                         .substring(colon + 1)));
+    }
+
+    /**
+     * Run the load generator.
+     * 
+     * @param args command-line arguments
+     * 
+     * @throws Exception if an error occurs
+     */
+    public static void main(String[] args) throws Exception {
+        int conns = 4;
+        int depth = 8;
+        int total = 10000;
+        int bodyLength = 1024;
+        String uri = "/";
+        String target = null;
+        for (int i = 0; i < args.length; i++) {
+            switch (args[i]) {
+            case "-c":
+                conns = Integer.parseInt(args[++i]);
+                break;
+
+            case "-m":
+                depth = Integer.parseInt(args[++i]);
+                break;
+
+            case "-n":
+                total = Integer.parseInt(args[++i]);
+                break;
+
+            case "-b":
+                bodyLength = Integer.parseInt(args[++i]);
+                break;
+
+            case "-u":
+                uri = args[++i];
+                break;
+
+            default:
+                target = args[i];
+                break;
+            }
+        }
+        if (target == null || conns < 1 || depth < 1 || depth > 0xffff ||
+            total < 0 || bodyLength < 0) {
+            System.err.printf("usage: %s [-c conns] [-m depth] [-n requests]"
+                + " [-b body-bytes] [-u uri] host:port|path%n",
+                              LoadGenerator.class.getName());
+            System.exit(1);
+        }
+        new LoadGenerator(parseTarget(target), depth, total, bodyLength, uri)
+            .run(conns);
+    }
+}
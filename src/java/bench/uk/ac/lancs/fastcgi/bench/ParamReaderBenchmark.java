@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.ByteArrayInputStream;
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.util.concurrent.TimeUnit;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.infra.Blackhole;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
+import uk.ac.lancs.fastcgi.proto.serial.ParamMap;
+import uk.ac.lancs.fastcgi.proto.serial.ParamReader;
+
+/**
+ * Measures decoding of a typical set of request parameters, delivered
+ * as one record's content and then as several small ones.
+ *
+ * @author simpsons
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+public class ParamReaderBenchmark {
+    private byte[] encoded;
+
+    private final BufferPool buffers = BufferPool.start().create();
+
+    private ParamMap result;
+
+    /**
+     * Encode the parameters.
+     */
+    @Setup
+    public void setUp() {
+        encoded = Records.encode(Records.typicalParams("/app/index", 0),
+                                 StandardCharsets.UTF_8);
+    }
+
+    /**
+     * Decode the parameters from a single record.
+     * 
+     * @param bh a sink for the result
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    @Benchmark
+    public void whole(Blackhole bh) throws IOException {
+        ParamReader reader =
+            new ParamReader(m -> result = m, StandardCharsets.UTF_8, buffers);
+        reader.consume(new ByteArrayInputStream(encoded));
+        reader.complete();
+        bh.consume(result.get("HTTP_COOKIE"));
+    }
+
+    /**
+     * Decode the parameters split across records of 64 bytes, so that
+     * names and values straddle record boundaries.
+     * 
+     * @param bh a sink for the result
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    @Benchmark
+    public void fragmented(Blackhole bh) throws IOException {
+        ParamReader reader =
+            new ParamReader(m -> result = m, StandardCharsets.UTF_8, buffers);
+        for (int off = 0; off < encoded.length; off += 64)
+            reader.consume(new ByteArrayInputStream(encoded, off, Integer
+                .min(64, encoded.length - off)));
+        reader.complete();
+        bh.consume(result.get("HTTP_COOKIE"));
+    }
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.charset.StandardCharsets;
+import java.util.Collection;
+import java.util.concurrent.TimeUnit;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OperationsPerInvocation;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.infra.Blackhole;
+import uk.ac.lancs.fastcgi.proto.RecordTypes;
+import uk.ac.lancs.fastcgi.proto.RequestFlags;
+import uk.ac.lancs.fastcgi.proto.RoleTypes;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
+import uk.ac.lancs.fastcgi.proto.serial.RecordHandler;
+import uk.ac.lancs.fastcgi.proto.serial.RecordReader;
+
+/**
+ * Measures deserialization and dispatch of a stream of requests by
+ * {@link RecordReader#processRecord()}. Each request is a
+ * request-beginning record, parameters and a body, and the score is
+ * per request.
+ *
+ * @author simpsons
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@OperationsPerInvocation(RecordReaderBenchmark.REQUESTS)
+public class RecordReaderBenchmark {
+    static final int REQUESTS = 100;
+
+    /**
+     * Specifies the request body length in bytes.
+     */
+    @Param({ "0", "1024", "65536" })
+    public int bodyLength;
+
+    private byte[] input;
+
+    private final BufferPool buffers = BufferPool.start().create();
+
+    /**
+     * Serialize the requests.
+     */
+    @Setup
+    public void setUp() {
+        byte[] params = Records.encode(Records
+            .typicalParams("/app/index", bodyLength), StandardCharsets.UTF_8);
+        byte[] body = new byte[bodyLength];
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        for (int i = 0; i < REQUESTS; i++) {
+            final int id = 1 + i % 8;
+            Records.begin(out, id, RoleTypes.RESPONDER,
+                          RequestFlags.KEEP_CONN);
+            Records.stream(out, RecordTypes.PARAMS, id, params, 0,
+                           params.length);
+            Records.stream(out, RecordTypes.STDIN, id, body, 0, body.length);
+        }
+        input = out.toByteArray();
+    }
+
+    /**
+     * Consumes every record, passing content to the black hole.
+     */
+    private static final class Sink implements RecordHandler {
+        final Blackhole bh;
+
+        final byte[] buf = new byte[8192];
+
+        Sink(Blackhole bh) {
+            this.bh = bh;
+        }
+
+        private void drain(InputStream in) throws IOException {
+            int got;
+            while ((got = in.read(buf)) > 0)
+                bh.consume(got);
+        }
+
+        @Override
+        public void getValues(Collection<? extends String> names) {
+            bh.consume(names);
+        }
+
+        @Override
+        public void beginRequest(int id, int role, int flags) {
+            bh.consume(id + role + flags);
+        }
+
+        @Override
+        public void abortRequest(int id) {
+            bh.consume(id);
+        }
+
+        @Override
+        public void params(int id, int len, InputStream in)
+            throws IOException {
+            drain(in);
+        }
+
+        @Override
+        public void paramsEnd(int id) {
+            bh.consume(id);
+        }
+
+        @Override
+        public void stdin(int id, int len, InputStream in)
+            throws IOException {
+            drain(in);
+        }
+
+        @Override
+        public void stdinEnd(int id) {
+            bh.consume(id);
+        }
+
+        @Override
+        public void data(int id, int len, InputStream in)
+            throws IOException {
+            drain(in);
+        }
+
+        @Override
+        public void dataEnd(int id) {
+            bh.consume(id);
+        }
+
+        @Override
+        public void bad(int reasons, int version, int type, int length,
+                        int id) {
+            throw new AssertionError("bad record " + reasons);
+        }
+    }
+
+    /**
+     * Read and dispatch all the requests.
+     * 
+     * @param bh a sink for record content
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    @Benchmark
+    public void processRecord(Blackhole bh) throws IOException {
+        RecordReader reader =
+            new RecordReader(new ByteArrayInputStream(input),
+                             StandardCharsets.UTF_8, new Sink(bh), buffers);
+        try {
+            while (reader.processRecord())
+                ;
+        } finally {
+            reader.release();
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.GatheringByteChannel;
+import java.nio.charset.StandardCharsets;
+import java.util.concurrent.TimeUnit;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
+import uk.ac.lancs.fastcgi.proto.serial.RecordIOException;
+import uk.ac.lancs.fastcgi.proto.serial.RecordWriter;
+
+/**
+ * Measures {@link RecordWriter#writeStdout(int, byte[], int, int)} to a
+ * destination that discards everything, for a stream or a gathering
+ * channel, with or without coalescing. Run with several threads (e.g.,
+ * <kbd>-t 4</kbd>) to measure contention between sessions sharing a
+ * connection.
+ *
+ * @author simpsons
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+public class RecordWriterBenchmark {
+    /**
+     * Specifies the content length of each record.
+     */
+    @Param({ "64", "1024", "16384", "65528" })
+    public int payload;
+
+    /**
+     * Specifies whether records are written to a gathering channel
+     * rather than a stream.
+     */
+    @Param({ "false", "true" })
+    public boolean channel;
+
+    /**
+     * Specifies whether records from several threads are coalesced.
+     */
+    @Param({ "false", "true" })
+    public boolean coalesce;
+
+    private RecordWriter writer;
+
+    private byte[] content;
+
+    /**
+     * Discards all bytes passed to it, as if the peer read them
+     * immediately.
+     */
+    private static final class NullChannel implements GatheringByteChannel {
+        @Override
+        public long write(ByteBuffer[] srcs, int offset, int length) {
+            long total = 0;
+            for (int i = offset; i < offset + length; i++) {
+                total += srcs[i].remaining();
+                srcs[i].position(srcs[i].limit());
+            }
+            return total;
+        }
+
+        @Override
+        public long write(ByteBuffer[] srcs) {
+            return write(srcs, 0, srcs.length);
+        }
+
+        @Override
+        public int write(ByteBuffer src) {
+            final int amount = src.remaining();
+            src.position(src.limit());
+            return amount;
+        }
+
+        @Override
+        public boolean isOpen() {
+            return true;
+        }
+
+        @Override
+        public void close() {}
+    }
+
+    /**
+     * Create the writer.
+     */
+    @Setup
+    public void setUp() {
+        content = new byte[payload];
+        BufferPool buffers = BufferPool.start().create();
+        RecordWriter.Builder builder = RecordWriter.start();
+        if (channel)
+            builder.channel(new NullChannel());
+        else
+            builder.output(OutputStream.nullOutputStream());
+        writer = builder.charset(StandardCharsets.UTF_8).coalesce(coalesce)
+            .buffers(buffers).create();
+    }
+
+    /**
+     * Flush any queued records.
+     * 
+     * @throws RecordIOException if an I/O error occurs
+     */
+    @TearDown
+    public void tearDown() throws RecordIOException {
+        writer.flush();
+    }
+
+    /**
+     * Write one record.
+     * 
+     * @return the number of bytes written
+     * 
+     * @throws RecordIOException if an I/O error occurs
+     */
+    @Benchmark
+    public int writeStdout() throws RecordIOException {
+        return writer.writeStdout(1, content, 0, content.length);
+    }
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.ByteArrayOutputStream;
+import java.nio.charset.Charset;
+import java.util.Map;
+import uk.ac.lancs.fastcgi.proto.RecordTypes;
+
+/**
+ * Serializes the records that a server sends to an application. The
+ * {@link uk.ac.lancs.fastcgi.proto.serial} classes only frame records
+ * in the application's direction, so benchmark input and the load
+ * generator's requests are built with this.
+ *
+ * @author simpsons
+ */
+final class Records {
+    private Records() {}
+
+    private static final int MAX_CONTENT_LENGTH = 0xffff;
+
+    private static final byte[] PADDING = new byte[7];
+
+    /**
+     * Write a record header and its content, padded to a multiple of 8
+     * bytes.
+     * 
+     * @param out the destination
+     * 
+     * @param type the record type
+     * 
+     * @param id the request id
+     * 
+     * @param buf an array containing the content
+     * 
+     * @param off the offset of the content
+     * 
+     * @param len the content length, at most 65535
+     */
+    static void record(ByteArrayOutputStream out, byte type, int id,
+                       byte[] buf, int off, int len) {
+        assert len <= MAX_CONTENT_LENGTH;
+        final int pad = (8 - len % 8) % 8;
+        out.write(1); // version
+        out.write(type);
+        out.write(id >> 8);
+        out.write(id);
+        out.write(len >> 8);
+        out.write(len);
+        out.write(pad);
+        out.write(0); // reserved
+        out.write(buf, off, len);
+        out.write(PADDING, 0, pad);
+    }
+
+    /**
+     * Write a request-beginning record.
+     * 
+     * @param out the destination
+     * 
+     * @param id the request id
+     * 
+     * @param role the role type
+     * 
+     * @param flags the request flags
+     */
+    static void begin(ByteArrayOutputStream out, int id, int role,
+                      int flags) {
+        byte[] body = { (byte) (role >> 8), (byte) role, (byte) flags, 0, 0,
+            0, 0, 0 };
+        record(out, RecordTypes.BEGIN_REQUEST, id, body, 0, body.length);
+    }
+
+    /**
+     * Write a stream, split into records of the maximum length, and
+     * terminated by an empty record.
+     * 
+     * @param out the destination
+     * 
+     * @param type the stream's record type
+     * 
+     * @param id the request id
+     * 
+     * @param buf an array containing the stream's content
+     * 
+     * @param off the offset of the content
+     * 
+     * @param len the length of the content
+     */
+    static void stream(ByteArrayOutputStream out, byte type, int id,
+                       byte[] buf, int off, int len) {
+        while (len > 0) {
+            final int amount = Integer.min(len, MAX_CONTENT_LENGTH);
+            record(out, type, id, buf, off, amount);
+            off += amount;
+            len -= amount;
+        }
+        record(out, type, id, buf, off, 0);
+    }
+
+    /**
+     * Encode name-value pairs in the FastCGI format.
+     * 
+     * @param params the pairs to encode
+     * 
+     * @param charset the encoding of names and values
+     * 
+     * @return the encoded pairs
+     */
+    static byte[] encode(Map<? extends String, ? extends String> params,
+                         Charset charset) {
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        for (var entry : params.entrySet()) {
+            byte[] name = entry.getKey().getBytes(charset);
+            byte[] value = entry.getValue().getBytes(charset);
+            length(out, name.length);
+            length(out, value.length);
+            out.write(name, 0, name.length);
+            out.write(value, 0, value.length);
+        }
+        return out.toByteArray();
+    }
+
+    private static void length(ByteArrayOutputStream out, int len) {
+        if (len <= 127) {
+            out.write(len);
+        } else {
+            out.write((len >> 24) | 0x80);
+            out.write(len >> 16);
+            out.write(len >> 8);
+            out.write(len);
+        }
+    }
+
+    /**
+     * Get a typical set of CGI parameters for a request.
+     * 
+     * @param path the request path
+     * 
+     * @param contentLength the length of the request body
+     * 
+     * @return the parameters
+     */
+    static Map<String, String> typicalParams(String path,
+                                             int contentLength) {
+        return Map.ofEntries(Map.entry("GATEWAY_INTERFACE", "CGI/1.1"),
+                             Map.entry("SERVER_SOFTWARE", "bench/1.0"),
+                             Map.entry("SERVER_NAME", "localhost"),
+                             Map.entry("SERVER_PORT", "80"),
+                             Map.entry("SERVER_PROTOCOL", "HTTP/1.1"),
+                             Map.entry("SERVER_ADDR", "127.0.0.1"),
+                             Map.entry("REMOTE_ADDR", "127.0.0.1"),
+                             Map.entry("REMOTE_PORT", "54321"),
+                             Map.entry("REQUEST_METHOD",
+                                       contentLength > 0 ? "POST" : "GET"),
+                             Map.entry("REQUEST_URI", path),
+                             Map.entry("SCRIPT_NAME", path),
+                             Map.entry("PATH_INFO", ""),
+                             Map.entry("QUERY_STRING", "a=1&b=2"),
+                             Map.entry("DOCUMENT_ROOT", "/var/www/html"),
+                             Map.entry("CONTENT_TYPE",
+                                       "application/octet-stream"),
+                             Map.entry("CONTENT_LENGTH",
+                                       Integer.toString(contentLength)),
+                             Map.entry("HTTP_HOST", "localhost"),
+                             Map.entry("HTTP_USER_AGENT",
+                                       "Mozilla/5.0 (X11; Linux x86_64) "
+                                           + "bench/1.0"),
+                             Map.entry("HTTP_ACCEPT",
+                                       "text/html,application/xhtml+xml,"
+                                           + "application/xml;q=0.9,"
+                                           + "*/*;q=0.8"),
+                             Map.entry("HTTP_ACCEPT_LANGUAGE",
+                                       "en-GB,en;q=0.5"),
+                             Map.entry("HTTP_ACCEPT_ENCODING",
+                                       "gzip, deflate, br"),
+                             Map.entry("HTTP_CONNECTION", "keep-alive"),
+                             Map.entry("HTTP_COOKIE",
+                                       "session=0123456789abcdef"
+                                           + "0123456789abcdef"));
+    }
+}
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.bench;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
+import java.io.PrintWriter;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.TimeUnit;
+import uk.ac.lancs.fastcgi.Responder;
+import uk.ac.lancs.fastcgi.context.ResponderContext;
+import uk.ac.lancs.fastcgi.engine.Attribute;
+import uk.ac.lancs.fastcgi.engine.Engine;
+import uk.ac.lancs.fastcgi.proto.RecordTypes;
+import uk.ac.lancs.fastcgi.transport.CaptureReader;
+import uk.ac.lancs.fastcgi.transport.CaptureRecorder;
+import uk.ac.lancs.fastcgi.transport.Connection;
+import uk.ac.lancs.fastcgi.transport.RecordScanner;
+import uk.ac.lancs.fastcgi.transport.Transport;
+
+/**
+ * Feeds traffic captured by {@link CaptureRecorder} into an engine,
+ * preserving each connection's record boundaries, fragmentation,
+ * multiplexing and aborts. It reports the latency of each request, from
+ * delivery of its request-beginning record to receipt of its
+ * request-ending record, and the same measure as captured originally.
+ * 
+ * <p>
+ * Usage:
+ * 
+ * <pre>
+ * java uk.ac.lancs.fastcgi.bench.ReplayDriver [-s <var>speed</var>] \
+ *      [-a <var>responder-class</var>] <var>capture-file</var>
+ * </pre>
+ * 
+ * <p>
+ * The speed is a multiple of the original rate, defaulting to 1. A
+ * speed of 0 feeds the traffic as fast as the engine will take it. The
+ * responder class must have a public no-argument constructor, such as
+ * the demo <code>MD5SumResponder</code>. By default, a responder that
+ * reads the request body and writes a short response is used. Engine
+ * attributes are taken from system properties, as for
+ * {@link uk.ac.lancs.fastcgi.app.FastCGIApplication}.
+ *
+ * @author simpsons
+ */
+public final class ReplayDriver {
+    /**
+     * The longest time to wait for outstanding responses after a
+     * connection's captured input is exhausted, in milliseconds
+     */
+    private static final long DRAIN_TIMEOUT = 30_000;
+
+    private static final class Chunk {
+        final long micros;
+
+        final byte[] data;
+
+        Chunk(long micros, byte[] data) {
+            this.micros = micros;
+            this.data = data;
+        }
+    }
+
+    /**
+     * Holds the input of one captured connection, and measures its
+     * original latencies while loading.
+     */
+    private final class Captured {
+        final long openMicros;
+
+        final List<Chunk> input = new ArrayList<>();
+
+        final Map<Integer, Long> begun = new HashMap<>();
+
+        long now;
+
+        final RecordScanner inScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type == RecordTypes.BEGIN_REQUEST) begun.put(id, now);
+            });
+
+        final RecordScanner outScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type != RecordTypes.END_REQUEST) return;
+                Long start = begun.remove(id);
+                if (start != null) original.record((now - start) * 1000);
+            });
+
+        Captured(long openMicros) {
+            this.openMicros = openMicros;
+        }
+    }
+
+    private final List<Captured> captures = new ArrayList<>();
+
+    private final double speed;
+
+    private final Latencies original;
+
+    private final Latencies replayed;
+
+    private long firstMicros;
+
+    private long startNanos;
+
+    private final CountDownLatch finished;
+
+    private ReplayDriver(Path file, double speed) throws IOException {
+        this.speed = speed;
+        Map<Integer, Captured> open = new HashMap<>();
+        List<Captured> loaded = new ArrayList<>();
+        int requests = 0;
+        this.original = new Latencies(1 << 20);
+        try (CaptureReader reader =
+            new CaptureReader(Files.newInputStream(file))) {
+            while (reader.next()) {
+                final int conn = reader.connection();
+                final Captured cap;
+                switch (reader.kind()) {
+                case CaptureRecorder.OPEN:
+                    cap = new Captured(reader.micros());
+                    open.put(conn, cap);
+                    loaded.add(cap);
+                    break;
+
+                case CaptureRecorder.INPUT:
+                    cap = open.get(conn);
+                    if (cap == null) break;
+                    cap.input.add(new Chunk(reader.micros(), reader.data()));
+                    cap.now = reader.micros();
+                    final int before = cap.begun.size();
+                    cap.inScan.feed(reader.data(), 0, reader.data().length);
+                    requests += Integer.max(0, cap.begun.size() - before);
+                    break;
+
+                case CaptureRecorder.OUTPUT:
+                    cap = open.get(conn);
+                    if (cap == null) break;
+                    cap.now = reader.micros();
+                    cap.outScan.feed(reader.data(), 0, reader.data().length);
+                    break;
+
+                default:
+                    open.remove(conn);
+                    break;
+                }
+            }
+        }
+        captures.addAll(loaded);
+        this.replayed = new Latencies(Integer.max(requests, 1) * 2);
+        this.finished = new CountDownLatch(captures.size());
+        if (!captures.isEmpty()) firstMicros = captures.get(0).openMicros;
+    }
+
+    /**
+     * Get the time at which a captured event should be replayed.
+     * 
+     * @param micros the time of the event in the capture
+     * 
+     * @return the replay time according to {@link System#nanoTime()}
+     */
+    private long due(long micros) {
+        if (speed <= 0.0) return startNanos;
+        return startNanos + (long) ((micros - firstMicros) * 1000.0 / speed);
+    }
+
+    private static void sleepUntil(long due) throws InterruptedIOException {
+        long rem;
+        while ((rem = due - System.nanoTime()) > 0) {
+            try {
+                TimeUnit.NANOSECONDS.sleep(rem);
+            } catch (InterruptedException ex) {
+                Thread.currentThread().interrupt();
+                throw new InterruptedIOException("replay interrupted");
+            }
+        }
+    }
+
+    /**
+     * Presents captured connections at their original relative times.
+     */
+    private final Transport transport = new Transport() {
+        private int next = 0;
+
+        @Override
+        public Connection nextConnection() throws IOException {
+            if (next == 0) startNanos = System.nanoTime();
+            if (next == captures.size()) return null;
+            Captured cap = captures.get(next++);
+            sleepUntil(due(cap.openMicros));
+            return new ReplayConnection(cap);
+        }
+    };
+
+    private final class ReplayConnection implements Connection {
+        private final Captured cap;
+
+        /**
+         * Holds the start time of each request in progress. Guarded by
+         * {@code this}.
+         */
+        private final Map<Integer, Long> begun = new HashMap<>();
+
+        private final RecordScanner inScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type == RecordTypes.BEGIN_REQUEST)
+                    begun.put(id, System.nanoTime());
+            });
+
+        private final RecordScanner outScan =
+            new RecordScanner((type, id, buf, off, len) -> {
+                if (type != RecordTypes.END_REQUEST) return;
+                Long start = begun.remove(id);
+                if (start == null) return;
+                replayed.record(System.nanoTime() - start);
+                notifyAll();
+            });
+
+        private boolean closed = false;
+
+        ReplayConnection(Captured cap) {
+            this.cap = cap;
+        }
+
+        private final InputStream in = new InputStream() {
+            private int next = 0;
+
+            private byte[] current;
+
+            private int pos;
+
+            @Override
+            public int read() throws IOException {
+                byte[] buf = new byte[1];
+                final int got = read(buf, 0, 1);
+                return got < 0 ? -1 : buf[0] & 0xff;
+            }
+
+            @Override
+            public int read(byte[] b, int off, int len) throws IOException {
+                if (len == 0) return 0;
+                if (current == null || pos == current.length) {
+                    if (next == cap.input.size()) {
+                        awaitResponses();
+                        return -1;
+                    }
+                    Chunk chunk = cap.input.get(next++);
+                    sleepUntil(due(chunk.micros));
+                    current = chunk.data;
+                    pos = 0;
+                    synchronized (ReplayConnection.this) {
+                        inScan.feed(current, 0, current.length);
+                    }
+                }
+                final int amount = Integer.min(len, current.length - pos);
+                System.arraycopy(current, pos, b, off, amount);
+                pos += amount;
+                return amount;
+            }
+        };
+
+        private final OutputStream out = new OutputStream() {
+            @Override
+            public void write(int b) {
+                write(new byte[] { (byte) b }, 0, 1);
+            }
+
+            @Override
+            public void write(byte[] b, int off, int len) {
+                synchronized (ReplayConnection.this) {
+                    outScan.feed(b, off, len);
+                }
+            }
+        };
+
+        /**
+         * Wait until every request begun on this connection has ended,
+         * as a server would before closing it.
+         * 
+         * @throws InterruptedIOException if interrupted while waiting
+         */
+        private synchronized void awaitResponses()
+            throws InterruptedIOException {
+            final long deadline = System.currentTimeMillis() + DRAIN_TIMEOUT;
+            long rem;
+            while (!begun.isEmpty() &&
+                (rem = deadline - System.currentTimeMillis()) > 0) {
+                try {
+                    wait(rem);
+                } catch (InterruptedException ex) {
+                    Thread.currentThread().interrupt();
+                    throw new InterruptedIOException("awaiting responses");
+                }
+            }
+        }
+
+        @Override
+        public InputStream input() {
+            return in;
+        }
+
+        @Override
+        public OutputStream output() {
+            return out;
+        }
+
+        @Override
+        public synchronized void close() {
+            if (closed) return;
+            closed = true;
+            finished.countDown();
+        }
+
+        @Override
+        public String description() {
+            return "replay";
+        }
+
+        @Override
+        public String internalDescription() {
+            return "";
+        }
+    }
+
+    /**
+     * Reads the request body, and writes a short response.
+     */
+    private static final class DrainingResponder implements Responder {
+        @Override
+        public void respond(ResponderContext ctxt) throws Exception {
+            byte[] buf = new byte[8192];
+            long total = 0;
+            int got;
+            while ((got = ctxt.in().read(buf)) >= 0)
+                total += got;
+            ctxt.setHeader("Content-Type", "text/plain; charset=UTF-8");
+            try (PrintWriter out =
+                new PrintWriter(ctxt.out(), false, StandardCharsets.UTF_8)) {
+                out.printf("Read %d bytes%n", total);
+            }
+        }
+    }
+
+    private void run(Responder responder)
+        throws IOException, InterruptedException {
+        Engine engine =
+            Engine.start().with(Attribute.RESPONDER, responder)
+                .using(System.getProperties()).build().apply(transport);
+        while (engine.process())
+            ;
+        finished.await();
+        final double secs = (System.nanoTime() - startNanos) / 1e9;
+        final int n = replayed.count();
+        System.out.printf("connections: %d; requests: %d in %.3f s"
+            + " (%.1f req/s)%n", captures.size(), n, secs, n / secs);
+        original.report(System.out, "captured");
+        replayed.report(System.out, "replayed");
+    }
+
+    /**
+     * Replay a capture file.
+     * 
+     * @param args command-line arguments
+     * 
+     * @throws Exception if an error occurs
+     */
+    public static void main(String[] args) throws Exception {
+        double speed = 1.0;
+        String className = null;
+        String file = null;
+        for (int i = 0; i < args.length; i++) {
+            switch (args[i]) {
+            case "-s":
+                speed = Double.parseDouble(args[++i]);
+                break;
+
+            case "-a":
+                className = args[++i];
+                break;
+
+            default:
+                file = args[i];
+                break;
+            }
+        }
+        if (file == null || speed < 0.0) {
+            System.err.printf("usage: %s [-s speed] [-a responder-class]"
+                + " capture-file%n", ReplayDriver.class.getName());
+            System.exit(1);
+        }
+        Responder responder = className == null ? new DrainingResponder() :
+            Class.forName(className).asSubclass(Responder.class)
+                .getConstructor().newInstance();
+        new ReplayDriver(Paths.get(file), speed).run(responder);
+    }
+}
@@ -37,6 +37,8 @@
 package uk.ac.lancs.fastcgi.engine.std;
 
 import java.io.BufferedOutputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
@@ -45,17 +47,23 @@ import java.io.PrintStream;
 import java.io.PrintWriter;
 import java.nio.charset.Charset;
 import java.nio.charset.StandardCharsets;
+import java.nio.file.Path;
 import java.util.ArrayList;
-import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Objects;
 import java.util.TreeMap;
+import java.util.concurrent.CancellationException;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.CompletionException;
+import java.util.concurrent.CompletionStage;
 import java.util.concurrent.Executor;
 import uk.ac.lancs.fastcgi.context.Diagnostics;
 import uk.ac.lancs.fastcgi.context.OverloadException;
 import uk.ac.lancs.fastcgi.context.SessionContext;
+import uk.ac.lancs.fastcgi.engine.util.Pipe;
 import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
 import uk.ac.lancs.fastcgi.proto.serial.ParamReader;
 import uk.ac.lancs.fastcgi.proto.serial.RecordIOException;
 import uk.ac.lancs.fastcgi.proto.serial.RecordWriter;
@@ -91,6 +99,32 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
      */
     final Runnable cleanUp;
 
+    /**
+     * Supplies the buffer for standard output.
+     */
+    private final BufferPool buffers;
+
+    /**
+     * Records the session's timings for the engine's metrics.
+     */
+    private final EngineMetrics.Timings timings;
+
+    /**
+     * Holds the time in nanoseconds at which the session started.
+     */
+    private final long startTime = System.nanoTime();
+
+    /**
+     * Holds the time in nanoseconds at which the application was
+     * submitted for execution.
+     */
+    private long readyTime;
+
+    /**
+     * Serializes the response header.
+     */
+    private final ResponseHeaderEncoder headerEncoder;
+
     /**
      * Holds the means to write records to the transport connection.
      */
@@ -108,14 +142,16 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
     final Charset charset;
 
     /**
-     * Holds the accumulated request parameters. Once complete, the map
-     * is frozen, and only then is the application behaviour invoked.
+     * Holds the request parameters. This is set only once they are
+     * complete, and only then is the application behaviour invoked.
+     * Values are decoded as the application accesses them.
      */
-    Map<String, String> params = new HashMap<>();
+    Map<String, String> params = Map.of();
 
     /**
      * Holds context while parsing records that provide request
-     * parameters. Each decoded parameter is written to {@link #params}.
+     * parameters. The completed parameters are written to
+     * {@link #params}.
      */
     ParamReader paramReader;
 
@@ -145,6 +181,30 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
      */
     private Thread thread;
 
+    /**
+     * Holds the stage that completes when the application has finished
+     * with the session, if it continues without a thread.
+     */
+    private CompletionStage<?> pending;
+
+    /**
+     * Holds the last of the output operations requested without
+     * blocking. Each is performed after its predecessor.
+     */
+    private CompletableFuture<Void> outQueue =
+        CompletableFuture.completedFuture(null);
+
+    /**
+     * Records whether the application has been invoked.
+     */
+    private boolean ran = false;
+
+    /**
+     * Records whether the session has been abandoned to relieve the
+     * engine's input budget.
+     */
+    private volatile boolean shed = false;
+
     /**
      * Records whether the handler has started. This is used to detect
      * when the server attempts to begin a request that is already in
@@ -159,7 +219,8 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
     private final PrintStream err;
 
     /**
-     * Reduces calls on {@link #out} by buffering.
+     * Reduces calls on {@link #out} by buffering, framing each record
+     * in place.
      */
     private OutputStream bufferedOut;
 
@@ -170,35 +231,74 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
      */
     private int bufferSize;
 
+    /**
+     * Records whether the end of standard output has been signalled.
+     */
+    private boolean outClosed = false;
+
+    /**
+     * Accumulates a copy of standard output, including the response
+     * header; or {@code null} if not required, or if it has exceeded
+     * {@link #captureLimit}
+     */
+    private ByteArrayOutputStream capture;
+
+    /**
+     * Holds the maximum number of bytes of standard output to capture.
+     */
+    private int captureLimit;
+
+    /**
+     * Records whether any standard output has been passed to the
+     * record writer.
+     */
+    private boolean stdoutStarted = false;
+
+    /**
+     * Note that standard output is about to be passed to the record
+     * writer. On the first call, the time to first byte is recorded.
+     * The response header is usually buffered with the start of the
+     * body, so this can be much later than the header's completion.
+     */
+    private void stdoutStarting() {
+        if (stdoutStarted) return;
+        stdoutStarted = true;
+        timings.firstByte.record(System.nanoTime() - startTime);
+    }
+
     /**
      * Converts output-stream operations into FCGI_STDOUT records.
      */
     private final OutputStream out = new OutputStream() {
-        private boolean closed = false;
-
         private final byte[] buf1 = new byte[1];
 
         @Override
         public void write(int b) throws IOException {
-            if (closed) throw new IOException("closed");
+            if (outClosed) throw new IOException("closed");
             buf1[0] = (byte) b;
+            stdoutStarting();
             recordsOut.writeStdout(id, buf1, 0, 1);
         }
 
         @Override
         public void close() throws IOException {
-            if (closed) return;
-            closed = true;
+            if (outClosed) return;
+            outClosed = true;
+            stdoutStarting();
             recordsOut.writeStdoutEnd(id);
         }
 
         @Override
         public void write(byte[] b, int off, int len) throws IOException {
-            if (closed) throw new IOException("closed");
-
-            /* TODO: For large values of len, break into multiple
-             * calls. */
-            recordsOut.writeStdout(id, b, off, len);
+            if (outClosed) throw new IOException("closed");
+            if (len > 0) stdoutStarting();
+
+            /* Each record carries only so much. */
+            while (len > 0) {
+                final int done = recordsOut.writeStdout(id, b, off, len);
+                off += done;
+                len -= done;
+            }
         }
     };
 
@@ -211,12 +311,22 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
         public void write(byte[] b, int off, int len) throws IOException {
             ensureResponseHeader();
             bufferedOut.write(b, off, len);
+            if (capture == null) return;
+            if (capture.size() + len > captureLimit)
+                capture = null;
+            else
+                capture.write(b, off, len);
         }
 
         @Override
         public void write(int b) throws IOException {
             ensureResponseHeader();
             bufferedOut.write(b);
+            if (capture == null) return;
+            if (capture.size() >= captureLimit)
+                capture = null;
+            else
+                capture.write(b);
         }
 
         @Override
@@ -249,8 +359,10 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
         this.charset = ctxt.charset;
 
         this.paramReader =
-            new ParamReader(params, ctxt.charset, ctxt.paramBufs.getBuffer(),
-                            ctxt.paramBufs::returnParamBuf);
+            new ParamReader(m -> params = m, ctxt.charset, ctxt.buffers);
+        this.buffers = ctxt.buffers;
+        this.timings = ctxt.timings;
+        this.headerEncoder = ctxt.headerEncoder;
         this.bufferSize = ctxt.stdoutBufferSize;
         this.err = new PrintStream(new BufferedOutputStream(new OutputStream() {
             private boolean closed = false;
@@ -312,38 +424,140 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
      */
     abstract void innerRun() throws Exception;
 
+    /**
+     * Start the role-specific behaviour, which may complete after the
+     * invoking thread has returned. Failure of the returned stage is
+     * handled as the corresponding exception thrown by
+     * {@link #innerRun()}.
+     * 
+     * @default {@link #innerRun()} is invoked, and {@code null} is
+     * returned.
+     * 
+     * @return a stage that completes when the behaviour is complete; or
+     * {@code null} if it has already completed
+     * 
+     * @throws Exception as for {@link #innerRun()}
+     */
+    CompletionStage<?> innerStart() throws Exception {
+        innerRun();
+        return null;
+    }
+
     /**
      * Run the application-specific behaviour of this handler. This
-     * wraps an invocation of {@link #innerRun()} such that the
+     * wraps an invocation of {@link #innerStart()} such that the
      * executing thread is recorded (allowing it to be interrupted on
      * error), and that various exceptions are caught and handled
-     * appropriately.
+     * appropriately. If the behaviour continues asynchronously, the
+     * session is completed when it does, and after any queued output.
      */
     void run() {
         synchronized (this) {
+            if (shed) {
+                /* The end of the session has already been
+                 * reported. */
+                cleanUp.run();
+                return;
+            }
             this.thread = Thread.currentThread();
+            ran = true;
+        }
+        timings.queue.record(System.nanoTime() - readyTime);
+        Throwable failure = null;
+        CompletionStage<?> stage = null;
+        try {
+            stage = innerStart();
+        } catch (Exception | Error ex) {
+            failure = ex;
+        } finally {
+            final boolean interrupted = Thread.interrupted();
+            synchronized (this) {
+                this.thread = null;
+                this.pending = stage;
+            }
+
+            /* An interruption meant for the application arrived as it
+             * was leaving. */
+            if (interrupted && stage != null) cancel(stage);
+        }
+        if (stage == null) {
+            complete(failure);
+            return;
+        }
+
+        /* Release this thread, and complete the session when the
+         * application and its output have. */
+        stage.handle((r, ex) -> ex)
+            .thenCompose(ex -> outputQueue().handle((r, oex) -> ex))
+            .thenAcceptAsync(ex -> complete(unwrap(ex)), executor);
+    }
+
+    /**
+     * Identify the real reason for failure of an asynchronous stage.
+     * Cancellation is treated as interruption.
+     * 
+     * @param ex the reason for failure, or {@code null}
+     * 
+     * @return the unwrapped reason, or {@code null}
+     */
+    private static Throwable unwrap(Throwable ex) {
+        while (ex instanceof CompletionException && ex.getCause() != null)
+            ex = ex.getCause();
+        if (ex instanceof CancellationException) {
+            InterruptedException iex = new InterruptedException("cancelled");
+            iex.initCause(ex);
+            return iex;
         }
+        return ex;
+    }
+
+    /**
+     * Attempt to cancel the application's stage. If it does not
+     * support cancellation, the application must notice that its
+     * input has been withdrawn.
+     * 
+     * @param stage the stage to cancel
+     */
+    private static void cancel(CompletionStage<?> stage) {
+        try {
+            stage.toCompletableFuture().cancel(true);
+        } catch (UnsupportedOperationException ex) {
+            /* Let the stage complete in its own time. */
+        }
+    }
+
+    /**
+     * End the session according to how the application-specific
+     * behaviour finished, and release its resources.
+     * 
+     * @param failure the reason the behaviour failed; or {@code null}
+     * if it succeeded
+     */
+    private void complete(Throwable failure) {
         try {
             boolean completed = false;
             try {
-                try {
-                    innerRun();
-                    Thread.interrupted();
-                } finally {
-                    synchronized (this) {
-                        this.thread = null;
-                    }
-                }
+                if (failure instanceof Error) throw (Error) failure;
+                if (failure != null) throw (Exception) failure;
             } catch (RecordIOException ex) {
                 ex.unpack();
             } catch (InterruptedException ex) {
-                recordsOut.writeEndRequest(id, -1,
-                                           ProtocolStatuses.REQUEST_COMPLETE);
+                final int protoStatus = shed ? ProtocolStatuses.OVERLOADED :
+                    ProtocolStatuses.REQUEST_COMPLETE;
+                recordsOut.writeEndRequest(id, shed ? -2 : -1, protoStatus);
                 completed = true;
             } catch (OverloadException ex) {
                 recordsOut.writeEndRequest(id, -2, ProtocolStatuses.OVERLOADED);
                 completed = true;
             } catch (Exception | Error ex) {
+                if (shed) {
+                    /* The application most likely failed because its
+                     * input was withdrawn. */
+                    recordsOut.writeEndRequest(id, -2,
+                                               ProtocolStatuses.OVERLOADED);
+                    completed = true;
+                    return;
+                }
                 try {
                     try {
                         setStatus(501);
@@ -371,13 +585,17 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
             } finally {
                 if (!completed) {
                     try {
+                        /* Send whatever the application left in the
+                         * buffer, including the header. */
                         ensureResponseHeader();
+                        bufferedOut.flush();
                         recordsOut
                             .writeEndRequest(id, appStatus,
                                              ProtocolStatuses.REQUEST_COMPLETE);
                     } catch (RecordIOException ex2) {
                         ex2.unpack();
                     }
+                    if (failure == null) succeeded();
                 }
             }
         } catch (IOException ex) {
@@ -385,15 +603,134 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
              * to terminate all handlers on this connection. */
             connAbort.run();
         } finally {
+            discardInput();
+            timings.duration.record(System.nanoTime() - startTime);
             cleanUp.run();
         }
     }
 
+    /**
+     * Start keeping a copy of standard output, including the response
+     * header, for {@link #capturedOutput()}. This must be called before
+     * the application runs.
+     * 
+     * @param limit the maximum number of bytes to keep; more causes
+     * the copy to be abandoned
+     */
+    void captureOutput(int limit) {
+        captureLimit = limit;
+        capture = new ByteArrayOutputStream(Math.min(limit, 256));
+    }
+
+    /**
+     * Get the copy of standard output kept since
+     * {@link #captureOutput(int)} was called.
+     * 
+     * @return the complete output; or {@code null} if not captured, or
+     * if it exceeded the limit, or included a file
+     */
+    byte[] capturedOutput() {
+        return capture == null ? null : capture.toByteArray();
+    }
+
+    /**
+     * Answer the request without running the application, once its
+     * parameters are complete. This is called on the connection's
+     * thread, so it must not block for long.
+     * 
+     * @default {@code false} is returned.
+     * 
+     * @return {@code true} if the request has been answered and the
+     * session cleaned up; {@code false} if the application must run
+     * 
+     * @throws IOException if an I/O error occurs in transmitting the
+     * answer
+     */
+    boolean replay() throws IOException {
+        return false;
+    }
+
+    /**
+     * Take action after the application has returned normally, and the
+     * end of the request has been transmitted.
+     * 
+     * @default Nothing is done.
+     */
+    void succeeded() {}
+
+    /**
+     * Discard request content that the application has not read, and
+     * any still to arrive. This is called when the application has
+     * finished with the session.
+     * 
+     * @default Nothing is done.
+     */
+    void discardInput() {}
+
+    /**
+     * Close the input of a pipe, so that its unread content is
+     * discarded. Errors are ignored.
+     * 
+     * @param pipe the pipe whose input is to be closed
+     */
+    static void discard(Pipe pipe) {
+        try {
+            pipe.getInputStream().close();
+        } catch (IOException ex) {
+            /* The content is unwanted anyway. */
+        }
+    }
+
     protected synchronized void terminate() {
-        if (thread == null)
-            cleanUp.run();
-        else
+        if (thread != null)
             thread.interrupt();
+        else if (pending != null)
+            cancel(pending);
+        else
+            cleanUp.run();
+    }
+
+    /**
+     * Performs an output operation that might block.
+     */
+    interface OutputAction {
+        /**
+         * Perform the operation.
+         * 
+         * @throws IOException if an I/O error occurs
+         */
+        void perform() throws IOException;
+    }
+
+    /**
+     * Perform an output operation after all previously queued ones,
+     * without blocking the caller. If a previous operation failed, so
+     * does this one.
+     * 
+     * @param action the operation to perform
+     * 
+     * @return a stage that completes when the operation has been
+     * performed
+     */
+    synchronized CompletionStage<Void> queueOutput(OutputAction action) {
+        outQueue = outQueue.thenRunAsync(() -> {
+            try {
+                action.perform();
+            } catch (IOException ex) {
+                throw new CompletionException(ex);
+            }
+        }, executor);
+        return outQueue;
+    }
+
+    /**
+     * Get the last of the queued output operations.
+     * 
+     * @return a stage that completes when all output operations queued
+     * so far are complete
+     */
+    private synchronized CompletionStage<Void> outputQueue() {
+        return outQueue;
     }
 
     @Override
@@ -401,6 +738,21 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
         terminate();
     }
 
+    @Override
+    public void overload() throws IOException {
+        final boolean report;
+        synchronized (this) {
+            shed = true;
+            report = !ran;
+        }
+        if (report) {
+            /* The application has not been invoked, and now won't
+             * be, so no-one else will end the session. */
+            recordsOut.writeEndRequest(id, -3, ProtocolStatuses.OVERLOADED);
+        }
+        abortRequest();
+    }
+
     @Override
     public void transportFailure(IOException ex) {
         terminate();
@@ -422,17 +774,17 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
         }
         paramReader = null;
 
-        /* Freeze the parameters, */
-        params = Map.copyOf(params);
-
-        /* Let the application run. */
+        /* Let the application run, unless the answer is already
+         * known. */
+        if (replay()) return;
+        readyTime = System.nanoTime();
         executor.execute(this::run);
     }
 
     @Override
     public Map<String, String> parameters() {
         /* We don't need to protect this. By the time the application is
-         * called, this has already been made an immutable copy. */
+         * called, this has already been completed, and is immutable. */
         return params;
     }
 
@@ -456,6 +808,29 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
         return headeredOut;
     }
 
+    @Override
+    public void transmit(Path path, long position, long length)
+        throws IOException {
+        if (position < 0 || length < 0)
+            throw new IllegalArgumentException("-ve region " + position
+                + "+" + length);
+        try (FileInputStream in = new FileInputStream(path.toFile())) {
+            final long size = in.getChannel().size();
+            if (position + length > size)
+                throw new IllegalArgumentException("region " + position
+                    + "+" + length + " beyond " + size);
+
+            /* Anything already written must precede the file's
+             * content. */
+            ensureResponseHeader();
+            bufferedOut.flush();
+            if (outClosed) throw new IOException("closed");
+            capture = null;
+            if (length > 0) stdoutStarting();
+            recordsOut.writeStdout(id, in, position, length);
+        }
+    }
+
     @Override
     public PrintStream err() {
         return err;
@@ -507,24 +882,25 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
 
         assert bufferedOut == null;
         bufferedOut =
-            bufferSize == 0 ? out : new BufferedOutputStream(out, bufferSize);
+            bufferSize == 0 ? out :
+                new FramedOutputStream(out, recordsOut, id, buffers,
+                                       bufferSize, this::stdoutStarting);
 
-        /* Don't autoclose this stream; we need the base to remain
-         * open. */
-        PrintStream pout = new PrintStream(bufferedOut, false, charset);
+        /* Write the header into the buffer without flushing, so that
+         * it goes out with the first bytes of the body. Unbuffered
+         * output still gets the header in one record. */
         try {
-            pout.printf("Status: %d %s%n", statusCode,
-                        getStatusMessage(statusCode));
-            for (var entry : outHeaders.entrySet()) {
-                List<String> values = entry.getValue();
-                if (values.isEmpty()) continue;
-                String name = entry.getKey();
-                for (String value : values)
-                    pout.printf("%s: %s%n", name, value);
+            if (bufferedOut == out) {
+                ByteArrayOutputStream hdr = new ByteArrayOutputStream(256);
+                headerEncoder.write(hdr, statusCode, outHeaders);
+                hdr.writeTo(out);
+                if (capture != null) hdr.writeTo(capture);
+            } else {
+                headerEncoder.write(bufferedOut, statusCode, outHeaders);
+                if (capture != null)
+                    headerEncoder.write(capture, statusCode, outHeaders);
             }
-            pout.println();
         } finally {
-            pout.flush();
             statusCode = -1;
         }
     }
@@ -563,7 +939,7 @@ abstract class AbstractHandler implements SessionHandler, SessionContext {
      * 
      * @return the equivalent message; or {@code "UNKNOWN"}.
      */
-    private static String getStatusMessage(int code) {
+    static String getStatusMessage(int code) {
         switch (code) {
         default:
             return "UNKNOWN";
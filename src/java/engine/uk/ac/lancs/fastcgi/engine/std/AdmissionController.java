@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.ArrayDeque;
+import java.util.Queue;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.ScheduledFuture;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.LongAdder;
+
+/**
+ * Limits the number of sessions running at once across all
+ * connections of an engine. A session that cannot be admitted
+ * immediately may wait in a short queue, unless the queue is full, or
+ * the projected wait exceeds the latency budget. A waiting session that
+ * is not admitted within the budget expires.
+ * 
+ * <p>
+ * The projected wait is the number of sessions ahead in the queue,
+ * multiplied by a smoothed mean service time, and divided by the
+ * session limit.
+ * 
+ * @author simpsons
+ */
+final class AdmissionController implements AdmissionControllerMXBean {
+    private final int limit;
+
+    private final int queueCapacity;
+
+    private final long budgetNanos;
+
+    /**
+     * Counts admitted sessions. Guarded by this object.
+     */
+    private int running;
+
+    /**
+     * Holds sessions waiting for admission, in order of arrival.
+     * Guarded by this object.
+     */
+    private final Queue<Ticket> waiting = new ArrayDeque<>();
+
+    /**
+     * Holds the smoothed mean service time in nanoseconds. Guarded by
+     * this object.
+     */
+    private double meanServiceNanos;
+
+    /**
+     * Specifies the weight of each new service time in the smoothed
+     * mean.
+     */
+    private static final double ALPHA = 0.125;
+
+    private final LongAdder admittedCount = new LongAdder();
+
+    private final LongAdder queuedCount = new LongAdder();
+
+    private final LongAdder rejectedCount = new LongAdder();
+
+    private final LongAdder expiredCount = new LongAdder();
+
+    private static final ScheduledExecutorService timer =
+        Executors.newSingleThreadScheduledExecutor(r -> {
+            Thread t = new Thread(r, "admission-timer");
+            t.setDaemon(true);
+            return t;
+        });
+
+    /**
+     * Create an admission controller.
+     * 
+     * @param limit the maximum number of running sessions
+     * 
+     * @param queueCapacity the maximum number of waiting sessions
+     * 
+     * @param budgetMillis the longest time in milliseconds that a
+     * session may wait for admission
+     */
+    AdmissionController(int limit, int queueCapacity, long budgetMillis) {
+        this.limit = limit;
+        this.queueCapacity = queueCapacity;
+        this.budgetNanos = TimeUnit.MILLISECONDS.toNanos(budgetMillis);
+    }
+
+    private static final int WAITING = 0;
+
+    private static final int GRANTED = 1;
+
+    private static final int EXPIRED = 2;
+
+    private static final int RELEASED = 3;
+
+    /**
+     * Represents a session's claim on admission.
+     */
+    final class Ticket {
+        /**
+         * Records the state of the claim. Guarded by the controller.
+         */
+        private int state;
+
+        /**
+         * Holds the task to run when the claim is granted. Guarded by
+         * the controller.
+         */
+        private Runnable task;
+
+        private final Runnable onExpiry;
+
+        private ScheduledFuture<?> timeout;
+
+        private long grantTime;
+
+        private Ticket(int state, Runnable onExpiry) {
+            this.state = state;
+            this.onExpiry = onExpiry;
+            if (state == GRANTED) grantTime = System.nanoTime();
+        }
+
+        /**
+         * Run a task as soon as the claim is granted. If already
+         * granted, the task is run immediately. If the claim has
+         * expired or been released, the task is discarded.
+         * 
+         * @param task the task to run
+         */
+        void whenGranted(Runnable task) {
+            synchronized (AdmissionController.this) {
+                if (state == WAITING) {
+                    this.task = task;
+                    return;
+                }
+                if (state != GRANTED) return;
+            }
+            task.run();
+        }
+
+        /**
+         * Relinquish the claim. If granted, the next waiting session
+         * is admitted. This method has no effect after the first call,
+         * or if the claim has expired.
+         */
+        void release() {
+            Ticket next;
+            synchronized (AdmissionController.this) {
+                switch (state) {
+                case WAITING:
+                    state = RELEASED;
+                    waiting.remove(this);
+                    timeout.cancel(false);
+                    return;
+
+                case GRANTED:
+                    state = RELEASED;
+                    final long service = System.nanoTime() - grantTime;
+                    meanServiceNanos += ALPHA * (service - meanServiceNanos);
+                    running--;
+                    next = grantNext();
+                    break;
+
+                default:
+                    return;
+                }
+            }
+            if (next != null) next.granted();
+        }
+
+        /**
+         * Invoked without the lock once the claim has been granted
+         * after waiting.
+         */
+        private void granted() {
+            timeout.cancel(false);
+            Runnable t;
+            synchronized (AdmissionController.this) {
+                t = task;
+                task = null;
+            }
+            if (t != null) t.run();
+        }
+
+        private void expire() {
+            synchronized (AdmissionController.this) {
+                if (state != WAITING) return;
+                state = EXPIRED;
+                task = null;
+                waiting.remove(this);
+            }
+            expiredCount.increment();
+            onExpiry.run();
+        }
+    }
+
+    /**
+     * Admit the longest-waiting session, if there is one and capacity
+     * permits. The caller must hold the lock on this object.
+     * 
+     * @return the admitted session; or {@code null} if none
+     */
+    private Ticket grantNext() {
+        if (running >= limit) return null;
+        Ticket next = waiting.poll();
+        if (next == null) return null;
+        next.state = GRANTED;
+        next.grantTime = System.nanoTime();
+        running++;
+        admittedCount.increment();
+        return next;
+    }
+
+    /**
+     * Request admission for a new session.
+     * 
+     * @param onExpiry an action to take if the session waits too long,
+     * invoked on an internal thread
+     * 
+     * @return a claim, which might already be granted, or might be
+     * waiting; or {@code null} if the session should be refused
+     */
+    Ticket admit(Runnable onExpiry) {
+        final Ticket ticket;
+        synchronized (this) {
+            if (running < limit && waiting.isEmpty()) {
+                running++;
+                admittedCount.increment();
+                return new Ticket(GRANTED, onExpiry);
+            }
+            final double projected =
+                (waiting.size() + 1) * meanServiceNanos / limit;
+            if (waiting.size() >= queueCapacity || projected > budgetNanos) {
+                rejectedCount.increment();
+                return null;
+            }
+            ticket = new Ticket(WAITING, onExpiry);
+            waiting.add(ticket);
+            ticket.timeout = timer.schedule(ticket::expire, budgetNanos,
+                                            TimeUnit.NANOSECONDS);
+        }
+        queuedCount.increment();
+        return ticket;
+    }
+
+    @Override
+    public int getLimit() {
+        return limit;
+    }
+
+    @Override
+    public int getQueueCapacity() {
+        return queueCapacity;
+    }
+
+    @Override
+    public long getBudgetMillis() {
+        return TimeUnit.NANOSECONDS.toMillis(budgetNanos);
+    }
+
+    @Override
+    public synchronized int getRunning() {
+        return running;
+    }
+
+    @Override
+    public synchronized int getQueued() {
+        return waiting.size();
+    }
+
+    @Override
+    public long getAdmittedCount() {
+        return admittedCount.sum();
+    }
+
+    @Override
+    public long getQueuedCount() {
+        return queuedCount.sum();
+    }
+
+    @Override
+    public long getRejectedCount() {
+        return rejectedCount.sum();
+    }
+
+    @Override
+    public long getExpiredCount() {
+        return expiredCount.sum();
+    }
+
+    @Override
+    public synchronized double getMeanServiceMillis() {
+        return meanServiceNanos / 1e6;
+    }
+}
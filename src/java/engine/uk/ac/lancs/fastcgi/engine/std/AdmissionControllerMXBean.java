@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+/**
+ * Exposes the live state of an engine's admission of sessions for
+ * monitoring.
+ * 
+ * @author simpsons
+ */
+public interface AdmissionControllerMXBean {
+    /**
+     * Get the maximum number of sessions that may run at once.
+     * 
+     * @return the session limit
+     */
+    int getLimit();
+
+    /**
+     * Get the maximum number of sessions that may wait for admission.
+     * 
+     * @return the queue capacity
+     */
+    int getQueueCapacity();
+
+    /**
+     * Get the longest time that a session may wait for admission.
+     * 
+     * @return the latency budget in milliseconds
+     */
+    long getBudgetMillis();
+
+    /**
+     * Get the number of sessions currently admitted.
+     * 
+     * @return the number of running sessions
+     */
+    int getRunning();
+
+    /**
+     * Get the number of sessions currently waiting for admission.
+     * 
+     * @return the number of queued sessions
+     */
+    int getQueued();
+
+    /**
+     * Get the number of sessions admitted, whether immediately or after
+     * waiting.
+     * 
+     * @return the total number of admitted sessions
+     */
+    long getAdmittedCount();
+
+    /**
+     * Get the number of sessions that have had to wait for admission.
+     * 
+     * @return the total number of queued sessions
+     */
+    long getQueuedCount();
+
+    /**
+     * Get the number of sessions refused without waiting.
+     * 
+     * @return the total number of rejected sessions
+     */
+    long getRejectedCount();
+
+    /**
+     * Get the number of sessions refused after waiting too long.
+     * 
+     * @return the total number of expired sessions
+     */
+    long getExpiredCount();
+
+    /**
+     * Get the smoothed mean time for which admitted sessions run.
+     * 
+     * @return the mean service time in milliseconds
+     */
+    double getMeanServiceMillis();
+}
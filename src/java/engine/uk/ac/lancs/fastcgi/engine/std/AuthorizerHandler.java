@@ -36,9 +36,12 @@
 
 package uk.ac.lancs.fastcgi.engine.std;
 
+import java.io.IOException;
 import java.util.Objects;
 import uk.ac.lancs.fastcgi.context.AuthorizerContext;
 import uk.ac.lancs.fastcgi.Authorizer;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
 
 /**
  * Handles Authorizer sessions.
@@ -48,16 +51,24 @@ import uk.ac.lancs.fastcgi.Authorizer;
 class AuthorizerHandler extends AbstractHandler implements AuthorizerContext {
     private final Authorizer app;
 
+    private final DecisionCache decisions;
+
     /**
      * Create an Authorizer handler.
      * 
      * @param ctxt the context
      * 
      * @param app the application-specific behaviour
+     * 
+     * @param decisions a cache of previous decisions; or {@code null}
+     * if not used
      */
-    public AuthorizerHandler(HandlerContext ctxt, Authorizer app) {
+    public AuthorizerHandler(HandlerContext ctxt, Authorizer app,
+                             DecisionCache decisions) {
         super(ctxt);
         this.app = app;
+        this.decisions = decisions;
+        if (decisions != null) captureOutput(decisions.outputLimit());
     }
 
     @Override
@@ -65,6 +76,32 @@ class AuthorizerHandler extends AbstractHandler implements AuthorizerContext {
         app.authorize(this);
     }
 
+    @Override
+    boolean replay() throws IOException {
+        if (decisions == null) return false;
+        DecisionCache.Decision decision = decisions.get(params);
+        if (decision == null) return false;
+        try {
+            byte[] output = decision.output();
+            int off = 0;
+            while (off < output.length)
+                off += recordsOut.writeStdout(id, output, off,
+                                              output.length - off);
+            recordsOut.writeStdoutEnd(id);
+            recordsOut.writeEndRequest(id, decision.exitStatus(),
+                                       ProtocolStatuses.REQUEST_COMPLETE);
+        } finally {
+            cleanUp.run();
+        }
+        return true;
+    }
+
+    @Override
+    void succeeded() {
+        byte[] output = capturedOutput();
+        if (output != null) decisions.put(params, output, appStatus);
+    }
+
     @Override
     public void addHeader(String name, String value) {
         Objects.requireNonNull(name, "name");
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.ArrayDeque;
+import java.util.Queue;
+import java.util.concurrent.Executor;
+
+/**
+ * Limits the number of tasks running at once on another executor.
+ * Tasks submitted while the limit is reached are queued, and started
+ * in order as running tasks complete. Submission never blocks, so it
+ * is safe from a transport's shared thread.
+ * 
+ * @author simpsons
+ */
+final class BoundedExecutor implements Executor {
+    private final Executor base;
+
+    /**
+     * Holds tasks waiting for a running task to complete. Guarded by
+     * {@code this}.
+     */
+    private final Queue<Runnable> waiting = new ArrayDeque<>();
+
+    /**
+     * Counts the tasks that may yet be started without waiting.
+     * Guarded by {@code this}.
+     */
+    private int available;
+
+    /**
+     * Create a bounded executor.
+     * 
+     * @param base the executor to run tasks on
+     * 
+     * @param limit the maximum number of tasks to run at once
+     */
+    BoundedExecutor(Executor base, int limit) {
+        if (limit < 1)
+            throw new IllegalArgumentException("limit " + limit + " < 1");
+        this.base = base;
+        this.available = limit;
+    }
+
+    @Override
+    public void execute(Runnable task) {
+        synchronized (this) {
+            if (available == 0) {
+                waiting.add(task);
+                return;
+            }
+            available--;
+        }
+        launch(task);
+    }
+
+    private void launch(Runnable task) {
+        try {
+            base.execute(() -> {
+                try {
+                    task.run();
+                } finally {
+                    next();
+                }
+            });
+        } catch (RuntimeException ex) {
+            next();
+            throw ex;
+        }
+    }
+
+    /**
+     * Start the next waiting task, or give up a place if there is
+     * none.
+     */
+    private void next() {
+        final Runnable task;
+        synchronized (this) {
+            task = waiting.poll();
+            if (task == null) {
+                available++;
+                return;
+            }
+        }
+        launch(task);
+    }
+}
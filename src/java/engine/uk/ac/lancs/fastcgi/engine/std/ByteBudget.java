@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.IdentityHashMap;
+import java.util.Iterator;
+import java.util.Map;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+
+/**
+ * Accounts for request content that has been received from the server
+ * but not yet consumed by the application. An engine-wide budget is
+ * divided into connection budgets, and each of those into session
+ * accounts. Bytes charged to an account are also charged to its
+ * connection and to the engine, so a connection that is over its own
+ * limit, has any session over its limit, or belongs to an engine over
+ * its limit, is blocked, and should stop reading records until
+ * applications catch up.
+ * 
+ * <p>
+ * An account may be opened held, for a session still waiting for
+ * admission. Its bytes are not charged to its connection or the engine
+ * until it is admitted, and it never blocks its connection, as no
+ * application is consuming its content yet; blocking would only starve
+ * the connection's running sessions. A held account that goes over its
+ * own limit is evicted instead.
+ * 
+ * <p>
+ * A limit of zero or less means unlimited.
+ * 
+ * @author simpsons
+ */
+class ByteBudget {
+    /**
+     * Holds the engine budget that this connection budget belongs to;
+     * or {@code null} if this is the engine budget
+     */
+    private final ByteBudget parent;
+
+    private final long limit;
+
+    private final AtomicLong used = new AtomicLong(0);
+
+    /**
+     * Counts session accounts of this connection budget that are over
+     * their limits.
+     */
+    private final AtomicInteger accountsOver = new AtomicInteger(0);
+
+    /**
+     * Holds the actions to resume blocked connections, indexed by
+     * their budgets. Only the engine budget uses this.
+     */
+    private final Map<ByteBudget, Runnable> paused;
+
+    private ByteBudget(ByteBudget parent, long limit) {
+        this.parent = parent;
+        this.limit = limit;
+        this.paused = parent == null ? new IdentityHashMap<>() : null;
+    }
+
+    /**
+     * Create an engine-wide budget.
+     * 
+     * @param limit the maximum number of unconsumed bytes across all
+     * connections
+     */
+    ByteBudget(long limit) {
+        this(null, limit);
+    }
+
+    /**
+     * Create a budget for a connection from this engine budget.
+     * 
+     * @param limit the maximum number of unconsumed bytes across all
+     * sessions of the connection
+     * 
+     * @return the new budget
+     */
+    ByteBudget connection(long limit) {
+        assert parent == null;
+        return new ByteBudget(this, limit);
+    }
+
+    /**
+     * Open an account for a session from this connection budget.
+     * 
+     * @param limit the maximum number of unconsumed bytes of the
+     * session
+     * 
+     * @param overrun an action to take the first time the account goes
+     * over its limit; or {@code null} if the connection is to be
+     * blocked instead
+     * 
+     * @param evict an action to take if the account goes over its
+     * limit while held; or {@code null} if the account is to be
+     * admitted immediately
+     * 
+     * @return the new account
+     */
+    Account open(long limit, Runnable overrun, Runnable evict) {
+        assert parent != null;
+        return new Account(limit, overrun, evict);
+    }
+
+    private boolean over() {
+        return limit > 0 && used.get() > limit;
+    }
+
+    /**
+     * Determine whether this connection budget is blocked, i.e.,
+     * whether it, any of its sessions, or the engine is over its
+     * limit.
+     * 
+     * @return {@code true} if the connection should not read further
+     * records
+     */
+    boolean blocked() {
+        return over() || accountsOver.get() > 0 || parent.over();
+    }
+
+    /**
+     * Arrange to resume a connection when it ceases to be blocked, if
+     * it is blocked now.
+     * 
+     * @param resume the action to take once the connection is no
+     * longer blocked
+     * 
+     * @return {@code true} if the connection is blocked, and the
+     * action will be invoked later; {@code false} if the connection is
+     * not blocked, and the action will not be invoked
+     */
+    boolean pauseUnlessClear(Runnable resume) {
+        synchronized (parent.paused) {
+            if (!blocked()) return false;
+            parent.paused.put(this, resume);
+            return true;
+        }
+    }
+
+    /**
+     * Resume all connections that are no longer blocked. This is
+     * invoked on the engine budget after any limit has been relieved.
+     */
+    private void resumeClear() {
+        Collection<Runnable> actions = new ArrayList<>();
+        synchronized (paused) {
+            for (Iterator<Map.Entry<ByteBudget, Runnable>> iter =
+                paused.entrySet().iterator(); iter.hasNext();) {
+                var entry = iter.next();
+                if (entry.getKey().blocked()) continue;
+                actions.add(entry.getValue());
+                iter.remove();
+            }
+        }
+        actions.forEach(Runnable::run);
+    }
+
+    /**
+     * Adjust the usage of this budget and its parent.
+     * 
+     * @param delta the change in usage
+     * 
+     * @return {@code true} if either budget has fallen back within its
+     * limit
+     */
+    private boolean adjust(long delta) {
+        boolean relieved = false;
+        for (ByteBudget b = this; b != null; b = b.parent) {
+            final long now = b.used.addAndGet(delta);
+            if (b.limit > 0 && now <= b.limit && now - delta > b.limit)
+                relieved = true;
+        }
+        return relieved;
+    }
+
+    /**
+     * Tracks the unconsumed bytes of a single session.
+     */
+    final class Account {
+        private final long limit;
+
+        private final Runnable overrun;
+
+        private final Runnable evict;
+
+        private long used = 0;
+
+        private boolean closed = false;
+
+        /**
+         * Records whether the account's bytes are not yet charged to
+         * the connection and engine. Guarded by {@code this}.
+         */
+        private boolean held;
+
+        private volatile boolean discarding = false;
+
+        private Account(long limit, Runnable overrun, Runnable evict) {
+            this.limit = limit;
+            this.overrun = overrun;
+            this.evict = evict;
+            this.held = evict != null;
+        }
+
+        /**
+         * Charge the account's bytes to its connection and the engine
+         * from now on, as its session has been admitted. Subsequent
+         * calls have no effect.
+         */
+        void admit() {
+            synchronized (this) {
+                if (closed || !held) return;
+                held = false;
+                adjust(used);
+            }
+        }
+
+        /**
+         * Record bytes delivered to the session.
+         * 
+         * @param amount the number of bytes
+         */
+        void charge(long amount) {
+            final boolean crossed;
+            final Runnable action;
+            synchronized (this) {
+                if (closed) return;
+                final long was = used;
+                used += amount;
+                crossed = limit > 0 && was <= limit && used > limit;
+                if (held) {
+                    action = evict;
+                    if (crossed) discarding = true;
+                } else {
+                    action = overrun;
+                    adjust(amount);
+                    if (crossed) {
+                        if (overrun == null)
+                            accountsOver.incrementAndGet();
+                        else
+                            discarding = true;
+                    }
+                }
+            }
+            if (crossed && action != null) action.run();
+        }
+
+        /**
+         * Determine whether further content for the session should be
+         * discarded, because the account has gone over its limit and
+         * the session has been aborted.
+         * 
+         * @return {@code true} if content should be discarded
+         */
+        boolean discarding() {
+            return discarding;
+        }
+
+        /**
+         * Record bytes consumed by the application. The amount is
+         * ignored if the account has been closed.
+         * 
+         * @param amount the number of bytes
+         */
+        void credit(long amount) {
+            final boolean relieved;
+            synchronized (this) {
+                if (closed) return;
+                relieved = release(Long.min(amount, used));
+            }
+            if (relieved) parent.resumeClear();
+        }
+
+        /**
+         * Close the account, crediting all bytes not yet consumed.
+         * Subsequent calls have no effect.
+         */
+        void close() {
+            final boolean relieved;
+            synchronized (this) {
+                if (closed) return;
+                relieved = release(used);
+                closed = true;
+            }
+            if (relieved) parent.resumeClear();
+        }
+
+        private boolean release(long amount) {
+            if (amount <= 0) return false;
+            final long was = used;
+            used -= amount;
+            if (held) return false;
+            boolean relieved = adjust(-amount);
+            if (limit > 0 && was > limit && used <= limit &&
+                overrun == null) {
+                accountsOver.decrementAndGet();
+                relieved = true;
+            }
+            return relieved;
+        }
+    }
+}
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.IOException;
+import java.util.LinkedHashMap;
+import java.util.Map;
+import java.util.concurrent.atomic.LongAdder;
+import java.util.function.Function;
+import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.util.PipePool;
+import uk.ac.lancs.fastcgi.proto.serial.RecordMonitor;
+
+/**
+ * Accumulates an engine's counters and timings. Every counter is a
+ * {@link LongAdder}, so that connections and sessions updating them
+ * concurrently do not contend, and only reading them costs a sum.
+ *
+ * @author simpsons
+ */
+final class EngineMetrics implements EngineMetricsMXBean, RecordMonitor {
+    /**
+     * Names record types by value, with unrecognized types counted
+     * under the first
+     */
+    private static final String[] TYPE_NAMES = { "other", "begin_request",
+        "abort_request", "end_request", "params", "stdin", "stdout",
+        "stderr", "data", "get_values", "get_values_result",
+        "unknown_type" };
+
+    /**
+     * Names role types by value
+     */
+    private static final String[] ROLE_NAMES =
+        { null, "responder", "authorizer", "filter" };
+
+    /**
+     * Holds the timing histograms of one role.
+     */
+    static final class Timings {
+        /**
+         * Records the time from parameters being complete to the
+         * application starting.
+         */
+        final LatencyHistogram queue = new LatencyHistogram();
+
+        /**
+         * Records the time from the session starting to its first
+         * standard output reaching the record writer.
+         */
+        final LatencyHistogram firstByte = new LatencyHistogram();
+
+        /**
+         * Records the time from the session starting to its
+         * completion.
+         */
+        final LatencyHistogram duration = new LatencyHistogram();
+    }
+
+    private final Timings[] timings = new Timings[ROLE_NAMES.length];
+
+    private final LongAdder[] recordsIn = adders(TYPE_NAMES.length);
+
+    private final LongAdder[] bytesIn = adders(TYPE_NAMES.length);
+
+    private final LongAdder[] recordsOut = adders(TYPE_NAMES.length);
+
+    private final LongAdder[] bytesOut = adders(TYPE_NAMES.length);
+
+    private final LongAdder reads = new LongAdder();
+
+    private final LongAdder writes = new LongAdder();
+
+    private final LongAdder lockAcquisitions = new LongAdder();
+
+    private final LongAdder lockWait = new LongAdder();
+
+    private final LongAdder connections = new LongAdder();
+
+    private final LongAdder sessions = new LongAdder();
+
+    /**
+     * Reports pipe memory and spillage; or {@code null} if the pool
+     * does not
+     */
+    private final CachePipePool cache;
+
+    /**
+     * Create a set of metrics.
+     * 
+     * @param pipes the engine's source of pipes, whose usage is
+     * reported if it is a {@link CachePipePool}
+     */
+    EngineMetrics(PipePool pipes) {
+        this.cache = pipes instanceof CachePipePool c ? c : null;
+        for (int i = 1; i < timings.length; i++)
+            timings[i] = new Timings();
+    }
+
+    private static LongAdder[] adders(int n) {
+        LongAdder[] result = new LongAdder[n];
+        for (int i = 0; i < n; i++)
+            result[i] = new LongAdder();
+        return result;
+    }
+
+    private static int typeIndex(int type) {
+        return type > 0 && type < TYPE_NAMES.length ? type : 0;
+    }
+
+    /**
+     * Get the timing histograms of a role.
+     * 
+     * @param role the role type
+     * 
+     * @return the role's histograms
+     */
+    Timings timings(int role) {
+        return timings[role];
+    }
+
+    /**
+     * Note that a transport connection has opened.
+     */
+    void connectionOpened() {
+        connections.increment();
+    }
+
+    /**
+     * Note that a transport connection has closed.
+     */
+    void connectionClosed() {
+        connections.decrement();
+    }
+
+    /**
+     * Note that a session has started.
+     */
+    void sessionStarted() {
+        sessions.increment();
+    }
+
+    /**
+     * Note that a session has ended.
+     */
+    void sessionEnded() {
+        sessions.decrement();
+    }
+
+    @Override
+    public void received(int type, int contentLength) {
+        final int i = typeIndex(type);
+        recordsIn[i].increment();
+        bytesIn[i].add(contentLength);
+    }
+
+    @Override
+    public void sent(int type, int contentLength) {
+        final int i = typeIndex(type);
+        recordsOut[i].increment();
+        bytesOut[i].add(contentLength);
+    }
+
+    @Override
+    public void readCall(long amount) {
+        reads.increment();
+    }
+
+    @Override
+    public void writeCall(long amount) {
+        writes.increment();
+    }
+
+    @Override
+    public void lockAcquired(long nanos) {
+        lockAcquisitions.increment();
+        lockWait.add(nanos);
+    }
+
+    @Override
+    public long getActiveConnections() {
+        return connections.sum();
+    }
+
+    @Override
+    public long getActiveSessions() {
+        return sessions.sum();
+    }
+
+    private static Map<String, Long> byType(LongAdder[] counters) {
+        Map<String, Long> result = new LinkedHashMap<>();
+        for (int i = 0; i < counters.length; i++)
+            result.put(TYPE_NAMES[i], counters[i].sum());
+        return result;
+    }
+
+    private static long total(LongAdder[] counters) {
+        long sum = 0;
+        for (LongAdder c : counters)
+            sum += c.sum();
+        return sum;
+    }
+
+    @Override
+    public Map<String, Long> getRecordsReceived() {
+        return byType(recordsIn);
+    }
+
+    @Override
+    public Map<String, Long> getBytesReceived() {
+        return byType(bytesIn);
+    }
+
+    @Override
+    public Map<String, Long> getRecordsSent() {
+        return byType(recordsOut);
+    }
+
+    @Override
+    public Map<String, Long> getBytesSent() {
+        return byType(bytesOut);
+    }
+
+    @Override
+    public long getReadCalls() {
+        return reads.sum();
+    }
+
+    @Override
+    public long getWriteCalls() {
+        return writes.sum();
+    }
+
+    @Override
+    public double getReadCallsPerRecord() {
+        final long recs = total(recordsIn);
+        return recs == 0 ? 0.0 : (double) reads.sum() / recs;
+    }
+
+    @Override
+    public double getWriteCallsPerRecord() {
+        final long recs = total(recordsOut);
+        return recs == 0 ? 0.0 : (double) writes.sum() / recs;
+    }
+
+    @Override
+    public long getLockAcquisitions() {
+        return lockAcquisitions.sum();
+    }
+
+    @Override
+    public long getLockWaitNanos() {
+        return lockWait.sum();
+    }
+
+    @Override
+    public long getPipeMemoryBytes() {
+        return cache == null ? -1 : cache.memoryUsage();
+    }
+
+    @Override
+    public long getPipeSpilledBytes() {
+        return cache == null ? -1 : cache.spilledBytes();
+    }
+
+    @Override
+    public double[] getLatencyBoundsMillis() {
+        double[] result = new double[LatencyHistogram.BUCKETS - 1];
+        for (int i = 0; i < result.length; i++)
+            result[i] = LatencyHistogram.bound(i) / 1e6;
+        return result;
+    }
+
+    private Map<String, long[]>
+        byRole(Function<? super Timings, ? extends LatencyHistogram> field) {
+        Map<String, long[]> result = new LinkedHashMap<>();
+        for (int i = 1; i < timings.length; i++)
+            result.put(ROLE_NAMES[i], field.apply(timings[i]).counts());
+        return result;
+    }
+
+    @Override
+    public Map<String, long[]> getQueueTimes() {
+        return byRole(t -> t.queue);
+    }
+
+    @Override
+    public Map<String, long[]> getFirstByteTimes() {
+        return byRole(t -> t.firstByte);
+    }
+
+    @Override
+    public Map<String, long[]> getDurations() {
+        return byRole(t -> t.duration);
+    }
+
+    /**
+     * Write all metrics in the Prometheus text exposition format.
+     * 
+     * @param out the destination
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    void writePrometheus(Appendable out) throws IOException {
+        gauge(out, "fastcgi_connections", "Open transport connections",
+              connections.sum());
+        gauge(out, "fastcgi_sessions", "Sessions in progress",
+              sessions.sum());
+        byType(out, "fastcgi_records_received_total",
+               "Records received by type", recordsIn);
+        byType(out, "fastcgi_bytes_received_total",
+               "Content bytes received by record type", bytesIn);
+        byType(out, "fastcgi_records_sent_total", "Records sent by type",
+               recordsOut);
+        byType(out, "fastcgi_bytes_sent_total",
+               "Content bytes sent by record type", bytesOut);
+        counter(out, "fastcgi_read_calls_total", "Transport read operations",
+                reads.sum());
+        counter(out, "fastcgi_write_calls_total",
+                "Transport write operations", writes.sum());
+        counter(out, "fastcgi_writer_lock_acquisitions_total",
+                "Record-writer lock acquisitions", lockAcquisitions.sum());
+        counter(out, "fastcgi_writer_lock_wait_seconds_total",
+                "Time waiting for record-writer locks", lockWait.sum() / 1e9);
+        if (cache != null) {
+            gauge(out, "fastcgi_pipe_memory_bytes",
+                  "Request content held in RAM", cache.memoryUsage());
+            counter(out, "fastcgi_pipe_spilled_bytes_total",
+                    "Request content written to files", cache.spilledBytes());
+        }
+        histogram(out, "fastcgi_session_queue_seconds",
+                  "Time from parameters to application start", t -> t.queue);
+        histogram(out, "fastcgi_session_first_byte_seconds",
+                  "Time from session start to first output record",
+                  t -> t.firstByte);
+        histogram(out, "fastcgi_session_duration_seconds",
+                  "Time from session start to completion", t -> t.duration);
+    }
+
+    private static void header(Appendable out, String name, String help,
+                               String type)
+        throws IOException {
+        out.append("# HELP ").append(name).append(' ').append(help)
+            .append('\n');
+        out.append("# TYPE ").append(name).append(' ').append(type)
+            .append('\n');
+    }
+
+    private static void gauge(Appendable out, String name, String help,
+                              double value)
+        throws IOException {
+        header(out, name, help, "gauge");
+        out.append(name).append(' ').append(format(value)).append('\n');
+    }
+
+    private static void counter(Appendable out, String name, String help,
+                                double value)
+        throws IOException {
+        header(out, name, help, "counter");
+        out.append(name).append(' ').append(format(value)).append('\n');
+    }
+
+    private static void byType(Appendable out, String name, String help,
+                               LongAdder[] counters)
+        throws IOException {
+        header(out, name, help, "counter");
+        for (int i = 0; i < counters.length; i++)
+            out.append(name).append("{type=\"").append(TYPE_NAMES[i])
+                .append("\"} ").append(Long.toString(counters[i].sum()))
+                .append('\n');
+    }
+
+    private void histogram(Appendable out, String name, String help,
+                           Function<? super Timings,
+                                    ? extends LatencyHistogram> field)
+        throws IOException {
+        header(out, name, help, "histogram");
+        for (int r = 1; r < timings.length; r++) {
+            final String role = ROLE_NAMES[r];
+            final LatencyHistogram hist = field.apply(timings[r]);
+            final long[] counts = hist.counts();
+            long cumul = 0;
+            for (int i = 0; i < counts.length; i++) {
+                cumul += counts[i];
+                final String le = i < counts.length - 1 ?
+                    format(LatencyHistogram.bound(i) / 1e9) : "+Inf";
+                out.append(name).append("_bucket{role=\"").append(role)
+                    .append("\",le=\"").append(le).append("\"} ")
+                    .append(Long.toString(cumul)).append('\n');
+            }
+            out.append(name).append("_sum{role=\"").append(role)
+                .append("\"} ").append(format(hist.totalNanos() / 1e9))
+                .append('\n');
+            out.append(name).append("_count{role=\"").append(role)
+                .append("\"} ").append(Long.toString(cumul)).append('\n');
+        }
+    }
+
+    private static String format(double value) {
+        if (value == Math.rint(value) && Math.abs(value) < 1e15)
+            return Long.toString((long) value);
+        return Double.toString(value);
+    }
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.Map;
+
+/**
+ * Exposes cumulative counters and gauges of an engine's activity for
+ * monitoring. Record counts are keyed by lower-case record-type name,
+ * such as <samp>stdout</samp>. Timings are keyed by lower-case role
+ * name, such as <samp>responder</samp>, and are histograms whose
+ * buckets are bounded by {@link #getLatencyBoundsMillis()}.
+ * 
+ * @author simpsons
+ */
+public interface EngineMetricsMXBean {
+    /**
+     * Get the number of transport connections currently open.
+     * 
+     * @return the number of open connections
+     */
+    long getActiveConnections();
+
+    /**
+     * Get the number of sessions currently in progress.
+     * 
+     * @return the number of live sessions
+     */
+    long getActiveSessions();
+
+    /**
+     * Get the number of records received by type.
+     * 
+     * @return the total number of records received of each type
+     */
+    Map<String, Long> getRecordsReceived();
+
+    /**
+     * Get the number of content bytes received by record type.
+     * 
+     * @return the total content length received of each type
+     */
+    Map<String, Long> getBytesReceived();
+
+    /**
+     * Get the number of records sent by type.
+     * 
+     * @return the total number of records sent of each type
+     */
+    Map<String, Long> getRecordsSent();
+
+    /**
+     * Get the number of content bytes sent by record type.
+     * 
+     * @return the total content length sent of each type
+     */
+    Map<String, Long> getBytesSent();
+
+    /**
+     * Get the number of read operations invoked on transport
+     * connections.
+     * 
+     * @return the total number of reads
+     */
+    long getReadCalls();
+
+    /**
+     * Get the number of write operations invoked on transport
+     * connections.
+     * 
+     * @return the total number of writes
+     */
+    long getWriteCalls();
+
+    /**
+     * Get the mean number of read operations per record received.
+     * 
+     * @return the ratio of reads to received records
+     */
+    double getReadCallsPerRecord();
+
+    /**
+     * Get the mean number of write operations per record sent.
+     * Coalescing records from several sessions brings this below one.
+     * 
+     * @return the ratio of writes to sent records
+     */
+    double getWriteCallsPerRecord();
+
+    /**
+     * Get the number of times that a record writer's transmission lock
+     * or flushing role has been acquired.
+     * 
+     * @return the total number of acquisitions
+     */
+    long getLockAcquisitions();
+
+    /**
+     * Get the time spent waiting to acquire record writers'
+     * transmission locks or flushing roles.
+     * 
+     * @return the total wait in nanoseconds
+     */
+    long getLockWaitNanos();
+
+    /**
+     * Get the amount of RAM holding request content in pipes.
+     * 
+     * @return the number of bytes in memory; or -1 if the pipe pool
+     * does not report it
+     */
+    long getPipeMemoryBytes();
+
+    /**
+     * Get the amount of request content that pipes have written to
+     * files.
+     * 
+     * @return the total number of bytes spilled; or -1 if the pipe pool
+     * does not report it
+     */
+    long getPipeSpilledBytes();
+
+    /**
+     * Get the upper bounds of the timing histograms' buckets, except
+     * the last, which is unbounded.
+     * 
+     * @return the bounds in milliseconds
+     */
+    double[] getLatencyBoundsMillis();
+
+    /**
+     * Get histograms of the time that sessions wait to run after their
+     * parameters are complete, including admission.
+     * 
+     * @return the bucket counts for each role
+     */
+    Map<String, long[]> getQueueTimes();
+
+    /**
+     * Get histograms of the time from the start of each session to its
+     * first standard output reaching the record writer.
+     * 
+     * @return the bucket counts for each role
+     */
+    Map<String, long[]> getFirstByteTimes();
+
+    /**
+     * Get histograms of the time from the start of each session to its
+     * completion.
+     * 
+     * @return the bucket counts for each role
+     */
+    Map<String, long[]> getDurations();
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.net.InetSocketAddress;
+import java.nio.charset.Charset;
+import uk.ac.lancs.fastcgi.AsyncResponder;
+import uk.ac.lancs.fastcgi.Authorizer;
+import uk.ac.lancs.fastcgi.Filter;
+import uk.ac.lancs.fastcgi.Responder;
+import uk.ac.lancs.fastcgi.engine.Scheduling;
+import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.engine.util.PipePool;
+
+/**
+ * Gathers the parameters of a {@link MultiplexGenericEngine}. Each
+ * setter returns this object, so that calls can be chained. The engine
+ * takes its own copy of each value when it is created, so the same
+ * object may be used for several engines.
+ *
+ * @author simpsons
+ */
+final class EngineParameters {
+    Charset charset = Charset.defaultCharset();
+
+    Responder responder;
+
+    AsyncResponder asyncResponder;
+
+    Authorizer authorizer;
+
+    DecisionCache decisions;
+
+    Filter filter;
+
+    int maxConns;
+
+    int maxReqsPerConn;
+
+    int maxReqs;
+
+    int stdoutBufferSize = 1024;
+
+    int stderrBufferSize = 1024;
+
+    Scheduling scheduling = Scheduling.POOLED;
+
+    int queueCapacity;
+
+    long budgetMillis = 1000;
+
+    PipePool pipePool;
+
+    long sessionInputLimit;
+
+    long connInputLimit;
+
+    long inputLimit;
+
+    boolean shedding;
+
+    InetSocketAddress metricsAddress;
+
+    /**
+     * Set the character encoding for handling parameters from the
+     * server, application variable names and values, and response
+     * headers.
+     * 
+     * @param charset the character encoding
+     * 
+     * @return this object
+     * 
+     * @default {@link Charset#defaultCharset()}
+     */
+    EngineParameters charset(Charset charset) {
+        this.charset = charset;
+        return this;
+    }
+
+    /**
+     * Set the object to handle responder requests.
+     * 
+     * @param responder the responder; or {@code null} if not required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters responder(Responder responder) {
+        this.responder = responder;
+        return this;
+    }
+
+    /**
+     * Set the object to handle responder requests asynchronously, in
+     * preference to {@link #responder(Responder)}.
+     * 
+     * @param asyncResponder the responder; or {@code null} if not
+     * required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters asyncResponder(AsyncResponder asyncResponder) {
+        this.asyncResponder = asyncResponder;
+        return this;
+    }
+
+    /**
+     * Set the object to handle authorizer requests.
+     * 
+     * @param authorizer the authorizer; or {@code null} if not required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters authorizer(Authorizer authorizer) {
+        this.authorizer = authorizer;
+        return this;
+    }
+
+    /**
+     * Set the cache of authorizer decisions.
+     * 
+     * @param decisions the cache; or {@code null} if not required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters decisions(DecisionCache decisions) {
+        this.decisions = decisions;
+        return this;
+    }
+
+    /**
+     * Set the object to handle filter requests.
+     * 
+     * @param filter the filter; or {@code null} if not required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters filter(Filter filter) {
+        this.filter = filter;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of connections to offer to the server.
+     * 
+     * @param maxConns the maximum; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters maxConns(int maxConns) {
+        this.maxConns = maxConns;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of requests to handle simultaneously per
+     * connection.
+     * 
+     * @param maxReqsPerConn the maximum; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters maxReqsPerConn(int maxReqsPerConn) {
+        this.maxReqsPerConn = maxReqsPerConn;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of simultaneous requests to offer to the
+     * server, enforced across all connections.
+     * 
+     * @param maxReqs the maximum; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters maxReqs(int maxReqs) {
+        this.maxReqs = maxReqs;
+        return this;
+    }
+
+    /**
+     * Set the default output buffer size.
+     * 
+     * @param stdoutBufferSize the size in bytes
+     * 
+     * @return this object
+     * 
+     * @default {@code 1024}
+     */
+    EngineParameters stdoutBufferSize(int stdoutBufferSize) {
+        this.stdoutBufferSize = stdoutBufferSize;
+        return this;
+    }
+
+    /**
+     * Set the standard error output buffer size.
+     * 
+     * @param stderrBufferSize the size in bytes
+     * 
+     * @return this object
+     * 
+     * @default {@code 1024}
+     */
+    EngineParameters stderrBufferSize(int stderrBufferSize) {
+        this.stderrBufferSize = stderrBufferSize;
+        return this;
+    }
+
+    /**
+     * Set the means of executing sessions.
+     * 
+     * @param scheduling the means of execution
+     * 
+     * @return this object
+     * 
+     * @default {@link Scheduling#POOLED}
+     */
+    EngineParameters scheduling(Scheduling scheduling) {
+        this.scheduling = scheduling;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of sessions that may wait for admission
+     * when the maximum number of simultaneous requests is reached.
+     * 
+     * @param queueCapacity the maximum number of waiting sessions
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters queueCapacity(int queueCapacity) {
+        this.queueCapacity = queueCapacity;
+        return this;
+    }
+
+    /**
+     * Set the longest time that a session may wait for admission.
+     * 
+     * @param budgetMillis the time in milliseconds
+     * 
+     * @return this object
+     * 
+     * @default {@code 1000}
+     */
+    EngineParameters budgetMillis(long budgetMillis) {
+        this.budgetMillis = budgetMillis;
+        return this;
+    }
+
+    /**
+     * Set the source of pipes carrying request content to
+     * applications.
+     * 
+     * @param pipePool the source of pipes
+     * 
+     * @return this object
+     * 
+     * @default A {@link CachePipePool} with default parameters is
+     * created for each engine.
+     */
+    EngineParameters pipePool(PipePool pipePool) {
+        this.pipePool = pipePool;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of bytes of request content held for a
+     * session but not yet consumed.
+     * 
+     * @param sessionInputLimit the limit; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters sessionInputLimit(long sessionInputLimit) {
+        this.sessionInputLimit = sessionInputLimit;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of bytes of request content held for all
+     * sessions of a connection but not yet consumed.
+     * 
+     * @param connInputLimit the limit; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters connInputLimit(long connInputLimit) {
+        this.connInputLimit = connInputLimit;
+        return this;
+    }
+
+    /**
+     * Set the maximum number of bytes of request content held for all
+     * sessions but not yet consumed.
+     * 
+     * @param inputLimit the limit; or zero if unlimited
+     * 
+     * @return this object
+     * 
+     * @default {@code 0}
+     */
+    EngineParameters inputLimit(long inputLimit) {
+        this.inputLimit = inputLimit;
+        return this;
+    }
+
+    /**
+     * Set how a session exceeding its input limit is treated.
+     * 
+     * @param shedding {@code true} if the session is to be aborted;
+     * {@code false} if its connection is to stop reading until the
+     * application catches up
+     * 
+     * @return this object
+     * 
+     * @default {@code false}
+     */
+    EngineParameters shedding(boolean shedding) {
+        this.shedding = shedding;
+        return this;
+    }
+
+    /**
+     * Set the address on which to serve metrics in the Prometheus text
+     * format.
+     * 
+     * @param metricsAddress the address; or {@code null} if not
+     * required
+     * 
+     * @return this object
+     * 
+     * @default {@code null}
+     */
+    EngineParameters metricsAddress(InetSocketAddress metricsAddress) {
+        this.metricsAddress = metricsAddress;
+        return this;
+    }
+
+    /**
+     * Get the source of pipes, creating a default one if none has been
+     * set.
+     * 
+     * @return the source of pipes
+     */
+    PipePool pipes() {
+        return pipePool != null ? pipePool : CachePipePool.start().create();
+    }
+}
@@ -123,4 +123,10 @@ class FilterHandler extends AbstractHandler implements FilterContext {
     public InputStream data() {
         return dataPipe.getInputStream();
     }
+
+    @Override
+    void discardInput() {
+        discard(stdinPipe);
+        discard(dataPipe);
+    }
 }
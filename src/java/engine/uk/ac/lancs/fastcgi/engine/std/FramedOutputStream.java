@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.IOException;
+import java.io.OutputStream;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
+import uk.ac.lancs.fastcgi.proto.serial.RecordWriter;
+
+/**
+ * Buffers standard output in an array with a slot reserved for a
+ * record header, so that each flush hands one complete record to the
+ * connection without copying. The array is taken from the pool of the
+ * record writer, and passes to the writer with each flushed record, so
+ * a new one is taken for subsequent content. An array still held when
+ * the stream is closed is returned to the pool. Writes too big to
+ * buffer, and closure, are passed to an unbuffered stream of records.
+ *
+ * @author simpsons
+ */
+class FramedOutputStream extends OutputStream {
+    private final OutputStream out;
+
+    private final RecordWriter recordsOut;
+
+    private final int id;
+
+    private final BufferPool pool;
+
+    private final int headerLength;
+
+    private final int capacity;
+
+    private final Runnable starting;
+
+    private byte[] buf;
+
+    private int count = 0;
+
+    private boolean closed = false;
+
+    /**
+     * Create a framing output stream.
+     * 
+     * @param out the unbuffered stream of records, to which large
+     * writes and closure are passed
+     * 
+     * @param recordsOut the means to write framed records
+     * 
+     * @param id the request id
+     * 
+     * @param pool the pool to obtain buffers from, which must be the
+     * one that the record writer releases them to
+     * 
+     * @param capacity the number of content bytes to buffer, which
+     * must be positive, and is reduced to the optimum record payload if
+     * greater
+     * 
+     * @param starting an action to take before each buffered record is
+     * passed to the record writer
+     */
+    public FramedOutputStream(OutputStream out, RecordWriter recordsOut,
+                              int id, BufferPool pool, int capacity,
+                              Runnable starting) {
+        this.out = out;
+        this.recordsOut = recordsOut;
+        this.id = id;
+        this.pool = pool;
+        this.headerLength = recordsOut.headerLength();
+        this.capacity =
+            Integer.min(capacity, recordsOut.optimumPayloadLength());
+        this.starting = starting;
+    }
+
+    private void ensureBuffer() throws IOException {
+        if (buf != null) return;
+        if (closed) throw new IOException("closed");
+        buf = pool.allocate(recordsOut.framedBufferLength(capacity));
+    }
+
+    private void flushBuffer() throws IOException {
+        if (count > 0) {
+            /* The array now belongs to the writer, even if it fails. */
+            final byte[] rec = buf;
+            final int len = count;
+            buf = null;
+            count = 0;
+            starting.run();
+            recordsOut.writeFramedStdout(id, rec, len);
+        }
+    }
+
+    @Override
+    public void write(int b) throws IOException {
+        if (count >= capacity) flushBuffer();
+        ensureBuffer();
+        buf[headerLength + count++] = (byte) b;
+    }
+
+    @Override
+    public void write(byte[] b, int off, int len) throws IOException {
+        if (closed) throw new IOException("closed");
+        if (len >= capacity) {
+            /* The buffer would not help, so write directly. */
+            flushBuffer();
+            out.write(b, off, len);
+            return;
+        }
+        if (len > capacity - count) flushBuffer();
+        ensureBuffer();
+        System.arraycopy(b, off, buf, headerLength + count, len);
+        count += len;
+    }
+
+    @Override
+    public void flush() throws IOException {
+        flushBuffer();
+        out.flush();
+    }
+
+    @Override
+    public void close() throws IOException {
+        if (closed) return;
+        try {
+            flush();
+        } finally {
+            try {
+                out.close();
+            } finally {
+                if (buf != null) pool.release(buf);
+                buf = null;
+                closed = true;
+            }
+        }
+    }
+}
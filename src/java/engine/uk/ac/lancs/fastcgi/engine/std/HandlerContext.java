@@ -38,10 +38,14 @@ package uk.ac.lancs.fastcgi.engine.std;
 
 import java.nio.charset.Charset;
 import java.util.concurrent.Executor;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
 import uk.ac.lancs.fastcgi.proto.serial.RecordWriter;
 
 /**
  * Provides context for initializing all kinds of session handlers.
+ * Contexts are created by a {@link Builder}, which a connection
+ * configures once with its own details, and then completes for each
+ * session.
  *
  * @author simpsons
  */
@@ -66,64 +70,241 @@ class HandlerContext {
 
     final Charset charset;
 
-    final BufferPool paramBufs;
+    final BufferPool buffers;
+
+    final ResponseHeaderEncoder headerEncoder;
 
     final int stdoutBufferSize;
 
     final int stderrBufferSize;
 
+    final EngineMetrics.Timings timings;
+
+    private HandlerContext(Builder builder) {
+        this.connId = builder.connId;
+        this.id = builder.id;
+        this.impl = builder.impl;
+        this.connDescr = builder.connDescr;
+        this.intConnDescr = builder.intConnDescr;
+        this.connAbort = builder.connAbort;
+        this.cleanUp = builder.cleanUp;
+        this.recordsOut = builder.recordsOut;
+        this.executor = builder.executor;
+        this.charset = builder.charset;
+        this.buffers = builder.buffers;
+        this.headerEncoder = builder.headerEncoder;
+        this.stdoutBufferSize = builder.stdoutBufferSize;
+        this.stderrBufferSize = builder.stderrBufferSize;
+        this.timings = builder.timings;
+    }
+
     /**
+     * Builds session contexts in stages. A builder may be used to
+     * create several contexts, but only by one thread at a time.
+     */
+    static final class Builder {
+        private int connId;
+
+        private int id;
+
+        private Package impl;
+
+        private String connDescr;
+
+        private String intConnDescr;
+
+        private Runnable connAbort;
+
+        private Runnable cleanUp;
+
+        private RecordWriter recordsOut;
+
+        private Executor executor;
+
+        private Charset charset;
+
+        private BufferPool buffers;
+
+        private ResponseHeaderEncoder headerEncoder;
+
+        private int stdoutBufferSize;
+
+        private int stderrBufferSize;
+
+        private EngineMetrics.Timings timings;
+
+        private Builder() {}
+
+        /**
+         * Identify the transport connection.
+         * 
+         * @param connId the internal transport connection id
+         * 
+         * @param impl the implementation of the transport connection
+         * 
+         * @param connDescr a textual description of the transport
+         * connection
+         * 
+         * @param intConnDescr sensitive parts of the textual
+         * description of the transport connection
+         * 
+         * @return this object
+         */
+        Builder connection(int connId, Package impl, String connDescr,
+                           String intConnDescr) {
+            this.connId = connId;
+            this.impl = impl;
+            this.connDescr = connDescr;
+            this.intConnDescr = intConnDescr;
+            return this;
+        }
+
+        /**
+         * Set the action to take if the transport is disrupted.
+         * 
+         * @param connAbort the action
+         * 
+         * @return this object
+         */
+        Builder connAbort(Runnable connAbort) {
+            this.connAbort = connAbort;
+            return this;
+        }
+
+        /**
+         * Set the means to write FastCGI records to the transport
+         * connection.
+         * 
+         * @param recordsOut the record writer
+         * 
+         * @return this object
+         */
+        Builder recordsOut(RecordWriter recordsOut) {
+            this.recordsOut = recordsOut;
+            return this;
+        }
+
+        /**
+         * Set the character encoding for the standard error output and
+         * the response headers.
+         * 
+         * @param charset the character encoding
+         * 
+         * @return this object
+         */
+        Builder charset(Charset charset) {
+            this.charset = charset;
+            return this;
+        }
+
+        /**
+         * Set the pool of buffers for reading in request parameters and
+         * buffering standard output.
+         * 
+         * @param buffers the buffer pool
+         * 
+         * @return this object
+         */
+        Builder buffers(BufferPool buffers) {
+            this.buffers = buffers;
+            return this;
+        }
+
+        /**
+         * Set the serializer of response headers.
+         * 
+         * @param headerEncoder the serializer
+         * 
+         * @return this object
+         */
+        Builder headerEncoder(ResponseHeaderEncoder headerEncoder) {
+            this.headerEncoder = headerEncoder;
+            return this;
+        }
+
+        /**
+         * Set the output buffer sizes.
+         * 
+         * @param stdoutBufferSize the default buffer size for standard
+         * output
+         * 
+         * @param stderrBufferSize the buffer size of standard error
+         * output
+         * 
+         * @return this object
+         */
+        Builder bufferSizes(int stdoutBufferSize, int stderrBufferSize) {
+            this.stdoutBufferSize = stdoutBufferSize;
+            this.stderrBufferSize = stderrBufferSize;
+            return this;
+        }
+
+        /**
+         * Set the session id.
+         * 
+         * @param id the session id
+         * 
+         * @return this object
+         */
+        Builder session(int id) {
+            this.id = id;
+            return this;
+        }
+
+        /**
+         * Set the action to take when the session is complete.
+         * 
+         * @param cleanUp the action
+         * 
+         * @return this object
+         */
+        Builder cleanUp(Runnable cleanUp) {
+            this.cleanUp = cleanUp;
+            return this;
+        }
+
+        /**
+         * Set the means to execute the application.
+         * 
+         * @param executor the executor
+         * 
+         * @return this object
+         */
+        Builder executor(Executor executor) {
+            this.executor = executor;
+            return this;
+        }
+
+        /**
+         * Set the histograms recording the session's timings.
+         * 
+         * @param timings the histograms
+         * 
+         * @return this object
+         */
+        Builder timings(EngineMetrics.Timings timings) {
+            this.timings = timings;
+            return this;
+        }
+
+        /**
+         * Create a context with the current parameters.
+         * 
+         * @return the new context
+         */
+        HandlerContext create() {
+            return new HandlerContext(this);
+        }
+    }
+
+    /**
+     * Prepare to create session contexts.
      * 
-     * @param connId the internal transport connection id
-     * 
-     * @param id the session id
-     * 
-     * @param impl the implementation of the transport connection
-     * 
-     * @param connDescr a textual description of the transport
-     * connection
-     * 
-     * @param intConnDescr sensitive parts of the textual description of
-     * the transport connection
-     * 
-     * @param connAbort an action to take if the transport is disrupted
-     * 
-     * @param cleanUp an action to take when the session is complete
-     * 
-     * @param recordsOut a means to write FastCGI records to the
-     * transport connection
-     * 
-     * @param executor a means to execute the application
-     * 
-     * @param charset the character encoding for the standard error
-     * output and the response headers
-     * 
-     * @param paramBufs a pool of buffers for reading in request
-     * parameters
-     * 
-     * @param stdoutBufferSize the default buffer size for standard
-     * output
+     * @return a builder with no parameters set
      * 
-     * @param stderrBufferSize the buffer size of standard error output
+     * @constructor
      */
-    public HandlerContext(int connId, int id, Package impl, String connDescr,
-                          String intConnDescr, Runnable connAbort,
-                          Runnable cleanUp, RecordWriter recordsOut,
-                          Executor executor, Charset charset,
-                          BufferPool paramBufs, int stdoutBufferSize,
-                          int stderrBufferSize) {
-        this.connId = connId;
-        this.id = id;
-        this.impl = impl;
-        this.connDescr = connDescr;
-        this.intConnDescr = intConnDescr;
-        this.connAbort = connAbort;
-        this.cleanUp = cleanUp;
-        this.recordsOut = recordsOut;
-        this.executor = executor;
-        this.charset = charset;
-        this.paramBufs = paramBufs;
-        this.stdoutBufferSize = stdoutBufferSize;
-        this.stderrBufferSize = stderrBufferSize;
+    static Builder start() {
+        return new Builder();
     }
 }
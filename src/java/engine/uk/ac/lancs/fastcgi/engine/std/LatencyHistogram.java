@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.concurrent.atomic.LongAdder;
+
+/**
+ * Counts durations in exponentially sized buckets. Bucket <var>i</var>
+ * counts durations less than {@link #bound(int)}, and at least the
+ * previous bucket's bound. The last bucket has no bound. Recording is
+ * lock-free, and cheap under contention.
+ *
+ * @author simpsons
+ */
+final class LatencyHistogram {
+    /**
+     * The number of buckets, namely {@value}, including the unbounded
+     * one
+     */
+    static final int BUCKETS = 24;
+
+    /**
+     * The bound of the first bucket in nanoseconds, namely {@value}
+     */
+    private static final long FIRST_BOUND = 16_000;
+
+    private final LongAdder[] counts = new LongAdder[BUCKETS];
+
+    private final LongAdder total = new LongAdder();
+
+    /**
+     * Create an empty histogram.
+     */
+    LatencyHistogram() {
+        for (int i = 0; i < BUCKETS; i++)
+            counts[i] = new LongAdder();
+    }
+
+    /**
+     * Get the exclusive upper bound of a bucket.
+     * 
+     * @param i the bucket index, less than {@link #BUCKETS} - 1
+     * 
+     * @return the bucket's bound in nanoseconds
+     */
+    static long bound(int i) {
+        return FIRST_BOUND << i;
+    }
+
+    /**
+     * Record a duration.
+     * 
+     * @param nanos the duration in nanoseconds
+     */
+    void record(long nanos) {
+        if (nanos < 0) nanos = 0;
+        final int i = 64 - Long.numberOfLeadingZeros(nanos / FIRST_BOUND);
+        counts[Integer.min(i, BUCKETS - 1)].increment();
+        total.add(nanos);
+    }
+
+    /**
+     * Get the number of durations recorded in each bucket.
+     * 
+     * @return an array of {@link #BUCKETS} counts
+     */
+    long[] counts() {
+        long[] result = new long[BUCKETS];
+        for (int i = 0; i < BUCKETS; i++)
+            result[i] = counts[i].sum();
+        return result;
+    }
+
+    /**
+     * Get the sum of all recorded durations.
+     * 
+     * @return the total in nanoseconds
+     */
+    long totalNanos() {
+        return total.sum();
+    }
+}
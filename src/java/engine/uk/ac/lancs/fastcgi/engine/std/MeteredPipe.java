@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.FilterInputStream;
+import java.io.FilterOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.WritableByteChannel;
+import uk.ac.lancs.fastcgi.context.BufferReader;
+import uk.ac.lancs.fastcgi.engine.util.Pipe;
+
+/**
+ * Charges bytes written to a pipe to a session account, and credits
+ * them as they are read. Once the account has gone over its limit and
+ * its session has been shed, or once the reader has closed its stream,
+ * writes are silently discarded, and closing the stream credits what
+ * was left unread. Buffered
+ * reads are passed through if the pipe supports them, and are
+ * credited as each buffer is supplied.
+ *
+ * @author simpsons
+ */
+class MeteredPipe implements Pipe {
+    private final Pipe base;
+
+    private final ByteBudget.Account account;
+
+    private final OutputStream out;
+
+    private final InputStream in;
+
+    /**
+     * Counts bytes charged to the account by this pipe and not yet
+     * credited. This is guarded by {@code this}.
+     */
+    private long held = 0;
+
+    /**
+     * Records whether the reader has closed its stream. This is
+     * guarded by {@code this}.
+     */
+    private boolean released = false;
+
+    /**
+     * Meter a pipe.
+     * 
+     * @param base the pipe to be metered
+     * 
+     * @param account the account to charge and credit
+     */
+    public MeteredPipe(Pipe base, ByteBudget.Account account) {
+        this.base = base;
+        this.account = account;
+        this.out = new FilterOutputStream(base.getOutputStream()) {
+            @Override
+            public void write(int b) throws IOException {
+                if (account.discarding()) return;
+                synchronized (MeteredPipe.this) {
+                    if (released) return;
+                    super.out.write(b);
+                    charge(1);
+                }
+            }
+
+            @Override
+            public void write(byte[] b, int off, int len) throws IOException {
+                if (account.discarding()) return;
+                synchronized (MeteredPipe.this) {
+                    if (released) return;
+                    super.out.write(b, off, len);
+                    charge(len);
+                }
+            }
+        };
+        final InputStream baseIn = base.getInputStream();
+        this.in = baseIn instanceof BufferReader ?
+            new MeteredBufferInput(baseIn) : new MeteredInput(baseIn);
+    }
+
+    private void charge(long amount) {
+        assert Thread.holdsLock(this);
+        held += amount;
+        account.charge(amount);
+    }
+
+    private void credit(long amount) {
+        synchronized (this) {
+            held -= amount;
+        }
+        account.credit(amount);
+    }
+
+    /**
+     * Stop charging, and credit everything left unread.
+     */
+    private void release() {
+        final long amount;
+        synchronized (this) {
+            if (released) return;
+            released = true;
+            amount = held;
+            held = 0;
+        }
+        account.credit(amount);
+    }
+
+    /**
+     * Credits bytes as they are read from a pipe.
+     */
+    private class MeteredInput extends FilterInputStream {
+        MeteredInput(InputStream in) {
+            super(in);
+        }
+
+        @Override
+        public int read() throws IOException {
+            int c = super.read();
+            if (c >= 0) credit(1);
+            return c;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) throws IOException {
+            int c = super.read(b, off, len);
+            if (c > 0) credit(c);
+            return c;
+        }
+
+        @Override
+        public long skip(long n) throws IOException {
+            long c = super.skip(n);
+            if (c > 0) credit(c);
+            return c;
+        }
+
+        @Override
+        public void close() throws IOException {
+            try {
+                super.close();
+            } finally {
+                release();
+            }
+        }
+    }
+
+    /**
+     * Credits bytes as they are read from a pipe, including as buffers.
+     */
+    private class MeteredBufferInput extends MeteredInput
+        implements BufferReader {
+        private final BufferReader reader;
+
+        MeteredBufferInput(InputStream in) {
+            super(in);
+            this.reader = (BufferReader) in;
+        }
+
+        @Override
+        public ByteBuffer nextBuffer() throws IOException {
+            ByteBuffer buf = reader.nextBuffer();
+            if (buf != null) credit(buf.remaining());
+            return buf;
+        }
+
+        @Override
+        public void release() throws IOException {
+            reader.release();
+        }
+
+        @Override
+        public long transferTo(WritableByteChannel out) throws IOException {
+            long c = reader.transferTo(out);
+            if (c > 0) credit(c);
+            return c;
+        }
+    }
+
+    @Override
+    public OutputStream getOutputStream() {
+        return out;
+    }
+
+    @Override
+    public void abort(Throwable reason) {
+        base.abort(reason);
+    }
+
+    @Override
+    public InputStream getInputStream() {
+        return in;
+    }
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.BufferedReader;
+import java.io.IOException;
+import java.io.InputStreamReader;
+import java.io.OutputStream;
+import java.net.InetSocketAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
+import java.nio.charset.StandardCharsets;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+
+/**
+ * Serves an engine's metrics in the Prometheus text format over plain
+ * HTTP at <samp>/metrics</samp>. One daemon thread answers each
+ * request in turn, and closes the connection after it, which suits an
+ * occasional scraper. The thread ends when the endpoint is closed.
+ *
+ * @author simpsons
+ */
+final class MetricsEndpoint implements Runnable {
+    private final EngineMetrics metrics;
+
+    private final ServerSocket server;
+
+    /**
+     * Create an endpoint bound to an address, and start serving it.
+     * 
+     * @param metrics the metrics to serve
+     * 
+     * @param address the address to listen on
+     * 
+     * @throws IOException if the address could not be bound
+     */
+    MetricsEndpoint(EngineMetrics metrics, InetSocketAddress address)
+        throws IOException {
+        this.metrics = metrics;
+        this.server = new ServerSocket();
+        this.server.bind(address);
+        Thread t = new Thread(this, "metrics-" + address);
+        t.setDaemon(true);
+        t.start();
+    }
+
+    @Override
+    public void run() {
+        while (!server.isClosed()) {
+            try (Socket sock = server.accept()) {
+                sock.setSoTimeout(5000);
+                serve(sock);
+            } catch (IOException ex) {
+                logger.log(Level.FINE, "metrics request", ex);
+            }
+        }
+    }
+
+    /**
+     * Stop listening, so that the serving thread ends, and the address
+     * may be bound again. Failure is logged, but otherwise ignored.
+     */
+    void close() {
+        try {
+            server.close();
+        } catch (IOException ex) {
+            logger.log(Level.WARNING, "closing metrics endpoint", ex);
+        }
+    }
+
+    private void serve(Socket sock) throws IOException {
+        BufferedReader in = new BufferedReader(
+            new InputStreamReader(sock.getInputStream(),
+                                  StandardCharsets.US_ASCII));
+        final String request = in.readLine();
+        if (request == null) return;
+
+        /* Skip the request header. */
+        String line;
+        while ((line = in.readLine()) != null && !line.isEmpty())
+            ;
+
+        final String[] parts = request.split(" ");
+        final String status;
+        final StringBuilder body = new StringBuilder();
+        if (parts.length < 2 || !parts[0].equals("GET")) {
+            status = "405 Method Not Allowed";
+        } else if (!parts[1].equals("/metrics") &&
+            !parts[1].startsWith("/metrics?")) {
+            status = "404 Not Found";
+        } else {
+            status = "200 OK";
+            metrics.writePrometheus(body);
+        }
+
+        byte[] content = body.toString().getBytes(StandardCharsets.UTF_8);
+        String head = "HTTP/1.0 " + status + "\r\n"
+            + "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            + "Content-Length: " + content.length + "\r\n"
+            + "Connection: close\r\n\r\n";
+        OutputStream out = sock.getOutputStream();
+        out.write(head.getBytes(StandardCharsets.US_ASCII));
+        out.write(content);
+        out.flush();
+    }
+
+    private static final Logger logger =
+        Logger.getLogger(MetricsEndpoint.class.getPackageName());
+}
@@ -38,33 +38,52 @@ package uk.ac.lancs.fastcgi.engine.std;
 
 import java.io.IOException;
 import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.lang.management.ManagementFactory;
+import java.lang.reflect.Method;
+import java.net.InetSocketAddress;
+import java.nio.channels.GatheringByteChannel;
+import java.nio.channels.ReadableByteChannel;
 import java.nio.charset.Charset;
 import java.util.Collection;
 import java.util.HashMap;
+import java.util.List;
 import java.util.Map;
+import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.Executor;
+import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
+import java.util.concurrent.ForkJoinPool;
+import java.util.concurrent.ForkJoinWorkerThread;
 import java.util.concurrent.ThreadFactory;
 import java.util.concurrent.atomic.AtomicInteger;
-import java.util.function.Function;
+import java.util.concurrent.atomic.AtomicReference;
+import java.util.concurrent.locks.LockSupport;
 import java.util.function.Supplier;
 import java.util.logging.Level;
 import java.util.logging.Logger;
+import javax.management.JMException;
+import javax.management.ObjectName;
+import uk.ac.lancs.fastcgi.AsyncResponder;
 import uk.ac.lancs.fastcgi.Authorizer;
 import uk.ac.lancs.fastcgi.Filter;
 import uk.ac.lancs.fastcgi.Responder;
 import uk.ac.lancs.fastcgi.engine.Engine;
-import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.Scheduling;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
 import uk.ac.lancs.fastcgi.engine.util.Pipe;
+import uk.ac.lancs.fastcgi.engine.util.PipePool;
 import uk.ac.lancs.fastcgi.proto.ApplicationVariables;
 import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
 import uk.ac.lancs.fastcgi.proto.RequestFlags;
 import uk.ac.lancs.fastcgi.proto.RoleTypes;
+import uk.ac.lancs.fastcgi.proto.serial.BufferPool;
 import uk.ac.lancs.fastcgi.proto.serial.RecordHandler;
 import uk.ac.lancs.fastcgi.proto.serial.RecordReader;
 import uk.ac.lancs.fastcgi.proto.serial.RecordWriter;
 import uk.ac.lancs.fastcgi.transport.Connection;
+import uk.ac.lancs.fastcgi.transport.SelectableConnection;
 import uk.ac.lancs.fastcgi.transport.Transport;
 
 /**
@@ -80,8 +99,12 @@ class MultiplexGenericEngine implements Engine {
 
     private final Responder responder;
 
+    private final AsyncResponder asyncResponder;
+
     private final Authorizer authorizer;
 
+    private final DecisionCache decisions;
+
     private final Filter filter;
 
     private final int maxConns;
@@ -94,78 +117,382 @@ class MultiplexGenericEngine implements Engine {
 
     private final int stdoutBufferSize;
 
-    private final Supplier<? extends Pipe> pipes =
-        CachePipePool.start().create()::newPipe;
+    private final Supplier<? extends Pipe> pipes;
 
     private final ThreadGroup conntg = new ThreadGroup("connections");
 
+    /**
+     * Accounts for request content not yet consumed by applications;
+     * or {@code null} if no input limits apply
+     */
+    private final ByteBudget inputBudget;
+
+    private final long sessionInputLimit;
+
+    private final long connInputLimit;
+
+    private final boolean shedding;
+
     /**
      * Create an engine.
      * 
      * @param connections the supply of connections
      * 
-     * @param charset the character encoding for handling parameters
-     * from the server, application variable names and values, and
-     * response headers
+     * @param params the roles, limits and other parameters of the
+     * engine
+     */
+    public MultiplexGenericEngine(Transport connections,
+                                  EngineParameters params) {
+        final PipePool pipePool = params.pipes();
+        this.connections = connections;
+        this.pipes = pipePool::newPipe;
+        this.metrics = new EngineMetrics(pipePool);
+        this.sessionInputLimit = params.sessionInputLimit;
+        this.connInputLimit = params.connInputLimit;
+        this.shedding = params.shedding;
+        this.inputBudget = params.sessionInputLimit > 0 ||
+            params.connInputLimit > 0 || params.inputLimit > 0 ?
+                new ByteBudget(params.inputLimit) : null;
+        this.charset = params.charset;
+        this.headerEncoder = new ResponseHeaderEncoder(charset);
+        this.responder = params.responder;
+        this.asyncResponder = params.asyncResponder;
+        this.authorizer = params.authorizer;
+        this.decisions = params.decisions;
+        this.filter = params.filter;
+        this.maxConns = params.maxConns;
+        this.maxReqs = params.maxReqs;
+        this.maxReqsPerConn = params.maxReqsPerConn;
+        this.stdoutBufferSize = params.stdoutBufferSize;
+        this.stderrBufferSize = params.stderrBufferSize;
+        this.admission = maxReqs >= 1 ?
+            new AdmissionController(maxReqs, params.queueCapacity,
+                                    params.budgetMillis) :
+            null;
+        final InetSocketAddress metricsAddress = params.metricsAddress;
+        final Scheduling scheduling = params.scheduling;
+        final int engineId = engineIds.getAndIncrement();
+        this.admissionBean = admission == null ? null :
+            register(admission, "AdmissionController", engineId);
+        this.metricsBean = register(metrics, "EngineMetrics", engineId);
+        MetricsEndpoint endpoint = null;
+        if (metricsAddress != null) {
+            try {
+                endpoint = new MetricsEndpoint(metrics, metricsAddress);
+            } catch (IOException ex) {
+                logger.log(Level.WARNING, "could not serve metrics on "
+                    + metricsAddress, ex);
+            }
+        }
+        this.endpoint = endpoint;
+        AtomicInteger ctid = new AtomicInteger(0);
+        ThreadFactory conntf =
+            (r) -> new Thread(conntg, r, "ct-" + ctid.getAndIncrement());
+        final Executor virtual = scheduling == Scheduling.VIRTUAL ?
+            newVirtualExecutor() : null;
+        if (virtual != null) {
+            /* Connections and sessions each get a virtual thread, but
+             * no more connections are served at once than if each had
+             * a platform thread. */
+            this.sessionExecutor = virtual;
+            this.blockingExecutor = virtual;
+            this.connExecutor = maxConns >= 1 ?
+                new BoundedExecutor(virtual, maxConns) : virtual;
+        } else {
+            if (scheduling == Scheduling.SHARED) {
+                /* All sessions share one work-stealing pool. Sessions
+                 * that call blocking applications tell the pool so, so
+                 * that it can start workers to compensate. */
+                final int par = maxReqs >= 1 ? maxReqs :
+                    Runtime.getRuntime().availableProcessors();
+                final ForkJoinPool pool = new ForkJoinPool(par, fjp -> {
+                    ForkJoinWorkerThread t = ForkJoinPool
+                        .defaultForkJoinWorkerThreadFactory.newThread(fjp);
+                    t.setName("session-" + t.getPoolIndex());
+                    return t;
+                }, null, true);
+                this.sessionExecutor = pool;
+                this.blockingExecutor =
+                    task -> pool.execute(() -> runBlocking(task));
+            } else {
+                /* Each connection creates its own pool. */
+                this.sessionExecutor = null;
+                this.blockingExecutor = null;
+            }
+            this.connExecutor =
+                maxConns == 0 ? Executors.newCachedThreadPool(conntf) :
+                    Executors.newFixedThreadPool(maxConns, conntf);
+        }
+    }
+
+    /**
+     * Limits the number of sessions across all connections; or
+     * {@code null} if unlimited
+     */
+    private final AdmissionController admission;
+
+    /**
+     * Accumulates counters and timings of all connections and sessions
+     */
+    private final EngineMetrics metrics;
+
+    private static final AtomicInteger engineIds = new AtomicInteger(0);
+
+    /**
+     * Serves the metrics over HTTP; or {@code null} if not required,
+     * or the address could not be bound
+     */
+    private final MetricsEndpoint endpoint;
+
+    /**
+     * Identifies the registered {@link #admission} MBean; or
+     * {@code null} if not registered
+     */
+    private final ObjectName admissionBean;
+
+    /**
+     * Identifies the registered {@link #metrics} MBean; or
+     * {@code null} if not registered
+     */
+    private final ObjectName metricsBean;
+
+    /**
+     * Make part of an engine's state available for monitoring through
+     * the platform MBean server. Failure is logged, but otherwise
+     * ignored.
      * 
-     * @param responder the object to handle responder requests; or
-     * {@code null} if not required
+     * @param bean the object to register
      * 
-     * @param authorizer the object to handle authorizer requests; or
-     * {@code null} if not required
+     * @param type the type to include in the object name
      * 
-     * @param filter the object to handle filter requests; or
-     * {@code null} if not required
+     * @param engineId the engine's identifier to include in the object
+     * name
      * 
-     * @param maxConns the maximum number of connections to offer to the
-     * server; or {@code null} if unlimited
+     * @return the name under which the object was registered; or
+     * {@code null} if registration failed
+     */
+    private static ObjectName register(Object bean, String type,
+                                       int engineId) {
+        try {
+            ObjectName name = new ObjectName("uk.ac.lancs.fastcgi:type="
+                + type + ",name=engine-" + engineId);
+            ManagementFactory.getPlatformMBeanServer().registerMBean(bean,
+                                                                     name);
+            return name;
+        } catch (JMException | RuntimeException ex) {
+            logger.log(Level.WARNING, "could not register " + type + " MBean",
+                       ex);
+            return null;
+        }
+    }
+
+    /**
+     * Withdraw part of an engine's state from the platform MBean
+     * server. Failure is logged, but otherwise ignored.
      * 
-     * @param maxReqsPerConn the maximum number of requests to handle
-     * simultaneously per connection; or {@code null} if unlimited
+     * @param name the name under which the object was registered; or
+     * {@code null} if it was not
+     */
+    private static void unregister(ObjectName name) {
+        if (name == null) return;
+        try {
+            ManagementFactory.getPlatformMBeanServer().unregisterMBean(name);
+        } catch (JMException | RuntimeException ex) {
+            logger.log(Level.WARNING, "could not unregister " + name, ex);
+        }
+    }
+
+    private boolean closed = false;
+
+    /**
+     * {@inheritDoc}
      * 
-     * @param maxReqs the maximum number of simultaneous requests to
-     * offer to the server; or {@code null} if unlimited
+     * <p>
+     * The metrics endpoint, if any, stops listening, and the engine's
+     * MBeans are unregistered, so that another engine may take over the
+     * same address.
+     */
+    @Override
+    public synchronized void close() {
+        if (closed) return;
+        closed = true;
+        if (endpoint != null) endpoint.close();
+        unregister(admissionBean);
+        unregister(metricsBean);
+    }
+
+    /**
+     * Create an executor that starts a virtual thread for each task, if
+     * the runtime supports it. The method is invoked reflectively, so
+     * that the library can still be built and run on earlier
+     * runtimes.
      * 
-     * @param stdoutBufferSize the default output buffer size
+     * @return the new executor; or {@code null} if virtual threads are
+     * not supported
+     */
+    private static Executor newVirtualExecutor() {
+        try {
+            Method m = Executors.class
+                .getMethod("newVirtualThreadPerTaskExecutor");
+            return (Executor) m.invoke(null);
+        } catch (ReflectiveOperationException | RuntimeException ex) {
+            logger.log(Level.WARNING,
+                       "virtual threads unavailable; using pools", ex);
+            return null;
+        }
+    }
+
+    /**
+     * Executes sessions of all connections; or {@code null} if each
+     * connection creates its own pool
+     */
+    private final Executor sessionExecutor;
+
+    /**
+     * Executes sessions of all connections whose applications may
+     * block; or {@code null} if each connection creates its own pool
+     */
+    private final Executor blockingExecutor;
+
+    /**
+     * Run a task on a work-stealing pool as a blocking operation. The
+     * pool may then start another worker to maintain its parallelism
+     * while the task waits on I/O or the application.
      * 
-     * @param stderrBufferSize the standard error output buffer size
+     * @param task the task to run
      */
-    public MultiplexGenericEngine(Transport connections, Charset charset,
-                                  Responder responder, Authorizer authorizer,
-                                  Filter filter, int maxConns,
-                                  int maxReqsPerConn, int maxReqs,
-                                  int stdoutBufferSize, int stderrBufferSize) {
-        this.connections = connections;
-        this.charset = charset;
-        this.responder = responder;
-        this.authorizer = authorizer;
-        this.filter = filter;
-        this.maxConns = maxConns;
-        this.maxReqs = maxReqs;
-        this.maxReqsPerConn = maxReqsPerConn;
-        this.stdoutBufferSize = stdoutBufferSize;
-        this.stderrBufferSize = stderrBufferSize;
-        AtomicInteger ctid = new AtomicInteger(0);
-        ThreadFactory conntf =
-            (r) -> new Thread(conntg, r, "ct-" + ctid.getAndIncrement());
-        this.connExecutor =
-            maxConns == 0 ? Executors.newCachedThreadPool(conntf) :
-                Executors.newFixedThreadPool(maxConns, conntf);
+    private static void runBlocking(Runnable task) {
+        try {
+            ForkJoinPool.managedBlock(new ForkJoinPool.ManagedBlocker() {
+                private boolean done = false;
+
+                @Override
+                public boolean block() {
+                    task.run();
+                    done = true;
+                    return true;
+                }
+
+                @Override
+                public boolean isReleasable() {
+                    return done;
+                }
+            });
+        } catch (InterruptedException ex) {
+            /* The task doesn't throw this, but preserve the status
+             * anyway. */
+            Thread.currentThread().interrupt();
+        }
     }
 
     private final Executor connExecutor;
 
-    private final BufferPool paramBufs = new BufferPool();
+    /**
+     * Supplies buffers for reading and writing records, decoding
+     * parameters, and buffering standard output
+     */
+    private final BufferPool buffers = BufferPool.start().create();
+
+    private final ResponseHeaderEncoder headerEncoder;
 
-    @Override
-    public boolean process() throws IOException {
-        Connection conn = connections.nextConnection();
+    /**
+     * Records whether threads have been started to accept from the
+     * transport's secondary listeners.
+     */
+    private boolean acceptorsStarted = false;
+
+    /**
+     * Start a thread for each of the transport's listeners except the
+     * first, which is served by the caller of {@link #process()}.
+     */
+    private synchronized void startAcceptors() {
+        if (acceptorsStarted) return;
+        acceptorsStarted = true;
+        List<? extends Transport> listeners = connections.listeners();
+        for (int i = 1; i < listeners.size(); i++) {
+            final Transport source = listeners.get(i);
+            Thread t = new Thread(conntg, () -> {
+                try {
+                    while (accept(source))
+                        ;
+                } catch (IOException ex) {
+                    logger.log(Level.SEVERE, "listener failed", ex);
+                }
+            }, "acceptor-" + i);
+            t.setDaemon(true);
+            t.start();
+        }
+    }
+
+    /**
+     * Accept a connection from a source, and start serving it.
+     * 
+     * @param source the source of the connection
+     * 
+     * @return {@code false} if the source has no more connections;
+     * {@code true} otherwise
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    private boolean accept(Transport source) throws IOException {
+        Connection conn = source.nextConnection();
         if (conn == null) return false;
         ConnHandler ch = new ConnHandler(conn);
-        connExecutor.execute(ch);
+        handlers.add(ch);
+        if (draining) ch.drain();
+        if (!ch.startReactive()) connExecutor.execute(ch);
         return true;
     }
 
+    /**
+     * Holds the handlers of all open connections, so that they can be
+     * drained. It is also used as the monitor on which
+     * {@link #drain(long)} waits.
+     */
+    private final Set<ConnHandler> handlers = ConcurrentHashMap.newKeySet();
+
+    /**
+     * Records whether {@link #drain(long)} has been called
+     */
+    private volatile boolean draining = false;
+
+    /**
+     * {@inheritDoc}
+     * 
+     * <p>
+     * Connections accepted after this call, such as one that was
+     * already being accepted, are drained as soon as they are
+     * registered.
+     */
+    @Override
+    public boolean drain(long timeoutMillis) throws InterruptedException {
+        draining = true;
+        for (ConnHandler ch : handlers)
+            ch.drain();
+        final long deadline = System.currentTimeMillis() + timeoutMillis;
+        synchronized (handlers) {
+            long rem;
+            while (!handlers.isEmpty() &&
+                (rem = deadline - System.currentTimeMillis()) > 0)
+                handlers.wait(rem);
+            return handlers.isEmpty();
+        }
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * <p>
+     * If the transport has several listeners, the first call starts a
+     * thread to accept from each but the first, and this call accepts
+     * from the first.
+     */
+    @Override
+    public boolean process() throws IOException {
+        startAcceptors();
+        return accept(connections.listeners().get(0));
+    }
+
     private final AtomicInteger connIds = new AtomicInteger(0);
 
     private static int optimizeBufferSize(int requested, int recommended,
@@ -188,9 +515,6 @@ class MultiplexGenericEngine implements Engine {
     private class ConnHandler implements Runnable, RecordHandler {
         private final int id = connIds.getAndIncrement();
 
-        private final ThreadGroup sesstg =
-            new ThreadGroup(conntg, "sessions-" + id);
-
         private final Connection conn;
 
         private final RecordReader recordsIn;
@@ -199,41 +523,267 @@ class MultiplexGenericEngine implements Engine {
 
         private final Executor executor;
 
+        /**
+         * Executes sessions whose applications may block
+         */
+        private final Executor blockingExecutor;
+
         private final int optimizedBufferSize;
 
+        /**
+         * Holds the connection's details for the contexts of its
+         * sessions, which are completed as they begin
+         */
+        private final HandlerContext.Builder contexts;
+
+        /**
+         * Accounts for request content of this connection's sessions;
+         * or {@code null} if no input limits apply
+         */
+        private final ByteBudget budget;
+
         public ConnHandler(Connection conn) throws IOException {
             this.conn = conn;
-            this.recordsIn = new RecordReader(conn.input(), charset, this);
-            this.recordsOut = new RecordWriter(conn.output(), charset);
+            this.budget = inputBudget == null ? null :
+                inputBudget.connection(connInputLimit);
+            this.recordsIn = new RecordReader(conn.input(), charset, this,
+                                              buffers, metrics);
+            /* Prefer a gathering channel, so that each record is sent
+             * in a single operation without copying its content. If
+             * several sessions can share the connection, let them
+             * queue their records rather than contend to write. */
+            GatheringByteChannel channel = conn.outputChannel();
+            RecordWriter.Builder writer = RecordWriter.start();
+            if (channel != null)
+                writer.channel(channel);
+            else
+                writer.output(conn.output());
+            this.recordsOut = writer.charset(charset)
+                .coalesce(maxReqsPerConn != 1).buffers(buffers)
+                .monitor(metrics).create();
             this.optimizedBufferSize =
                 optimizeBufferSize(stdoutBufferSize,
                                    this.recordsOut.optimumPayloadLength(),
                                    this.recordsOut.alignment());
-            AtomicInteger intSessIds = new AtomicInteger(0);
-            ThreadFactory tf = r -> new Thread(sesstg, r, "session-" + id + "-"
-                + intSessIds.getAndIncrement());
-            this.executor = maxReqsPerConn >= 1 ?
-                Executors.newFixedThreadPool(maxReqsPerConn, tf) :
-                Executors.newCachedThreadPool(tf);
+            if (sessionExecutor != null) {
+                this.executor = sessionExecutor;
+                this.blockingExecutor = blockingExecutor;
+                this.ownExecutor = null;
+            } else {
+                ThreadGroup sesstg = new ThreadGroup(conntg, "sessions-" + id);
+                AtomicInteger intSessIds = new AtomicInteger(0);
+                ThreadFactory tf = r -> new Thread(sesstg, r, "session-" +
+                    id + "-" + intSessIds.getAndIncrement());
+                this.ownExecutor = maxReqsPerConn >= 1 ?
+                    Executors.newFixedThreadPool(maxReqsPerConn, tf) :
+                    Executors.newCachedThreadPool(tf);
+                this.executor = this.ownExecutor;
+                this.blockingExecutor = this.ownExecutor;
+            }
+            this.contexts = HandlerContext.start()
+                .connection(id, conn.implementation(), conn.description(),
+                            conn.internalDescription())
+                .connAbort(this::abortConnection).recordsOut(recordsOut)
+                .charset(charset).buffers(buffers)
+                .headerEncoder(headerEncoder)
+                .bufferSizes(optimizedBufferSize, stderrBufferSize);
+            metrics.connectionOpened();
         }
 
-        private final Map<Integer, SessionHandler> sessions =
-            new ConcurrentHashMap<>();
+        /**
+         * Holds the pool created for this connection alone; or
+         * {@code null} if sessions run on an engine-wide executor
+         */
+        private final ExecutorService ownExecutor;
+
+        /**
+         * Release the connection, and let the pool's threads terminate
+         * once their sessions are complete.
+         * 
+         * @throws IOException if an I/O error occurs
+         */
+        private void release() throws IOException {
+            if (!released) metrics.connectionClosed();
+            released = true;
+            try {
+                conn.close();
+            } finally {
+                recordsIn.release();
+                if (ownExecutor != null) ownExecutor.shutdown();
+                if (handlers.remove(this) && draining) {
+                    synchronized (handlers) {
+                        handlers.notifyAll();
+                    }
+                }
+            }
+        }
+
+        /**
+         * Stop accepting requests on this connection, and close it once
+         * it has no sessions.
+         */
+        void drain() {
+            keepGoing = false;
+            closeIfIdle();
+        }
+
+        /**
+         * Stop reading from the connection if it is draining and has no
+         * sessions, so that whichever thread is serving it sees
+         * end-of-file and releases it. Output remains open until then,
+         * so responses already queued are still delivered.
+         */
+        private void closeIfIdle() {
+            if (keepGoing || !sessions.isEmpty()) return;
+            try {
+                conn.shutdownInput();
+            } catch (IOException ex) {
+                logger.log(Level.FINE, "connection " + id, ex);
+            }
+        }
+
+        /**
+         * Records whether {@link #release()} has been called, so that
+         * the connection is only counted as closed once
+         */
+        private boolean released = false;
+
+        private final SessionTable<SessionHandler> sessions =
+            new SessionTable<>();
+
+        /**
+         * Remove a session from the table, and count it as ended if it
+         * was present.
+         * 
+         * @param id the session id
+         * 
+         * @return the removed session; or {@code null} if not present
+         */
+        private SessionHandler dropSession(int id) {
+            SessionHandler sess = sessions.remove(id);
+            if (sess != null) metrics.sessionEnded();
+            if (draining) closeIfIdle();
+            return sess;
+        }
 
         private volatile boolean keepGoing = true;
 
         @Override
         public void run() {
             try {
-                while ((keepGoing || !sessions.isEmpty()) &&
+                while ((keepGoing || !sessions.isEmpty()) && awaitBudget() &&
                     recordsIn.processRecord()) {
                     /* All work is done in processRecords(). */
                 }
-                conn.close();
+                recordsOut.flush();
+                release();
+            } catch (IOException ex) {
+                /* There was an error reading to or writing from the
+                 * connection. */
+                logger.log(Level.SEVERE, "connection " + id, ex);
+                try {
+                    release();
+                } catch (IOException sup) {
+                    ex.addSuppressed(sup);
+                }
+            }
+        }
+
+        /**
+         * Wait until this connection's sessions have consumed enough of
+         * their content to be within budget.
+         * 
+         * @return {@code true}
+         * 
+         * @throws InterruptedIOException if the thread was interrupted
+         * while waiting
+         */
+        private boolean awaitBudget() throws InterruptedIOException {
+            if (budget == null) return true;
+            final Thread self = Thread.currentThread();
+            while (budget.pauseUnlessClear(() -> LockSupport.unpark(self))) {
+                LockSupport.park(this);
+                if (Thread.interrupted())
+                    throw new InterruptedIOException("awaiting input budget");
+            }
+            return true;
+        }
+
+        private SelectableConnection selectable;
+
+        private ReadableByteChannel inputChannel;
+
+        /**
+         * Start waiting for the connection's input on the transport's
+         * shared threads, if it supports that. Records are processed on
+         * a connection thread only once they have arrived.
+         * 
+         * @return {@code true} if the connection is being served;
+         * {@code false} if it must be served by calling {@link #run()}
+         * 
+         * @throws IOException if an I/O error occurs
+         */
+        boolean startReactive() throws IOException {
+            if (!(conn instanceof SelectableConnection sc)) return false;
+            selectable = sc;
+            inputChannel = sc.inputChannel();
+            sc.whenReadable(this::dispatch);
+            return true;
+        }
+
+        /**
+         * Process newly available records on a connection thread.
+         * Handling records can block on pipes, spill files and writes to
+         * the server, so it must not hold up the transport's shared
+         * thread, which serves other connections too.
+         */
+        private void dispatch() {
+            connExecutor.execute(this::react);
+        }
+
+        /**
+         * Process all records currently available, and either wait for
+         * more or close the connection.
+         */
+        private void react() {
+            try {
+                if (recordsIn.processAvailable(inputChannel) &&
+                    (keepGoing || !sessions.isEmpty())) {
+                    /* Stop reading while over budget, and let the
+                     * sessions that bring us back within it re-arm the
+                     * connection. */
+                    if (budget == null ||
+                        !budget.pauseUnlessClear(this::rearm))
+                        selectable.whenReadable(this::dispatch);
+                    return;
+                }
+                recordsOut.flush();
+                release();
             } catch (IOException ex) {
                 /* There was an error reading to or writing from the
                  * connection. */
                 logger.log(Level.SEVERE, "connection " + id, ex);
+                try {
+                    release();
+                } catch (IOException sup) {
+                    ex.addSuppressed(sup);
+                }
+            }
+        }
+
+        /**
+         * Resume reading from the connection once back within budget.
+         */
+        private void rearm() {
+            try {
+                selectable.whenReadable(this::dispatch);
+            } catch (IOException ex) {
+                logger.log(Level.SEVERE, "connection " + id, ex);
+                try {
+                    release();
+                } catch (IOException sup) {
+                    ex.addSuppressed(sup);
+                }
             }
         }
 
@@ -281,6 +831,21 @@ class MultiplexGenericEngine implements Engine {
                 /* Proceed with this one, though! */
             }
 
+            if (sessions.get(id) != null) {
+                /* There must be no existing session. */
+                keepGoing = false;
+                logger.log(Level.SEVERE,
+                           () -> "server began existing request" + id);
+                return;
+            }
+
+            if (!supports(role)) {
+                /* We don't recognize the role. */
+                recordsOut.writeEndRequest(id, -3,
+                                           ProtocolStatuses.UNKNOWN_ROLE);
+                return;
+            }
+
             /* Detect temporary overload based on the configured maximum
              * requests per connection. */
             if (maxReqsPerConn > 0 && sessions.size() >= maxReqsPerConn) {
@@ -291,54 +856,168 @@ class MultiplexGenericEngine implements Engine {
                 return;
             }
 
-            /* Package components required by all roles. */
-            Supplier<HandlerContext> ctxt =
-                () -> new HandlerContext(this.id, id, conn.implementation(),
-                                         conn.description(),
-                                         conn.internalDescription(),
-                                         this::abortConnection,
-                                         () -> sessions.remove(id), recordsOut,
-                                         executor, charset, paramBufs,
-                                         optimizedBufferSize, stderrBufferSize);
-
-            /* Create the session if there isn't one with the specified
-             * id, and the role type is recognized. */
-            Function<Integer, SessionHandler> handlerMaker = k -> {
-                switch (role) {
-                case RoleTypes.RESPONDER:
-                    if (responder == null) return null;
-                    return new ResponderHandler(ctxt.get(), responder,
-                                                pipes.get());
-
-                case RoleTypes.FILTER:
-                    if (filter == null) return null;
-                    return new FilterHandler(ctxt.get(), filter, pipes.get(),
-                                             pipes.get());
-
-                case RoleTypes.AUTHORIZER:
-                    if (authorizer == null) return null;
-                    return new AuthorizerHandler(ctxt.get(), authorizer);
-
-                default:
-                    /* No mapping is to be recorded. */
-                    return null;
+            /* Claim a place among the engine's running sessions.
+             * Waiting sessions read in their parameters and input, but
+             * their applications are not invoked until admitted. An
+             * Authorizer session that might be answered from the
+             * decision cache claims its place only once it turns out
+             * to need the application, so that replayed decisions are
+             * neither refused nor delayed by admission. */
+            final Executor roleExecutor =
+                role == RoleTypes.RESPONDER && asyncResponder != null ?
+                    executor : blockingExecutor;
+            final boolean claimLate = admission != null &&
+                role == RoleTypes.AUTHORIZER && decisions != null;
+            final AtomicReference<AdmissionController.Ticket> ticket =
+                new AtomicReference<>();
+            if (admission != null && !claimLate) {
+                AdmissionController.Ticket t =
+                    admission.admit(() -> expire(id));
+                if (t == null) {
+                    recordsOut.writeEndRequest(id, -3,
+                                               ProtocolStatuses.OVERLOADED);
+                    return;
                 }
+                ticket.set(t);
+            }
+
+            /* Charge the session's content to the connection's budget,
+             * and give up the unconsumed remainder when the session
+             * ends. Until a waiting session is admitted, its content
+             * is accounted separately, so that it can't pause the
+             * connection and starve the sessions already running. */
+            final ByteBudget.Account account;
+            final Supplier<? extends Pipe> sessPipes;
+            if (budget == null) {
+                account = null;
+                sessPipes = pipes;
+            } else {
+                account = budget.open(sessionInputLimit,
+                                      shedding ? () -> shed(id) : null,
+                                      admission == null ? null :
+                                          () -> shed(id));
+                sessPipes = () -> new MeteredPipe(pipes.get(), account);
+            }
+
+            final Executor sessExecutor;
+            if (admission == null) {
+                sessExecutor = roleExecutor;
+            } else {
+                sessExecutor = task -> {
+                    AdmissionController.Ticket t = ticket.get();
+                    if (t == null) {
+                        /* Make a late claim, now that the application
+                         * is needed. */
+                        t = admission.admit(() -> expire(id));
+                        if (t == null) {
+                            expire(id);
+                            return;
+                        }
+                        ticket.set(t);
+                    }
+                    t.whenGranted(() -> {
+                        if (account != null) account.admit();
+                        roleExecutor.execute(task);
+                    });
+                };
+            }
+            final Runnable cleanUp = () -> {
+                if (account != null) account.close();
+                dropSession(id);
+                AdmissionController.Ticket t = ticket.get();
+                if (t != null) t.release();
             };
-            SessionHandler sess = sessions.computeIfAbsent(id, handlerMaker);
 
-            if (sess == null) {
-                /* No mapping was recorded, meaning that we don't
-                 * recognize the role. */
-                recordsOut.writeEndRequest(id, -3,
-                                           ProtocolStatuses.UNKNOWN_ROLE);
-                return;
+            /* Package components required by all roles. */
+            HandlerContext ctxt = contexts.session(id).cleanUp(cleanUp)
+                .executor(sessExecutor).timings(metrics.timings(role))
+                .create();
+
+            /* Create the session for the role, which we know we
+             * support. */
+            final SessionHandler sess;
+            switch (role) {
+            case RoleTypes.RESPONDER:
+                if (asyncResponder != null)
+                    sess = new AsyncResponderHandler(ctxt, asyncResponder,
+                                                     sessPipes.get());
+                else
+                    sess = new ResponderHandler(ctxt, responder,
+                                                sessPipes.get());
+                break;
+
+            case RoleTypes.FILTER:
+                sess = new FilterHandler(ctxt, filter, sessPipes.get(),
+                                         sessPipes.get());
+                break;
+
+            default:
+                assert role == RoleTypes.AUTHORIZER;
+                sess = new AuthorizerHandler(ctxt, authorizer, decisions);
+                break;
             }
+            SessionHandler old = sessions.putIfAbsent(id, sess);
+            assert old == null;
+            metrics.sessionStarted();
+            sess.start();
+        }
 
-            if (sess.start()) {
-                /* There must be no existing session. */
-                keepGoing = false;
-                logger.log(Level.SEVERE,
-                           () -> "server began existing request" + id);
+        /**
+         * Determine whether this engine can handle a role.
+         * 
+         * @param role the role type
+         * 
+         * @return {@code true} if sessions of the role can be created
+         */
+        private boolean supports(int role) {
+            switch (role) {
+            case RoleTypes.RESPONDER:
+                return responder != null || asyncResponder != null;
+
+            case RoleTypes.FILTER:
+                return filter != null;
+
+            case RoleTypes.AUTHORIZER:
+                return authorizer != null;
+
+            default:
+                return false;
+            }
+        }
+
+        /**
+         * Refuse a session that waited too long for admission, or that
+         * could not wait at all.
+         * 
+         * @param id the session id
+         */
+        private void expire(int id) {
+            SessionHandler sess = dropSession(id);
+            if (sess == null) return;
+            try {
+                recordsOut.writeEndRequest(id, -3, ProtocolStatuses.OVERLOADED);
+                sess.abortRequest();
+            } catch (IOException ex) {
+                logger.log(Level.WARNING, "connection " + this.id, ex);
+                abortConnection();
+            }
+        }
+
+        /**
+         * Abort a session that has exceeded its input budget.
+         * 
+         * @param id the session id
+         */
+        private void shed(int id) {
+            SessionHandler sess = dropSession(id);
+            if (sess == null) return;
+            logger.warning(() -> "connection " + this.id + " session " + id
+                + " shed over input budget");
+            try {
+                sess.overload();
+            } catch (IOException ex) {
+                logger.log(Level.WARNING, "connection " + this.id, ex);
+                abortConnection();
             }
         }
 
@@ -398,7 +1077,7 @@ class MultiplexGenericEngine implements Engine {
 
         private void abortConnection() {
             keepGoing = false;
-            sessions.forEach((k, v) -> v
+            sessions.forEach(v -> v
                 .transportFailure(new IOException("transport failure")));
         }
 
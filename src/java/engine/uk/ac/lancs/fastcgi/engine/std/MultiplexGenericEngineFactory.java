@@ -36,8 +36,10 @@
 
 package uk.ac.lancs.fastcgi.engine.std;
 
+import java.net.InetSocketAddress;
 import java.nio.charset.Charset;
 import java.util.function.Function;
+import uk.ac.lancs.fastcgi.AsyncResponder;
 import uk.ac.lancs.fastcgi.Authorizer;
 import uk.ac.lancs.fastcgi.Filter;
 import uk.ac.lancs.fastcgi.Responder;
@@ -45,6 +47,9 @@ import uk.ac.lancs.fastcgi.engine.Attribute;
 import uk.ac.lancs.fastcgi.engine.Engine;
 import uk.ac.lancs.fastcgi.engine.EngineConfiguration;
 import uk.ac.lancs.fastcgi.engine.EngineFactory;
+import uk.ac.lancs.fastcgi.engine.Scheduling;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.engine.util.PipePool;
 import uk.ac.lancs.scc.jardeps.Service;
 import uk.ac.lancs.fastcgi.transport.Transport;
 
@@ -52,13 +57,26 @@ import uk.ac.lancs.fastcgi.transport.Transport;
  * Provides engines which can handle responders, authorizers and
  * filters, supporting multiplexed sessions on each connection. This
  * implementation reads the attributes {@link Attribute#RESPONDER},
- * {@link Attribute#AUTHORIZER}, {@link Attribute#FILTER},
+ * {@link Attribute#ASYNC_RESPONDER} (preferred over
+ * {@link Attribute#RESPONDER}), {@link Attribute#AUTHORIZER},
+ * {@link Attribute#AUTHORIZER_CACHE}, {@link Attribute#FILTER},
  * {@link Attribute#MAX_CONN} (must be non-positive if set),
  * {@link Attribute#MAX_SESS} (non-positive if set) and
  * {@link Attribute#MAX_SESS_PER_CONN} (non-positive if set). All are
  * optional, except that at least one role must be specified. The
  * attribute {@link Attribute#BUFFER_SIZE} is also read, and is not
- * optional.
+ * optional. {@link Attribute#SCHEDULING} selects how sessions are
+ * executed. If {@link Attribute#MAX_SESS} is set, it is enforced
+ * across all connections, and {@link Attribute#ADMISSION_QUEUE} and
+ * {@link Attribute#ADMISSION_BUDGET} (both non-negative) govern how
+ * excess sessions wait. {@link Attribute#PIPES} supplies the pipes
+ * carrying request content. {@link Attribute#SESSION_INPUT_LIMIT},
+ * {@link Attribute#CONN_INPUT_LIMIT} and {@link Attribute#INPUT_LIMIT}
+ * (all non-negative) bound the request content held for applications,
+ * and {@link Attribute#INPUT_SHEDDING} determines whether a session
+ * over its limit is aborted. {@link Attribute#METRICS_ADDRESS}
+ * optionally gives an address on which to serve metrics over HTTP;
+ * they are always registered as an MBean.
  * 
  * @author simpsons
  */
@@ -69,10 +87,12 @@ public class MultiplexGenericEngineFactory implements EngineFactory {
         test(EngineConfiguration config) {
         /* Identify the roles. */
         Responder responder = config.get(Attribute.RESPONDER);
+        AsyncResponder asyncResponder = config.get(Attribute.ASYNC_RESPONDER);
         Authorizer authorizer = config.get(Attribute.AUTHORIZER);
+        DecisionCache decisions = config.get(Attribute.AUTHORIZER_CACHE);
         Filter filter = config.get(Attribute.FILTER);
-        if (responder == null && authorizer == null && filter == null)
-            return null;
+        if (responder == null && asyncResponder == null &&
+            authorizer == null && filter == null) return null;
 
         /* Get and validate performance parameters. */
         Integer maxConn = config.get(Attribute.MAX_CONN);
@@ -83,15 +103,35 @@ public class MultiplexGenericEngineFactory implements EngineFactory {
         if (maxSessPerConn != null && maxSessPerConn < 1) return null;
         int outBufSize = config.get(Attribute.BUFFER_SIZE);
         if (outBufSize < 0) return null;
+        Scheduling scheduling = config.get(Attribute.SCHEDULING);
+        int queueCapacity = config.get(Attribute.ADMISSION_QUEUE);
+        int budget = config.get(Attribute.ADMISSION_BUDGET);
+        if (queueCapacity < 0 || budget < 0) return null;
+        PipePool pipePool = config.get(Attribute.PIPES);
+        int sessInputLimit = config.get(Attribute.SESSION_INPUT_LIMIT);
+        int connInputLimit = config.get(Attribute.CONN_INPUT_LIMIT);
+        int inputLimit = config.get(Attribute.INPUT_LIMIT);
+        if (sessInputLimit < 0 || connInputLimit < 0 || inputLimit < 0)
+            return null;
+        boolean shedding = config.get(Attribute.INPUT_SHEDDING);
+        InetSocketAddress metricsAddress =
+            config.get(Attribute.METRICS_ADDRESS);
 
-        /* Create the factory for creating the engine from a connection
-         * supply. */
-        return cs -> new MultiplexGenericEngine(cs, Charset.defaultCharset(),
-                                                responder, authorizer, filter,
-                                                maxConn != null ? maxConn : 0,
-                                                maxSessPerConn != null ?
-                                                    maxSessPerConn : 0,
-                                                maxSess != null ? maxSess : 0,
-                                                outBufSize, 1024 * 1);
+        /* Gather the parameters, and create the factory for creating
+         * the engine from a connection supply. */
+        EngineParameters params = new EngineParameters()
+            .charset(Charset.defaultCharset()).responder(responder)
+            .asyncResponder(asyncResponder).authorizer(authorizer)
+            .decisions(decisions).filter(filter)
+            .maxConns(maxConn != null ? maxConn : 0)
+            .maxReqsPerConn(maxSessPerConn != null ? maxSessPerConn : 0)
+            .maxReqs(maxSess != null ? maxSess : 0)
+            .stdoutBufferSize(outBufSize).stderrBufferSize(1024 * 1)
+            .scheduling(scheduling).queueCapacity(queueCapacity)
+            .budgetMillis(budget).pipePool(pipePool)
+            .sessionInputLimit(sessInputLimit)
+            .connInputLimit(connInputLimit).inputLimit(inputLimit)
+            .shedding(shedding).metricsAddress(metricsAddress);
+        return cs -> new MultiplexGenericEngine(cs, params);
     }
 }
@@ -101,4 +101,9 @@ class ResponderHandler extends AbstractHandler implements ResponderContext {
     public InputStream in() {
         return stdinPipe.getInputStream();
     }
+
+    @Override
+    void discardInput() {
+        discard(stdinPipe);
+    }
 }
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.charset.Charset;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Serializes CGI response headers from pre-encoded fragments. Status
+ * lines are encoded once per status code, and common header names are
+ * encoded when the encoder is created. The fragments are written
+ * directly to the session's output buffer, which is not flushed, so
+ * the header block can share a record with the first bytes of the
+ * body.
+ *
+ * @author simpsons
+ */
+final class ResponseHeaderEncoder {
+    private static final String[] COMMON_NAMES = {
+        "Access-Control-Allow-Origin", "Cache-Control", "Content-Disposition",
+        "Content-Encoding", "Content-Language", "Content-Length",
+        "Content-Security-Policy", "Content-Type", "ETag", "Expires",
+        "Last-Modified", "Link", "Location", "Pragma", "Set-Cookie",
+        "Strict-Transport-Security", "Vary", "WWW-Authenticate",
+        "X-Content-Type-Options", "X-Frame-Options",
+    };
+
+    private final Charset charset;
+
+    private final byte[] eol;
+
+    private final byte[] separator;
+
+    /**
+     * Holds encoded header names followed by the separator, indexed by
+     * the names as the application is likely to spell them.
+     */
+    private final Map<String, byte[]> names = new HashMap<>();
+
+    /**
+     * Holds encoded status lines including the line terminator,
+     * indexed by status code minus 100. Elements are filled in on
+     * demand; a race only results in duplicate encoding.
+     */
+    private final byte[][] statusLines = new byte[500][];
+
+    /**
+     * Create an encoder.
+     * 
+     * @param charset the encoding of the response header
+     */
+    ResponseHeaderEncoder(Charset charset) {
+        this.charset = charset;
+        this.eol = System.lineSeparator().getBytes(charset);
+        this.separator = ": ".getBytes(charset);
+        for (String name : COMMON_NAMES)
+            names.put(name, (name + ": ").getBytes(charset));
+    }
+
+    private byte[] statusLine(int code) {
+        final int i = code - 100;
+        byte[] line = statusLines[i];
+        if (line == null) {
+            line = ("Status: " + code + " "
+                + AbstractHandler.getStatusMessage(code)
+                + System.lineSeparator()).getBytes(charset);
+            statusLines[i] = line;
+        }
+        return line;
+    }
+
+    /**
+     * Write a response header.
+     * 
+     * @param out the destination
+     * 
+     * @param code the HTTP status code, in the range 100 to 599
+     * 
+     * @param fields the header fields, excluding the status, in the
+     * order to be written
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    void write(OutputStream out, int code,
+               Map<String, List<String>> fields)
+        throws IOException {
+        out.write(statusLine(code));
+        for (var entry : fields.entrySet()) {
+            List<String> values = entry.getValue();
+            if (values.isEmpty()) continue;
+            String name = entry.getKey();
+            byte[] prefix = names.get(name);
+            for (String value : values) {
+                if (prefix != null) {
+                    out.write(prefix);
+                } else {
+                    out.write(name.getBytes(charset));
+                    out.write(separator);
+                }
+                out.write(value.getBytes(charset));
+                out.write(eol);
+            }
+        }
+        out.write(eol);
+    }
+}
@@ -64,6 +64,16 @@ interface SessionHandler {
      */
     void abortRequest() throws IOException;
 
+    /**
+     * Abort a request because the engine cannot afford to hold its
+     * content. The request is terminated with
+     * {@link uk.ac.lancs.fastcgi.proto.ProtocolStatuses#OVERLOADED}.
+     *
+     * @throws IOException if an I/O error occurs in transmitting a
+     * responding record
+     */
+    void overload() throws IOException;
+
     /**
      * Receive a stream of parameter data.
      * 
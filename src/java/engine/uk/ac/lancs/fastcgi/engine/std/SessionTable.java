@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicReferenceArray;
+import java.util.function.Consumer;
+
+/**
+ * Maps request ids to sessions of a single connection. Servers tend to
+ * re-use small ids, so these are held in an array indexed by id, grown
+ * as required up to a limit. Larger ids are held in a hash map. Lookups
+ * do not lock, while changes are serialized, so the number of entries
+ * is exact.
+ * 
+ * @param <V> the session type
+ * 
+ * @author simpsons
+ */
+final class SessionTable<V> {
+    /**
+     * The initial length of the dense array, namely {@value}
+     */
+    private static final int INITIAL_LENGTH = 16;
+
+    /**
+     * The maximum length of the dense array, namely {@value}
+     */
+    private static final int DENSE_LIMIT = 1024;
+
+    /**
+     * Holds sessions with small ids, indexed by id.
+     */
+    private volatile AtomicReferenceArray<V> dense =
+        new AtomicReferenceArray<>(INITIAL_LENGTH);
+
+    /**
+     * Holds sessions with ids too large for the dense array.
+     */
+    private final Map<Integer, V> sparse = new ConcurrentHashMap<>();
+
+    /**
+     * Holds the number of entries. This is changed only while holding
+     * this object's monitor.
+     */
+    private volatile int size = 0;
+
+    /**
+     * Get the session with a given id.
+     * 
+     * @param id the request id
+     * 
+     * @return the session with that id; or {@code null} if none
+     */
+    V get(int id) {
+        AtomicReferenceArray<V> dense = this.dense;
+        if (id >= 0 && id < dense.length()) return dense.get(id);
+        if (id < DENSE_LIMIT) return null;
+        return sparse.get(id);
+    }
+
+    /**
+     * Record a session against an id, unless one is already recorded.
+     * 
+     * @param id the request id
+     * 
+     * @param sess the session
+     * 
+     * @return the existing session, which is retained; or {@code null}
+     * if the new session was recorded
+     */
+    synchronized V putIfAbsent(int id, V sess) {
+        assert sess != null;
+        if (id < 0) throw new IllegalArgumentException("-ve id " + id);
+        if (id >= DENSE_LIMIT) {
+            V old = sparse.putIfAbsent(id, sess);
+            if (old == null) size++;
+            return old;
+        }
+        if (id >= dense.length()) grow(id);
+        V old = dense.get(id);
+        if (old != null) return old;
+        dense.set(id, sess);
+        size++;
+        return null;
+    }
+
+    /**
+     * Enlarge the dense array to accommodate an id. The caller must
+     * hold this object's monitor.
+     * 
+     * @param id the id to accommodate
+     */
+    private void grow(int id) {
+        assert Thread.holdsLock(this);
+        AtomicReferenceArray<V> old = dense;
+        int len = old.length();
+        while (len <= id)
+            len *= 2;
+        AtomicReferenceArray<V> made =
+            new AtomicReferenceArray<>(Integer.min(len, DENSE_LIMIT));
+        for (int i = 0; i < old.length(); i++)
+            made.set(i, old.get(i));
+        dense = made;
+    }
+
+    /**
+     * Remove the session with a given id.
+     * 
+     * @param id the request id
+     * 
+     * @return the removed session; or {@code null} if there was none
+     */
+    synchronized V remove(int id) {
+        final V old;
+        if (id >= DENSE_LIMIT)
+            old = sparse.remove(id);
+        else if (id >= 0 && id < dense.length())
+            old = dense.getAndSet(id, null);
+        else
+            old = null;
+        if (old != null) size--;
+        return old;
+    }
+
+    /**
+     * Get the number of sessions.
+     * 
+     * @return the number of recorded sessions
+     */
+    int size() {
+        return size;
+    }
+
+    /**
+     * Determine whether there are no sessions.
+     * 
+     * @return {@code true} if there are no sessions
+     */
+    boolean isEmpty() {
+        return size == 0;
+    }
+
+    /**
+     * Apply an action to every session. Sessions added or removed
+     * concurrently may or may not be visited.
+     * 
+     * @param action the action to apply
+     */
+    void forEach(Consumer<? super V> action) {
+        AtomicReferenceArray<V> dense = this.dense;
+        for (int i = 0; i < dense.length(); i++) {
+            V sess = dense.get(i);
+            if (sess != null) action.accept(sess);
+        }
+        sparse.values().forEach(action);
+    }
+}
@@ -36,110 +36,168 @@
 
 package uk.ac.lancs.fastcgi.transport.iis;
 
+import java.io.File;
+import java.io.FileNotFoundException;
 import java.io.IOException;
-import java.io.InputStream;
-import java.io.OutputStream;
+import java.io.InterruptedIOException;
 import java.io.RandomAccessFile;
+import java.util.logging.Logger;
 import uk.ac.lancs.fastcgi.transport.Connection;
 import uk.ac.lancs.fastcgi.transport.Transport;
 
 /**
- * Supplies a single connection over a named pipe. Attempts to obtain a
- * second connection will block indefinitely.
+ * Supplies connections over instances of a named pipe. The first
+ * instance is opened when the transport is created. Further instances
+ * are opened as connections are requested, up to a limit, so that
+ * several connections can be served concurrently. At the limit, a
+ * request for another connection blocks until one closes. While all of
+ * the server's instances are busy, opening is retried with increasing
+ * delays. Once the pipe no longer exists, no more connections are
+ * supplied.
  * 
  * @author simpsons
  */
 class ForkedIISTransport implements Transport {
-    private static final String DESCR = "iis";
+    /**
+     * The shortest delay before retrying to open a busy pipe, in
+     * milliseconds
+     */
+    private static final long MIN_RETRY = 10;
 
     /**
-     * Create a transport over a named pipe. Only one connection will be
-     * provided. Its description will be {@value #DESCR}.
-     * 
-     * @param file the named pipe
-     * 
-     * @param intDescr the sensitive description of the connection, such
-     * as the name of the pipe
+     * The longest delay before retrying to open a busy pipe, in
+     * milliseconds
      */
-    public ForkedIISTransport(RandomAccessFile file, String intDescr) {
-        final InputStream in = new InputStream() {
-            @Override
-            public int read() throws IOException {
-                return file.read();
-            }
+    private static final long MAX_RETRY = 1000;
 
-            @Override
-            public long skip(long n) throws IOException {
-                return file.skipBytes((int) Long.max(n, Integer.MAX_VALUE));
-            }
+    private final String pipeName;
 
-            @Override
-            public int read(byte[] b, int off, int len) throws IOException {
-                return file.read(b, off, len);
-            }
-        };
+    private final int maxInstances;
 
-        final OutputStream out = new OutputStream() {
-            @Override
-            public void write(int b) throws IOException {
-                file.write(b);
-            }
+    /**
+     * Holds the first instance, until it is delivered. Guarded by
+     * {@code this}.
+     */
+    private RandomAccessFile first;
 
-            @Override
-            public void write(byte[] b, int off, int len) throws IOException {
-                file.write(b, off, len);
-            }
-        };
+    /**
+     * Counts the instances open or being opened. Guarded by
+     * {@code this}.
+     */
+    private int instances = 0;
 
-        primary = new Connection() {
-            @Override
-            public InputStream input() throws IOException {
-                return in;
-            }
+    /**
+     * Create a transport over a named pipe.
+     * 
+     * @param first the first instance of the pipe, already open
+     * 
+     * @param pipeName the name of the pipe, used to open further
+     * instances, and as the sensitive description of each connection
+     * 
+     * @param maxInstances the maximum number of instances to have open
+     * at once
+     */
+    public ForkedIISTransport(RandomAccessFile first, String pipeName,
+                              int maxInstances) {
+        this.first = first;
+        this.pipeName = pipeName;
+        this.maxInstances = Integer.max(1, maxInstances);
+    }
 
-            @Override
-            public OutputStream output() throws IOException {
-                return out;
-            }
+    private synchronized void released() {
+        instances--;
+        notifyAll();
+    }
 
-            @Override
-            public void close() throws IOException {
-                file.close();
-            }
+    /**
+     * Determine whether the pipe still exists. The pipe namespace is
+     * listed, rather than the pipe itself examined, as anything that
+     * opens the pipe would take an instance.
+     * 
+     * @return {@code false} if the pipe is known not to exist;
+     * {@code true} otherwise
+     */
+    private boolean pipeExists() {
+        final File pipe = new File(pipeName);
+        final File dir = pipe.getParentFile();
+        final String[] names = dir == null ? null : dir.list();
+        if (names == null) return true;
+        for (String name : names)
+            if (name.equalsIgnoreCase(pipe.getName())) return true;
+        return false;
+    }
 
-            @Override
-            public String description() {
-                return DESCR;
+    /**
+     * Open another instance of the pipe, waiting while the server has
+     * none free.
+     * 
+     * @return the open instance; or {@code null} if the pipe no longer
+     * exists
+     * 
+     * @throws InterruptedIOException if interrupted while waiting
+     */
+    private RandomAccessFile openInstance() throws InterruptedIOException {
+        long delay = MIN_RETRY;
+        for (;;) {
+            try {
+                return new RandomAccessFile(pipeName, "rw");
+            } catch (FileNotFoundException ex) {
+                /* The same exception reports that all instances are
+                 * busy and that the pipe is gone, so look for the
+                 * pipe to tell which. */
+                if (!pipeExists()) {
+                    logger.fine(() -> "pipe gone: " + ex.getMessage());
+                    return null;
+                }
+                logger.finer(() -> "pipe busy: " + ex.getMessage());
             }
-
-            @Override
-            public String internalDescription() {
-                return intDescr;
+            try {
+                Thread.sleep(delay);
+            } catch (InterruptedException ex) {
+                Thread.currentThread().interrupt();
+                throw new InterruptedIOException("opening " + pipeName);
             }
-        };
+            delay = Long.min(delay * 2, MAX_RETRY);
+        }
     }
 
-    private Connection primary;
-
     /**
      * {@inheritDoc}
      * 
-     * @default On the first call, the sole connection is returned. A
-     * subsequent call will block indefinitely.
+     * @default On the first call, the connection over the initial
+     * instance is returned. Subsequent calls open further instances,
+     * blocking while the maximum are open, and return {@code null}
+     * once the pipe no longer exists.
      */
     @Override
     public Connection nextConnection() throws IOException {
-        if (primary != null) {
-            Connection result = primary;
-            primary = null;
-            return result;
+        RandomAccessFile file;
+        synchronized (this) {
+            while (instances >= maxInstances) {
+                try {
+                    wait();
+                } catch (InterruptedException ex) {
+                    Thread.currentThread().interrupt();
+                    throw new InterruptedIOException("awaiting instance");
+                }
+            }
+            instances++;
+            file = first;
+            first = null;
         }
-
-        for (;;)
-            try {
-                Thread.sleep(100000);
-            } catch (InterruptedException ex) {
-                // Do nothing.
+        try {
+            if (file == null) file = openInstance();
+            if (file == null) {
+                released();
+                return null;
             }
+            return new PipeConnection(file, pipeName, this::released);
+        } catch (IOException | RuntimeException ex) {
+            released();
+            throw ex;
+        }
     }
+
+    private static final Logger logger =
+        Logger.getLogger(ForkedIISTransport.class.getPackageName());
 }
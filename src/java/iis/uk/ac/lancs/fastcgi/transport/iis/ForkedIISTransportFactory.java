@@ -45,7 +45,9 @@ import uk.ac.lancs.scc.jardeps.Service;
 
 /**
  * Recognizes invocation by IIS as a FastCGI process, if the environment
- * variable {@value #ENV_NAME} is set.
+ * variable {@value #ENV_NAME} is set. The {@linkplain System#getProperties()
+ * system property} {@value #INSTANCES_PROP} optionally sets how many
+ * instances of the pipe may be open at once.
  * 
  * @author simpsons
  */
@@ -57,12 +59,22 @@ public class ForkedIISTransportFactory implements TransportFactory {
         if (pipeName == null) return null;
         try {
             RandomAccessFile file = new RandomAccessFile(pipeName, "rw");
-            return new ForkedIISTransport(file, pipeName);
+            return new ForkedIISTransport(file, pipeName,
+                                          Integer.getInteger(INSTANCES_PROP,
+                                                             1));
         } catch (FileNotFoundException ex) {
             throw new TransportConfigurationException(pipeName, ex);
         }
     }
 
+    /**
+     * Specifies the {@linkplain System#getProperties() system property}
+     * giving the maximum number of instances of the pipe to have open
+     * at once, each carrying its own connection. The default is 1.
+     */
+    public static final String INSTANCES_PROP =
+        "uk.ac.lancs.fastcgi.transport.iis.instances";
+
     /**
      * Identifies the environment variable naming the pipe over which
      * requests and responses are carried.
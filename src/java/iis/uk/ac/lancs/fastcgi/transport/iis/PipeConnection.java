@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.iis;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.GatheringByteChannel;
+import java.util.concurrent.atomic.AtomicBoolean;
+import uk.ac.lancs.fastcgi.transport.Connection;
+
+/**
+ * Carries a connection over one instance of a named pipe. Bytes are
+ * read from the pipe in large blocks, so that a record's header and
+ * content are usually obtained by a single call. Records written
+ * through the {@linkplain #outputChannel() channel} are staged and
+ * sent in as few calls as possible.
+ * 
+ * <p>
+ * The file's own methods are used rather than its channel, as the
+ * channel serializes reads and writes, and a reader blocked waiting
+ * for the next request would hold up responses.
+ *
+ * @author simpsons
+ */
+class PipeConnection implements Connection {
+    private static final String DESCR = "iis";
+
+    /**
+     * Specifies the capacity of each of the buffers through which bytes
+     * pass to and from the pipe.
+     */
+    private static final int BUFFER_SIZE = 64 * 1024;
+
+    private final RandomAccessFile file;
+
+    private final String intDescr;
+
+    private final Runnable onClose;
+
+    /**
+     * Holds bytes received from the pipe but not yet delivered, from
+     * {@link #inPos} to {@link #inLim}.
+     */
+    private final byte[] inBuf = new byte[BUFFER_SIZE];
+
+    private int inPos = 0;
+
+    private int inLim = 0;
+
+    /**
+     * Stages bytes being sent to the pipe. Also used as the lock on
+     * output.
+     */
+    private final byte[] outBuf = new byte[BUFFER_SIZE];
+
+    /**
+     * Records whether the connection is open. This is not guarded by
+     * {@link #outBuf}, so that closing the connection can release a
+     * writer blocked while holding it.
+     */
+    private final AtomicBoolean open = new AtomicBoolean(true);
+
+    /**
+     * Create a connection over a pipe instance. Its description will
+     * be {@value #DESCR}.
+     * 
+     * @param file the open pipe instance
+     * 
+     * @param intDescr the sensitive description of the connection, such
+     * as the name of the pipe
+     * 
+     * @param onClose an action to take when the connection is first
+     * closed
+     */
+    PipeConnection(RandomAccessFile file, String intDescr,
+                   Runnable onClose) {
+        this.file = file;
+        this.intDescr = intDescr;
+        this.onClose = onClose;
+    }
+
+    /**
+     * Ensure that there are bytes to deliver from the input buffer,
+     * reading as many as are available from the pipe if it is empty.
+     * 
+     * @return {@code false} if end-of-file has been reached;
+     * {@code true} otherwise
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    private boolean fill() throws IOException {
+        if (inPos < inLim) return true;
+        final int got = file.read(inBuf, 0, inBuf.length);
+        inPos = 0;
+        inLim = Integer.max(got, 0);
+        return got > 0;
+    }
+
+    private final InputStream input = new InputStream() {
+        @Override
+        public int read() throws IOException {
+            if (!fill()) return -1;
+            return inBuf[inPos++] & 0xff;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) throws IOException {
+            if (len == 0) return 0;
+            if (!fill()) return -1;
+            final int amount = Integer.min(len, inLim - inPos);
+            System.arraycopy(inBuf, inPos, b, off, amount);
+            inPos += amount;
+            return amount;
+        }
+
+        @Override
+        public long skip(long n) throws IOException {
+            if (n <= 0) return 0;
+            if (!fill()) return 0;
+            final int amount = (int) Long.min(n, inLim - inPos);
+            inPos += amount;
+            return amount;
+        }
+
+        @Override
+        public int available() {
+            return inLim - inPos;
+        }
+
+        @Override
+        public void close() throws IOException {
+            PipeConnection.this.close();
+        }
+    };
+
+    private final OutputStream output = new OutputStream() {
+        @Override
+        public void write(int b) throws IOException {
+            synchronized (outBuf) {
+                file.write(b);
+            }
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) throws IOException {
+            synchronized (outBuf) {
+                file.write(b, off, len);
+            }
+        }
+
+        @Override
+        public void close() throws IOException {
+            PipeConnection.this.close();
+        }
+    };
+
+    private final GatheringByteChannel outputChannel =
+        new GatheringByteChannel() {
+            @Override
+            public long write(ByteBuffer[] srcs, int offset, int length)
+                throws IOException {
+                synchronized (outBuf) {
+                    if (!open.get()) throw new ClosedChannelException();
+                    long total = 0;
+                    int staged = 0;
+                    for (int i = offset; i < offset + length; i++) {
+                        final ByteBuffer src = srcs[i];
+                        total += src.remaining();
+                        while (src.hasRemaining()) {
+                            if (staged == outBuf.length) {
+                                file.write(outBuf, 0, staged);
+                                staged = 0;
+                            }
+                            final int amount =
+                                Integer.min(src.remaining(),
+                                            outBuf.length - staged);
+                            src.get(outBuf, staged, amount);
+                            staged += amount;
+                        }
+                    }
+                    if (staged > 0) file.write(outBuf, 0, staged);
+                    return total;
+                }
+            }
+
+            @Override
+            public long write(ByteBuffer[] srcs) throws IOException {
+                return write(srcs, 0, srcs.length);
+            }
+
+            @Override
+            public int write(ByteBuffer src) throws IOException {
+                return (int) write(new ByteBuffer[] { src }, 0, 1);
+            }
+
+            @Override
+            public boolean isOpen() {
+                return open.get();
+            }
+
+            @Override
+            public void close() throws IOException {
+                PipeConnection.this.close();
+            }
+        };
+
+    @Override
+    public InputStream input() {
+        return input;
+    }
+
+    @Override
+    public OutputStream output() {
+        return output;
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * @default The returned channel stages the bytes of all supplied
+     * buffers, and writes them to the pipe in blocks of up to
+     * {@value #BUFFER_SIZE} bytes.
+     */
+    @Override
+    public GatheringByteChannel outputChannel() {
+        return outputChannel;
+    }
+
+    @Override
+    public void close() throws IOException {
+        if (!open.compareAndSet(true, false)) return;
+        try {
+            file.close();
+        } finally {
+            onClose.run();
+        }
+    }
+
+    @Override
+    public String description() {
+        return DESCR;
+    }
+
+    @Override
+    public String internalDescription() {
+        return intDescr;
+    }
+}
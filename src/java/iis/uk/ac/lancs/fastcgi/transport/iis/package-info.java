@@ -41,7 +41,10 @@
  * connections, so several requests must go on one connection, and
  * concurrency is achieved either by starting up multiple processes
  * receiving requests in serial, or by a single process receiving
- * interleaved requests.
+ * interleaved requests. If the server offers several instances of the
+ * pipe, more can be opened on demand up to the limit set by
+ * {@value ForkedIISTransportFactory#INSTANCES_PROP}, and each carries
+ * its own connection.
  * 
  * <p>
  * <strong>This package is completely untested!</strong>
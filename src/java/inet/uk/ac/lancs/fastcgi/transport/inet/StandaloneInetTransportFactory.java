@@ -40,8 +40,13 @@ import java.io.IOException;
 import java.net.InetAddress;
 import java.net.InetSocketAddress;
 import java.net.ServerSocket;
+import java.net.StandardSocketOptions;
+import java.util.ArrayList;
 import java.util.Collection;
+import java.util.List;
+import java.util.logging.Logger;
 import uk.ac.lancs.fastcgi.proto.InvocationVariables;
+import uk.ac.lancs.fastcgi.transport.ShardedTransport;
 import uk.ac.lancs.fastcgi.transport.TransportConfigurationException;
 import uk.ac.lancs.scc.jardeps.Service;
 import uk.ac.lancs.fastcgi.transport.Transport;
@@ -52,7 +57,12 @@ import uk.ac.lancs.fastcgi.transport.TransportFactory;
  * variable {@value InvocationVariables#INET_BIND_ADDR} must be set,
  * specifying the address to bind to. The environment variable
  * {@value InvocationVariables#WEB_SERVER_ADDRS} also must be set,
- * listing valid peer addresses.
+ * listing valid peer addresses. If
+ * {@value InvocationVariables#NIO_SELECTORS} is set to a positive
+ * number, this transport is not used. If
+ * {@value InvocationVariables#LISTENERS} is greater than 1, that many
+ * sockets are bound with <code>SO_REUSEPORT</code>, each validating
+ * its peers against the same list.
  * 
  * <p>
  * Each connection's description begins
@@ -74,21 +84,53 @@ public class StandaloneInetTransportFactory implements TransportFactory {
                 InvocationVariables.getInetBindAddress();
             if (bindAddress == null) return null;
 
+            /* Defer to the selector-based transport if requested. */
+            if (InvocationVariables.getNioSelectorCount() > 0) return null;
+
             /* We must know what peers are permitted. */
             Collection<InetAddress> allowedPeers =
                 InvocationVariables.getAuthorizedStandaloneInetPeers();
             if (allowedPeers == null) return null;
 
-            final ServerSocket ss;
-            final String descr;
-            ss = new ServerSocket(bindAddress.getPort(), 5,
-                                  bindAddress.getAddress());
-            descr = STANDALONE_DESCRIPTION;
-            return new StandaloneInetTransport(descr, ss, allowedPeers);
+            final String descr = STANDALONE_DESCRIPTION;
+            final int count = InvocationVariables.getListenerCount();
+            if (count == 1) {
+                final ServerSocket ss =
+                    new ServerSocket(bindAddress.getPort(), 5,
+                                     bindAddress.getAddress());
+                return new StandaloneInetTransport(descr, ss, allowedPeers);
+            }
+
+            /* Bind several sockets to the same address, so the kernel
+             * spreads connections over them. If that's not possible,
+             * let several threads accept from one socket. */
+            List<Transport> listeners = new ArrayList<>(count);
+            ServerSocket shared = null;
+            for (int i = 0; i < count; i++) {
+                ServerSocket ss = shared;
+                if (ss == null) {
+                    ss = new ServerSocket();
+                    if (ss.supportedOptions()
+                        .contains(StandardSocketOptions.SO_REUSEPORT)) {
+                        ss.setOption(StandardSocketOptions.SO_REUSEPORT, true);
+                    } else {
+                        logger.warning("SO_REUSEPORT unsupported;"
+                            + " sharing one socket");
+                        shared = ss;
+                    }
+                    ss.bind(bindAddress, 5);
+                }
+                listeners.add(new StandaloneInetTransport(descr, ss,
+                                                          allowedPeers));
+            }
+            return new ShardedTransport(listeners);
         } catch (IOException ex) {
             throw new TransportConfigurationException(ex);
         }
     }
 
     private static final String STANDALONE_DESCRIPTION = "inet-standalone";
+
+    private static final Logger logger = Logger
+        .getLogger(StandaloneInetTransportFactory.class.getPackageName());
 }
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.nio;
+
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.FileChannel;
+import java.nio.channels.GatheringByteChannel;
+import java.nio.channels.ReadableByteChannel;
+import java.nio.channels.SelectionKey;
+import java.nio.channels.SocketChannel;
+import java.util.Objects;
+import java.util.concurrent.CountDownLatch;
+import uk.ac.lancs.fastcgi.proto.serial.FileTransferChannel;
+import uk.ac.lancs.fastcgi.transport.SelectableConnection;
+
+/**
+ * Implements a FastCGI connection over a non-blocking socket channel.
+ * Readiness is reported by a shared {@link SelectorLoop}. The blocking
+ * stream and channel views park the calling thread until that loop
+ * reports the socket as ready, so they never occupy the shared thread,
+ * and need no selector of their own.
+ * 
+ * @author simpsons
+ */
+final class NioConnection implements SelectableConnection {
+    private final SocketChannel channel;
+
+    private final String descr;
+
+    private final String intDescr;
+
+    private final SelectorLoop.Watch watch;
+
+    /**
+     * Create a connection.
+     * 
+     * @param channel the non-blocking channel over which the
+     * connection is implemented
+     * 
+     * @param descr a diagnostic description of this connection,
+     * excluding sensitive information
+     * 
+     * @param intDescr sensitive information describing this connection
+     * 
+     * @param loop the selector thread that reports readiness
+     */
+    NioConnection(SocketChannel channel, String descr, String intDescr,
+                  SelectorLoop loop) {
+        this.channel = channel;
+        this.descr = descr;
+        this.intDescr = intDescr;
+        this.watch = loop.watch(channel);
+    }
+
+    private final Object readLock = new Object();
+
+    private final Object writeLock = new Object();
+
+    /**
+     * Wait until the channel might be able to perform an operation.
+     * The calling thread waits on the shared selector, so no further
+     * descriptors are consumed.
+     * 
+     * @param op the operation to wait for
+     * 
+     * @throws ClosedChannelException if the connection was closed
+     * while waiting
+     * 
+     * @throws InterruptedIOException if the thread was interrupted
+     * while waiting
+     */
+    private void await(int op) throws IOException {
+        CountDownLatch ready = new CountDownLatch(1);
+        watch.arm(op, ready::countDown);
+        try {
+            ready.await();
+        } catch (InterruptedException ex) {
+            Thread.currentThread().interrupt();
+            throw new InterruptedIOException();
+        }
+        if (!channel.isOpen()) throw new ClosedChannelException();
+    }
+
+    private long gather(ByteBuffer[] srcs, int offset, int length)
+        throws IOException {
+        Objects.checkFromIndexSize(offset, length, srcs.length);
+        synchronized (writeLock) {
+            long total = 0;
+            for (int i = offset; i < offset + length; i++)
+                total += srcs[i].remaining();
+            for (long rem = total; rem > 0;) {
+                long got = channel.write(srcs, offset, length);
+                if (got == 0)
+                    await(SelectionKey.OP_WRITE);
+                rem -= got;
+            }
+            return total;
+        }
+    }
+
+    private long transfer(FileInputStream file, long position, long count)
+        throws IOException {
+        FileChannel src = file.getChannel();
+        synchronized (writeLock) {
+            long done = 0;
+            while (done < count) {
+                long got = src.transferTo(position + done, count - done,
+                                          channel);
+                if (got == 0) {
+                    /* Distinguish end-of-file from a full socket. */
+                    if (position + done >= src.size()) break;
+                    await(SelectionKey.OP_WRITE);
+                }
+                done += got;
+            }
+            return done;
+        }
+    }
+
+    private final FileTransferChannel outputChannel =
+        new FileTransferChannel() {
+            @Override
+            public long transferFrom(FileInputStream file, long position,
+                                     long count)
+                throws IOException {
+                return transfer(file, position, count);
+            }
+
+            @Override
+            public long write(ByteBuffer[] srcs, int offset, int length)
+                throws IOException {
+                return gather(srcs, offset, length);
+            }
+
+            @Override
+            public long write(ByteBuffer[] srcs) throws IOException {
+                return gather(srcs, 0, srcs.length);
+            }
+
+            @Override
+            public int write(ByteBuffer src) throws IOException {
+                return (int) gather(new ByteBuffer[] { src }, 0, 1);
+            }
+
+            @Override
+            public boolean isOpen() {
+                return channel.isOpen();
+            }
+
+            @Override
+            public void close() throws IOException {
+                NioConnection.this.close();
+            }
+        };
+
+    private final OutputStream output = new OutputStream() {
+        @Override
+        public void write(int b) throws IOException {
+            write(new byte[] { (byte) b }, 0, 1);
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) throws IOException {
+            gather(new ByteBuffer[] { ByteBuffer.wrap(b, off, len) }, 0, 1);
+        }
+
+        @Override
+        public void close() throws IOException {
+            NioConnection.this.close();
+        }
+    };
+
+    private final InputStream input = new InputStream() {
+        @Override
+        public int read() throws IOException {
+            byte[] buf = new byte[1];
+            int got = read(buf, 0, 1);
+            if (got < 0) return -1;
+            return buf[0] & 0xff;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) throws IOException {
+            Objects.checkFromIndexSize(off, len, b.length);
+            if (len == 0) return 0;
+            ByteBuffer dst = ByteBuffer.wrap(b, off, len);
+            synchronized (readLock) {
+                while (true) {
+                    int got = channel.read(dst);
+                    if (got != 0) return got;
+                    await(SelectionKey.OP_READ);
+                }
+            }
+        }
+
+        @Override
+        public void close() throws IOException {
+            NioConnection.this.close();
+        }
+    };
+
+    @Override
+    public InputStream input() throws IOException {
+        return input;
+    }
+
+    @Override
+    public OutputStream output() throws IOException {
+        return output;
+    }
+
+    @Override
+    public GatheringByteChannel outputChannel() throws IOException {
+        return outputChannel;
+    }
+
+    @Override
+    public ReadableByteChannel inputChannel() throws IOException {
+        return channel;
+    }
+
+    @Override
+    public void whenReadable(Runnable action) throws IOException {
+        watch.arm(SelectionKey.OP_READ, action);
+    }
+
+    @Override
+    public void close() throws IOException {
+        try {
+            channel.close();
+        } finally {
+            /* Release any thread waiting for readiness. */
+            watch.close();
+        }
+    }
+
+    @Override
+    public void shutdownInput() throws IOException {
+        channel.shutdownInput();
+    }
+
+    @Override
+    public String description() {
+        return descr;
+    }
+
+    @Override
+    public String internalDescription() {
+        return intDescr;
+    }
+}
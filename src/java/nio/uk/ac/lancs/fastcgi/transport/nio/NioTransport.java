@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.nio;
+
+import java.io.IOException;
+import java.nio.channels.ServerSocketChannel;
+import java.nio.channels.SocketChannel;
+import java.util.concurrent.atomic.AtomicInteger;
+import uk.ac.lancs.fastcgi.transport.Connection;
+import uk.ac.lancs.fastcgi.transport.Transport;
+
+/**
+ * Creates connections by accepting channels from a server channel, and
+ * spreading them over a pool of selector threads.
+ * 
+ * @author simpsons
+ */
+final class NioTransport implements Transport {
+    /**
+     * Determines whether a connection from a given peer should be
+     * accepted, and how to identify the connection.
+     */
+    interface PeerValidator {
+        /**
+         * Determine whether the connection should be accepted.
+         * 
+         * @param channel the newly accepted channel
+         * 
+         * @return a public description of the connection; or
+         * {@code null} if it should be rejected
+         * 
+         * @throws IOException if an I/O error occurs
+         */
+        String describe(SocketChannel channel) throws IOException;
+    }
+
+    private final ServerSocketChannel server;
+
+    private final PeerValidator validator;
+
+    private final String intDescr;
+
+    private final SelectorLoop[] loops;
+
+    private final AtomicInteger nextLoop = new AtomicInteger(0);
+
+    /**
+     * Create a transport based on a bound server channel.
+     * 
+     * @param server the blocking channel from which connections will
+     * be accepted
+     * 
+     * @param validator a means to check and describe each accepted
+     * channel
+     * 
+     * @param loops the selector threads to spread connections over
+     * 
+     * @throws IOException if the channel's address could not be
+     * obtained
+     */
+    NioTransport(ServerSocketChannel server, PeerValidator validator,
+                 SelectorLoop[] loops)
+        throws IOException {
+        this.server = server;
+        this.validator = validator;
+        this.intDescr = server.getLocalAddress().toString();
+        this.loops = loops.clone();
+    }
+
+    /**
+     * Create selector threads, and deal them out among a number of
+     * listeners. If there are fewer threads than listeners, threads
+     * are shared.
+     * 
+     * @param selectors the number of selector threads to create
+     * 
+     * @param listeners the number of listeners
+     * 
+     * @return an array of arrays of threads, one per listener
+     * 
+     * @throws IOException if a selector could not be opened
+     */
+    static SelectorLoop[][] openLoops(int selectors, int listeners)
+        throws IOException {
+        SelectorLoop[] all = new SelectorLoop[selectors];
+        for (int i = 0; i < selectors; i++)
+            all[i] = new SelectorLoop("selector-" + i);
+        SelectorLoop[][] result = new SelectorLoop[listeners][];
+        for (int l = 0; l < listeners; l++) {
+            final int n = Integer.max(1, (selectors - l + listeners - 1) /
+                listeners);
+            result[l] = new SelectorLoop[n];
+            for (int i = 0; i < n; i++)
+                result[l][i] = all[(l + i * listeners) % selectors];
+        }
+        return result;
+    }
+
+    /**
+     * {@inheritDoc}
+     * 
+     * @default Channels are accepted and submitted to the validator
+     * until one is permitted. It is made non-blocking, and assigned to
+     * the next selector thread in turn.
+     */
+    @Override
+    public Connection nextConnection() throws IOException {
+        while (server.isOpen()) {
+            SocketChannel channel = server.accept();
+            String descr = validator.describe(channel);
+            if (descr == null) {
+                channel.close();
+                continue;
+            }
+            channel.configureBlocking(false);
+            final int i = nextLoop.getAndIncrement() & Integer.MAX_VALUE;
+            return new NioConnection(channel, descr, intDescr,
+                                     loops[i % loops.length]);
+        }
+        return null;
+    }
+}
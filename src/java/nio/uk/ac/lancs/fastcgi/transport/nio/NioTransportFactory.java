@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.nio;
+
+import java.io.IOException;
+import java.net.InetAddress;
+import java.net.InetSocketAddress;
+import java.net.StandardProtocolFamily;
+import java.net.StandardSocketOptions;
+import java.net.UnixDomainSocketAddress;
+import java.nio.channels.ServerSocketChannel;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.List;
+import java.util.Set;
+import java.util.logging.Logger;
+import uk.ac.lancs.fastcgi.proto.InvocationVariables;
+import uk.ac.lancs.fastcgi.transport.ShardedTransport;
+import uk.ac.lancs.fastcgi.transport.Transport;
+import uk.ac.lancs.fastcgi.transport.TransportConfigurationException;
+import uk.ac.lancs.fastcgi.transport.TransportFactory;
+import uk.ac.lancs.scc.jardeps.Service;
+
+/**
+ * Recognizes stand-alone transports to be served by selector threads.
+ * The environment variable {@value InvocationVariables#NIO_SELECTORS}
+ * must be set to a positive number of threads. Then, if
+ * {@value InvocationVariables#INET_BIND_ADDR} is set, an
+ * Internet-domain channel is bound to it, and
+ * {@value InvocationVariables#INET_SERVER_ADDRS} must list valid peer
+ * addresses. Otherwise, if {@value InvocationVariables#UNIX_BIND_ADDR}
+ * is set, a Unix-domain channel is bound to the rendezvous point it
+ * specifies.
+ * 
+ * <p>
+ * If {@value InvocationVariables#LISTENERS} is greater than 1, that
+ * many listeners are created, each with its own share of the selector
+ * threads. Internet-domain listeners are distinct channels bound with
+ * <code>SO_REUSEPORT</code> where supported.
+ * 
+ * <p>
+ * Connection descriptions are formed as by the blocking stand-alone
+ * transports.
+ * 
+ * @author simpsons
+ */
+@Service(TransportFactory.class)
+public class NioTransportFactory implements TransportFactory {
+    @Override
+    public Transport getTransport() {
+        try {
+            final int selectors = InvocationVariables.getNioSelectorCount();
+            if (selectors <= 0) return null;
+            final int listenerCount = InvocationVariables.getListenerCount();
+
+            InetSocketAddress bindAddress =
+                InvocationVariables.getInetBindAddress();
+            if (bindAddress != null) {
+                /* We must know what peers are permitted. */
+                Collection<InetAddress> allowed =
+                    InvocationVariables.getAuthorizedStandaloneInetPeers();
+                if (allowed == null) return null;
+                final Set<InetAddress> allowedPeers = Set.copyOf(allowed);
+
+                NioTransport.PeerValidator validator = ch -> {
+                    InetSocketAddress peer =
+                        (InetSocketAddress) ch.getRemoteAddress();
+                    if (!allowedPeers.contains(peer.getAddress())) {
+                        logger.warning(() -> String
+                            .format("rejected connection from %s to %s",
+                                    peer, bindAddress));
+                        return null;
+                    }
+                    return INET_DESCRIPTION + "#" + peer;
+                };
+
+                /* Bind a channel for each listener, sharing the address
+                 * through SO_REUSEPORT if possible, or sharing one
+                 * channel otherwise. Each listener gets its own
+                 * selector threads. */
+                SelectorLoop[][] loops =
+                    NioTransport.openLoops(selectors, listenerCount);
+                List<Transport> listeners = new ArrayList<>(listenerCount);
+                ServerSocketChannel shared = null;
+                for (int i = 0; i < listenerCount; i++) {
+                    ServerSocketChannel ssc = shared;
+                    if (ssc == null) {
+                        ssc = ServerSocketChannel.open();
+                        final var reusePort =
+                            StandardSocketOptions.SO_REUSEPORT;
+                        if (listenerCount > 1) {
+                            if (ssc.supportedOptions().contains(reusePort)) {
+                                ssc.setOption(reusePort, true);
+                            } else {
+                                logger.warning("SO_REUSEPORT unsupported;"
+                                    + " sharing one channel");
+                                shared = ssc;
+                            }
+                        }
+                        ssc.bind(bindAddress, 5);
+                    }
+                    listeners.add(new NioTransport(ssc, validator, loops[i]));
+                }
+                return combine(listeners);
+            }
+
+            String pathText = System.getenv(InvocationVariables.UNIX_BIND_ADDR);
+            if (pathText != null) {
+                UnixDomainSocketAddress addr =
+                    UnixDomainSocketAddress.of(pathText);
+                ServerSocketChannel ssc =
+                    ServerSocketChannel.open(StandardProtocolFamily.UNIX);
+                ssc.bind(addr);
+
+                /* A rendezvous point can be bound only once, so the
+                 * listeners share the channel. */
+                SelectorLoop[][] loops =
+                    NioTransport.openLoops(selectors, listenerCount);
+                List<Transport> listeners = new ArrayList<>(listenerCount);
+                for (int i = 0; i < listenerCount; i++)
+                    listeners.add(new NioTransport(ssc, ch -> UNIX_DESCRIPTION,
+                                                   loops[i]));
+                return combine(listeners);
+            }
+
+            return null;
+        } catch (IOException ex) {
+            throw new TransportConfigurationException(ex);
+        }
+    }
+
+    private static Transport combine(List<Transport> listeners) {
+        if (listeners.size() == 1) return listeners.get(0);
+        return new ShardedTransport(listeners);
+    }
+
+    private static final String INET_DESCRIPTION = "inet-standalone";
+
+    private static final String UNIX_DESCRIPTION = "unix-standalone";
+
+    private static final Logger logger =
+        Logger.getLogger(NioTransportFactory.class.getPackageName());
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+package uk.ac.lancs.fastcgi.transport.nio;
+
+import java.io.IOException;
+import java.nio.channels.CancelledKeyException;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.SelectionKey;
+import java.nio.channels.Selector;
+import java.nio.channels.SocketChannel;
+import java.util.Iterator;
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+
+/**
+ * Watches many channels for readiness from a single thread, and
+ * invokes an action for each as it becomes ready. Each registration is
+ * one-shot, and must be renewed to receive further notifications.
+ * 
+ * @author simpsons
+ */
+final class SelectorLoop {
+    private final Selector selector;
+
+    private final Thread thread;
+
+    /**
+     * Holds changes to registrations to be made by the selector
+     * thread.
+     */
+    private final Queue<Runnable> tasks = new ConcurrentLinkedQueue<>();
+
+    /**
+     * Create a selector and start its thread.
+     * 
+     * @param name the name of the thread
+     * 
+     * @throws IOException if the selector could not be opened
+     */
+    SelectorLoop(String name) throws IOException {
+        this.selector = Selector.open();
+        this.thread = new Thread(this::run, name);
+        this.thread.setDaemon(true);
+        this.thread.start();
+    }
+
+    /**
+     * Prepare to watch a channel.
+     * 
+     * @param channel the channel to watch, which must be non-blocking
+     * 
+     * @return a means to watch the channel
+     */
+    Watch watch(SocketChannel channel) {
+        return new Watch(channel);
+    }
+
+    /**
+     * Watches a single channel for readability and writability. At
+     * most one selection key is registered per channel, whatever the
+     * operations being waited for.
+     */
+    final class Watch {
+        private final SocketChannel channel;
+
+        /**
+         * Identifies the channel's registration. Accessed only by the
+         * selector thread.
+         */
+        private SelectionKey key;
+
+        /**
+         * Holds the actions to invoke when the channel becomes
+         * readable. Guarded by {@code this}.
+         */
+        private Runnable onRead;
+
+        /**
+         * Holds the actions to invoke when the channel becomes
+         * writable. Guarded by {@code this}.
+         */
+        private Runnable onWrite;
+
+        /**
+         * Records whether the channel has been closed. Guarded by
+         * {@code this}.
+         */
+        private boolean closed;
+
+        private Watch(SocketChannel channel) {
+            this.channel = channel;
+        }
+
+        /**
+         * Invoke an action once, when the channel next becomes ready
+         * for an operation. If the channel is closed, the action is
+         * invoked anyway, so that it can detect the condition.
+         * 
+         * @param op the operation, {@link SelectionKey#OP_READ} or
+         * {@link SelectionKey#OP_WRITE}
+         * 
+         * @param action the action to invoke
+         */
+        void arm(int op, Runnable action) {
+            synchronized (this) {
+                if (!closed) {
+                    if (op == SelectionKey.OP_WRITE)
+                        onWrite = chain(onWrite, action);
+                    else
+                        onRead = chain(onRead, action);
+                    action = null;
+                }
+            }
+            if (action != null) {
+                Runnable act = action;
+                submit(() -> invoke(act));
+            } else {
+                submit(this::update);
+            }
+        }
+
+        /**
+         * Invoke all pending actions, and accept no more. This should
+         * be called when the channel is closed, as the selector does
+         * not report cancelled keys.
+         */
+        void close() {
+            synchronized (this) {
+                closed = true;
+            }
+            submit(this::fire);
+        }
+
+        /**
+         * Make the registration reflect the pending actions. This must
+         * be called by the selector thread.
+         */
+        private void update() {
+            int ops;
+            synchronized (this) {
+                ops = (onRead == null ? 0 : SelectionKey.OP_READ) |
+                    (onWrite == null ? 0 : SelectionKey.OP_WRITE);
+            }
+            try {
+                if (key == null) {
+                    if (ops != 0) key = channel.register(selector, ops, this);
+                } else {
+                    key.interestOps(ops);
+                }
+            } catch (ClosedChannelException | CancelledKeyException ex) {
+                fire();
+            }
+        }
+
+        /**
+         * Invoke the actions for the operations that are ready. This
+         * must be called by the selector thread.
+         * 
+         * @param ready the ready operations
+         */
+        private void ready(int ready) {
+            Runnable r = null, w = null;
+            synchronized (this) {
+                if ((ready & SelectionKey.OP_READ) != 0) {
+                    r = onRead;
+                    onRead = null;
+                }
+                if ((ready & SelectionKey.OP_WRITE) != 0) {
+                    w = onWrite;
+                    onWrite = null;
+                }
+            }
+            update();
+            if (r != null) invoke(r);
+            if (w != null) invoke(w);
+        }
+
+        /**
+         * Invoke all pending actions. This must be called by the
+         * selector thread.
+         */
+        private void fire() {
+            Runnable r, w;
+            synchronized (this) {
+                r = onRead;
+                w = onWrite;
+                onRead = onWrite = null;
+            }
+            if (r != null) invoke(r);
+            if (w != null) invoke(w);
+        }
+    }
+
+    private static Runnable chain(Runnable first, Runnable second) {
+        if (first == null) return second;
+        return () -> {
+            invoke(first);
+            invoke(second);
+        };
+    }
+
+    /**
+     * Run a task on the selector thread.
+     * 
+     * @param task the task to run
+     */
+    private void submit(Runnable task) {
+        if (Thread.currentThread() == thread) {
+            /* We're being called from an action, so we can make the
+             * change immediately, and the selector will see it when
+             * the action returns. */
+            task.run();
+            return;
+        }
+        tasks.add(task);
+        selector.wakeup();
+    }
+
+    private static void invoke(Runnable action) {
+        try {
+            action.run();
+        } catch (RuntimeException ex) {
+            logger.log(Level.SEVERE, "selector action", ex);
+        }
+    }
+
+    private void run() {
+        try {
+            while (true) {
+                selector.select();
+                for (Runnable task; (task = tasks.poll()) != null;)
+                    task.run();
+                for (Iterator<SelectionKey> iter =
+                    selector.selectedKeys().iterator(); iter.hasNext();) {
+                    SelectionKey key = iter.next();
+                    iter.remove();
+                    Watch watch = (Watch) key.attachment();
+                    int ready;
+                    try {
+                        ready = key.readyOps();
+                    } catch (CancelledKeyException ex) {
+                        /* The channel has been closed, but let the
+                         * actions discover that. */
+                        watch.fire();
+                        continue;
+                    }
+                    watch.ready(ready);
+                }
+            }
+        } catch (IOException ex) {
+            logger.log(Level.SEVERE, "selector failed", ex);
+        }
+    }
+
+    private static final Logger logger =
+        Logger.getLogger(SelectorLoop.class.getPackageName());
+}
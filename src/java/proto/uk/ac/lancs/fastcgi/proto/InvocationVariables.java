@@ -235,6 +235,56 @@ public final class InvocationVariables {
      */
     public static final String UNIX_BIND_ADDR = "FASTCGI4J_UNIX_BIND";
 
+    /**
+     * Specifies the name of the environment variable instructing a
+     * stand-alone application process to use non-blocking channels
+     * multiplexed by selector threads. Its value is the number of
+     * selector threads, which must be positive to enable the mode. The
+     * value is {@value}.
+     */
+    public static final String NIO_SELECTORS = "FASTCGI4J_NIO_SELECTORS";
+
+    /**
+     * Get the number of selector threads to serve stand-alone
+     * connections with.
+     * 
+     * @return the number of selector threads; or {@code 0} if
+     * stand-alone connections should not use selectors
+     * 
+     * @throws NumberFormatException if the value is not a decimal
+     * integer
+     */
+    public static int getNioSelectorCount() {
+        String value = System.getenv(NIO_SELECTORS);
+        if (value == null) return 0;
+        return Integer.max(0, Integer.parseInt(value.trim()));
+    }
+
+    /**
+     * Specifies the name of the environment variable instructing a
+     * stand-alone application process to accept connections on
+     * several listeners, each served by its own thread. Where
+     * supported, each Internet-domain listener is a distinct socket
+     * bound with <code>SO_REUSEPORT</code>, so that the kernel spreads
+     * connections over them. The value is {@value}.
+     */
+    public static final String LISTENERS = "FASTCGI4J_LISTENERS";
+
+    /**
+     * Get the number of listeners to accept stand-alone connections
+     * on.
+     * 
+     * @return the number of listeners, at least {@code 1}
+     * 
+     * @throws NumberFormatException if the value is not a decimal
+     * integer
+     */
+    public static int getListenerCount() {
+        String value = System.getenv(LISTENERS);
+        if (value == null) return 1;
+        return Integer.max(1, Integer.parseInt(value.trim()));
+    }
+
     private static final String DECIMAL_OCTET =
         "(?:(?:[12][0-9]|[1-9])?[0-9]|25[0-5])";
 
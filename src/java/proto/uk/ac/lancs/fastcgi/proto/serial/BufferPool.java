@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.proto.serial;
+
+import java.util.Arrays;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.LongAdder;
+
+/**
+ * Recycles byte arrays of a fixed set of sizes. A request is met with
+ * an array of the smallest size class that is big enough. Released
+ * arrays are kept in a shared depot, whose total size is bounded.
+ * Arrays that do not fit, or are not of a class size, are left to the
+ * garbage collector. Each size class of the depot is an array-backed
+ * stack, so releasing an array allocates nothing once the stack has
+ * grown to its working size, and the most recently released array,
+ * likely still in cache, is the next to be re-used.
+ * 
+ * <p>
+ * There is deliberately no per-thread cache. Buffers are often
+ * released by a different thread from the one that allocated them,
+ * such as a record buffer passed from a connection to a session, or a
+ * pipe chunk written by one and read by the other. Per-thread caches
+ * would then fill on one side and stay empty on the other, and each
+ * virtual thread would discard its own.
+ * 
+ * <p>
+ * By default, the size classes are powers of two from 128 bytes to
+ * 64KiB, plus the sizes needed by {@link RecordReader} and
+ * {@link RecordWriter}, so that one pool can serve all buffers of an
+ * engine.
+ * 
+ * @author simpsons
+ */
+public final class BufferPool {
+    private final int[] sizes;
+
+    private final long depotLimit;
+
+    private final AtomicLong depotBytes = new AtomicLong(0);
+
+    private final Stack[] depot;
+
+    private final LongAdder hits = new LongAdder();
+
+    private final LongAdder misses = new LongAdder();
+
+    private BufferPool(int[] sizes, long depotLimit) {
+        this.sizes = sizes;
+        this.depotLimit = depotLimit;
+        this.depot = new Stack[sizes.length];
+        for (int i = 0; i < sizes.length; i++) {
+            final long bound = depotLimit / sizes[i];
+            this.depot[i] =
+                new Stack((int) Long.min(bound, Integer.MAX_VALUE - 8));
+        }
+    }
+
+    /**
+     * Holds released arrays of one size class. Its storage grows by
+     * doubling, but never beyond the number of arrays of the class that
+     * the depot limit allows.
+     */
+    private static final class Stack {
+        private final int bound;
+
+        private byte[][] slots = new byte[0][];
+
+        private int count = 0;
+
+        Stack(int bound) {
+            this.bound = bound;
+        }
+
+        /**
+         * Take the most recently released array.
+         * 
+         * @return the array; or {@code null} if there are none
+         */
+        synchronized byte[] pop() {
+            if (count == 0) return null;
+            final byte[] array = slots[--count];
+            slots[count] = null;
+            return array;
+        }
+
+        /**
+         * Keep an array.
+         * 
+         * @param array the array to keep
+         * 
+         * @return {@code true} if the array was kept; {@code false} if
+         * the stack is full
+         */
+        synchronized boolean push(byte[] array) {
+            if (count == slots.length) {
+                if (count >= bound) return false;
+                slots = Arrays.copyOf(slots, (int) Long
+                    .min(bound, Long.max(16, 2L * count)));
+            }
+            slots[count++] = array;
+            return true;
+        }
+    }
+
+    /**
+     * Specifies the default limit on the total size of arrays in the
+     * shared depot, namely {@value} bytes.
+     */
+    public static final long DEPOT_LIMIT = 4L * 1024 * 1024;
+
+    /**
+     * Builds a buffer pool in stages.
+     */
+    public static final class Builder {
+        private int[] sizes;
+
+        private long depotLimit = DEPOT_LIMIT;
+
+        private Builder() {
+            int[] s = new int[12];
+            int n = 0;
+            for (int size = 128; size <= 64 * 1024; size *= 2)
+                s[n++] = size;
+            s[n++] = RecordWriter.BUFFER_LENGTH;
+            s[n++] = RecordReader.BUFFER_SIZE;
+            sizes = Arrays.copyOf(s, n);
+        }
+
+        /**
+         * Set the size classes.
+         * 
+         * @param sizes the array sizes to be pooled
+         * 
+         * @return this object
+         * 
+         * @throws IllegalArgumentException if no size is given, or a
+         * size is not positive
+         */
+        public Builder sizes(int... sizes) {
+            int[] s = sizes.clone();
+            Arrays.sort(s);
+            s = Arrays.stream(s).distinct().toArray();
+            if (s.length == 0 || s[0] <= 0)
+                throw new IllegalArgumentException("bad sizes "
+                    + Arrays.toString(sizes));
+            this.sizes = s;
+            return this;
+        }
+
+        /**
+         * Set the limit on the total size of arrays in the shared
+         * depot.
+         * 
+         * @param depotLimit the limit in bytes
+         * 
+         * @return this object
+         * 
+         * @default {@value BufferPool#DEPOT_LIMIT}
+         */
+        public Builder depotLimit(long depotLimit) {
+            this.depotLimit = depotLimit;
+            return this;
+        }
+
+        /**
+         * Create a buffer pool with the current parameters.
+         * 
+         * @return the new pool
+         */
+        public BufferPool create() {
+            return new BufferPool(sizes, depotLimit);
+        }
+    }
+
+    /**
+     * Prepare to create a buffer pool.
+     * 
+     * @return a builder with default parameters
+     * 
+     * @constructor
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    private static final class Shared {
+        static final BufferPool INSTANCE = start().create();
+    }
+
+    /**
+     * Get a pool with default parameters shared by the whole process.
+     * 
+     * @return the shared pool
+     */
+    public static BufferPool shared() {
+        return Shared.INSTANCE;
+    }
+
+    /**
+     * Identify the smallest size class no smaller than a given size.
+     * 
+     * @param size the requested size
+     * 
+     * @return the size class; or {@code -1} if the size is too big
+     */
+    private int classFor(int size) {
+        for (int c = 0; c < sizes.length; c++)
+            if (sizes[c] >= size) return c;
+        return -1;
+    }
+
+    /**
+     * Obtain an array.
+     * 
+     * @param size the minimum size
+     * 
+     * @return an array of at least the requested size, possibly
+     * containing old data
+     */
+    public byte[] allocate(int size) {
+        final int c = classFor(size);
+        if (c < 0) {
+            misses.increment();
+            return new byte[size];
+        }
+        final int len = sizes[c];
+        byte[] array = depot[c].pop();
+        if (array != null) {
+            depotBytes.addAndGet(-len);
+            hits.increment();
+            return array;
+        }
+        misses.increment();
+        return new byte[len];
+    }
+
+    /**
+     * Return an array for re-use. Arrays not of a class size are
+     * ignored. The caller must not retain the reference.
+     * 
+     * @param array the array to be recycled
+     */
+    public void release(byte[] array) {
+        final int len = array.length;
+        final int c = Arrays.binarySearch(sizes, len);
+        if (c < 0) return;
+        if (depotBytes.addAndGet(len) > depotLimit ||
+            !depot[c].push(array)) depotBytes.addAndGet(-len);
+    }
+
+    /**
+     * Get the number of requests met with a recycled array.
+     * 
+     * @return the number of hits
+     */
+    public long hits() {
+        return hits.sum();
+    }
+
+    /**
+     * Get the number of requests met with a new array.
+     * 
+     * @return the number of misses
+     */
+    public long misses() {
+        return misses.sum();
+    }
+
+    /**
+     * Get the total size of arrays held in the shared depot.
+     * 
+     * @return the depot size in bytes
+     */
+    public long depotBytes() {
+        return depotBytes.get();
+    }
+}
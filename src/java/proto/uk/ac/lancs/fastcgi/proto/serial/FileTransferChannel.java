@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.proto.serial;
+
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.nio.channels.GatheringByteChannel;
+
+/**
+ * Accepts regions of files as well as buffers. An implementation might
+ * pass the bytes of a file to its destination without copying them
+ * through user space. {@link RecordWriter} uses this interface, if
+ * implemented by its channel, to transmit file content as record
+ * payloads.
+ * 
+ * @author simpsons
+ */
+public interface FileTransferChannel extends GatheringByteChannel {
+    /**
+     * Write a region of a file to the channel. The file's own position
+     * is neither consulted nor modified.
+     * 
+     * @param file the file containing the bytes
+     * 
+     * @param position the offset into the file of the first byte to
+     * write
+     * 
+     * @param count the number of bytes to write
+     * 
+     * @return the number of bytes written, which is less than requested
+     * only if the end of the file was reached
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    long transferFrom(FileInputStream file, long position, long count)
+        throws IOException;
+}
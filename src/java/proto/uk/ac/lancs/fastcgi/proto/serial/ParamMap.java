@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.proto.serial;
+
+import java.nio.charset.Charset;
+import java.nio.charset.StandardCharsets;
+import java.util.AbstractMap;
+import java.util.AbstractSet;
+import java.util.Iterator;
+import java.util.Map;
+import java.util.NoSuchElementException;
+import java.util.Set;
+
+/**
+ * Presents byte-encoded parameters as an immutable map. The encoded
+ * bytes are retained in a single array, with an index of where each
+ * name and value lies. Names are decoded when the map is built, but
+ * well-known CGI variable names are matched against a table of
+ * constant strings, so they are not allocated anew. Values are decoded
+ * only when first accessed.
+ * 
+ * <p>
+ * Duplicate names are resolved in favour of the last occurrence.
+ * Instances are safe for use by several threads, although two threads
+ * accessing the same value for the first time might each decode it.
+ *
+ * @author simpsons
+ */
+public final class ParamMap extends AbstractMap<String, String> {
+    /**
+     * Lists well-known names of CGI variables.
+     */
+    private static final String[] WELL_KNOWN = {
+        "AUTH_TYPE", "CONTENT_LENGTH", "CONTENT_TYPE", "CONTEXT_PREFIX",
+        "CONTEXT_DOCUMENT_ROOT", "DOCUMENT_ROOT", "DOCUMENT_URI",
+        "FCGI_ROLE", "GATEWAY_INTERFACE", "HTTPS", "PATH", "PATH_INFO",
+        "PATH_TRANSLATED", "QUERY_STRING", "REDIRECT_STATUS",
+        "REMOTE_ADDR", "REMOTE_HOST", "REMOTE_IDENT", "REMOTE_PORT",
+        "REMOTE_USER", "REQUEST_METHOD", "REQUEST_SCHEME", "REQUEST_URI",
+        "SCRIPT_FILENAME", "SCRIPT_NAME", "SERVER_ADDR", "SERVER_ADMIN",
+        "SERVER_NAME", "SERVER_PORT", "SERVER_PROTOCOL",
+        "SERVER_SIGNATURE", "SERVER_SOFTWARE", "UNIQUE_ID",
+        "HTTP_ACCEPT", "HTTP_ACCEPT_CHARSET", "HTTP_ACCEPT_ENCODING",
+        "HTTP_ACCEPT_LANGUAGE", "HTTP_AUTHORIZATION",
+        "HTTP_CACHE_CONTROL", "HTTP_CONNECTION", "HTTP_CONTENT_LENGTH",
+        "HTTP_CONTENT_TYPE", "HTTP_COOKIE", "HTTP_DNT", "HTTP_HOST",
+        "HTTP_IF_MATCH", "HTTP_IF_MODIFIED_SINCE", "HTTP_IF_NONE_MATCH",
+        "HTTP_IF_RANGE", "HTTP_IF_UNMODIFIED_SINCE", "HTTP_ORIGIN",
+        "HTTP_PRAGMA", "HTTP_RANGE", "HTTP_REFERER",
+        "HTTP_SEC_CH_UA", "HTTP_SEC_CH_UA_MOBILE",
+        "HTTP_SEC_CH_UA_PLATFORM", "HTTP_SEC_FETCH_DEST",
+        "HTTP_SEC_FETCH_MODE", "HTTP_SEC_FETCH_SITE",
+        "HTTP_SEC_FETCH_USER", "HTTP_TE", "HTTP_UPGRADE",
+        "HTTP_UPGRADE_INSECURE_REQUESTS", "HTTP_USER_AGENT", "HTTP_VIA",
+        "HTTP_X_FORWARDED_FOR", "HTTP_X_FORWARDED_HOST",
+        "HTTP_X_FORWARDED_PROTO", "HTTP_X_REAL_IP",
+        "HTTP_X_REQUESTED_WITH",
+    };
+
+    /**
+     * Holds the well-known names in an open-addressed hash table,
+     * indexed by the same hash as {@link String#hashCode()}.
+     */
+    private static final String[] KNOWN_TABLE;
+
+    static {
+        int cap = Integer.highestOneBit(WELL_KNOWN.length * 4 - 1) << 1;
+        KNOWN_TABLE = new String[cap];
+        for (String name : WELL_KNOWN) {
+            int i = name.hashCode() & (cap - 1);
+            while (KNOWN_TABLE[i] != null)
+                i = (i + 1) & (cap - 1);
+            KNOWN_TABLE[i] = name;
+        }
+    }
+
+    /**
+     * Find a well-known name matching a byte sequence. Only bytes
+     * under 128 can match, so the caller must ensure that the
+     * character encoding is ASCII-compatible.
+     * 
+     * @param buf the array containing the bytes
+     * 
+     * @param off the offset of the first byte
+     * 
+     * @param len the number of bytes
+     * 
+     * @return the matching name; or {@code null} if none matches
+     */
+    private static String findKnown(byte[] buf, int off, int len) {
+        int h = 0;
+        for (int i = 0; i < len; i++) {
+            final byte b = buf[off + i];
+            if (b < 0) return null;
+            h = 31 * h + b;
+        }
+        final int mask = KNOWN_TABLE.length - 1;
+        for (int i = h & mask;; i = (i + 1) & mask) {
+            final String cand = KNOWN_TABLE[i];
+            if (cand == null) return null;
+            if (cand.length() != len) continue;
+            int j = 0;
+            while (j < len && cand.charAt(j) == buf[off + j])
+                j++;
+            if (j == len) return cand;
+        }
+    }
+
+    private static boolean isAsciiCompatible(Charset charset) {
+        return charset.equals(StandardCharsets.UTF_8) ||
+            charset.equals(StandardCharsets.ISO_8859_1) ||
+            charset.equals(StandardCharsets.US_ASCII);
+    }
+
+    private final byte[] data;
+
+    private final Charset charset;
+
+    /**
+     * Holds the start of each entry's name, and the lengths of the name
+     * and value, three elements per entry. The value immediately
+     * follows the name.
+     */
+    private final int[] index;
+
+    /**
+     * Holds each entry's decoded name.
+     */
+    private final String[] names;
+
+    /**
+     * Holds each entry's decoded value, once it has been accessed.
+     */
+    private final String[] values;
+
+    /**
+     * Lists the entries that are not superseded by later entries of
+     * the same name, in order of the names' first appearance.
+     */
+    private final int[] live;
+
+    private final int size;
+
+    /**
+     * Holds positions in {@link #live} plus one, indexed by the hash
+     * of the name; zero marks an empty slot.
+     */
+    private final int[] slots;
+
+    /**
+     * Create a map from encoded parameters.
+     * 
+     * @param data the bytes of the encoded parameters, which must not
+     * be modified subsequently
+     * 
+     * @param index the start of each entry's name, and the lengths of
+     * the name and value, as three elements per entry
+     * 
+     * @param count the number of entries
+     * 
+     * @param charset the character encoding of names and values
+     */
+    ParamMap(byte[] data, int[] index, int count, Charset charset) {
+        this.data = data;
+        this.index = index;
+        this.charset = charset;
+        this.names = new String[count];
+        this.values = new String[count];
+        this.live = new int[count];
+        this.slots =
+            new int[count == 0 ? 1 :
+                Integer.highestOneBit(count * 2 - 1) << 1];
+
+        final boolean ascii = isAsciiCompatible(charset);
+        final int mask = slots.length - 1;
+        int n = 0;
+        for (int e = 0; e < count; e++) {
+            final int start = index[e * 3];
+            final int len = index[e * 3 + 1];
+            String name = ascii ? findKnown(data, start, len) : null;
+            if (name == null) name = new String(data, start, len, charset);
+            names[e] = name;
+
+            int i = name.hashCode() & mask;
+            while (true) {
+                final int pos = slots[i] - 1;
+                if (pos < 0) {
+                    slots[i] = n + 1;
+                    live[n++] = e;
+                    break;
+                }
+                if (names[live[pos]].equals(name)) {
+                    live[pos] = e;
+                    break;
+                }
+                i = (i + 1) & mask;
+            }
+        }
+        this.size = n;
+    }
+
+    /**
+     * Find the entry for a name.
+     * 
+     * @param key the name
+     * 
+     * @return the entry number; or {@code -1} if not present
+     */
+    private int find(Object key) {
+        if (!(key instanceof String name)) return -1;
+        final int mask = slots.length - 1;
+        for (int i = name.hashCode() & mask;; i = (i + 1) & mask) {
+            final int pos = slots[i] - 1;
+            if (pos < 0) return -1;
+            final int e = live[pos];
+            if (names[e].equals(name)) return e;
+        }
+    }
+
+    /**
+     * Get an entry's value, decoding it if not already done.
+     * 
+     * @param e the entry number
+     * 
+     * @return the value
+     */
+    private String value(int e) {
+        String v = values[e];
+        if (v != null) return v;
+        final int vstart = index[e * 3] + index[e * 3 + 1];
+        v = new String(data, vstart, index[e * 3 + 2], charset);
+        values[e] = v;
+        return v;
+    }
+
+    @Override
+    public String get(Object key) {
+        final int e = find(key);
+        return e < 0 ? null : value(e);
+    }
+
+    @Override
+    public boolean containsKey(Object key) {
+        return find(key) >= 0;
+    }
+
+    @Override
+    public int size() {
+        return size;
+    }
+
+    @Override
+    public boolean isEmpty() {
+        return size == 0;
+    }
+
+    private final Set<Map.Entry<String, String>> entrySet =
+        new AbstractSet<Map.Entry<String, String>>() {
+            @Override
+            public Iterator<Map.Entry<String, String>> iterator() {
+                return new Iterator<Map.Entry<String, String>>() {
+                    int next = 0;
+
+                    @Override
+                    public boolean hasNext() {
+                        return next < size;
+                    }
+
+                    @Override
+                    public Map.Entry<String, String> next() {
+                        if (next >= size) throw new NoSuchElementException();
+                        final int e = live[next++];
+                        return new AbstractMap.SimpleImmutableEntry<>(names[e],
+                                                                      value(e));
+                    }
+                };
+            }
+
+            @Override
+            public int size() {
+                return size;
+            }
+        };
+
+    @Override
+    public Set<Map.Entry<String, String>> entrySet() {
+        return entrySet;
+    }
+}
@@ -44,13 +44,40 @@ import java.util.Map;
 import java.util.function.Consumer;
 
 /**
- * Reads byte-encoded parameters from a sequence of input streams.
+ * Reads byte-encoded parameters from a sequence of input streams. The
+ * parameters are either decoded into a supplied map as they arrive, or
+ * indexed and delivered as a {@link ParamMap} once complete.
  *
  * @author simpsons
  */
 public class ParamReader {
+    /**
+     * Receives decoded parameters; or {@code null} if a
+     * {@link ParamMap} is to be built
+     */
     private final Map<? super String, ? super String> params;
 
+    /**
+     * Receives the completed parameters; or {@code null} if they are
+     * being decoded into {@link #params}
+     */
+    private final Consumer<? super ParamMap> sink;
+
+    /**
+     * Holds the start of each indexed parameter's name, and the lengths
+     * of its name and value
+     */
+    private int[] index;
+
+    private int count = 0;
+
+    /**
+     * Holds the number of leading bytes of the buffer consumed by
+     * indexed parameters. This remains zero if parameters are being
+     * decoded into {@link #params}.
+     */
+    private int pos = 0;
+
     private final Consumer<byte[]> pool;
 
     private final Charset charset;
@@ -74,11 +101,48 @@ public class ParamReader {
     public ParamReader(Map<? super String, ? super String> dest,
                        Charset charset, byte[] buf, Consumer<byte[]> pool) {
         this.params = dest;
+        this.sink = null;
         this.charset = charset;
         this.buf = buf;
         this.pool = pool;
+        this.buffers = null;
+    }
+
+    /**
+     * Prepare to read byte-encoded parameters into a map that decodes
+     * values on demand.
+     * 
+     * @param dest the recipient of the completed map
+     * 
+     * @param charset the character encoding for parameter names and
+     * values
+     * 
+     * @param buffers a pool supplying the internal buffer as it grows,
+     * and taking it back on completion
+     */
+    public ParamReader(Consumer<? super ParamMap> dest, Charset charset,
+                       BufferPool buffers) {
+        this.params = null;
+        this.sink = dest;
+        this.charset = charset;
+        this.buffers = buffers;
+        this.buf = buffers.allocate(INITIAL_BUFFER_SIZE);
+        this.pool = buffers::release;
+        this.index = new int[48];
     }
 
+    /**
+     * Specifies the initial size of a pooled buffer, namely {@value}
+     * bytes.
+     */
+    private static final int INITIAL_BUFFER_SIZE = 1024;
+
+    /**
+     * Supplies larger buffers as the parameters grow; or {@code null}
+     * if the buffer is simply reallocated
+     */
+    private final BufferPool buffers;
+
     /**
      * Read all bytes from a stream, and decode them as parameters.
      * 
@@ -94,22 +158,29 @@ public class ParamReader {
     }
 
     /**
-     * Indicate that no more encoded parameter data is forthcoming.
+     * Indicate that no more encoded parameter data is forthcoming. If
+     * a {@link ParamMap} is being built, it is delivered now, even if
+     * there are trailing bytes.
      * 
      * @throws IllegalStateException if this method has already been
      * called, or if there are trailing bytes in the internal buffer
      */
     public void complete() {
         /* Detect a duplicate call, and save away the parameter buffer
-         * for later use. */
+         * for later use. The indexed bytes are copied out first, so the
+         * map need not hold on to the whole buffer. */
         if (buf == null)
             throw new IllegalStateException("parameters ended twice");
+        if (sink != null)
+            sink.accept(new ParamMap(Arrays.copyOf(buf, pos), index, count,
+                                     charset));
         pool.accept(buf);
         buf = null;
 
         /* Check that we have no excess parameter data. */
-        if (len > 0)
-            throw new IllegalStateException("trailing parameter bytes: " + len);
+        final int rem = len - pos;
+        if (rem > 0)
+            throw new IllegalStateException("trailing parameter bytes: " + rem);
     }
 
     /**
@@ -128,9 +199,15 @@ public class ParamReader {
 
         /* If our array is too small, allocate a little more space. */
         if (len == buf.length) {
-            len += 128;
-            len *= 2;
-            buf = Arrays.copyOf(buf, len);
+            final int newSize = (len + 128) * 2;
+            if (buffers == null) {
+                buf = Arrays.copyOf(buf, newSize);
+            } else {
+                byte[] bigger = buffers.allocate(newSize);
+                System.arraycopy(buf, 0, bigger, 0, len);
+                buffers.release(buf);
+                buf = bigger;
+            }
         }
 
         /* Read as many bytes into the remaining space of the array as
@@ -148,9 +225,11 @@ public class ParamReader {
     }
 
     /**
-     * Attempt to decode one parameter at the start of the buffer. If a
-     * parameter is decoded, its bytes are removed from the buffer, and
-     * the trailing bytes are moved to the head of the buffer.
+     * Attempt to decode one parameter at the start of the unconsumed
+     * bytes of the buffer. If a parameter is decoded into a supplied
+     * map, its bytes are removed from the buffer, and the trailing bytes
+     * are moved to the head of the buffer. Otherwise, the parameter is
+     * indexed, and its bytes are retained.
      * 
      * @return {@code true} if the method should be called again;
      * {@code false} otherwise, e.g., if there are insufficient bytes to
@@ -161,44 +240,45 @@ public class ParamReader {
          * length is either 1 byte (in the range 0 to 127) or 4 bytes
          * (big-endian, with the top bit set in the first, which must be
          * cleared.). */
-        if (len < 2) return false;
+        final int avail = len - pos;
+        if (avail < 2) return false;
         final int nameLen, valueLen, nameStart;
-        if (buf[0] < 0) {
+        if (buf[pos] < 0) {
             /* The name length is 4 bytes. Are there sufficient to
              * encode the value length? */
-            if (len < 5) return false;
+            if (avail < 5) return false;
 
-            if (buf[4] < 0) {
+            if (buf[pos + 4] < 0) {
                 /* The value length is also 4 bytes. Are there
                  * sufficient to encode it? */
-                if (len < 8) return false;
+                if (avail < 8) return false;
                 /* Decode the value length. The name starts at 4+4. */
-                valueLen = getInt(buf, 4);
-                nameStart = 8;
+                valueLen = getInt(buf, pos + 4);
+                nameStart = pos + 8;
             } else {
                 /* The value length is a single byte. The name starts at
                  * 4+1. */
-                valueLen = buf[4] & 0xff;
-                nameStart = 5;
+                valueLen = buf[pos + 4] & 0xff;
+                nameStart = pos + 5;
             }
-            nameLen = getInt(buf, 0);
+            nameLen = getInt(buf, pos);
         } else {
             /* The name length is 1 byte. We already know we have at
              * least 2. */
-            if (buf[1] < 0) {
+            if (buf[pos + 1] < 0) {
                 /* The value length is 4 bytes. Are there sufficient to
                  * encode it? */
-                if (len < 5) return false;
+                if (avail < 5) return false;
                 /* Decode the value length. The name starts at 1+4. */
-                valueLen = getInt(buf, 1);
-                nameStart = 5;
+                valueLen = getInt(buf, pos + 1);
+                nameStart = pos + 5;
             } else {
                 /* The value length is 1 byte, so the name starts at
                  * position 2. */
-                valueLen = buf[1] & 0xff;
-                nameStart = 2;
+                valueLen = buf[pos + 1] & 0xff;
+                nameStart = pos + 2;
             }
-            nameLen = buf[0] & 0xff;
+            nameLen = buf[pos] & 0xff;
         }
 
         /* Work out how many bytes we need in total. If we don't have
@@ -206,6 +286,19 @@ public class ParamReader {
         final int end = nameStart + nameLen + valueLen;
         if (len < end) return false;
 
+        if (params == null) {
+            /* We have all the bytes for a complete parameter. Index it
+             * for later decoding, and move on to the next. */
+            if (count * 3 == index.length)
+                index = Arrays.copyOf(index, index.length * 2);
+            index[count * 3] = nameStart;
+            index[count * 3 + 1] = nameLen;
+            index[count * 3 + 2] = valueLen;
+            count++;
+            pos = end;
+            return len - pos >= 2;
+        }
+
         /* We have all the bytes for a complete parameter. Decode and
          * store it. */
         final String name = new String(buf, nameStart, nameLen, charset);
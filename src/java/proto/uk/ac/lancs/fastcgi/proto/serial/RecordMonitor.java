@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.proto.serial;
+
+/**
+ * Observes records and transport operations of a {@link RecordReader}
+ * or {@link RecordWriter}. Methods are called on the reading or
+ * writing thread, often concurrently for a writer, so implementations
+ * should be cheap and thread-safe.
+ *
+ * @author simpsons
+ */
+public interface RecordMonitor {
+    /**
+     * Note that a record has been received.
+     * 
+     * @default This method does nothing.
+     * 
+     * @param type the record type
+     * 
+     * @param contentLength the length of the record's content,
+     * excluding header and padding
+     */
+    default void received(int type, int contentLength) {}
+
+    /**
+     * Note that a record has been sent, or queued to be sent.
+     * 
+     * @default This method does nothing.
+     * 
+     * @param type the record type
+     * 
+     * @param contentLength the length of the record's content,
+     * excluding header and padding
+     */
+    default void sent(int type, int contentLength) {}
+
+    /**
+     * Note that a read operation has been invoked on the underlying
+     * stream or channel.
+     * 
+     * @default This method does nothing.
+     * 
+     * @param amount the number of bytes obtained, or negative at
+     * end-of-stream
+     */
+    default void readCall(long amount) {}
+
+    /**
+     * Note that a write operation has been invoked on the underlying
+     * stream or channel.
+     * 
+     * @default This method does nothing.
+     * 
+     * @param amount the number of bytes written
+     */
+    default void writeCall(long amount) {}
+
+    /**
+     * Note that the writer's transmission lock has been acquired.
+     * 
+     * @default This method does nothing.
+     * 
+     * @param nanos the time spent waiting for the lock, in nanoseconds
+     */
+    default void lockAcquired(long nanos) {}
+}
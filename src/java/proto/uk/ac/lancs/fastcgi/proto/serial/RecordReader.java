@@ -38,13 +38,21 @@ package uk.ac.lancs.fastcgi.proto.serial;
 
 import java.io.IOException;
 import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.ReadableByteChannel;
 import java.nio.charset.Charset;
 import java.util.HashMap;
 import java.util.Map;
+import java.util.Objects;
 import uk.ac.lancs.fastcgi.proto.RecordTypes;
 
 /**
- * Deserializes FastCGI records.
+ * Deserializes FastCGI records. Bytes are read from the stream into an
+ * internal buffer in as large amounts as the stream will yield, so
+ * several records may be obtained with a single read. Each record is
+ * parsed only once it is wholly in the buffer, and its content is
+ * presented to the handler as a view of the buffer.
  *
  * @author simpsons
  */
@@ -55,6 +63,26 @@ public class RecordReader {
 
     private final RecordHandler handler;
 
+    /**
+     * Specifies the size of a record header.
+     */
+    private static final int HEADER_LENGTH = 8;
+
+    /**
+     * Specifies the size of the largest possible record, namely
+     * {@value} bytes, comprising the header, the maximum content
+     * length, and the maximum padding length.
+     */
+    private static final int MAX_RECORD_LENGTH = HEADER_LENGTH + 0xffff + 0xff;
+
+    /**
+     * Specifies the capacity of the read buffer. This is large enough
+     * to hold two of the largest possible records, so that a read is
+     * never limited to a small amount just because an earlier record
+     * has not yet been processed.
+     */
+    static final int BUFFER_SIZE = 2 * MAX_RECORD_LENGTH;
+
     /**
      * Prepare to read records from a stream.
      * 
@@ -66,33 +94,170 @@ public class RecordReader {
      */
     public RecordReader(InputStream in, Charset charset,
                         RecordHandler handler) {
+        this(in, charset, handler, BufferPool.shared());
+    }
+
+    /**
+     * Prepare to read records from a stream, using a buffer from a
+     * given pool.
+     * 
+     * @param in the stream of serialized records
+     * 
+     * @param charset the encoding to expect for name/value pairs
+     * 
+     * @param handler a destination for deserialized records
+     * 
+     * @param buffers the pool to obtain the read buffer from, and to
+     * return it to on {@link #release()}
+     */
+    public RecordReader(InputStream in, Charset charset,
+                        RecordHandler handler, BufferPool buffers) {
+        this(in, charset, handler, buffers, null);
+    }
+
+    /**
+     * Prepare to read records from a stream, using a buffer from a
+     * given pool, and reporting activity to a monitor.
+     * 
+     * @param in the stream of serialized records
+     * 
+     * @param charset the encoding to expect for name/value pairs
+     * 
+     * @param handler a destination for deserialized records
+     * 
+     * @param buffers the pool to obtain the read buffer from, and to
+     * return it to on {@link #release()}
+     * 
+     * @param monitor an observer of received records and read
+     * operations; or {@code null} if not required
+     */
+    public RecordReader(InputStream in, Charset charset,
+                        RecordHandler handler, BufferPool buffers,
+                        RecordMonitor monitor) {
         this.in = in;
         this.charset = charset;
         this.handler = handler;
+        this.buffers = buffers;
+        this.monitor = monitor;
+        this.buf = buffers.allocate(BUFFER_SIZE);
     }
 
-    private byte[] buf = new byte[8];
+    private final RecordMonitor monitor;
+
+    private final BufferPool buffers;
+
+    /**
+     * Holds bytes read from the stream but not yet processed; or
+     * {@code null} once released.
+     */
+    private byte[] buf;
+
+    /**
+     * Return the read buffer to its pool. The reader must not be used
+     * again. Subsequent calls have no effect.
+     */
+    public void release() {
+        if (buf == null) return;
+        buffers.release(buf);
+        buf = null;
+    }
+
+    /**
+     * Indexes the first unprocessed byte in {@link #buf}.
+     */
+    private int start = 0;
+
+    /**
+     * Indexes the byte in {@link #buf} after the last one read.
+     */
+    private int end = 0;
 
+    /**
+     * Ensure that a number of unprocessed bytes are held in the
+     * buffer. If there are fewer, the unprocessed bytes are moved to
+     * the start of the buffer if necessary, and as many bytes as the
+     * stream will yield are read after them, until there are enough.
+     * 
+     * @param exp the required number of bytes
+     * 
+     * @return {@code true} if the bytes are available; {@code false} if
+     * EOF was reached first
+     * 
+     * @throws IOException if an I/O error occurred
+     */
     private boolean require(int exp) throws IOException {
-        if (exp > buf.length) buf = new byte[exp];
-        int len = 0;
-        while (len < exp) {
-            int got = in.read(buf, len, exp - len);
+        assert exp <= buf.length;
+        if (end - start >= exp) return true;
+        if (buf.length - start < exp) {
+            System.arraycopy(buf, start, buf, 0, end - start);
+            end -= start;
+            start = 0;
+        }
+        while (end - start < exp) {
+            int got = in.read(buf, end, buf.length - end);
+            if (monitor != null) monitor.readCall(got);
             if (got < 0) return false;
-            len += got;
+            end += got;
         }
         return true;
     }
 
-    private void skip(int amount) throws IOException {
-        while (amount > 0) {
-            /* We can cast the result to int because we only supply an
-             * int. */
-            int got = (int) in.skip(amount);
-            amount -= got;
+    /**
+     * Presents the content of the current record. The same object is
+     * re-used for every record, and is only valid during the call to
+     * the handler.
+     */
+    private final class Content extends InputStream {
+        private int pos;
+
+        private int lim;
+
+        void reset(int pos, int len) {
+            this.pos = pos;
+            this.lim = pos + len;
+        }
+
+        @Override
+        public int read() {
+            if (pos == lim) return -1;
+            return buf[pos++] & 0xff;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) {
+            Objects.checkFromIndexSize(off, len, b.length);
+            if (len == 0) return 0;
+            if (pos == lim) return -1;
+            final int amount = Integer.min(len, lim - pos);
+            System.arraycopy(buf, pos, b, off, amount);
+            pos += amount;
+            return amount;
+        }
+
+        @Override
+        public long skip(long n) {
+            if (n <= 0) return 0;
+            final int amount = (int) Long.min(n, lim - pos);
+            pos += amount;
+            return amount;
+        }
+
+        @Override
+        public int available() {
+            return lim - pos;
+        }
+
+        @Override
+        public long transferTo(OutputStream out) throws IOException {
+            final int amount = lim - pos;
+            out.write(buf, pos, amount);
+            pos = lim;
+            return amount;
         }
     }
 
+    private final Content content = new Content();
+
     /**
      * Read and process at most one record. If EOF is encountered before
      * reading a complete record, {@code false} is returned.
@@ -105,15 +270,25 @@ public class RecordReader {
     public boolean processRecord() throws IOException {
         if (false) System.err.printf("Awaiting next record...%n");
         /* Read in the header. */
-        if (!require(8)) return false;
+        if (!require(HEADER_LENGTH)) return false;
         if (false) System.err.printf("  Got header%n");
-        final int rver = unser(buf, 0, 1);
-        final int rtype = unser(buf, 1, 1);
-        final int rid = unser(buf, 2, 2);
-        int clen = unser(buf, 4, 2);
-        int plen = unser(buf, 6, 1);
+        final int rver = unser(buf, start, 1);
+        final int rtype = unser(buf, start + 1, 1);
+        final int rid = unser(buf, start + 2, 2);
+        final int clen = unser(buf, start + 4, 2);
+        final int plen = unser(buf, start + 6, 1);
         if (false) System.err.printf("ver=%d type=%d rid=%d clen=%d plen=%d%n",
                                      rver, rtype, rid, clen, plen);
+
+        /* Get the rest of the record, and consume it before handling,
+         * so that the buffer remains consistent even if the handler
+         * throws. */
+        final int rlen = HEADER_LENGTH + clen + plen;
+        if (!require(rlen)) return false;
+        final int cpos = start + HEADER_LENGTH;
+        start += rlen;
+        if (monitor != null) monitor.received(rtype, clen);
+
         int reasons = 0;
         switch (rtype) {
         case RecordTypes.ABORT_REQUEST:
@@ -121,7 +296,6 @@ public class RecordReader {
             if (clen != 0) reasons |= RecordHandler.BAD_LENGTH;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
@@ -133,13 +307,11 @@ public class RecordReader {
             if (clen != 8) reasons |= RecordHandler.BAD_LENGTH;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
-            if (!require(clen)) return false;
-            int role = unser(buf, 0, 2);
-            int flags = unser(buf, 2, 1);
+            int role = unser(buf, cpos, 2);
+            int flags = unser(buf, cpos + 2, 1);
             if (false)
                 System.err.printf("beginning req %d in role %d with flags %x%n",
                                   rid, role, flags);
@@ -150,53 +322,44 @@ public class RecordReader {
             if (rver < 1) reasons |= RecordHandler.BAD_VERSION;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
             Map<String, String> vars = new HashMap<>();
-            while (clen > 0) {
-                if (!require(1)) return false;
-                int nlen = unser(buf, 0, 1);
-                clen--;
+            int p = cpos;
+            final int cend = cpos + clen;
+            while (p < cend) {
+                int nlen = unser(buf, p++, 1);
                 if (nlen > 127) {
-                    if (clen < 3) break;
-                    if (!require(3)) return false;
-                    clen -= 3;
-                    nlen = unser(nlen & 0x7f, buf, 0, 3);
+                    if (cend - p < 3) break;
+                    nlen = unser(nlen & 0x7f, buf, p, 3);
+                    p += 3;
                 }
 
-                if (clen < 1) break;
-                if (!require(1)) return false;
-                int vlen = unser(buf, 0, 1);
-                clen--;
+                if (cend - p < 1) break;
+                int vlen = unser(buf, p++, 1);
                 if (vlen > 127) {
-                    if (clen < 3) break;
-                    if (!require(3)) return false;
-                    clen -= 3;
-                    vlen = unser(vlen & 0x7f, buf, 0, 3);
+                    if (cend - p < 3) break;
+                    vlen = unser(vlen & 0x7f, buf, p, 3);
+                    p += 3;
                 }
 
-                if (clen < nlen) break;
-                if (!require(nlen)) return false;
-                clen -= nlen;
-                String name = new String(buf, 0, nlen, charset);
+                if (cend - p < nlen) break;
+                String name = new String(buf, p, nlen, charset);
+                p += nlen;
 
-                if (clen < vlen) break;
-                if (!require(vlen)) return false;
-                clen -= vlen;
-                String value = new String(buf, 0, vlen, charset);
+                if (cend - p < vlen) break;
+                String value = new String(buf, p, vlen, charset);
+                p += vlen;
                 vars.put(name, value);
             }
-            plen += clen;
             handler.getValues(vars.keySet());
             break;
 
-        case RecordTypes.PARAMS: {
+        case RecordTypes.PARAMS:
             if (rver < 1) reasons |= RecordHandler.BAD_VERSION;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
@@ -204,19 +367,16 @@ public class RecordReader {
                 handler.paramsEnd(rid);
                 break;
             }
-            FixedLengthInputStream out = new FixedLengthInputStream(clen, in);
             if (false) System.err
                 .printf("Receiving %d bytes of params on req %d%n", clen, rid);
-            handler.params(rid, clen, out);
-            out.skipRemaining();
+            content.reset(cpos, clen);
+            handler.params(rid, clen, content);
             break;
-        }
 
-        case RecordTypes.STDIN: {
+        case RecordTypes.STDIN:
             if (rver < 1) reasons |= RecordHandler.BAD_VERSION;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
@@ -224,17 +384,14 @@ public class RecordReader {
                 handler.stdinEnd(rid);
                 break;
             }
-            FixedLengthInputStream out = new FixedLengthInputStream(clen, in);
-            handler.stdin(rid, clen, out);
-            out.skipRemaining();
+            content.reset(cpos, clen);
+            handler.stdin(rid, clen, content);
             break;
-        }
 
-        case RecordTypes.DATA: {
+        case RecordTypes.DATA:
             if (rver < 1) reasons |= RecordHandler.BAD_VERSION;
             if (rid == 0) reasons |= RecordHandler.BAD_REQ_ID;
             if (reasons != 0) {
-                skip(clen);
                 handler.bad(reasons, rver, rtype, clen, rid);
                 break;
             }
@@ -242,32 +399,64 @@ public class RecordReader {
                 handler.dataEnd(rid);
                 break;
             }
-            FixedLengthInputStream out = new FixedLengthInputStream(clen, in);
-            handler.data(rid, clen, out);
-            out.skipRemaining();
+            content.reset(cpos, clen);
+            handler.data(rid, clen, content);
             break;
-        }
 
         default:
-            if (!require(clen)) return false;
             handler.bad(RecordHandler.UNKNOWN_TYPE, rver, rtype, clen, rid);
             break;
         }
 
-        /* Skip over trailing padding. */
-        while (plen > 0) {
-            long got = in.skip(plen);
-            plen -= got;
-            if (got == 0 && plen > 0) {
-                int c = in.read();
-                if (c < 0) return false;
-                plen--;
-            }
-        }
-
         return true;
     }
 
+    /**
+     * Determine whether a complete record is held in the buffer.
+     * 
+     * @return {@code true} if a call to {@link #processRecord()} will
+     * not need to read more bytes; {@code false} otherwise
+     */
+    private boolean recordReady() {
+        final int avail = end - start;
+        if (avail < HEADER_LENGTH) return false;
+        final int clen = unser(buf, start + 4, 2);
+        final int plen = unser(buf, start + 6, 1);
+        return avail >= HEADER_LENGTH + clen + plen;
+    }
+
+    /**
+     * Read whatever bytes are immediately available from a channel,
+     * and process every record then complete in the buffer. The
+     * channel should be non-blocking, or at least have bytes ready to
+     * read. Bytes of an incomplete record are retained until the next
+     * call.
+     * 
+     * @param channel the source of serialized records
+     * 
+     * @return {@code true} if further bytes might be available later;
+     * {@code false} if end-of-stream was reached
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    public boolean processAvailable(ReadableByteChannel channel)
+        throws IOException {
+        /* Make sure there's room for the largest record after any
+         * partial one we already have. */
+        if (start > 0 && buf.length - end < MAX_RECORD_LENGTH) {
+            System.arraycopy(buf, start, buf, 0, end - start);
+            end -= start;
+            start = 0;
+        }
+        ByteBuffer dst = ByteBuffer.wrap(buf, end, buf.length - end);
+        final int got = channel.read(dst);
+        if (monitor != null) monitor.readCall(got);
+        if (got > 0) end += got;
+        while (recordReady())
+            processRecord();
+        return got >= 0;
+    }
+
     private static int unser(byte[] buf, int off, int len) {
         return unser(0, buf, off, len);
     }
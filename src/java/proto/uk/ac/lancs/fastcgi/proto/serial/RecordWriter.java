@@ -36,11 +36,22 @@
 
 package uk.ac.lancs.fastcgi.proto.serial;
 
+import java.io.EOFException;
+import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.channels.GatheringByteChannel;
 import java.nio.charset.Charset;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
 import java.util.Map;
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicLong;
 import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
 import uk.ac.lancs.fastcgi.proto.RecordTypes;
 
@@ -52,6 +63,15 @@ import uk.ac.lancs.fastcgi.proto.RecordTypes;
 public class RecordWriter {
     private final OutputStream out;
 
+    private final GatheringByteChannel channel;
+
+    /**
+     * Holds framed records awaiting transmission, if records from
+     * several threads are to be coalesced; or {@code null} if each
+     * record is written by its producer
+     */
+    private final Queue<ByteBuffer> queue;
+
     private final Charset charset;
 
     /**
@@ -116,6 +136,29 @@ public class RecordWriter {
         return ALIGNMENT;
     }
 
+    /**
+     * Get the length of a record header. A buffer to be framed in place
+     * by {@link #writeFramedStdout(int, byte[], int)} must reserve this
+     * many bytes before its content.
+     * 
+     * @return the header length
+     */
+    public int headerLength() {
+        return HEADER_LENGTH;
+    }
+
+    /**
+     * Get the size of buffer needed to frame a given amount of content
+     * in place, including the header slot and the largest padding.
+     * 
+     * @param capacity the maximum content length
+     * 
+     * @return the required buffer size
+     */
+    public int framedBufferLength(int capacity) {
+        return HEADER_LENGTH + capacity + ALIGNMENT - 1;
+    }
+
     private static void checkHeaderLength(int amount) {
         assert amount == HEADER_LENGTH :
             "header not " + HEADER_LENGTH + ": " + amount;
@@ -142,7 +185,8 @@ public class RecordWriter {
     }
 
     /**
-     * Prepare to write records.
+     * Prepare to write records. This is equivalent to
+     * <code>{@linkplain #start()}.output(out).charset(charset).create()</code>.
      * 
      * @param out the destination for serialized records
      * 
@@ -150,22 +194,498 @@ public class RecordWriter {
      * pairs
      */
     public RecordWriter(OutputStream out, Charset charset) {
-        this.out = out;
-        this.charset = charset;
+        this(start().output(out).charset(charset));
+    }
+
+    private RecordWriter(Builder builder) {
+        this.out = builder.out;
+        this.channel = builder.channel;
+        this.charset = builder.charset;
+        this.queue = builder.coalesce ? new ConcurrentLinkedQueue<>() : null;
+        this.buffers = builder.buffers;
+        this.monitor = builder.monitor;
+    }
+
+    /**
+     * Builds a record writer in stages.
+     */
+    public static final class Builder {
+        private OutputStream out;
+
+        private GatheringByteChannel channel;
+
+        private Charset charset;
+
+        private boolean coalesce = false;
+
+        private BufferPool buffers = BufferPool.shared();
+
+        private RecordMonitor monitor;
+
+        private Builder() {}
+
+        /**
+         * Write records to a stream. This or
+         * {@link #channel(GatheringByteChannel)} must be called before
+         * {@link #create()}.
+         * 
+         * @param out the destination for serialized records
+         * 
+         * @return this object
+         */
+        public Builder output(OutputStream out) {
+            this.out = out;
+            this.channel = null;
+            return this;
+        }
+
+        /**
+         * Write records to a channel. Each record's header, content and
+         * padding are passed to the channel in a single gathering
+         * write, so the content is not copied by the writer.
+         * 
+         * @param channel the destination for serialized records
+         * 
+         * @return this object
+         */
+        public Builder channel(GatheringByteChannel channel) {
+            this.channel = channel;
+            this.out = null;
+            return this;
+        }
+
+        /**
+         * Set the character encoding for writing name-value pairs. This
+         * must be called before {@link #create()}.
+         * 
+         * @param charset the character encoding
+         * 
+         * @return this object
+         */
+        public Builder charset(Charset charset) {
+            this.charset = charset;
+            return this;
+        }
+
+        /**
+         * Set whether records from several threads are coalesced.
+         * 
+         * @param coalesce {@code true} if records are to be queued and
+         * written in batches by whichever thread claims the flushing
+         * role; {@code false} if each is to be written by its producer
+         * 
+         * @return this object
+         * 
+         * @default {@code false}
+         */
+        public Builder coalesce(boolean coalesce) {
+            this.coalesce = coalesce;
+            return this;
+        }
+
+        /**
+         * Set the source of buffers for framing records.
+         * 
+         * @param buffers the buffer pool
+         * 
+         * @return this object
+         * 
+         * @default {@link BufferPool#shared()}
+         */
+        public Builder buffers(BufferPool buffers) {
+            this.buffers = buffers;
+            return this;
+        }
+
+        /**
+         * Set the observer of sent records, write operations and lock
+         * contention.
+         * 
+         * @param monitor the observer; or {@code null} if not required
+         * 
+         * @return this object
+         * 
+         * @default {@code null}
+         */
+        public Builder monitor(RecordMonitor monitor) {
+            this.monitor = monitor;
+            return this;
+        }
+
+        /**
+         * Create a record writer with the current parameters.
+         * 
+         * @return the new writer
+         * 
+         * @throws IllegalStateException if no destination or character
+         * encoding has been set
+         */
+        public RecordWriter create() {
+            if (out == null && channel == null)
+                throw new IllegalStateException("no destination");
+            if (charset == null) throw new IllegalStateException("no charset");
+            return new RecordWriter(this);
+        }
+    }
+
+    /**
+     * Prepare to create a record writer.
+     * 
+     * @return a builder with default parameters
+     * 
+     * @constructor
+     */
+    public static Builder start() {
+        return new Builder();
+    }
+
+    private final RecordMonitor monitor;
+
+    /**
+     * Prepare to time acquisition of the transmission lock.
+     * 
+     * @return the current time in nanoseconds if a monitor is present;
+     * zero otherwise
+     */
+    private long lockStart() {
+        return monitor == null ? 0 : System.nanoTime();
+    }
+
+    /**
+     * Report acquisition of the transmission lock to the monitor, if
+     * present.
+     * 
+     * @param start the result of an earlier call to
+     * {@link #lockStart()}
+     */
+    private void locked(long start) {
+        if (monitor != null) monitor.lockAcquired(System.nanoTime() - start);
+    }
+
+    /**
+     * Report a write operation to the monitor, if present.
+     * 
+     * @param amount the number of bytes written
+     */
+    private void wrote(long amount) {
+        if (monitor != null) monitor.writeCall(amount);
+    }
+
+    /**
+     * Report a record to the monitor, if present, once it has been
+     * written or queued without error.
+     * 
+     * @param type the record type
+     * 
+     * @param contentLength the content length
+     */
+    private void sent(byte type, int contentLength) {
+        if (monitor != null) monitor.sent(type & 0xff, contentLength);
+    }
+
+    /**
+     * Specifies the size of the largest record, including padding.
+     */
+    private static final int MAX_RECORD_LENGTH =
+        align(HEADER_LENGTH + MAX_CONTENT_LENGTH);
+
+    /**
+     * Specifies how many bytes of queued records are accumulated
+     * before a batch is written. While fewer are queued, the flusher
+     * writes whatever it has, rather than wait for more.
+     */
+    private static final int CORK_LENGTH =
+        HEADER_LENGTH + OPTIMUM_PAYLOAD;
+
+    /**
+     * Specifies the largest batch of queued records.
+     */
+    private static final int MAX_BATCH_LENGTH = 2 * MAX_RECORD_LENGTH;
+
+    /**
+     * Specifies the largest number of queued records in a batch.
+     */
+    private static final int MAX_BATCH_RECORDS = 64;
+
+    /**
+     * Specifies how many bytes may be queued before producers wait
+     * for them to be written.
+     */
+    private static final long QUEUE_LIMIT = 16L * MAX_RECORD_LENGTH;
+
+    /**
+     * Indicates whether a thread has claimed the flushing role.
+     */
+    private final AtomicBoolean flushing = new AtomicBoolean(false);
+
+    /**
+     * Counts the bytes queued but not yet written.
+     */
+    private final AtomicLong queued = new AtomicLong(0);
+
+    /**
+     * Records the error that stopped the flusher, after which no more
+     * records are accepted.
+     */
+    private volatile IOException failure;
+
+    /**
+     * Holds the batch being written. Only used by the flusher.
+     */
+    private final ByteBuffer[] batchBufs = new ByteBuffer[MAX_BATCH_RECORDS];
+
+    /**
+     * Holds the concatenated batch being written to a stream. Only used
+     * by the flusher.
+     */
+    private byte[] batchBytes;
+
+    /**
+     * Queue a framed record, and write out queued records if no other
+     * thread is doing so. If too many bytes are queued, the caller
+     * waits until some have been written. The record's array passes to
+     * this writer, which returns it to {@link #buffers} once written.
+     * 
+     * @param rec the complete record, from its position to its limit,
+     * in an array obtained from {@link #buffers}
+     * 
+     * @throws IOException if an I/O error occurred in writing queued
+     * records, now or earlier
+     */
+    private void enqueue(ByteBuffer rec) throws IOException {
+        IOException ex = failure;
+        if (ex != null) {
+            buffers.release(rec.array());
+            throw new IOException("earlier failure", ex);
+        }
+        final long total = queued.addAndGet(rec.remaining());
+        queue.add(rec);
+        drain();
+        if (total > QUEUE_LIMIT) await(QUEUE_LIMIT);
+    }
+
+    /**
+     * Write out queued records while there are any and no other thread
+     * is doing so.
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    private void drain() throws IOException {
+        /* Having released the role, we check the queue again, as
+         * another thread could have added to it after we found it empty
+         * but before we released, and failed to claim the role. */
+        while (!queue.isEmpty() && flushing.compareAndSet(false, true)) {
+            try {
+                flushQueue();
+            } catch (IOException ex) {
+                failure = ex;
+                queue.clear();
+                queued.set(0);
+                throw ex;
+            } finally {
+                flushing.set(false);
+                synchronized (queue) {
+                    queue.notifyAll();
+                }
+            }
+        }
+    }
+
+    /**
+     * Write out batches of queued records until none remain. Each
+     * batch is gathered until it reaches {@link #CORK_LENGTH}, or no
+     * more records are queued. The caller must hold the flushing role.
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    private void flushQueue() throws IOException {
+        ByteBuffer rec;
+        while ((rec = queue.peek()) != null) {
+            int n = 0;
+            int total = 0;
+            do {
+                if (n > 0 && total + rec.remaining() > MAX_BATCH_LENGTH)
+                    break;
+                queue.poll();
+                batchBufs[n++] = rec;
+                total += rec.remaining();
+            } while (n < MAX_BATCH_RECORDS && total < CORK_LENGTH &&
+                (rec = queue.peek()) != null);
+
+            if (channel != null) {
+                gather(batchBufs, n);
+            } else {
+                if (batchBytes == null) batchBytes = new byte[MAX_BATCH_LENGTH];
+                int pos = 0;
+                for (int i = 0; i < n; i++) {
+                    final int len = batchBufs[i].remaining();
+                    batchBufs[i].get(batchBytes, pos, len);
+                    pos += len;
+                }
+                out.write(batchBytes, 0, pos);
+                wrote(pos);
+            }
+            for (int i = 0; i < n; i++) {
+                buffers.release(batchBufs[i].array());
+                batchBufs[i] = null;
+            }
+            queued.addAndGet(-total);
+        }
+    }
+
+    /**
+     * Wait until no more than a given number of queued bytes remain
+     * unwritten.
+     * 
+     * @param threshold the acceptable number of unwritten bytes
+     * 
+     * @throws IOException if an I/O error occurred in writing queued
+     * records
+     */
+    private void await(long threshold) throws IOException {
+        boolean interrupted = false;
+        try {
+            synchronized (queue) {
+                while (queued.get() > threshold && failure == null) {
+                    try {
+                        queue.wait();
+                    } catch (InterruptedException e) {
+                        interrupted = true;
+                    }
+                }
+            }
+        } finally {
+            if (interrupted) Thread.currentThread().interrupt();
+        }
+        IOException ex = failure;
+        if (ex != null) throw new IOException("flush failure", ex);
+    }
+
+    /**
+     * Wait until all queued records have been written. This should be
+     * called before closing the underlying connection. If records are
+     * not being coalesced, this method returns immediately.
+     * 
+     * @throws RecordIOException if an I/O error occurred in writing
+     * queued records
+     */
+    public void flush() throws RecordIOException {
+        if (queue == null) return;
+        try {
+            await(0);
+        } catch (IOException ex) {
+            throw new RecordIOException("flush", ex);
+        }
     }
 
     /**
-     * Holds a buffer per calling thread.
+     * Write out a complete record held in a buffer from its start to
+     * its position, either immediately or by queuing the buffer itself.
+     * Either way, the buffer's array is returned to {@link #buffers}
+     * once written, so the caller must not release it.
+     * 
+     * @param bf the buffer containing the record, obtained from
+     * {@link #lease(int)}
+     * 
+     * @throws IOException if an I/O error occurred
      */
-    private final ThreadLocal<ByteBuffer> buffer = new ThreadLocal<>() {
-        @Override
-        protected ByteBuffer initialValue() {
-            /* The maximum number of bytes we can write in a single
-             * record is 8 bytes for the header, and 65535 for the
-             * payload, plus enough padding to a multiple of 8. */
-            return ByteBuffer.allocate(align(8 + MAX_CONTENT_LENGTH));
+    private void send(ByteBuffer bf) throws IOException {
+        if (queue != null) {
+            bf.flip();
+            enqueue(bf);
+            return;
         }
-    };
+        try {
+            final long start = lockStart();
+            synchronized (this) {
+                locked(start);
+                transmit(bf);
+            }
+        } finally {
+            buffers.release(bf.array());
+        }
+    }
+
+    /**
+     * Write out a complete record held in a buffer from its start to
+     * its position. The caller must hold the lock on this object.
+     * 
+     * @param bf the buffer containing the record
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    private void transmit(ByteBuffer bf) throws IOException {
+        if (channel == null) {
+            out.write(bf.array(), 0, bf.position());
+            wrote(bf.position());
+        } else {
+            bf.flip();
+            gather(bf);
+        }
+    }
+
+    /**
+     * Write out all remaining bytes of a sequence of buffers to the
+     * channel. The caller must hold the lock on this object.
+     * 
+     * @param bufs the buffers to write
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    private void gather(ByteBuffer... bufs) throws IOException {
+        gather(bufs, bufs.length);
+    }
+
+    /**
+     * Write out all remaining bytes of the leading buffers of an array
+     * to the channel. The caller must hold the lock on this object, or
+     * the flushing role.
+     * 
+     * @param bufs the array of buffers
+     * 
+     * @param len the number of buffers to write
+     * 
+     * @throws IOException if an I/O error occurred
+     */
+    private void gather(ByteBuffer[] bufs, int len) throws IOException {
+        long rem = 0;
+        for (int i = 0; i < len; i++)
+            rem += bufs[i].remaining();
+        while (rem > 0) {
+            final long done = channel.write(bufs, 0, len);
+            wrote(done);
+            rem -= done;
+        }
+    }
+
+    /**
+     * Specifies the size of buffer needed to frame any record, namely
+     * {@value} bytes. This is 8 bytes for the header, and 65535 for the
+     * payload, plus enough padding to a multiple of 8.
+     */
+    static final int BUFFER_LENGTH = align(8 + MAX_CONTENT_LENGTH);
+
+    /**
+     * Supplies buffers for framing records.
+     */
+    private final BufferPool buffers;
+
+    /**
+     * Obtain a buffer for framing a record. The caller should release
+     * its array to {@link #buffers} when done, or pass it to
+     * {@link #send(ByteBuffer)} or {@link #enqueue(ByteBuffer)}.
+     * Leasing only what is needed keeps small control records and
+     * headers out of the largest size class.
+     * 
+     * @param length the number of bytes required, which must not exceed
+     * {@link #BUFFER_LENGTH}
+     * 
+     * @return a buffer of at least the requested size
+     */
+    private ByteBuffer lease(int length) {
+        assert length <= BUFFER_LENGTH;
+        return ByteBuffer.wrap(buffers.allocate(length));
+    }
 
     /**
      * Write a string length into a buffer. If the length is less than
@@ -187,35 +707,41 @@ public class RecordWriter {
     }
 
     /**
-     * Write a name-value pair into a buffer. The name and value are
-     * converted to byte arrays, and then their lengths are encoded into
-     * the buffer as 1- or 4-byte values, followed by the name and then
-     * the value. If the remaining space in the buffer is too small, the
-     * buffer is unmodified, and {@code false} is returned.
+     * Get the encoded length of a name-value pair.
      * 
-     * @param buf the buffer to extend
-     * 
-     * @param name the name to encode
+     * @param nameBytes the encoded name
      * 
-     * @param value the value to encode
+     * @param valueBytes the encoded value
      * 
-     * @return {@code true} if no overflow occurred; {@code false}
-     * otherwise
+     * @return the number of bytes occupied by the lengths, the name and
+     * the value
      */
-    private boolean writeNameValue(ByteBuffer buf, String name, String value) {
-        byte[] nameBytes = name.getBytes(charset);
-        byte[] valueBytes = value.getBytes(charset);
+    private static int nameValueLength(byte[] nameBytes, byte[] valueBytes) {
         int len = 0;
         len += nameBytes.length > 127 ? 4 : 1;
         len += valueBytes.length > 127 ? 4 : 1;
         len += nameBytes.length;
         len += valueBytes.length;
-        if (buf.remaining() < len) return false;
+        return len;
+    }
+
+    /**
+     * Write an encoded name-value pair into a buffer. The lengths are
+     * encoded as 1- or 4-byte values, followed by the name and then the
+     * value.
+     * 
+     * @param buf the buffer to extend
+     * 
+     * @param nameBytes the encoded name
+     * 
+     * @param valueBytes the encoded value
+     */
+    private static void writeNameValue(ByteBuffer buf, byte[] nameBytes,
+                                       byte[] valueBytes) {
         writeStringLength(buf, nameBytes.length);
         writeStringLength(buf, valueBytes.length);
         buf.put(nameBytes);
         buf.put(valueBytes);
-        return true;
     }
 
     /**
@@ -248,7 +774,21 @@ public class RecordWriter {
      */
     public void writeValues(Map<? extends String, ? extends String> values)
         throws RecordIOException {
-        ByteBuffer buf = buffer.get();
+        /* Encode as many requested values as will fit, so that we
+         * know how big a buffer to lease. */
+        List<byte[]> encoded = new ArrayList<>(values.size() * 2);
+        int content = 0;
+        for (var entry : values.entrySet()) {
+            byte[] nameBytes = entry.getKey().getBytes(charset);
+            byte[] valueBytes = entry.getValue().getBytes(charset);
+            final int pairLen = nameValueLength(nameBytes, valueBytes);
+            if (content + pairLen > MAX_CONTENT_LENGTH) break;
+            content += pairLen;
+            encoded.add(nameBytes);
+            encoded.add(valueBytes);
+        }
+
+        ByteBuffer buf = lease(align(HEADER_LENGTH + content));
         buf.clear();
 
         /* Write the header, leaving length fields empty. */
@@ -263,10 +803,9 @@ public class RecordWriter {
         final int begin = buf.position();
         checkHeaderLength(begin);
 
-        /* Write as many requested values as will fit. */
-        buf.limit(buf.position() + MAX_CONTENT_LENGTH);
-        for (var entry : values.entrySet())
-            if (!writeNameValue(buf, entry.getKey(), entry.getValue())) break;
+        /* Write the values that fit. */
+        for (int i = 0; i < encoded.size(); i += 2)
+            writeNameValue(buf, encoded.get(i), encoded.get(i + 1));
 
         /* Compute and store the record length. */
         final int end = buf.position();
@@ -291,9 +830,8 @@ public class RecordWriter {
 
         checkAlignment(buf);
         try {
-            synchronized (this) {
-                out.write(buf.array(), 0, buf.position());
-            }
+            send(buf);
+            sent(RecordTypes.GET_VALUES_RESULT, len);
         } catch (IOException ex) {
             throw new RecordIOException("writeValues", ex);
         }
@@ -310,7 +848,7 @@ public class RecordWriter {
      * @see RecordTypes#UNKNOWN_TYPE
      */
     public void writeUnknownType(int type) throws RecordIOException {
-        ByteBuffer buf = buffer.get();
+        ByteBuffer buf = lease(HEADER_LENGTH + 8);
         buf.clear();
 
         buf.put((byte) 1); // version
@@ -326,9 +864,8 @@ public class RecordWriter {
 
         checkAlignment(buf);
         try {
-            synchronized (this) {
-                out.write(buf.array(), 0, buf.position());
-            }
+            send(buf);
+            sent(RecordTypes.UNKNOWN_TYPE, 8);
         } catch (IOException ex) {
             throw new RecordIOException("writeUnknownType", ex);
         }
@@ -351,7 +888,7 @@ public class RecordWriter {
      */
     public void writeEndRequest(int id, int appStatus, int protoStatus)
         throws RecordIOException {
-        ByteBuffer buf = buffer.get();
+        ByteBuffer buf = lease(HEADER_LENGTH + 8);
         buf.clear();
 
         buf.put((byte) 1); // version
@@ -368,14 +905,76 @@ public class RecordWriter {
 
         checkAlignment(buf);
         try {
-            synchronized (this) {
-                out.write(buf.array(), 0, buf.position());
-            }
+            send(buf);
+            sent(RecordTypes.END_REQUEST, 8);
         } catch (IOException ex) {
             throw new RecordIOException("writeEndRequest", ex);
         }
     }
 
+    /**
+     * Choose how much content to send in the next record of a stream.
+     * 
+     * @param len the number of bytes awaiting transmission, which must
+     * be positive
+     * 
+     * @return the amount of content to be sent in the next record
+     */
+    private static int streamAmount(long len) {
+        assert len > 0;
+        if (len < MAX_CONTENT_LENGTH) {
+            /* Since the amount is less than our strict limit, just send
+             * the lot, and include whatever padding is required. It's
+             * not worth sending another record to save a few bytes of
+             * padding on this one. */
+            return (int) len;
+        }
+
+        /* Send fewer than our maximum to avoid padding. We might not
+         * save anything in the end, but if the last segment needs no
+         * padding, we can ensure that by adding no padding here. */
+        return alignBack(HEADER_LENGTH + MAX_CONTENT_LENGTH) - HEADER_LENGTH;
+    }
+
+    /**
+     * Write the header of a stream record into the start of a buffer,
+     * and set the padding length accordingly. On return, the buffer's
+     * position is just after the header.
+     * 
+     * @param bf the buffer to write the header into
+     * 
+     * @param rt the FastCGI record type
+     * 
+     * @param id the request id
+     * 
+     * @param amount the amount of content to be sent in this record, as
+     * chosen by {@link #streamAmount(long)}
+     */
+    private static void frameStream(ByteBuffer bf, byte rt, int id,
+                                    int amount) {
+        assert amount > 0 && amount <= MAX_CONTENT_LENGTH;
+        bf.clear();
+
+        bf.put((byte) 1); // version
+        bf.put(rt); // type
+        bf.putShort((short) id); // request id
+        bf.putShort((short) amount); // content length
+        final int padPos = bf.position();
+        bf.put((byte) 0); // unknown padding length
+        bf.put((byte) 0); // reserved
+        final int begin = bf.position();
+        checkHeaderLength(begin);
+
+        /* Work out the content end/padding start, and so the amount of
+         * padding. Write it into the header. */
+        final int end = begin + amount;
+        final int padEnd = align(end);
+        final int pad = padEnd - end;
+        bf.put(padPos, (byte) pad);
+
+        checkAlignment(begin + amount + pad);
+    }
+
     /**
      * Write bytes to one of the streams.
      * 
@@ -406,70 +1005,226 @@ public class RecordWriter {
         if (len == 0) return 0;
         assert len > 0;
 
-        ByteBuffer bf = buffer.get();
-        bf.clear();
-
-        /* Write the header, not knowing the amount of content or
-         * padding to write. */
-        bf.put((byte) 1); // version
-        bf.put(rt); // type
-        bf.putShort((short) id); // request id
-        final int lenPos = bf.position();
-        bf.putShort((short) 0); // unknown content length
-        final int padPos = bf.position();
-        bf.put((byte) 0); // unknown padding length
-        bf.put((byte) 0); // reserved
+        /* Only a header is needed if the content can be gathered from
+         * the caller's array. */
+        final int amount = streamAmount(len);
+        ByteBuffer bf = lease(queue == null && channel != null ?
+            HEADER_LENGTH : align(HEADER_LENGTH + amount));
+        frameStream(bf, rt, id, amount);
         final int begin = bf.position();
-        checkHeaderLength(begin);
-
-        /* Determine how much content to actually send this time. */
-        final int amount;
-        if (len < MAX_CONTENT_LENGTH) {
-            /* Since the amount is less than our strict limit, just send
-             * the lot, and include whatever padding is required. It's
-             * not worth sending another record to save a few bytes of
-             * padding on this one. */
-            amount = len;
-        } else {
-            /* Send fewer than our maximum to avoid padding. We might
-             * not save anything in the end, but if the last segment
-             * needs no padding, we can ensure that by adding no padding
-             * here. */
-            amount = alignBack(begin + MAX_CONTENT_LENGTH) - begin;
+        final int pad = align(begin + amount) - (begin + amount);
+        try {
+            if (queue != null) {
+                /* Complete the record in the leased buffer, and queue
+                 * the buffer itself. The flusher releases it. */
+                bf.put(buf, off, amount);
+                bf.put(padding, 0, pad);
+                bf.flip();
+                final ByteBuffer rec = bf;
+                bf = null;
+                enqueue(rec);
+            } else if (channel == null) {
+                /* Append the content and padding to the header, so the
+                 * whole record goes out in one operation. Our buffer is
+                 * big enough for the record, and the copy is made
+                 * before taking the lock. */
+                bf.put(buf, off, amount);
+                bf.put(padding, 0, pad);
+                final long start = lockStart();
+                synchronized (this) {
+                    locked(start);
+                    out.write(bf.array(), 0, bf.position());
+                    wrote(bf.position());
+                }
+            } else {
+                /* Holding the lock, pass the header, content and
+                 * padding to the channel in one gathering operation. */
+                bf.flip();
+                ByteBuffer data = ByteBuffer.wrap(buf, off, amount);
+                ByteBuffer padBuf = ByteBuffer.wrap(padding, 0, pad);
+                final long start = lockStart();
+                synchronized (this) {
+                    locked(start);
+                    gather(bf, data, padBuf);
+                }
+            }
+            sent(rt, amount);
+        } catch (IOException ex) {
+            throw new RecordIOException("write" + label + ":rec", ex);
+        } finally {
+            if (bf != null) buffers.release(bf.array());
         }
+        return amount;
+    }
 
-        /* Store the determined content length. */
-        assert amount <= MAX_CONTENT_LENGTH;
-        bf.putShort(lenPos, (short) amount); // content length
-
-        /* Work out the content end/padding start, and so the amount of
-         * padding. Write it into the header. */
-        final int end = begin + amount;
-        final int padEnd = align(end);
-        final int pad = padEnd - end;
-        bf.put(padPos, (byte) pad);
-
-        checkAlignment(begin + amount + pad);
-
-        /* Holding the lock, write out the header, content and padding
-         * as three operations. */
-        String pos = "hdr";
+    /**
+     * Write a region of a file as the content of one record of a
+     * stream. If the channel accepts file regions, the file's bytes are
+     * passed to it directly; otherwise, they are read into a pooled
+     * buffer, and the record is sent as any other.
+     * 
+     * @param label a diagnostic label used in the formation of
+     * log/exception messages
+     * 
+     * @param rt the FastCGI record type
+     * 
+     * @param id the request id
+     * 
+     * @param file the file containing the bytes to write
+     * 
+     * @param position the offset into the file of the first byte to
+     * write
+     * 
+     * @param len the maximum number of bytes to write, which must be
+     * positive
+     * 
+     * @return the number of bytes from the file that were written
+     * 
+     * @throws RecordIOException if an I/O error occurred, including
+     * reaching the end of the file before the region ends
+     */
+    private int writeStream(String label, byte rt, int id,
+                            FileInputStream file, long position, long len)
+        throws RecordIOException {
+        assert len > 0;
+        final int amount = streamAmount(len);
+        ByteBuffer bf = lease(channel != null ? HEADER_LENGTH :
+            align(HEADER_LENGTH + amount));
+        frameStream(bf, rt, id, amount);
+        final int begin = bf.position();
+        final int pad = align(begin + amount) - (begin + amount);
         try {
-            synchronized (this) {
-                out.write(bf.array(), 0, begin);
+            if (channel == null) {
+                /* Read the content after the header, and send the
+                 * record as if it came from an array. */
+                bf.limit(begin + amount);
+                FileChannel fc = file.getChannel();
+                while (bf.hasRemaining()) {
+                    final int got =
+                        fc.read(bf, position + bf.position() - begin);
+                    if (got < 0) throw new EOFException("file truncated");
+                }
+                bf.limit(begin + amount + pad);
+                bf.put(padding, 0, pad);
+                final ByteBuffer rec = bf;
+                bf = null;
+                send(rec);
+                sent(rt, amount);
+                return amount;
+            }
 
-                pos = "data";
-                out.write(buf, off, amount);
+            bf.flip();
+            ByteBuffer padBuf = ByteBuffer.wrap(padding, 0, pad);
+            if (queue == null) {
+                final long start = lockStart();
+                synchronized (this) {
+                    locked(start);
+                    transferRecord(bf, file, position, amount, padBuf);
+                }
+                sent(rt, amount);
+                return amount;
+            }
 
-                if (pad > 0) {
-                    pos = "pad";
-                    out.write(padding, 0, pad);
+            /* Queued records must go out first, and no other thread
+             * must write while ours is in progress, so we must become
+             * the flusher. */
+            claimFlushing();
+            try {
+                flushQueue();
+                transferRecord(bf, file, position, amount, padBuf);
+            } catch (IOException ex) {
+                failure = ex;
+                queue.clear();
+                queued.set(0);
+                throw ex;
+            } finally {
+                flushing.set(false);
+                synchronized (queue) {
+                    queue.notifyAll();
                 }
             }
+            drain();
+            sent(rt, amount);
+            return amount;
         } catch (IOException ex) {
-            throw new RecordIOException("write" + label + ":" + pos, ex);
+            throw new RecordIOException("write" + label + ":file", ex);
+        } finally {
+            if (bf != null) buffers.release(bf.array());
+        }
+    }
+
+    /**
+     * Write out a record whose content is a region of a file. The
+     * caller must hold the lock on this object, or the flushing role.
+     * 
+     * @param header the record header
+     * 
+     * @param file the file containing the content
+     * 
+     * @param position the offset into the file of the content
+     * 
+     * @param amount the content length
+     * 
+     * @param padBuf the padding
+     * 
+     * @throws IOException if an I/O error occurred, including reaching
+     * the end of the file before the content ends
+     */
+    private void transferRecord(ByteBuffer header, FileInputStream file,
+                                long position, int amount, ByteBuffer padBuf)
+        throws IOException {
+        gather(header);
+        if (channel instanceof FileTransferChannel ftc) {
+            final long done = ftc.transferFrom(file, position, amount);
+            wrote(done);
+            if (done < amount) throw new EOFException("file truncated");
+        } else {
+            FileChannel fc = file.getChannel();
+            for (long done = 0; done < amount;) {
+                final long got =
+                    fc.transferTo(position + done, amount - done, channel);
+                wrote(got);
+                if (got <= 0) throw new EOFException("file truncated");
+                done += got;
+            }
+        }
+        gather(padBuf);
+    }
+
+    /**
+     * Wait until the calling thread holds the flushing role.
+     * 
+     * @throws IOException if an I/O error occurred in writing queued
+     * records, now or earlier
+     */
+    private void claimFlushing() throws IOException {
+        final long start = lockStart();
+        boolean interrupted = false;
+        try {
+            synchronized (queue) {
+                while (!flushing.compareAndSet(false, true)) {
+                    IOException ex = failure;
+                    if (ex != null)
+                        throw new IOException("earlier failure", ex);
+                    try {
+                        queue.wait();
+                    } catch (InterruptedException e) {
+                        interrupted = true;
+                    }
+                }
+            }
+        } finally {
+            if (interrupted) Thread.currentThread().interrupt();
+        }
+        locked(start);
+        IOException ex = failure;
+        if (ex != null) {
+            flushing.set(false);
+            synchronized (queue) {
+                queue.notifyAll();
+            }
+            throw new IOException("earlier failure", ex);
         }
-        return amount;
     }
 
     /**
@@ -488,7 +1243,7 @@ public class RecordWriter {
      */
     private void writeEnd(String label, byte rt, int id)
         throws RecordIOException {
-        ByteBuffer bf = buffer.get();
+        ByteBuffer bf = lease(HEADER_LENGTH);
         bf.clear();
 
         bf.put((byte) 1); // version
@@ -499,11 +1254,9 @@ public class RecordWriter {
         bf.put((byte) 0); // reserved
         checkAlignment(bf);
         checkHeaderLength(bf.position());
-
         try {
-            synchronized (this) {
-                out.write(bf.array(), 0, bf.position());
-            }
+            send(bf);
+            sent(rt, 0);
         } catch (IOException ex) {
             throw new RecordIOException("write" + label + ":hdr0", ex);
         }
@@ -535,6 +1288,106 @@ public class RecordWriter {
         return writeStream("Stdout", RecordTypes.STDOUT, id, buf, off, len);
     }
 
+    /**
+     * Write bytes to the standard output of a request as a single
+     * record framed in place. The caller's array holds the content
+     * after a slot of {@link #headerLength()} bytes, and has space for
+     * padding after it, as given by {@link #framedBufferLength(int)}.
+     * The header and padding are written into the array, and the
+     * record goes out as one contiguous write. The array passes to this
+     * writer, which returns it to its pool once the record has been
+     * written, so the caller must obtain a fresh array for more
+     * content. If records are being coalesced, the array itself is
+     * queued; otherwise, it is written before this call returns.
+     * 
+     * @param id the request id
+     * 
+     * @param rec the array holding the header slot, the content and
+     * space for padding, obtained from the pool given to this writer
+     * 
+     * @param len the content length, which must be positive and no
+     * more than 65535
+     * 
+     * @throws RecordIOException if an I/O error occurred
+     * 
+     * @see RecordTypes#STDOUT
+     */
+    public void writeFramedStdout(int id, byte[] rec, int len)
+        throws RecordIOException {
+        if (len <= 0 || len > MAX_CONTENT_LENGTH)
+            throw new IllegalArgumentException("bad content length " + len);
+        final int end = HEADER_LENGTH + len;
+        final int total = align(end);
+        final int pad = total - end;
+
+        rec[0] = 1; // version
+        rec[1] = RecordTypes.STDOUT;
+        rec[2] = (byte) (id >> 8);
+        rec[3] = (byte) id;
+        rec[4] = (byte) (len >> 8);
+        rec[5] = (byte) len;
+        rec[6] = (byte) pad;
+        rec[7] = 0; // reserved
+        Arrays.fill(rec, end, total, (byte) 0);
+        try {
+            if (queue != null) {
+                enqueue(ByteBuffer.wrap(rec, 0, total));
+            } else {
+                try {
+                    final long start = lockStart();
+                    synchronized (this) {
+                        locked(start);
+                        if (channel == null) {
+                            out.write(rec, 0, total);
+                            wrote(total);
+                        } else {
+                            gather(ByteBuffer.wrap(rec, 0, total));
+                        }
+                    }
+                } finally {
+                    buffers.release(rec);
+                }
+            }
+            sent(RecordTypes.STDOUT, len);
+        } catch (IOException ex) {
+            throw new RecordIOException("writeStdout:framed", ex);
+        }
+    }
+
+    /**
+     * Write a region of a file to the standard output of a request.
+     * As many <code>FCGI_STDOUT</code> records are transmitted as
+     * necessary. Where the underlying channel permits, the content is
+     * passed from the file to the connection without being copied
+     * through this writer. Records from other requests may be
+     * interleaved between them.
+     * 
+     * @param id the request id
+     * 
+     * @param file the file containing the bytes to be written
+     * 
+     * @param position the offset into the file of the first byte to be
+     * written
+     * 
+     * @param length the number of bytes to be written
+     * 
+     * @throws RecordIOException if an I/O error occurred, including
+     * reaching the end of the file before the region ends, after which
+     * the connection is unusable
+     * 
+     * @see RecordTypes#STDOUT
+     */
+    public void writeStdout(int id, FileInputStream file, long position,
+                            long length)
+        throws RecordIOException {
+        while (length > 0) {
+            final int done = writeStream("Stdout", RecordTypes.STDOUT, id,
+                                         file, position, length);
+            position += done;
+            length -= done;
+        }
+    }
+
     /**
      * Indicate the end of standard output of a request. An empty
      * <code>FCGI_STDOUT</code> record is transmitted.
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.concurrent.atomic.AtomicInteger;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestByteBudget extends TestCase {
+    @Test
+    public void testWaitingSessionDoesNotBlock() {
+        ByteBudget conn = new ByteBudget(0).connection(100);
+        AtomicInteger evicted = new AtomicInteger(0);
+        ByteBudget.Account running = conn.open(0, null, null);
+        ByteBudget.Account waiting =
+            conn.open(0, null, evicted::incrementAndGet);
+
+        /* Content for the waiting session doesn't count yet. */
+        waiting.charge(150);
+        assertFalse("waiting blocks", conn.blocked());
+        running.charge(50);
+        assertFalse("within budget", conn.blocked());
+
+        /* The running session can still block and resume the
+         * connection. */
+        running.charge(60);
+        assertTrue("running over", conn.blocked());
+        AtomicInteger resumed = new AtomicInteger(0);
+        assertTrue("paused", conn.pauseUnlessClear(resumed::incrementAndGet));
+        running.credit(60);
+        assertEquals("resumed", 1, resumed.get());
+        assertFalse("running relieved", conn.blocked());
+
+        /* Once admitted, the waiting session's content counts. */
+        waiting.admit();
+        assertTrue("admitted over", conn.blocked());
+        waiting.credit(150);
+        assertFalse("admitted relieved", conn.blocked());
+        assertEquals("evicted", 0, evicted.get());
+    }
+
+    @Test
+    public void testWaitingSessionEvicted() {
+        ByteBudget conn = new ByteBudget(0).connection(0);
+        AtomicInteger evicted = new AtomicInteger(0);
+        ByteBudget.Account running = conn.open(100, null, null);
+        ByteBudget.Account waiting =
+            conn.open(100, null, evicted::incrementAndGet);
+
+        /* A waiting session over its limit is evicted, rather than
+         * blocking the connection. */
+        waiting.charge(150);
+        assertEquals("evicted", 1, evicted.get());
+        assertTrue("discarding", waiting.discarding());
+        assertFalse("waiting blocks", conn.blocked());
+        waiting.close();
+
+        running.charge(150);
+        assertFalse("running discarding", running.discarding());
+        assertTrue("running over", conn.blocked());
+        running.close();
+        assertFalse("closed", conn.blocked());
+    }
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InterruptedIOException;
+import java.io.OutputStream;
+import java.nio.charset.StandardCharsets;
+import java.util.Map;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+import junit.framework.TestCase;
+import org.junit.Test;
+import uk.ac.lancs.fastcgi.Authorizer;
+import uk.ac.lancs.fastcgi.engine.Scheduling;
+import uk.ac.lancs.fastcgi.engine.util.CachePipePool;
+import uk.ac.lancs.fastcgi.engine.util.DecisionCache;
+import uk.ac.lancs.fastcgi.proto.ProtocolStatuses;
+import uk.ac.lancs.fastcgi.proto.RecordTypes;
+import uk.ac.lancs.fastcgi.proto.RoleTypes;
+import uk.ac.lancs.fastcgi.transport.Connection;
+import uk.ac.lancs.fastcgi.transport.Transport;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestMultiplexGenericEngine extends TestCase {
+    private static final Connection END = new TestConnection(new byte[0]);
+
+    private static class TestConnection implements Connection {
+        final ByteArrayOutputStream out = new ByteArrayOutputStream();
+
+        final CountDownLatch hungUp = new CountDownLatch(1);
+
+        private final InputStream in;
+
+        TestConnection(byte[] request) {
+            ByteArrayInputStream data = new ByteArrayInputStream(request);
+            this.in = new InputStream() {
+                @Override
+                public int read() throws IOException {
+                    byte[] one = new byte[1];
+                    return read(one, 0, 1) < 0 ? -1 : one[0] & 0xff;
+                }
+
+                @Override
+                public int read(byte[] b, int off, int len)
+                    throws IOException {
+                    int got = data.read(b, off, len);
+                    if (got > 0) return got;
+
+                    /* Keep the connection open until the test is over,
+                     * as a server would. */
+                    try {
+                        hungUp.await();
+                    } catch (InterruptedException ex) {
+                        Thread.currentThread().interrupt();
+                    }
+                    return -1;
+                }
+            };
+        }
+
+        @Override
+        public InputStream input() {
+            return in;
+        }
+
+        @Override
+        public OutputStream output() {
+            return out;
+        }
+
+        @Override
+        public void close() {
+            hungUp.countDown();
+        }
+
+        @Override
+        public String description() {
+            return "test";
+        }
+
+        @Override
+        public String internalDescription() {
+            return "";
+        }
+
+        /**
+         * Wait for the end of the session with id 1.
+         * 
+         * @return the protocol status of the session
+         */
+        int awaitEnd() throws InterruptedException {
+            final long deadline = System.nanoTime() + 10_000_000_000L;
+            while (System.nanoTime() - deadline < 0) {
+                byte[] data = out.toByteArray();
+                int pos = 0;
+                while (pos + 8 <= data.length) {
+                    int len = (data[pos + 4] & 0xff) << 8 |
+                        (data[pos + 5] & 0xff);
+                    int next = pos + 8 + len + (data[pos + 6] & 0xff);
+                    if (next > data.length) break;
+                    if (data[pos + 1] == RecordTypes.END_REQUEST)
+                        return data[pos + 12];
+                    pos = next;
+                }
+                Thread.sleep(10);
+            }
+            fail("no end of session");
+            return -1;
+        }
+    }
+
+    private static void record(ByteArrayOutputStream out, byte type,
+                               byte[] content) {
+        out.write(1);
+        out.write(type);
+        out.write(0);
+        out.write(1);
+        out.write(content.length >> 8);
+        out.write(content.length);
+        out.write(0);
+        out.write(0);
+        out.writeBytes(content);
+    }
+
+    private static byte[] authorize(String user) {
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        record(out, RecordTypes.BEGIN_REQUEST, new byte[]
+        { 0, RoleTypes.AUTHORIZER, 0, 0, 0, 0, 0, 0 });
+        byte[] name = "REMOTE_USER".getBytes(StandardCharsets.US_ASCII);
+        byte[] value = user.getBytes(StandardCharsets.US_ASCII);
+        ByteArrayOutputStream params = new ByteArrayOutputStream();
+        params.write(name.length);
+        params.write(value.length);
+        params.writeBytes(name);
+        params.writeBytes(value);
+        record(out, RecordTypes.PARAMS, params.toByteArray());
+        record(out, RecordTypes.PARAMS, new byte[0]);
+        return out.toByteArray();
+    }
+
+    @Test
+    public void testReplayBypassesAdmission() throws Exception {
+        DecisionCache cache = DecisionCache.start().key("REMOTE_USER")
+            .create();
+        cache.put(Map.of("REMOTE_USER", "fred"),
+                  "Status: 200\r\n\r\n".getBytes(StandardCharsets.US_ASCII),
+                  0);
+        CountDownLatch entered = new CountDownLatch(1);
+        CountDownLatch released = new CountDownLatch(1);
+        Authorizer authorizer = ctxt -> {
+            if (!"jim".equals(ctxt.parameters().get("REMOTE_USER"))) return;
+            entered.countDown();
+            released.await();
+        };
+        BlockingQueue<Connection> queue = new LinkedBlockingQueue<>();
+        Transport transport = () -> {
+            try {
+                Connection conn = queue.take();
+                return conn == END ? null : conn;
+            } catch (InterruptedException ex) {
+                throw new InterruptedIOException();
+            }
+        };
+
+        /* Allow only one session to run, and none to wait. */
+        EngineParameters params = new EngineParameters()
+            .charset(StandardCharsets.UTF_8).authorizer(authorizer)
+            .decisions(cache).maxReqs(1).queueCapacity(0)
+            .scheduling(Scheduling.POOLED)
+            .pipePool(CachePipePool.start().create());
+        MultiplexGenericEngine engine =
+            new MultiplexGenericEngine(transport, params);
+        Thread acceptor = new Thread(() -> {
+            try {
+                while (engine.process())
+                    ;
+            } catch (IOException ex) {
+                throw new AssertionError(ex);
+            }
+        });
+        acceptor.start();
+
+        TestConnection busy = new TestConnection(authorize("jim"));
+        TestConnection cached = new TestConnection(authorize("fred"));
+        TestConnection later = new TestConnection(authorize("sam"));
+        try {
+            /* Occupy the only place. */
+            queue.add(busy);
+            assertTrue("entered", entered.await(10, TimeUnit.SECONDS));
+
+            /* A cached decision is replayed, not refused. */
+            queue.add(cached);
+            assertEquals("replayed", ProtocolStatuses.REQUEST_COMPLETE,
+                         cached.awaitEnd());
+
+            /* Once the running session ends, its place is free, and
+             * the replay has not taken it. */
+            released.countDown();
+            assertEquals("busy", ProtocolStatuses.REQUEST_COMPLETE,
+                         busy.awaitEnd());
+            queue.add(later);
+            assertEquals("later", ProtocolStatuses.REQUEST_COMPLETE,
+                         later.awaitEnd());
+        } finally {
+            released.countDown();
+            busy.close();
+            cached.close();
+            later.close();
+            queue.add(END);
+            acceptor.join(10_000);
+            engine.close();
+        }
+    }
+}
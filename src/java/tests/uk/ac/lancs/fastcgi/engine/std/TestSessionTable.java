@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+package uk.ac.lancs.fastcgi.engine.std;
+
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashSet;
+import java.util.Set;
+import java.util.concurrent.CountDownLatch;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestSessionTable extends TestCase {
+    private static Collection<String> contents(SessionTable<String> table) {
+        Collection<String> result = new HashSet<>();
+        table.forEach(result::add);
+        return result;
+    }
+
+    @Test
+    public void testDenseBoundary() {
+        SessionTable<String> table = new SessionTable<>();
+        assertTrue("initially empty", table.isEmpty());
+
+        /* The last dense slot and the first sparse id must be
+         * distinct. */
+        assertNull("put 1023", table.putIfAbsent(1023, "a"));
+        assertNull("put 1024", table.putIfAbsent(1024, "b"));
+        assertEquals("size", 2, table.size());
+        assertEquals("get 1023", "a", table.get(1023));
+        assertEquals("get 1024", "b", table.get(1024));
+        assertNull("get 1022", table.get(1022));
+        assertNull("get 1025", table.get(1025));
+        assertEquals("visited", Set.of("a", "b"), contents(table));
+
+        assertEquals("remove 1023", "a", table.remove(1023));
+        assertEquals("still sparse", "b", table.get(1024));
+        assertEquals("remove 1024", "b", table.remove(1024));
+        assertTrue("emptied", table.isEmpty());
+    }
+
+    @Test
+    public void testSparse() {
+        SessionTable<String> table = new SessionTable<>();
+        assertNull("put", table.putIfAbsent(65535, "x"));
+        assertEquals("retained", "x", table.putIfAbsent(65535, "y"));
+        assertEquals("size", 1, table.size());
+        assertEquals("get", "x", table.get(65535));
+
+        assertNull("remove absent", table.remove(40000));
+        assertEquals("size unchanged", 1, table.size());
+        assertEquals("remove", "x", table.remove(65535));
+        assertNull("removed", table.get(65535));
+        assertNull("remove again", table.remove(65535));
+        assertEquals("size", 0, table.size());
+    }
+
+    @Test
+    public void testReuse() {
+        SessionTable<String> table = new SessionTable<>();
+
+        /* Outgrow the initial dense array, and then re-use ids. */
+        for (int id = 1; id <= 100; id++)
+            assertNull("put " + id, table.putIfAbsent(id, "s" + id));
+        assertEquals("size", 100, table.size());
+        assertEquals("retained", "s50", table.putIfAbsent(50, "t50"));
+        for (int id = 1; id <= 100; id++)
+            assertEquals("remove " + id, "s" + id, table.remove(id));
+        assertTrue("emptied", table.isEmpty());
+
+        assertNull("reused", table.putIfAbsent(50, "t50"));
+        assertEquals("new occupant", "t50", table.get(50));
+        assertNull("not revived", table.get(49));
+        assertEquals("size", 1, table.size());
+    }
+
+    @Test
+    public void testConcurrentRemove() throws Exception {
+        SessionTable<String> table = new SessionTable<>();
+        final int count = 4000;
+        for (int id = 0; id < count; id++)
+            table.putIfAbsent(id, "s" + id);
+        assertEquals("filled", count, table.size());
+
+        /* Several threads race to remove every id, dense and sparse,
+         * so each is removed exactly once. */
+        final int threadCount = 4;
+        CountDownLatch start = new CountDownLatch(1);
+        int[] removed = new int[threadCount];
+        Collection<Thread> threads = new ArrayList<>();
+        for (int t = 0; t < threadCount; t++) {
+            final int index = t;
+            Thread thread = new Thread(() -> {
+                try {
+                    start.await();
+                } catch (InterruptedException ex) {
+                    return;
+                }
+                for (int id = 0; id < count; id++)
+                    if (table.remove(id) != null) removed[index]++;
+            });
+            threads.add(thread);
+            thread.start();
+        }
+        start.countDown();
+        for (Thread thread : threads)
+            thread.join();
+
+        int total = 0;
+        for (int n : removed)
+            total += n;
+        assertEquals("removed once each", count, total);
+        assertEquals("size", 0, table.size());
+        assertTrue("empty", table.isEmpty());
+        assertTrue("nothing visited", contents(table).isEmpty());
+    }
+
+    @Test
+    public void testNegativeId() {
+        SessionTable<String> table = new SessionTable<>();
+        assertNull("get", table.get(-1));
+        assertNull("remove", table.remove(-1));
+        try {
+            table.putIfAbsent(-1, "x");
+            fail("negative id accepted");
+        } catch (IllegalArgumentException ex) {
+            /* Expected */
+        }
+        assertEquals("size", 0, table.size());
+    }
+}
@@ -36,10 +36,13 @@
 
 package uk.ac.lancs.fastcgi.engine.util;
 
+import java.io.ByteArrayOutputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
 import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.channels.Channels;
 import java.nio.file.Files;
 import java.nio.file.Path;
 import java.nio.file.Paths;
@@ -49,6 +52,7 @@ import java.util.concurrent.atomic.AtomicLong;
 import java.util.concurrent.atomic.AtomicReference;
 import junit.framework.TestCase;
 import org.junit.Test;
+import uk.ac.lancs.fastcgi.context.BufferReader;
 import uk.ac.lancs.fastcgi.context.StreamAbortedException;
 
 /**
@@ -88,6 +92,148 @@ public class TestCachePipePool extends TestCase {
         }
     }
 
+    @Test
+    public void testMemoryChunkRecycled() throws IOException {
+        SlabAllocator slabs = new SlabAllocator(256, 1024, 4096);
+        assertEquals("rounded up", 512, slabs.sizeFor(300));
+        assertEquals("capped", 1024, slabs.sizeFor(5000));
+        AtomicLong usage = new AtomicLong(0);
+        byte[] array = slabs.allocate(256);
+        assertEquals("allocated", 256, array.length);
+        MemoryChunk chunk = new MemoryChunk(array, slabs, usage);
+        byte[] buf = new byte[100];
+        assertEquals("write", 100, chunk.write(buf, 0, buf.length));
+        chunk.complete();
+        assertEquals("read", 100, chunk.read(buf, 0, buf.length));
+        assertEquals("usage", 0, usage.get());
+        assertEquals("eof", -1, chunk.read(buf, 0, buf.length));
+        assertSame("recycled", array, slabs.allocate(200));
+    }
+
+    @Test
+    public void testMemoryChunkBuffers() throws IOException {
+        AtomicLong usage = new AtomicLong(0);
+        MemoryChunk chunk = new MemoryChunk(256, usage);
+        byte[] buf = new byte[512];
+        new Random(42).nextBytes(buf);
+        BufferReader reader = (BufferReader) chunk.getStream();
+        assertEquals("write 1", 200, chunk.write(buf, 0, 200));
+        ByteBuffer view = reader.nextBuffer();
+        assertEquals("lent", 200, view.remaining());
+        assertTrue("read-only", view.isReadOnly());
+        assertEquals("usage lent", 200, usage.get());
+        assertEquals("write unshifted", 56, chunk.write(buf, 200, 100));
+        for (int i = 0; i < 200; i++)
+            assertEquals("byte " + i, buf[i], view.get(i));
+        reader.release();
+        assertEquals("usage released", 56, usage.get());
+        assertEquals("write shifted", 100, chunk.write(buf, 256, 100));
+        chunk.complete();
+        view = reader.nextBuffer();
+        assertEquals("rest", 156, view.remaining());
+        for (int i = 0; i < 156; i++)
+            assertEquals("byte " + (200 + i), buf[200 + i], view.get(i));
+        assertNull("eof", reader.nextBuffer());
+        assertEquals("usage drained", 0, usage.get());
+    }
+
+    private static byte pattern(long i) {
+        return (byte) (i * 31 + (i >> 8));
+    }
+
+    private static Pipe fill(PipePool pool, int length) throws IOException {
+        Pipe pipe = pool.newPipe();
+        try (OutputStream out = pipe.getOutputStream()) {
+            byte[] buf = new byte[123];
+            for (int done = 0; done < length;) {
+                final int amount = Integer.min(buf.length, length - done);
+                for (int i = 0; i < amount; i++)
+                    buf[i] = pattern(done + i);
+                out.write(buf, 0, amount);
+                done += amount;
+            }
+        }
+        return pipe;
+    }
+
+    @Test
+    public void testPipeBuffers() throws IOException {
+        final int length = 3000;
+        Pipe pipe = fill(pool, length);
+        try (InputStream in = pipe.getInputStream()) {
+            assertTrue("buffered", in instanceof BufferReader);
+            BufferReader reader = (BufferReader) in;
+            long total = 0;
+            for (ByteBuffer view; (view = reader.nextBuffer()) != null;) {
+                assertTrue("non-empty", view.hasRemaining());
+                while (view.hasRemaining()) {
+                    assertEquals("byte " + total, pattern(total), view.get());
+                    total++;
+                }
+            }
+            assertEquals("length", length, total);
+        }
+    }
+
+    @Test
+    public void testPipeTransfer() throws IOException {
+        final int length = 3000;
+        Pipe pipe = fill(pool, length);
+        ByteArrayOutputStream sink = new ByteArrayOutputStream();
+        try (InputStream in = pipe.getInputStream()) {
+            assertEquals("byte 0", pattern(0), in.read());
+            BufferReader reader = (BufferReader) in;
+            assertEquals("transferred", length - 1,
+                         reader.transferTo(Channels.newChannel(sink)));
+        }
+        byte[] got = sink.toByteArray();
+        for (int i = 0; i < got.length; i++)
+            assertEquals("byte " + (i + 1), pattern(i + 1), got[i]);
+    }
+
+    @Test
+    public void testDiscard() throws IOException {
+        Pipe pipe = pool.newPipe();
+        byte[] buf = new byte[500];
+        OutputStream out = pipe.getOutputStream();
+        out.write(buf);
+        InputStream in = pipe.getInputStream();
+        assertEquals("read", 10, in.read(new byte[10]));
+
+        /* Closing must not wait for the writer, and the writer must be
+         * able to carry on, even past the spill threshold. */
+        in.close();
+        for (int i = 0; i < 10; i++)
+            out.write(buf);
+        out.close();
+        try {
+            in.read();
+            fail("read after close");
+        } catch (IOException ex) {
+            /* Expected. */
+        }
+    }
+
+    @Test
+    public void testUsage() throws IOException {
+        CachePipePool pool =
+            CachePipePool.start().ramThreshold(200).maxFileSize(1000).create();
+        assertEquals("initial spill", 0, pool.spilledBytes());
+        Pipe pipe = pool.newPipe();
+        OutputStream out = pipe.getOutputStream();
+        out.write(new byte[100]);
+        assertTrue("memory in use", pool.memoryUsage() > 0);
+        assertEquals("spill under threshold", 0, pool.spilledBytes());
+
+        /* Once the threshold is reached, content goes to files. */
+        for (int i = 0; i < 10; i++)
+            out.write(new byte[100]);
+        out.close();
+        final long spilled = pool.spilledBytes();
+        assertTrue("spill over threshold", spilled > 0);
+        assertTrue("spill within content", spilled <= 1000);
+    }
+
     @Test
     public void testFileChunk() throws IOException {
         Path dir = Paths.get(System.getProperty(CachePipePool.TMPDIR_SYSPROP));
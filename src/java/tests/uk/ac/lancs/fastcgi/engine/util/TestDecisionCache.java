@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import java.time.Duration;
+import java.util.HashMap;
+import java.util.Map;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestDecisionCache extends TestCase {
+    private static Map<String, String> params(String user, String uri) {
+        Map<String, String> result = new HashMap<>();
+        if (user != null) result.put("REMOTE_USER", user);
+        result.put("REQUEST_URI", uri);
+        return result;
+    }
+
+    @Test
+    public void testKeyed() {
+        DecisionCache cache =
+            DecisionCache.start().key("REMOTE_USER").create();
+        assertNull(cache.get(params("fred", "/a")));
+        cache.put(params("fred", "/a"), new byte[] { 1 }, 0);
+        cache.put(params(null, "/a"), new byte[] { 2 }, 3);
+
+        /* Parameters outside the key don't matter. */
+        DecisionCache.Decision d = cache.get(params("fred", "/b"));
+        assertNotNull(d);
+        assertEquals(1, d.output()[0]);
+        assertEquals(0, d.exitStatus());
+
+        /* An absent parameter is part of the key. */
+        d = cache.get(params(null, "/b"));
+        assertNotNull(d);
+        assertEquals(2, d.output()[0]);
+        assertEquals(3, d.exitStatus());
+        assertNull(cache.get(params("jim", "/a")));
+    }
+
+    @Test
+    public void testExpiry() throws Exception {
+        DecisionCache cache = DecisionCache.start().key("REMOTE_USER")
+            .ttl(Duration.ofMillis(50)).create();
+        cache.put(params("fred", "/a"), new byte[0], 0);
+        assertNotNull(cache.get(params("fred", "/a")));
+        Thread.sleep(100);
+        assertNull(cache.get(params("fred", "/a")));
+    }
+
+    @Test
+    public void testCapacity() {
+        DecisionCache cache =
+            DecisionCache.start().key("REMOTE_USER").capacity(3).create();
+        for (int i = 0; i < 5; i++)
+            cache.put(params("user" + i, "/"), new byte[0], i);
+        assertNull(cache.get(params("user0", "/")));
+        assertNull(cache.get(params("user1", "/")));
+        for (int i = 2; i < 5; i++)
+            assertEquals(i, cache.get(params("user" + i, "/")).exitStatus());
+
+        /* Replacing a decision must not let its old entry evict it. */
+        for (int i = 0; i < 10; i++)
+            cache.put(params("user4", "/"), new byte[0], 10 + i);
+        assertEquals(19, cache.get(params("user4", "/")).exitStatus());
+    }
+
+    @Test
+    public void testOutputLimit() {
+        DecisionCache cache = DecisionCache.start().key("REMOTE_USER")
+            .outputLimit(4).create();
+        cache.put(params("fred", "/"), new byte[5], 0);
+        assertNull(cache.get(params("fred", "/")));
+        cache.put(params("fred", "/"), new byte[4], 0);
+        assertNotNull(cache.get(params("fred", "/")));
+    }
+
+    @Test
+    public void testNoKey() {
+        try {
+            DecisionCache.start().create();
+            fail("created without key");
+        } catch (IllegalStateException ex) {
+            /* Expected. */
+        }
+    }
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.engine.util;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.Arrays;
+import java.util.Random;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicReference;
+import junit.framework.TestCase;
+import org.junit.Test;
+import uk.ac.lancs.fastcgi.context.StreamAbortedException;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestRingPipePool extends TestCase {
+    final PipePool pool = RingPipePool.start().ringSize(1000)
+        .overflow(CachePipePool.start().ramThreshold(200).maxFileSize(1000)
+            .create())
+        .create();
+
+    @Test
+    public void testClosePoolImmediately() throws IOException {
+        Pipe pipe = pool.newPipe();
+        pipe.getOutputStream().close();
+        assertEquals("eof", -1, pipe.getInputStream().read());
+    }
+
+    @Test
+    public void testWithinRing() throws IOException {
+        Pipe pipe = pool.newPipe();
+        byte[] buf = new byte[600];
+        new Random(42).nextBytes(buf);
+        try (OutputStream out = pipe.getOutputStream()) {
+            out.write(buf, 0, 300);
+        }
+        byte[] got = pipe.getInputStream().readAllBytes();
+        assertEquals("length", 300, got.length);
+        assertEquals("preserved", 0, Arrays.compare(buf, 0, 300, got, 0, 300));
+    }
+
+    @Test
+    public void testOverflow() throws IOException {
+        Pipe pipe = pool.newPipe();
+        byte[] buf = new byte[5000];
+        new Random(43).nextBytes(buf);
+        try (OutputStream out = pipe.getOutputStream()) {
+            out.write(buf, 0, 700);
+            out.write(buf, 700, 900);
+            out.write(buf, 1600, 3400);
+        }
+        byte[] got = pipe.getInputStream().readAllBytes();
+        assertEquals("length", buf.length, got.length);
+        assertTrue("preserved", Arrays.equals(buf, got));
+    }
+
+    @Test
+    public void testDiscardOverflow() throws IOException {
+        Pipe pipe = pool.newPipe();
+        byte[] buf = new byte[700];
+        OutputStream out = pipe.getOutputStream();
+        out.write(buf);
+        out.write(buf);
+        InputStream in = pipe.getInputStream();
+        assertEquals("read", 10, in.read(new byte[10]));
+
+        /* The overflow must be released without waiting for the
+         * writer. */
+        in.close();
+        for (int i = 0; i < 10; i++)
+            out.write(buf);
+        out.close();
+        try {
+            in.read();
+            fail("read after close");
+        } catch (IOException ex) {
+            /* Expected. */
+        }
+    }
+
+    @Test
+    public void testRunThroughPool() throws IOException, InterruptedException {
+        Pipe pipe = pool.newPipe();
+        final long seed = 71;
+        Random rng1 = new Random(seed);
+        Random rng2 = new Random(seed);
+
+        AtomicLong totalOut = new AtomicLong(0);
+        AtomicReference<Throwable> writeError = new AtomicReference<>();
+        Thread writer = new Thread() {
+            @Override
+            public void run() {
+                Random sizer = new Random(42);
+                final int calls = 50 + sizer.nextInt(50);
+                try (OutputStream out = pipe.getOutputStream()) {
+                    for (int i = 0; i < calls; i++) {
+                        byte[] buf = new byte[100 + sizer.nextInt(64) * 4];
+                        rng1.nextBytes(buf);
+                        out.write(buf);
+                        totalOut.addAndGet(buf.length);
+                        Thread.sleep(10);
+                    }
+                } catch (Throwable ex) {
+                    writeError.set(ex);
+                }
+            }
+        };
+        writer.start();
+
+        try (InputStream in = pipe.getInputStream()) {
+            byte[] buf = new byte[256];
+            int c;
+            long total = 0;
+            while ((c = in.readNBytes(buf, 0, buf.length)) > 0) {
+                byte[] exp = new byte[c];
+                rng2.nextBytes(exp);
+                assertEquals("block " + total + " to " + (total + c), 0,
+                             Arrays.compare(exp, 0, c, buf, 0, c));
+                total += c;
+                Thread.sleep(5);
+            }
+            assertEquals("same amount", totalOut.get(), total);
+        }
+
+        writer.join();
+        assertNull("writing exception", writeError.get());
+    }
+
+    @Test
+    public void testAbort() throws IOException {
+        Pipe pipe = pool.newPipe();
+        pipe.getOutputStream().write(new byte[10]);
+        pipe.abort(new RuntimeException("dummy"));
+        try {
+            pipe.getInputStream().read();
+            fail("unreached");
+        } catch (StreamAbortedException ex) {
+            assertEquals("reason", "dummy", ex.getCause().getMessage());
+        }
+    }
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestCapturingTransport extends TestCase {
+    private static final class MemoryConnection implements Connection {
+        final InputStream in;
+
+        final ByteArrayOutputStream out = new ByteArrayOutputStream();
+
+        boolean closed = false;
+
+        MemoryConnection(byte[] input) {
+            this.in = new ByteArrayInputStream(input);
+        }
+
+        @Override
+        public InputStream input() {
+            return in;
+        }
+
+        @Override
+        public OutputStream output() {
+            return out;
+        }
+
+        @Override
+        public void close() {
+            closed = true;
+        }
+
+        @Override
+        public String description() {
+            return "memory";
+        }
+
+        @Override
+        public String internalDescription() {
+            return "";
+        }
+    }
+
+    private static Transport supply(Connection... conns) {
+        return new Transport() {
+            int next = 0;
+
+            @Override
+            public Connection nextConnection() {
+                return next < conns.length ? conns[next++] : null;
+            }
+        };
+    }
+
+    @Test
+    public void testRoundTrip() throws IOException {
+        Path file = Files.createTempFile("capture-", ".bin");
+        /* The recorder insists on creating the file itself. */
+        Files.delete(file);
+        try {
+            MemoryConnection base = new MemoryConnection(new byte[] { 1, 2,
+                3, 4, 5 });
+            try (CaptureRecorder recorder =
+                CaptureRecorder.start().file(file).create()) {
+                Transport transport =
+                    new CapturingTransport(supply(base), recorder);
+                Connection conn = transport.nextConnection();
+                assertNotSame("wrapped", base, conn);
+                assertNull("captured channel", conn.outputChannel());
+                byte[] buf = new byte[10];
+                assertEquals(5, conn.input().read(buf));
+                assertEquals(-1, conn.input().read(buf));
+                conn.output().write(new byte[] { 9, 8 });
+                conn.close();
+                assertTrue("base closed", base.closed);
+                assertNull(transport.nextConnection());
+            }
+            assertTrue("base written",
+                       Arrays.equals(new byte[] { 9, 8 },
+                                     base.out.toByteArray()));
+
+            try (CaptureReader reader =
+                new CaptureReader(Files.newInputStream(file))) {
+                assertTrue(reader.next());
+                assertEquals(CaptureRecorder.OPEN, reader.kind());
+                final int conn = reader.connection();
+
+                assertTrue(reader.next());
+                assertEquals(CaptureRecorder.INPUT, reader.kind());
+                assertEquals(conn, reader.connection());
+                assertTrue(Arrays.equals(new byte[] { 1, 2, 3, 4, 5 },
+                                         reader.data()));
+                long last = reader.micros();
+
+                assertTrue(reader.next());
+                assertEquals(CaptureRecorder.OUTPUT, reader.kind());
+                assertTrue(Arrays.equals(new byte[] { 9, 8 },
+                                         reader.data()));
+                assertTrue("time order", reader.micros() >= last);
+
+                assertTrue(reader.next());
+                assertEquals(CaptureRecorder.CLOSE, reader.kind());
+                assertFalse(reader.next());
+            }
+        } finally {
+            Files.deleteIfExists(file);
+        }
+    }
+
+    @Test
+    public void testNoSample() throws IOException {
+        Path file = Files.createTempFile("capture-", ".bin");
+        /* The recorder insists on creating the file itself. */
+        Files.delete(file);
+        try {
+            MemoryConnection base = new MemoryConnection(new byte[0]);
+            try (CaptureRecorder recorder =
+                CaptureRecorder.start().file(file).ratio(0.0).create()) {
+                Transport transport =
+                    new CapturingTransport(supply(base), recorder);
+                assertSame("unwrapped", base, transport.nextConnection());
+            }
+            try (CaptureReader reader =
+                new CaptureReader(Files.newInputStream(file))) {
+                assertFalse(reader.next());
+            }
+        } finally {
+            Files.deleteIfExists(file);
+        }
+    }
+}
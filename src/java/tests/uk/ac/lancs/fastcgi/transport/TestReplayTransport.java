@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport;
+
+import java.io.ByteArrayInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestReplayTransport extends TestCase {
+    private static byte[] record(int type, int id, int len) {
+        byte[] r = new byte[8 + len];
+        r[0] = 1;
+        r[1] = (byte) type;
+        r[2] = (byte) (id >> 8);
+        r[3] = (byte) id;
+        r[4] = (byte) (len >> 8);
+        r[5] = (byte) len;
+        return r;
+    }
+
+    private static Path capture(byte[] input) throws IOException {
+        Path file = Files.createTempFile("capture-", ".bin");
+        /* The recorder insists on creating the file itself. */
+        Files.delete(file);
+        Connection base = new Connection() {
+            final InputStream in = new ByteArrayInputStream(input);
+
+            @Override
+            public InputStream input() {
+                return in;
+            }
+
+            @Override
+            public OutputStream output() {
+                return OutputStream.nullOutputStream();
+            }
+
+            @Override
+            public void close() {}
+
+            @Override
+            public String description() {
+                return "memory";
+            }
+
+            @Override
+            public String internalDescription() {
+                return "";
+            }
+        };
+        try (CaptureRecorder recorder =
+            CaptureRecorder.start().file(file).create()) {
+            Transport transport = new CapturingTransport(new Transport() {
+                boolean given = false;
+
+                @Override
+                public Connection nextConnection() {
+                    if (given) return null;
+                    given = true;
+                    return base;
+                }
+            }, recorder);
+            Connection conn = transport.nextConnection();
+            conn.input().readAllBytes();
+            conn.close();
+        }
+        return file;
+    }
+
+    @Test
+    public void testReplay() throws IOException {
+        final byte[] begin = record(1, 1, 8);
+        Path file = capture(begin);
+        try {
+            Transport transport = new ReplayTransport(file);
+            Connection conn = transport.nextConnection();
+            assertNotNull(conn);
+            assertNull(transport.nextConnection());
+
+            byte[] buf = new byte[begin.length];
+            int got = 0;
+            while (got < buf.length) {
+                final int n = conn.input().read(buf, got, buf.length - got);
+                assertTrue("premature end", n > 0);
+                got += n;
+            }
+            assertTrue(Arrays.equals(begin, buf));
+
+            /* End-of-file only follows the response. */
+            conn.output().write(record(3, 1, 8));
+            assertEquals(-1, conn.input().read());
+            conn.close();
+        } finally {
+            Files.deleteIfExists(file);
+        }
+    }
+
+    @Test
+    public void testShutdown() throws IOException {
+        Path file = capture(record(1, 1, 8));
+        try {
+            Connection conn = new ReplayTransport(file).nextConnection();
+            conn.input().readNBytes(16);
+
+            /* A draining engine need not respond. */
+            conn.shutdownInput();
+            assertEquals(-1, conn.input().read());
+        } finally {
+            Files.deleteIfExists(file);
+        }
+    }
+}
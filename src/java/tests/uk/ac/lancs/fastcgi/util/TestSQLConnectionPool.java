@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.util;
+
+import java.lang.reflect.Proxy;
+import java.sql.Connection;
+import java.sql.PreparedStatement;
+import java.sql.SQLException;
+import java.sql.SQLTransientConnectionException;
+import java.time.Duration;
+import java.util.concurrent.atomic.AtomicInteger;
+import junit.framework.TestCase;
+import org.junit.Test;
+
+/**
+ *
+ * @author simpsons
+ */
+public class TestSQLConnectionPool extends TestCase {
+    final AtomicInteger connections = new AtomicInteger(0);
+
+    final AtomicInteger prepared = new AtomicInteger(0);
+
+    final AtomicInteger rolledBack = new AtomicInteger(0);
+
+    private PreparedStatement newStatement(String sql) {
+        final String name = "stmt-" + prepared.getAndIncrement();
+        return (PreparedStatement) Proxy
+            .newProxyInstance(PreparedStatement.class.getClassLoader(),
+                              new Class<?>[] { PreparedStatement.class },
+                              (proxy, method, args) -> {
+                                  switch (method.getName()) {
+                                  case "toString":
+                                      return name;
+                                  default:
+                                      return null;
+                                  }
+                              });
+    }
+
+    private Connection newConnection() {
+        final String name = "conn-" + connections.getAndIncrement();
+        final boolean[] autoCommit = { true };
+        return (Connection) Proxy
+            .newProxyInstance(Connection.class.getClassLoader(),
+                              new Class<?>[] { Connection.class },
+                              (proxy, method, args) -> {
+                                  switch (method.getName()) {
+                                  case "toString":
+                                      return name;
+                                  case "getAutoCommit":
+                                      return autoCommit[0];
+                                  case "setAutoCommit":
+                                      autoCommit[0] = (Boolean) args[0];
+                                      return null;
+                                  case "rollback":
+                                      rolledBack.incrementAndGet();
+                                      return null;
+                                  case "isValid":
+                                      return true;
+                                  case "isClosed":
+                                      return false;
+                                  case "prepareStatement":
+                                      return newStatement((String) args[0]);
+                                  default:
+                                      return null;
+                                  }
+                              });
+    }
+
+    @Test
+    public void testAffinity() throws SQLException {
+        try (SQLConnectionPool pool =
+            SQLConnectionPool.start().factory(this::newConnection).create()) {
+            final String first;
+            try (Connection conn = pool.open()) {
+                first = conn.toString();
+            }
+            try (Connection conn = pool.open()) {
+                assertEquals("re-used", first, conn.toString());
+                try (Connection conn2 = pool.open()) {
+                    assertFalse("fresh", first.equals(conn2.toString()));
+                }
+            }
+            assertEquals("created", 2, connections.get());
+        }
+    }
+
+    @Test
+    public void testReset() throws SQLException {
+        try (SQLConnectionPool pool =
+            SQLConnectionPool.start().factory(this::newConnection).create()) {
+            Connection conn = pool.open();
+            conn.setAutoCommit(false);
+            conn.close();
+            assertTrue("closed", conn.isClosed());
+            conn.close();
+            assertEquals("rolled back once", 1, rolledBack.get());
+            try (Connection conn2 = pool.open()) {
+                assertTrue("auto-commit", conn2.getAutoCommit());
+            }
+            try {
+                conn.getAutoCommit();
+                fail("used after close");
+            } catch (SQLException ex) {
+                /* Expected. */
+            }
+        }
+    }
+
+    @Test
+    public void testMaxSize() throws SQLException {
+        try (SQLConnectionPool pool =
+            SQLConnectionPool.start().factory(this::newConnection).maxSize(1)
+                .maxWait(Duration.ofMillis(50)).create()) {
+            try (Connection conn = pool.open()) {
+                try {
+                    pool.open().close();
+                    fail("exceeded maximum");
+                } catch (SQLTransientConnectionException ex) {
+                    /* Expected. */
+                }
+            }
+            pool.open().close();
+            assertEquals("created", 1, connections.get());
+        }
+    }
+
+    @Test
+    public void testWaitForReturn() throws Exception {
+        try (SQLConnectionPool pool =
+            SQLConnectionPool.start().factory(this::newConnection).maxSize(1)
+                .maxWait(Duration.ofSeconds(10)).create()) {
+            Connection conn = pool.open();
+            final String first = conn.toString();
+            Thread returner = new Thread(() -> {
+                try {
+                    Thread.sleep(50);
+                    conn.close();
+                } catch (InterruptedException | SQLException ex) {
+                    throw new AssertionError(ex);
+                }
+            });
+            returner.start();
+            try (Connection conn2 = pool.open()) {
+                assertEquals("returned", first, conn2.toString());
+            }
+            returner.join();
+            assertEquals("created", 1, connections.get());
+        }
+    }
+
+    @Test
+    public void testStatementCache() throws SQLException {
+        try (SQLConnectionPool pool =
+            SQLConnectionPool.start().factory(this::newConnection)
+                .statementCacheSize(1).create()) {
+            final String sql = "SELECT 1";
+            final String first;
+            try (Connection conn = pool.open();
+                 PreparedStatement stmt = conn.prepareStatement(sql)) {
+                first = stmt.toString();
+                assertSame("owner", conn, stmt.getConnection());
+                try (PreparedStatement stmt2 = conn.prepareStatement(sql)) {
+                    assertFalse("duplicate",
+                                first.equals(stmt2.toString()));
+                }
+            }
+            try (Connection conn = pool.open();
+                 PreparedStatement stmt = conn.prepareStatement(sql)) {
+                assertEquals("cached", first, stmt.toString());
+            }
+            assertEquals("prepared", 2, prepared.get());
+        }
+    }
+}
@@ -36,9 +36,11 @@
 
 package uk.ac.lancs.fastcgi.transport.fork;
 
+import java.io.FileDescriptor;
 import java.io.IOException;
 import java.lang.ref.Cleaner;
 import java.net.SocketAddress;
+import java.nio.ByteBuffer;
 import java.util.logging.Level;
 import java.util.logging.Logger;
 
@@ -201,6 +203,140 @@ class Descriptor {
         writeSocket(fd(), b, off, len);
     }
 
+    /**
+     * Read bytes from the descriptor into a buffer. Bytes are stored
+     * from the buffer's position, which is then advanced by the number
+     * of bytes read. If the buffer is direct, the underlying call
+     * writes straight into its memory; if it is backed by an array, the
+     * array is used; otherwise, bytes are copied through a temporary
+     * array.
+     * 
+     * @param buf the destination buffer
+     * 
+     * @return the number of bytes read; or {@code -1} on end-of-file
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    public int read(ByteBuffer buf) throws IOException {
+        final int pos = buf.position();
+        final int len = buf.remaining();
+        if (len == 0) return 0;
+        final int got;
+        if (buf.isDirect()) {
+            got = readSocket(fd(), buf, pos, len);
+        } else if (buf.hasArray()) {
+            got = readSocket(fd(), buf.array(), buf.arrayOffset() + pos, len);
+        } else {
+            byte[] tmp = new byte[len];
+            got = readSocket(fd(), tmp, 0, len);
+            if (got > 0) buf.put(pos, tmp, 0, got);
+        }
+        if (got > 0) buf.position(pos + got);
+        return got;
+    }
+
+    /**
+     * Write all remaining bytes of a buffer to the descriptor. On
+     * return, the buffer's position will equal its limit. If the
+     * buffer is direct, the underlying call reads straight from its
+     * memory; if it is backed by an array, the array is used;
+     * otherwise, bytes are copied through a temporary array.
+     * 
+     * @param buf the buffer containing the bytes
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    public void write(ByteBuffer buf) throws IOException {
+        final int pos = buf.position();
+        final int len = buf.remaining();
+        if (len == 0) return;
+        if (buf.isDirect()) {
+            writeSocket(fd(), buf, pos, len);
+        } else if (buf.hasArray()) {
+            writeSocket(fd(), buf.array(), buf.arrayOffset() + pos, len);
+        } else {
+            byte[] tmp = new byte[len];
+            buf.get(pos, tmp);
+            writeSocket(fd(), tmp, 0, len);
+        }
+        buf.position(pos + len);
+    }
+
+    /**
+     * The maximum number of buffers that can be passed to a single
+     * {@linkplain #write(ByteBuffer[], int, int) gathering write}
+     */
+    public static final int MAX_GATHER = 64;
+
+    /**
+     * Write all remaining bytes of a sequence of direct buffers to the
+     * descriptor in as few system calls as possible. On return, each
+     * buffer's position will equal its limit.
+     * 
+     * @param bufs an array containing the buffers
+     * 
+     * @param off the index of the first buffer in the array
+     * 
+     * @param len the number of buffers to write
+     * 
+     * @throws IOException if an I/O error occurs
+     * 
+     * @throws IllegalArgumentException if too many buffers are
+     * specified, or a buffer is not direct
+     */
+    public void write(ByteBuffer[] bufs, int off, int len)
+        throws IOException {
+        if (len > MAX_GATHER)
+            throw new IllegalArgumentException("too many buffers " + len);
+        int[] poss = new int[len];
+        int[] lens = new int[len];
+        ByteBuffer[] vec = new ByteBuffer[len];
+        for (int i = 0; i < len; i++) {
+            ByteBuffer buf = bufs[off + i];
+            if (!buf.isDirect())
+                throw new IllegalArgumentException("buffer not direct");
+            vec[i] = buf;
+            poss[i] = buf.position();
+            lens[i] = buf.remaining();
+        }
+        writevSocket(fd(), vec, poss, lens, len);
+        for (int i = 0; i < len; i++)
+            vec[i].position(vec[i].limit());
+    }
+
+    /**
+     * Write a region of a file to the descriptor. This simply calls
+     * {@link #sendFile(int, FileDescriptor, long, long)}, passing the
+     * result of {@link #fd()} as the first argument.
+     * 
+     * @param file the file containing the bytes
+     * 
+     * @param pos the offset into the file of the first byte to write
+     * 
+     * @param len the number of bytes to write
+     * 
+     * @return the number of bytes written, which is less than requested
+     * only if end-of-file was reached
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    public long transfer(FileDescriptor file, long pos, long len)
+        throws IOException {
+        return sendFile(fd(), file, pos, len);
+    }
+
+    /**
+     * Stop receiving on the descriptor, so that a thread blocked
+     * reading from it sees end-of-file. This simply calls
+     * {@link #shutdownSocket(int)}, passing the result of {@link #fd()}
+     * as the argument.
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    public void shutdownInput() throws IOException {
+        shutdownSocket(fd());
+    }
+
     /**
      * Close a descriptor.
      * 
@@ -212,7 +348,9 @@ class Descriptor {
     static native void closeSocket(int descriptor) throws IOException;
 
     /**
-     * Check to see if file descriptor 0 is a server socket.
+     * Check to see if a file descriptor is a server socket.
+     * 
+     * @param descriptor the descriptor to check, usually 0
      * 
      * @param addrLen an array whose first element will contain the size
      * of the socket's address
@@ -222,7 +360,8 @@ class Descriptor {
      * @return the descriptor if it is a server socket; or a negative
      * value otherwise
      */
-    static native int checkDescriptor(int[] addrLen, byte[] addr);
+    static native int checkDescriptor(int descriptor, int[] addrLen,
+                                      byte[] addr);
 
     /**
      * Decode a socket address from a buffer.
@@ -258,6 +397,41 @@ class Descriptor {
                                        byte[] addr)
         throws IOException;
 
+    /**
+     * Accept the next connection from a permitted peer. Connections
+     * from other peers are closed without returning.
+     * 
+     * @param descriptor the descriptor on which to accept the
+     * connection
+     * 
+     * @param wake a descriptor which, on becoming readable, causes the
+     * call to return without a connection; or negative if the call
+     * cannot be woken. If non-negative, the listening descriptor must
+     * be {@linkplain #makeNonBlocking(int) non-blocking}.
+     * 
+     * @param rules a direct buffer holding the allowlist, as built by
+     * {@link PeerRules}
+     * 
+     * @param rulesLen the number of bytes of allowlist at the start of
+     * the buffer
+     * 
+     * @param info an array of at least two elements, the first of
+     * which will contain the size of the peer's address, and the
+     * second the number of connections rejected in the meantime
+     * 
+     * @param addr an array to write the peer's address into. Its length
+     * must be at least that returned by {@link #getAddressSize()}.
+     * 
+     * @return the descriptor of the connection; or negative if woken
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result, or the buffer is not direct
+     */
+    static native int acceptPermitted(int descriptor, int wake,
+                                      ByteBuffer rules, int rulesLen,
+                                      int[] info, byte[] addr)
+        throws IOException;
+
     /**
      * Get the minimum buffer size to be passed to
      * <code class="c">accept</code>. In a single process, this is a
@@ -316,6 +490,162 @@ class Descriptor {
     static native int readSocket(int descriptor, byte[] b, int off, int len)
         throws IOException;
 
+    /**
+     * Write bytes from a direct buffer. The buffer's position and limit
+     * are not consulted or modified.
+     * 
+     * @param descriptor the descriptor to write to
+     * 
+     * @param buf the direct buffer containing the bytes
+     * 
+     * @param pos the index into the buffer of the first byte to write
+     * 
+     * @param len the number of bytes to write
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result, or the buffer is not direct
+     */
+    static native void writeSocket(int descriptor, ByteBuffer buf, int pos,
+                                   int len)
+        throws IOException;
+
+    /**
+     * Write bytes from several direct buffers in a single gathering
+     * operation. The buffers' positions and limits are not consulted
+     * or modified.
+     * 
+     * @param descriptor the descriptor to write to
+     * 
+     * @param bufs the direct buffers containing the bytes
+     * 
+     * @param poss the index into each buffer of its first byte to
+     * write
+     * 
+     * @param lens the number of bytes to write from each buffer
+     * 
+     * @param count the number of buffers to write, no more than
+     * {@link #MAX_GATHER}
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result, or a buffer is not direct
+     */
+    static native void writevSocket(int descriptor, ByteBuffer[] bufs,
+                                    int[] poss, int[] lens, int count)
+        throws IOException;
+
+    /**
+     * Write a region of a file to a descriptor. Where available,
+     * <code class="c">sendfile</code> is used, so the bytes are not
+     * copied through user space. The file's own offset is not used or
+     * modified.
+     * 
+     * @param descriptor the descriptor to write to
+     * 
+     * @param file the file to read from
+     * 
+     * @param pos the offset into the file of the first byte to write
+     * 
+     * @param len the number of bytes to write
+     * 
+     * @return the number of bytes written, which is less than requested
+     * only if end-of-file was reached
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native long sendFile(int descriptor, FileDescriptor file,
+                                long pos, long len)
+        throws IOException;
+
+    /**
+     * Read bytes from a descriptor into a direct buffer without
+     * blocking. The buffer's position and limit are not consulted or
+     * modified.
+     * 
+     * @param descriptor the descriptor to read from
+     * 
+     * @param buf the direct buffer to read bytes into
+     * 
+     * @param pos the index into the buffer of the first byte
+     * 
+     * @param len the maximum number of bytes to read
+     * 
+     * @return the number of bytes read; {@code 0} if none are
+     * available yet; or negative if the end-of-file is reached
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result for any other reason, or the buffer is not direct
+     */
+    static native int readSocketNow(int descriptor, ByteBuffer buf, int pos,
+                                    int len)
+        throws IOException;
+
+    /**
+     * Create an event-polling descriptor. This is only available on
+     * Linux.
+     * 
+     * @return the new descriptor
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native int epollCreate() throws IOException;
+
+    /**
+     * Arrange for an event-polling descriptor to report a descriptor
+     * once when it next becomes readable, or reaches end-of-file. The
+     * descriptor is registered if it has not been already.
+     * 
+     * @param epfd the event-polling descriptor
+     * 
+     * @param descriptor the descriptor to watch
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native void epollArm(int epfd, int descriptor) throws IOException;
+
+    /**
+     * Wait for watched descriptors to become ready.
+     * 
+     * @param epfd the event-polling descriptor
+     * 
+     * @param descriptors an array to be filled with the ready
+     * descriptors, which must not be empty
+     * 
+     * @return the number of elements of the array filled, which may be
+     * zero if the call was interrupted
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     * 
+     * @throws IllegalArgumentException if the array is empty
+     */
+    static native int epollWait(int epfd, int[] descriptors)
+        throws IOException;
+
+    /**
+     * Read bytes from a descriptor into a direct buffer. The buffer's
+     * position and limit are not consulted or modified.
+     * 
+     * @param descriptor the descriptor to read from
+     * 
+     * @param buf the direct buffer to read bytes into
+     * 
+     * @param pos the index into the buffer of the first byte
+     * 
+     * @param len the maximum number of bytes to read
+     * 
+     * @return the number of bytes read; or negative if the end-of-file
+     * is reached
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result, or the buffer is not direct
+     */
+    static native int readSocket(int descriptor, ByteBuffer buf, int pos,
+                                 int len)
+        throws IOException;
+
     /**
      * Read a single byte from a descriptor.
      * 
@@ -329,6 +659,111 @@ class Descriptor {
      */
     static native int readSocket(int descriptor) throws IOException;
 
+    /**
+     * Stop receiving on a socket. Other threads blocked reading from
+     * it see end-of-file.
+     * 
+     * @param descriptor the socket descriptor
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native void shutdownSocket(int descriptor) throws IOException;
+
+    /**
+     * Create a pair of connected Unix-domain sockets.
+     * 
+     * @param descriptors an array of at least two elements to receive
+     * the descriptors
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native void socketPair(int[] descriptors) throws IOException;
+
+    /**
+     * Put a descriptor into non-blocking mode. For a shared listening
+     * socket, this affects all processes holding it.
+     * 
+     * @param descriptor the descriptor to modify
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native void makeNonBlocking(int descriptor) throws IOException;
+
+    /**
+     * Create a Unix-domain server socket on which a successor process
+     * can request a listening descriptor. An existing socket at the
+     * path owned by the same user is first removed, and the new socket
+     * is created accessible only to its owner.
+     * 
+     * @param path the bytes of the socket's path
+     * 
+     * @return the descriptor of the server socket
+     * 
+     * @throws IOException if the path is too long, if something other
+     * than a socket of the same user already exists at the path, or an
+     * internal call returns a negative result
+     */
+    static native int bindControl(byte[] path) throws IOException;
+
+    /**
+     * Connect to a predecessor process's Unix-domain server socket, as
+     * created by {@link #bindControl(byte[])}.
+     * 
+     * @param path the bytes of the socket's path
+     * 
+     * @return the descriptor of the connection; or negative if there
+     * is no socket at the path, or nothing is listening on it
+     * 
+     * @throws IOException if the path is too long, or an internal call
+     * returns a negative result for any other reason
+     */
+    static native int connectControl(byte[] path) throws IOException;
+
+    /**
+     * Accept a connection from a successor process running as the same
+     * user. Connections from other users are closed without returning.
+     * 
+     * @param descriptor the server socket, as returned by
+     * {@link #bindControl(byte[])}
+     * 
+     * @return the descriptor of the connection
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native int acceptControl(int descriptor) throws IOException;
+
+    /**
+     * Pass a descriptor to another process over a Unix-domain socket.
+     * The descriptor remains open in this process.
+     * 
+     * @param descriptor the Unix-domain socket
+     * 
+     * @param passed the descriptor to pass
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native void sendDescriptor(int descriptor, int passed)
+        throws IOException;
+
+    /**
+     * Receive a descriptor passed by another process with
+     * {@link #sendDescriptor(int, int)}.
+     * 
+     * @param descriptor the Unix-domain socket
+     * 
+     * @return the received descriptor; or negative if the other process
+     * closed the connection without passing one
+     * 
+     * @throws IOException if the internal call returns a negative
+     * result
+     */
+    static native int receiveDescriptor(int descriptor) throws IOException;
+
     /**
      * Ensures descriptors are closed when the containing object is
      * garbage-collected.
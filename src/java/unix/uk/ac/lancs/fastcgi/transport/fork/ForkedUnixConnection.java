@@ -36,9 +36,15 @@
 
 package uk.ac.lancs.fastcgi.transport.fork;
 
+import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.GatheringByteChannel;
+import java.util.Arrays;
+import uk.ac.lancs.fastcgi.proto.serial.FileTransferChannel;
 import uk.ac.lancs.fastcgi.transport.Connection;
 
 /**
@@ -58,10 +64,87 @@ class ForkedUnixConnection implements Connection {
         this.fd = new Descriptor(fd);
     }
 
+    /**
+     * Specifies the capacity of each of the direct buffers through
+     * which bytes pass to and from the descriptor.
+     */
+    private static final int BUFFER_SIZE = 64 * 1024;
+
+    /**
+     * Holds bytes received from the descriptor but not yet delivered.
+     * Between calls, the buffer is in its draining state, so its
+     * remaining bytes are those still to be delivered.
+     */
+    private final ByteBuffer inBuf =
+        ByteBuffer.allocateDirect(BUFFER_SIZE).limit(0);
+
+    /**
+     * Stages bytes being sent to the descriptor.
+     */
+    private final ByteBuffer outBuf = ByteBuffer.allocateDirect(BUFFER_SIZE);
+
+    /**
+     * Ensure that there are bytes to deliver from the input buffer,
+     * reading as many as are available from the descriptor if it is
+     * empty.
+     * 
+     * @return {@code false} if end-of-file has been reached;
+     * {@code true} otherwise
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    private boolean fill() throws IOException {
+        if (inBuf.hasRemaining()) return true;
+        inBuf.clear();
+        int got = fd.read(inBuf);
+        inBuf.flip();
+        return got > 0;
+    }
+
+    /**
+     * Read bytes without blocking, delivering any already in the input
+     * buffer first.
+     * 
+     * @param dst the buffer to store bytes in
+     * 
+     * @return the number of bytes read; {@code 0} if none are
+     * available; or {@code -1} on end-of-file
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    int readNow(ByteBuffer dst) throws IOException {
+        if (!dst.hasRemaining()) return 0;
+        if (!inBuf.hasRemaining()) {
+            inBuf.clear();
+            int got =
+                Descriptor.readSocketNow(fd.fd(), inBuf, 0, inBuf.capacity());
+            if (got <= 0) {
+                inBuf.limit(0);
+                return got;
+            }
+            inBuf.limit(got);
+        }
+        final int amount = Integer.min(dst.remaining(), inBuf.remaining());
+        dst.put(dst.position(), inBuf, inBuf.position(), amount);
+        dst.position(dst.position() + amount);
+        inBuf.position(inBuf.position() + amount);
+        return amount;
+    }
+
+    /**
+     * Get the internal file descriptor.
+     * 
+     * @return the descriptor; or negative if closed
+     */
+    int descriptor() {
+        return fd.fd();
+    }
+
     private final InputStream input = new InputStream() {
         @Override
         public int read() throws IOException {
-            return fd.read();
+            if (!fill()) return -1;
+            return inBuf.get() & 0xff;
         }
 
         @Override
@@ -71,14 +154,37 @@ class ForkedUnixConnection implements Connection {
 
         @Override
         public int read(byte[] b, int off, int len) throws IOException {
-            return fd.read(b, off, len);
+            if (len == 0) return 0;
+            if (!fill()) return -1;
+            final int amount = Integer.min(len, inBuf.remaining());
+            inBuf.get(b, off, amount);
+            return amount;
+        }
+
+        @Override
+        public long skip(long n) throws IOException {
+            if (n <= 0) return 0;
+            if (!fill()) return 0;
+            final int amount = (int) Long.min(n, inBuf.remaining());
+            inBuf.position(inBuf.position() + amount);
+            return amount;
+        }
+
+        @Override
+        public int available() throws IOException {
+            return inBuf.remaining();
         }
     };
 
     private final OutputStream output = new OutputStream() {
         @Override
         public void write(int b) throws IOException {
-            fd.write(b);
+            synchronized (outBuf) {
+                outBuf.clear();
+                outBuf.put((byte) b);
+                outBuf.flip();
+                fd.write(outBuf);
+            }
         }
 
         @Override
@@ -88,10 +194,149 @@ class ForkedUnixConnection implements Connection {
 
         @Override
         public void write(byte[] b, int off, int len) throws IOException {
-            fd.write(b, off, len);
+            synchronized (outBuf) {
+                while (len > 0) {
+                    final int amount = Integer.min(len, outBuf.capacity());
+                    outBuf.clear();
+                    outBuf.put(b, off, amount);
+                    outBuf.flip();
+                    fd.write(outBuf);
+                    off += amount;
+                    len -= amount;
+                }
+            }
         }
     };
 
+    /**
+     * Holds the buffers of the next gathering write. Direct buffers
+     * supplied by the caller are used as they are; the contents of
+     * others are staged into {@link #outBuf}, and a slice of it is
+     * used instead. Guarded by {@link #outBuf}.
+     */
+    private final ByteBuffer[] gather = new ByteBuffer[Descriptor.MAX_GATHER];
+
+    /**
+     * Records the number of elements of {@link #gather} in use.
+     * Guarded by {@link #outBuf}.
+     */
+    private int gathered;
+
+    /**
+     * Records whether the last element of {@link #gather} is a slice
+     * of {@link #outBuf}, so that staging further bytes can simply
+     * extend it. Guarded by {@link #outBuf}.
+     */
+    private boolean lastStaged;
+
+    /**
+     * Write out all gathered buffers, and prepare to gather more.
+     * The caller must hold the lock on {@link #outBuf}.
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    private void flushGathered() throws IOException {
+        if (gathered > 0) fd.write(gather, 0, gathered);
+        Arrays.fill(gather, 0, gathered, null);
+        gathered = 0;
+        lastStaged = false;
+        outBuf.clear();
+    }
+
+    private boolean open = true;
+
+    private final FileTransferChannel outputChannel =
+        new FileTransferChannel() {
+            @Override
+            public long transferFrom(FileInputStream file, long position,
+                                     long count)
+                throws IOException {
+                /* Nothing remains staged between writes, so the file's
+                 * bytes can go straight to the descriptor. */
+                synchronized (outBuf) {
+                    if (!open) throw new ClosedChannelException();
+                    return fd.transfer(file.getFD(), position, count);
+                }
+            }
+
+            @Override
+            public long write(ByteBuffer[] srcs, int offset, int length)
+                throws IOException {
+                synchronized (outBuf) {
+                    if (!open) throw new ClosedChannelException();
+                    long total = 0;
+                    outBuf.clear();
+                    for (int i = offset; i < offset + length; i++) {
+                        final ByteBuffer src = srcs[i];
+                        final int rem = src.remaining();
+                        if (rem == 0) continue;
+                        total += rem;
+
+                        /* Direct buffers can be passed straight to the
+                         * system call. */
+                        if (src.isDirect()) {
+                            if (gathered == gather.length) flushGathered();
+                            gather[gathered++] = src;
+                            lastStaged = false;
+                            continue;
+                        }
+
+                        /* Copy other buffers into our own direct
+                         * buffer, extending the previous staged slice
+                         * if it was the last element. */
+                        while (src.hasRemaining()) {
+                            if (!outBuf.hasRemaining() ||
+                                (!lastStaged && gathered == gather.length))
+                                flushGathered();
+                            final int start = outBuf.position();
+                            final int amount =
+                                Integer.min(src.remaining(),
+                                            outBuf.remaining());
+                            outBuf.put(start, src, src.position(), amount);
+                            outBuf.position(start + amount);
+                            src.position(src.position() + amount);
+                            if (lastStaged) {
+                                ByteBuffer prev = gather[gathered - 1];
+                                prev.limit(prev.limit() + amount);
+                            } else {
+                                final int cap = outBuf.capacity() - start;
+                                gather[gathered++] =
+                                    outBuf.slice(start, cap).limit(amount);
+                                lastStaged = true;
+                            }
+                        }
+                    }
+                    flushGathered();
+                    return total;
+                }
+            }
+
+            @Override
+            public long write(ByteBuffer[] srcs) throws IOException {
+                return write(srcs, 0, srcs.length);
+            }
+
+            @Override
+            public int write(ByteBuffer src) throws IOException {
+                return (int) write(new ByteBuffer[] { src }, 0, 1);
+            }
+
+            @Override
+            public boolean isOpen() {
+                synchronized (outBuf) {
+                    return open;
+                }
+            }
+
+            @Override
+            public void close() throws IOException {
+                synchronized (outBuf) {
+                    open = false;
+                }
+                fd.close();
+            }
+        };
+
     @Override
     public InputStream input() throws IOException {
         return input;
@@ -102,11 +347,21 @@ class ForkedUnixConnection implements Connection {
         return output;
     }
 
+    @Override
+    public GatheringByteChannel outputChannel() throws IOException {
+        return outputChannel;
+    }
+
     @Override
     public void close() throws IOException {
         fd.close();
     }
 
+    @Override
+    public void shutdownInput() throws IOException {
+        fd.shutdownInput();
+    }
+
     @Override
     public String description() {
         return descr;
@@ -42,7 +42,9 @@ import java.net.InetSocketAddress;
 import java.net.SocketAddress;
 import java.net.UnixDomainSocketAddress;
 import java.net.UnknownHostException;
+import java.nio.ByteBuffer;
 import java.util.Collection;
+import java.util.logging.Level;
 import java.util.logging.Logger;
 import uk.ac.lancs.fastcgi.proto.InvocationVariables;
 import uk.ac.lancs.fastcgi.transport.Connection;
@@ -58,114 +60,290 @@ class ForkedUnixTransport implements Transport {
     private final Descriptor fd;
 
     /**
-     * Determines whether a connection from a given peer should be
-     * accepted, and how to identify the connection.
+     * Identifies connections from permitted peers.
      */
-    private interface PeerValidator {
+    private interface PeerDescriber {
         /**
-         * Determine whether the connection from the peer should be
-         * accepted.
+         * Describe the connection from a peer.
          * 
          * @param addrLen the number of bytes in the peer's address
          * 
          * @param addr the bytes of the peer's address
          * 
-         * @return {@code null} if the connection should be rejected; or
-         * a suffix to be used in the connection's description (as
-         * defined by {@link Diagnostics#connectionDescription)
+         * @return a suffix to be used in the connection's description
+         * (as defined by {@link Diagnostics#connectionDescription)
          */
-        String permit(int addrLen, byte[] addr);
+        String describe(int addrLen, byte[] addr);
     }
 
-    private final PeerValidator validator;
+    /**
+     * Specifies the {@linkplain System#getProperties() system property}
+     * giving additional peers to be permitted, as a comma-separated
+     * list. Each item is an IP address or
+     * <samp><var>address</var>/<var>prefix-length</var></samp> for an
+     * Internet-domain transport, or <samp>uid:<var>n</var></samp> or
+     * <samp>gid:<var>n</var></samp> to match the credentials of a
+     * Unix-domain peer. The IP rules extend those from
+     * {@value InvocationVariables#WEB_SERVER_ADDRS}. If there are no
+     * rules for the transport's domain, all peers are permitted.
+     */
+    public static final String PEERS_PROP =
+        "uk.ac.lancs.fastcgi.transport.fork.peers";
+
+    /**
+     * Specifies the {@linkplain System#getProperties() system property}
+     * giving the path of a Unix-domain socket through which the
+     * listening socket is passed from each process to its successor.
+     * On start-up, a process connects to it, and takes over the
+     * listening socket of any predecessor listening there, in
+     * preference to file descriptor 0. It then listens on the path
+     * itself, and when a successor connects, passes the listening
+     * socket on and stops accepting connections. Only processes of the
+     * same user may take the socket. The listening socket is made
+     * non-blocking, so this is suitable only when the processes are
+     * started by a manager that does not also accept on it.
+     */
+    public static final String HANDOVER_PROP =
+        "uk.ac.lancs.fastcgi.transport.fork.handover";
+
+    private final PeerDescriber describer;
+
+    private final ByteBuffer rules;
+
+    private final int rulesLen;
 
     private final String descr;
 
     private final String intDescr;
 
+    private final SocketAddress saddr;
+
+    /**
+     * Receives the peer's address length and the number of rejected
+     * connections from each accept call.
+     */
+    private final int[] acceptInfo = new int[2];
+
+    /**
+     * Receives the peer's address from each accept call.
+     */
+    private final byte[] acceptAddr = new byte[Descriptor.getAddressSize()];
+
+    /**
+     * Becomes readable when the listening socket has been passed to a
+     * successor; or {@code null} if handover is not enabled
+     */
+    private final Descriptor wakeIn;
+
+    /**
+     * Is written to when the listening socket has been passed to a
+     * successor; or {@code null} if handover is not enabled
+     */
+    private final Descriptor wakeOut;
+
     private ForkedUnixTransport(int descriptor, String descr, String intDescr,
-                                PeerValidator validator) {
+                                SocketAddress saddr, PeerRules rules,
+                                PeerDescriber describer, String handover)
+        throws IOException {
         this.fd = new Descriptor(descriptor);
-        this.validator = validator;
+        this.rules = rules.toBuffer();
+        this.rulesLen = rules.size();
+        this.describer = describer;
         this.descr = descr;
         this.intDescr = intDescr;
+        this.saddr = saddr;
+        if (handover == null) {
+            this.wakeIn = null;
+            this.wakeOut = null;
+            return;
+        }
+
+        /* Both we and a successor may briefly accept from the same
+         * socket, so neither must block in accept. */
+        Descriptor.makeNonBlocking(descriptor);
+        int[] pair = new int[2];
+        Descriptor.socketPair(pair);
+        this.wakeIn = new Descriptor(pair[0]);
+        this.wakeOut = new Descriptor(pair[1]);
+        Thread t = new Thread(() -> {
+            try {
+                serveHandover(handover.getBytes());
+            } catch (IOException ex) {
+                logger.log(Level.SEVERE, "no handover on " + handover, ex);
+            }
+        }, "handover");
+        t.setDaemon(true);
+        t.start();
+    }
+
+    /**
+     * Take over the listening socket of a predecessor process.
+     * 
+     * @param control the bytes of the path of the predecessor's
+     * handover socket
+     * 
+     * @return the listening socket; or negative if there is no
+     * predecessor
+     * 
+     * @throws IOException if an I/O error occurs
+     */
+    private static int takeOver(byte[] control) throws IOException {
+        final int sock = Descriptor.connectControl(control);
+        if (sock < 0) return -1;
+        Descriptor peer = new Descriptor(sock);
+        try {
+            final int passed = Descriptor.receiveDescriptor(sock);
+            /* Confirm receipt, so the predecessor can stop accepting. */
+            if (passed >= 0) peer.write(1);
+            return passed;
+        } finally {
+            peer.close();
+        }
     }
 
     /**
-     * Detect a forked FastCGI transport on file descriptor 0. The
+     * Wait for a successor process to connect, pass it the listening
+     * socket, and stop accepting. A successor that fails to confirm
+     * receipt is ignored, and another is awaited.
+     * 
+     * @param control the bytes of the path on which to listen for the
+     * successor
+     * 
+     * @throws IOException if an I/O error occurs in listening for the
+     * successor
+     */
+    private void serveHandover(byte[] control) throws IOException {
+        Descriptor server = new Descriptor(Descriptor.bindControl(control));
+        try {
+            for (;;) {
+                Descriptor peer =
+                    new Descriptor(Descriptor.acceptControl(server.fd()));
+                try {
+                    Descriptor.sendDescriptor(peer.fd(), fd.fd());
+                    if (peer.read() < 0) continue;
+                } catch (IOException ex) {
+                    logger.log(Level.WARNING, "handover failed", ex);
+                    continue;
+                } finally {
+                    peer.close();
+                }
+                logger.info(() -> String.format("handed %s to successor",
+                                                saddr));
+                wakeOut.write(0);
+                return;
+            }
+        } finally {
+            server.close();
+        }
+    }
+
+    /**
+     * Detect a forked FastCGI transport on file descriptor 0, or one
+     * passed from a predecessor if {@value #HANDOVER_PROP} is set. The
      * transport is returned if detected. If {@code null} is returned,
      * no such transport is present, and another kind should be sought.
      * 
-     * @return a transport based on file descriptor 0; or {@code null}
-     * if no such transport is detected
+     * @return a transport based on file descriptor 0 or a
+     * predecessor's listening socket; or {@code null} if no such
+     * transport is detected
+     * 
+     * @throws IOException if an I/O error occurs in taking over from a
+     * predecessor, or in preparing to hand over to a successor
      * 
      * @throws UnknownHostException if a forked Internet-domain
      * transport is detected, but the environment variable
-     * {@value InvocationVariables#WEB_SERVER_ADDRS} contains an
-     * unresolved hostname or unparsed IP address
+     * {@value InvocationVariables#WEB_SERVER_ADDRS} or
+     * {@value #PEERS_PROP} contains an unresolved hostname or unparsed
+     * IP address
+     * 
+     * @throws IllegalArgumentException if {@value #PEERS_PROP} contains
+     * a malformed item
      * 
      * @constructor
      */
-    static ForkedUnixTransport create() throws UnknownHostException {
+    static ForkedUnixTransport create() throws IOException {
+        final String handover = System.getProperty(HANDOVER_PROP);
+        final int taken = handover == null ? -1 : takeOver(handover.getBytes());
         byte[] addr = new byte[Descriptor.getAddressSize()];
         int[] addrLen = new int[1];
-        int descriptor = Descriptor.checkDescriptor(addrLen, addr);
-        if (descriptor < 0) return null;
+        int descriptor = Descriptor.checkDescriptor(taken >= 0 ? taken : 0,
+                                                    addrLen, addr);
+        if (descriptor < 0) {
+            if (taken >= 0) Descriptor.closeSocket(taken);
+            return null;
+        }
         SocketAddress saddr = Descriptor.getSocketAddress(addrLen[0], addr);
-        final PeerValidator validator;
+        final PeerRules rules = new PeerRules();
+        final String extra = System.getProperty(PEERS_PROP);
+        if (extra != null) rules.parse(extra);
+        final PeerDescriber describer;
         final String intDescr;
         if (saddr instanceof InetSocketAddress) {
             final Collection<InetAddress> permittedCallers =
                 InvocationVariables.getAuthorizedInetPeers();
-            validator = (addrLen1, addr1) -> {
-                InetSocketAddress peerAddr = (InetSocketAddress) Descriptor
-                    .getSocketAddress(addrLen1, addr1);
-                if (!permittedCallers.contains(peerAddr.getAddress())) {
-                    logger.warning(() -> String
-                        .format("rejected connection from %s to %s", peerAddr,
-                                saddr));
-                    return null;
-                }
-                return "-inet-" + peerAddr;
-            };
+            if (permittedCallers != null)
+                for (InetAddress caller : permittedCallers)
+                    rules.addAddress(caller);
+            describer = (addrLen1, addr1) -> "-inet-"
+                + Descriptor.getSocketAddress(addrLen1, addr1);
             intDescr = saddr.toString();
         } else if (saddr instanceof UnixDomainSocketAddress udsa) {
-            validator = (addrLen1, addr1) -> "-unix";
+            describer = (addrLen1, addr1) -> "-unix";
             intDescr = udsa.getPath().toString();
         } else {
+            if (taken >= 0) Descriptor.closeSocket(taken);
             return null;
         }
-        return new ForkedUnixTransport(descriptor, "forked", intDescr,
-                                       validator);
+        if (taken >= 0)
+            logger.info(() -> String.format("took over %s", saddr));
+        return new ForkedUnixTransport(descriptor, "forked", intDescr, saddr,
+                                       rules, describer, handover);
     }
 
+    /**
+     * {@inheritDoc}
+     * 
+     * Peers are checked natively as connections are accepted, and
+     * unwelcome ones are closed without involving Java. Once the
+     * listening socket has been passed to a successor, {@code null} is
+     * returned.
+     */
     @Override
-    public Connection nextConnection() throws IOException {
+    public synchronized Connection nextConnection() throws IOException {
+        if (!fd.isValid()) return null;
         try {
-            byte[] addr = new byte[Descriptor.getAddressSize()];
-            int[] addrLen = new int[1];
-            while (fd.isValid()) {
-                int socket =
-                    Descriptor.acceptConnection(fd.fd(), addrLen, addr);
-                String suffix = validator.permit(addrLen[0], addr);
-                if (suffix == null) {
-                    Descriptor.closeSocket(socket);
-                    continue;
-                }
-                return new ForkedUnixConnection(descr + suffix, intDescr,
-                                                socket);
+            final int[] info = acceptInfo;
+            final byte[] addr = acceptAddr;
+            final int wake = wakeIn == null ? -1 : wakeIn.fd();
+            int socket = Descriptor.acceptPermitted(fd.fd(), wake, rules,
+                                                    rulesLen, info, addr);
+            final int rejected = info[1];
+            if (rejected > 0)
+                logger.warning(() -> String
+                    .format("rejected %d connections to %s", rejected, saddr));
+            if (socket < 0) {
+                /* A successor has taken over the listening socket. */
+                fd.close();
+                return null;
             }
-            return null;
+            String suffix = describer.describe(info[0], addr);
+            Reactor reactor = Reactor.next();
+            if (reactor != null)
+                return new SelectableForkedUnixConnection(descr + suffix,
+                                                          intDescr, socket,
+                                                          reactor);
+            return new ForkedUnixConnection(descr + suffix, intDescr, socket);
         } catch (IOException ex) {
             try {
                 fd.close();
             } catch (IOException sup) {
-                ex.addSuppressed(ex);
+                ex.addSuppressed(sup);
             }
             throw ex;
         }
     }
 
+
     private static final Logger logger =
         Logger.getLogger(ForkedUnixTransport.class.getPackageName());
 }
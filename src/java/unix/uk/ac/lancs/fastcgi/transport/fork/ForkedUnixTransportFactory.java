@@ -36,7 +36,7 @@
 
 package uk.ac.lancs.fastcgi.transport.fork;
 
-import java.net.UnknownHostException;
+import java.io.IOException;
 import uk.ac.lancs.fastcgi.transport.TransportConfigurationException;
 import uk.ac.lancs.scc.jardeps.Service;
 import uk.ac.lancs.fastcgi.transport.Transport;
@@ -46,7 +46,11 @@ import uk.ac.lancs.fastcgi.transport.TransportFactory;
  * Recognizes Unix-domain and Internet-domain transports on file
  * descriptor 0. This requires a {@linkplain System#getProperties()
  * system property} {@value Descriptor#LIBRARY_PROP} giving the name of
- * the supporting native library.
+ * the supporting native library. The system property
+ * {@value ForkedUnixTransport#PEERS_PROP} optionally extends the
+ * permitted peers, including by credentials for Unix-domain peers. The
+ * system property {@value ForkedUnixTransport#HANDOVER_PROP} enables
+ * the listening socket to be passed between successive processes.
  * 
  * @author simpsons
  */
@@ -56,7 +60,7 @@ public class ForkedUnixTransportFactory implements TransportFactory {
     public Transport getTransport() {
         try {
             return ForkedUnixTransport.create();
-        } catch (UnknownHostException ex) {
+        } catch (IOException ex) {
             throw new TransportConfigurationException(ex);
         }
     }
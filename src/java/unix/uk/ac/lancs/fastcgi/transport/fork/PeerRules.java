@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.fork;
+
+import java.io.ByteArrayOutputStream;
+import java.net.InetAddress;
+import java.net.UnknownHostException;
+import java.nio.ByteBuffer;
+import java.util.regex.Pattern;
+
+/**
+ * Builds an allowlist of peers in the binary form checked natively by
+ * {@link Descriptor#acceptPermitted(int, int, ByteBuffer, int, int[],
+ * byte[])}.
+ * Each rule is a tag byte followed by its operands. An IP rule has a
+ * prefix length in bits, and then the 4 or 16 bytes of the address. A
+ * credential rule has a 4-byte big-endian user or group id, and
+ * applies only to Unix-domain peers. A peer is permitted if any rule
+ * of its kind matches, or there are no rules of its kind.
+ * 
+ * @author simpsons
+ */
+final class PeerRules {
+    private static final int INET4 = 1;
+
+    private static final int INET6 = 2;
+
+    private static final int UID = 3;
+
+    private static final int GID = 4;
+
+    private final ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+
+    /**
+     * Permit a single IP address.
+     * 
+     * @param addr the address
+     */
+    void addAddress(InetAddress addr) {
+        addPrefix(addr, addr.getAddress().length * 8);
+    }
+
+    /**
+     * Permit a range of IP addresses.
+     * 
+     * @param addr the base address
+     * 
+     * @param bits the number of leading bits that must match
+     * 
+     * @throws IllegalArgumentException if the prefix length is out of
+     * range for the address
+     */
+    void addPrefix(InetAddress addr, int bits) {
+        byte[] raw = addr.getAddress();
+        if (bits < 0 || bits > raw.length * 8)
+            throw new IllegalArgumentException("bad prefix length " + bits
+                + " for " + addr.getHostAddress());
+        bytes.write(raw.length == 4 ? INET4 : INET6);
+        bytes.write(bits);
+        bytes.writeBytes(raw);
+    }
+
+    /**
+     * Permit Unix-domain peers running as a user.
+     * 
+     * @param uid the user id
+     */
+    void addUser(int uid) {
+        addId(UID, uid);
+    }
+
+    /**
+     * Permit Unix-domain peers running in a group.
+     * 
+     * @param gid the group id
+     */
+    void addGroup(int gid) {
+        addId(GID, gid);
+    }
+
+    private void addId(int tag, int id) {
+        bytes.write(tag);
+        bytes.write(id >>> 24);
+        bytes.write(id >>> 16);
+        bytes.write(id >>> 8);
+        bytes.write(id);
+    }
+
+    private static final Pattern COMMA = Pattern.compile(",");
+
+    /**
+     * Add rules from text. Items are separated by commas. Each item is
+     * either <samp>uid:<var>n</var></samp>,
+     * <samp>gid:<var>n</var></samp>, an address, or an address
+     * followed by <samp>/</samp> and a prefix length. Addresses are
+     * converted with {@link InetAddress#getByName(String)}.
+     * 
+     * @param text the text to parse
+     * 
+     * @throws UnknownHostException if an address did not parse, nor
+     * resolve as a host name
+     * 
+     * @throws IllegalArgumentException if an item is malformed
+     */
+    void parse(String text) throws UnknownHostException {
+        for (String item : COMMA.split(text)) {
+            item = item.trim();
+            if (item.isEmpty()) continue;
+            if (item.startsWith("uid:")) {
+                addUser(Integer.parseUnsignedInt(item.substring(4)));
+            } else if (item.startsWith("gid:")) {
+                addGroup(Integer.parseUnsignedInt(item.substring(4)));
+            } else {
+                final int slash = item.indexOf('/');
+                if (slash < 0) {
+                    addAddress(InetAddress.getByName(item));
+                } else {
+                    InetAddress addr =
+                        InetAddress.getByName(item.substring(0, slash));
+                    addPrefix(addr,
+                              Integer.parseInt(item.substring(slash + 1)));
+                }
+            }
+        }
+    }
+
+    /**
+     * Get the number of bytes of the rules.
+     * 
+     * @return the size of the rules
+     */
+    int size() {
+        return bytes.size();
+    }
+
+    /**
+     * Copy the rules into a direct buffer, for passing to native code.
+     * 
+     * @return a new buffer containing the rules at its start
+     */
+    ByteBuffer toBuffer() {
+        ByteBuffer result = ByteBuffer.allocateDirect(Math.max(1, size()));
+        result.put(bytes.toByteArray());
+        return result.flip();
+    }
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.fork;
+
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+
+/**
+ * Watches many descriptors for readability from a single thread, and
+ * invokes an action for each as it becomes ready. Each registration is
+ * one-shot, and must be renewed to receive further notifications.
+ * 
+ * @author simpsons
+ */
+final class Reactor {
+    private final int epfd;
+
+    /**
+     * Holds the pending action of each descriptor, indexed by the
+     * descriptor. Descriptors are small and dense, so this avoids
+     * boxing them as map keys. Guarded by {@code this}.
+     */
+    private Runnable[] actions = new Runnable[256];
+
+    private synchronized void put(int fd, Runnable action) {
+        if (fd >= actions.length)
+            actions = Arrays.copyOf(actions,
+                                    Integer.max(fd + 1, actions.length * 2));
+        actions[fd] = action;
+    }
+
+    private synchronized Runnable remove(int fd) {
+        if (fd < 0 || fd >= actions.length) return null;
+        Runnable action = actions[fd];
+        actions[fd] = null;
+        return action;
+    }
+
+    private Reactor(String name) throws IOException {
+        this.epfd = Descriptor.epollCreate();
+        Thread thread = new Thread(this::run, name);
+        thread.setDaemon(true);
+        thread.start();
+    }
+
+    /**
+     * Invoke an action once, when a descriptor next becomes readable.
+     * 
+     * @param fd the descriptor to watch
+     * 
+     * @param action the action to invoke
+     * 
+     * @throws IOException if the descriptor could not be watched
+     */
+    void arm(int fd, Runnable action) throws IOException {
+        put(fd, action);
+        try {
+            Descriptor.epollArm(epfd, fd);
+        } catch (IOException ex) {
+            remove(fd);
+            throw ex;
+        }
+    }
+
+    /**
+     * Discard any pending action for a descriptor. This should be
+     * called before the descriptor is closed, as its number could be
+     * re-used.
+     * 
+     * @param fd the descriptor no longer to be watched
+     */
+    void forget(int fd) {
+        remove(fd);
+    }
+
+    private void run() {
+        final int[] ready = new int[64];
+        try {
+            while (true) {
+                final int n = Descriptor.epollWait(epfd, ready);
+                for (int i = 0; i < n; i++) {
+                    Runnable action = remove(ready[i]);
+                    if (action == null) continue;
+                    try {
+                        action.run();
+                    } catch (RuntimeException ex) {
+                        logger.log(Level.SEVERE, "reactor action", ex);
+                    }
+                }
+            }
+        } catch (IOException ex) {
+            logger.log(Level.SEVERE, "reactor failed", ex);
+        }
+    }
+
+    /**
+     * Specifies the {@linkplain System#getProperties() system property}
+     * giving the number of reactor threads to serve connections. If
+     * absent or zero, each connection is read by its own thread.
+     */
+    public static final String REACTORS_PROP =
+        "uk.ac.lancs.fastcgi.transport.fork.reactors";
+
+    private static final Logger logger =
+        Logger.getLogger(Reactor.class.getPackageName());
+
+    private static final Reactor[] reactors = createReactors();
+
+    private static final AtomicInteger nextReactor = new AtomicInteger(0);
+
+    private static Reactor[] createReactors() {
+        final int count = Integer.getInteger(REACTORS_PROP, 0);
+        if (count <= 0) return new Reactor[0];
+        try {
+            Reactor[] result = new Reactor[count];
+            for (int i = 0; i < count; i++)
+                result[i] = new Reactor("reactor-" + i);
+            return result;
+        } catch (IOException | UnsatisfiedLinkError ex) {
+            logger.log(Level.WARNING, "reactors unavailable", ex);
+            return new Reactor[0];
+        }
+    }
+
+    /**
+     * Choose a reactor to serve a new connection. Reactors are chosen
+     * in turn.
+     * 
+     * @return the chosen reactor; or {@code null} if none are
+     * configured
+     */
+    static Reactor next() {
+        if (reactors.length == 0) return null;
+        final int i = nextReactor.getAndIncrement() & Integer.MAX_VALUE;
+        return reactors[i % reactors.length];
+    }
+}
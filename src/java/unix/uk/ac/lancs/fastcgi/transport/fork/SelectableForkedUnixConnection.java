@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2022, Lancaster University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
+ */
+
+package uk.ac.lancs.fastcgi.transport.fork;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.ReadableByteChannel;
+import uk.ac.lancs.fastcgi.transport.SelectableConnection;
+
+/**
+ * Serves a forked connection whose readability is watched by a shared
+ * {@link Reactor}.
+ * 
+ * @author simpsons
+ */
+final class SelectableForkedUnixConnection extends ForkedUnixConnection
+    implements SelectableConnection {
+    private final Reactor reactor;
+
+    SelectableForkedUnixConnection(String descr, String intDescr, int fd,
+                                   Reactor reactor) {
+        super(descr, intDescr, fd);
+        this.reactor = reactor;
+    }
+
+    private final ReadableByteChannel inputChannel =
+        new ReadableByteChannel() {
+            @Override
+            public int read(ByteBuffer dst) throws IOException {
+                if (!isOpen()) throw new ClosedChannelException();
+                return readNow(dst);
+            }
+
+            @Override
+            public boolean isOpen() {
+                return descriptor() >= 0;
+            }
+
+            @Override
+            public void close() throws IOException {
+                SelectableForkedUnixConnection.this.close();
+            }
+        };
+
+    @Override
+    public ReadableByteChannel inputChannel() throws IOException {
+        return inputChannel;
+    }
+
+    @Override
+    public void whenReadable(Runnable action) throws IOException {
+        reactor.arm(descriptor(), action);
+    }
+
+    @Override
+    public void close() throws IOException {
+        reactor.forget(descriptor());
+        super.close();
+    }
+}
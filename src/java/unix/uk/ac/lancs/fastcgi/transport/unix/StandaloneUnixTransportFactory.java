@@ -40,7 +40,10 @@ import java.io.IOException;
 import java.net.ServerSocket;
 import java.net.Socket;
 import java.net.UnixDomainSocketAddress;
+import java.util.ArrayList;
+import java.util.List;
 import uk.ac.lancs.fastcgi.proto.InvocationVariables;
+import uk.ac.lancs.fastcgi.transport.ShardedTransport;
 import uk.ac.lancs.fastcgi.transport.SocketTransport;
 import uk.ac.lancs.fastcgi.transport.Transport;
 import uk.ac.lancs.fastcgi.transport.TransportConfigurationException;
@@ -50,7 +53,11 @@ import uk.ac.lancs.scc.jardeps.Service;
 /**
  * Recognizes stand-alone Unix-domain transports. The environment
  * variable {@value InvocationVariables#UNIX_BIND_ADDR} must be set,
- * specifying the file of the rendezvous point.
+ * specifying the file of the rendezvous point. If
+ * {@value InvocationVariables#NIO_SELECTORS} is set to a positive
+ * number, this transport is not used. If
+ * {@value InvocationVariables#LISTENERS} is greater than 1, that many
+ * threads accept from the socket.
  * 
  * <p>
  * Each connection's description is {@value #STANDALONE_DESCRIPTION}.
@@ -65,15 +72,27 @@ public class StandaloneUnixTransportFactory implements TransportFactory {
             String pathText = System.getenv(InvocationVariables.UNIX_BIND_ADDR);
             if (pathText == null) return null;
 
+            /* Defer to the selector-based transport if requested. */
+            if (InvocationVariables.getNioSelectorCount() > 0) return null;
+
             UnixDomainSocketAddress addr = UnixDomainSocketAddress.of(pathText);
             final ServerSocket ss = new ServerSocket();
             ss.bind(addr);
-            return new SocketTransport(ss) {
-                @Override
-                protected String describe(Socket sock) {
-                    return STANDALONE_DESCRIPTION;
-                }
-            };
+
+            /* A rendezvous point can be bound only once, so several
+             * listeners just accept from the same socket. */
+            final int count = InvocationVariables.getListenerCount();
+            List<Transport> listeners = new ArrayList<>(count);
+            for (int i = 0; i < count; i++) {
+                listeners.add(new SocketTransport(ss) {
+                    @Override
+                    protected String describe(Socket sock) {
+                        return STANDALONE_DESCRIPTION;
+                    }
+                });
+            }
+            if (count == 1) return listeners.get(0);
+            return new ShardedTransport(listeners);
         } catch (IOException ex) {
             throw new TransportConfigurationException(ex);
         }
@@ -34,12 +34,25 @@
  *  Author: Steven Simpson <s.simpson@lancaster.ac.uk>
  */
 
+#ifdef __linux__
+/* for struct ucred */
+#define _GNU_SOURCE
+#endif
+
 #include <string.h>
 #include <errno.h>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#endif
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -53,14 +66,96 @@
       MAX(sizeof(struct sockaddr_in),					\
 	  MAX(sizeof(struct sockaddr_in6), sizeof(struct sockaddr_un))))
 
+/* The largest amount copied through the stack when transferring to or
+   from a Java array */
+#define IO_CHUNK 8192
+
+/* The largest number of buffers that may be passed to a single gathering
+   write */
+#define MAX_IOV 64
+
+/* Rule types of a peer allowlist, as built by PeerRules.  Each rule
+   is a tag byte followed by its operands.  IP rules have a prefix
+   length and then the address bytes; credential rules have a 4-byte
+   big-endian identifier. */
+#define RULE_INET4 1
+#define RULE_INET6 2
+#define RULE_UID 3
+#define RULE_GID 4
+
+/* Descriptors received from another process are to be closed on exec,
+   atomically where the system allows it. */
+#ifdef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC_FLAG MSG_CMSG_CLOEXEC
+#else
+#define MSG_CMSG_CLOEXEC_FLAG 0
+#endif
+
+/* Classes and members looked up once when the library is loaded */
+static struct {
+  jclass ioException;
+  jclass inetAddress;
+  jmethodID inetAddressGetByAddress;
+  jclass inetSocketAddress;
+  jmethodID inetSocketAddressInit;
+  jclass unixSocketAddress;
+  jmethodID unixSocketAddressOf;
+  jfieldID fileDescriptorFd;
+} ids;
+
+static jclass global_class(JNIEnv *env, const char *name)
+{
+  jclass local = (*env)->FindClass(env, name);
+  if (local == NULL) return NULL;
+  jclass global = (*env)->NewGlobalRef(env, local);
+  (*env)->DeleteLocalRef(env, local);
+  return global;
+}
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
+{
+  JNIEnv *env;
+  if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_8) != JNI_OK)
+    return JNI_ERR;
+
+  if ((ids.ioException = global_class(env, "java/io/IOException")) == NULL)
+    return JNI_ERR;
+
+  if ((ids.inetAddress = global_class(env, "java/net/InetAddress")) == NULL)
+    return JNI_ERR;
+  ids.inetAddressGetByAddress =
+    (*env)->GetStaticMethodID(env, ids.inetAddress, "getByAddress",
+			      "([B)Ljava/net/InetAddress;");
+  if (ids.inetAddressGetByAddress == NULL) return JNI_ERR;
+
+  ids.inetSocketAddress = global_class(env, "java/net/InetSocketAddress");
+  if (ids.inetSocketAddress == NULL) return JNI_ERR;
+  ids.inetSocketAddressInit =
+    (*env)->GetMethodID(env, ids.inetSocketAddress, "<init>",
+			"(Ljava/net/InetAddress;I)V");
+  if (ids.inetSocketAddressInit == NULL) return JNI_ERR;
+
+  ids.unixSocketAddress =
+    global_class(env, "java/net/UnixDomainSocketAddress");
+  if (ids.unixSocketAddress == NULL) return JNI_ERR;
+  ids.unixSocketAddressOf =
+    (*env)->GetStaticMethodID(env, ids.unixSocketAddress, "of",
+			      "(Ljava/lang/String;)"
+			      "Ljava/net/UnixDomainSocketAddress;");
+  if (ids.unixSocketAddressOf == NULL) return JNI_ERR;
+
+  jclass fdc = (*env)->FindClass(env, "java/io/FileDescriptor");
+  if (fdc == NULL) return JNI_ERR;
+  ids.fileDescriptorFd = (*env)->GetFieldID(env, fdc, "fd", "I");
+  (*env)->DeleteLocalRef(env, fdc);
+  if (ids.fileDescriptorFd == NULL) return JNI_ERR;
+
+  return JNI_VERSION_1_8;
+}
+
 static void throwErrno(JNIEnv *env, int ec)
 {
-  jclass ioext = (*env)->FindClass(env, "java/io/IOException");
-  jmethodID ctr = (*env)->GetMethodID(env, ioext, "<init>",
-				      "(Ljava/lang/String;)V");
-  jstring str = (*env)->NewStringUTF(env, strerror(ec));
-  jthrowable exc = (jthrowable) (*env)->NewObject(env, ioext, ctr, str);
-  (*env)->Throw(env, exc);
+  (*env)->ThrowNew(env, ids.ioException, strerror(ec));
 }
 
 JNIEXPORT void JNICALL
@@ -75,26 +170,20 @@ static void copy_back_addr(JNIEnv *env, jintArray ulen,
 			   jbyteArray ubuf,
 			   const char *ptr, socklen_t addrlen)
 {
-  jbyte *dst = (*env)->GetByteArrayElements(env, ubuf, NULL);
-  for (socklen_t i = 0; i < addrlen; i++)
-    dst[i] = ptr[i];
-  (*env)->ReleaseByteArrayElements(env, ubuf, dst, 0);
-
-  jint *lb = (*env)->GetIntArrayElements(env, ulen, NULL);
-  lb[0] = addrlen;
-  (*env)->ReleaseIntArrayElements(env, ulen, lb, 0);
+  (*env)->SetByteArrayRegion(env, ubuf, 0, addrlen, (const jbyte *) ptr);
+  jint len = addrlen;
+  (*env)->SetIntArrayRegion(env, ulen, 0, 1, &len);
 }
 
 /*
  * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
  * Method:    checkDescriptor
- * Signature: ([I[B)I
+ * Signature: (I[I[B)I
  */
 JNIEXPORT jint JNICALL
 Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_checkDescriptor
-(JNIEnv *env, jclass jc, jintArray ulen, jbyteArray ubuf)
+(JNIEnv *env, jclass jc, jint fd, jintArray ulen, jbyteArray ubuf)
 {
-  int fd = 0;
   union {
     struct sockaddr addr;
     char buf[MAX_SOCKADDR_LEN];
@@ -142,12 +231,9 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_getSocketAddress
   } u;
 
   /* Copy the address into our buffer. */
-  {
-    jbyte *src = (*env)->GetByteArrayElements(env, ubuf, NULL);
-    for (jint i = 0; i < ulen; i++)
-      u.buf[i] = src[i];
-    (*env)->ReleaseByteArrayElements(env, ubuf, src, 0);
-  }
+  if (ulen < 0 || (size_t) ulen > sizeof u.buf) return NULL;
+  (*env)->GetByteArrayRegion(env, ubuf, 0, ulen, (jbyte *) u.buf);
+  if ((*env)->ExceptionCheck(env)) return NULL;
 
   /* Check to see if it's AF_INET or AF_INET6. If so, extract the port
    * number, and identify the bytes of the IP address. */
@@ -181,25 +267,21 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_getSocketAddress
   case AF_INET6: {
     /* Convert the bytes into a Java byte array. */
     jbyteArray array = (*env)->NewByteArray(env, len);
-    {
-      jbyte *dst = (*env)->GetByteArrayElements(env, array, NULL);
-      for (size_t i = 0; i < len; i++)
-	dst[i] = ptr[i];
-      (*env)->ReleaseByteArrayElements(env, array, dst, 0);
-    }
+    if (array == NULL) return NULL;
+    (*env)->SetByteArrayRegion(env, array, 0, len, (const jbyte *) ptr);
 
     /* Create the InetAddress from the Java byte array. */
-    jclass inat = (*env)->FindClass(env, "java/net/InetAddress");
-    jmethodID gba = (*env)->GetMethodID(env, inat, "getByAddress",
-					"([b)Ljava/net/InetAddress;");
-    jobject aobj = (*env)->CallStaticObjectMethod(env, inat, gba, array);
+    jobject aobj =
+      (*env)->CallStaticObjectMethod(env, ids.inetAddress,
+				     ids.inetAddressGetByAddress, array);
+    (*env)->DeleteLocalRef(env, array);
     if ((*env)->ExceptionCheck(env)) return NULL;
 
     /* Combine the port with the IP address. */
-    jclass insat = (*env)->FindClass(env, "java/net/InetSocketAddress");
-    jmethodID ctr = (*env)->GetMethodID(env, insat, "<init>",
-					"(Ljava/net/InetAddress;I)V");
-    jobject insa = (*env)->NewObject(env, insat, ctr, aobj, port);
+    jobject insa = (*env)->NewObject(env, ids.inetSocketAddress,
+				     ids.inetSocketAddressInit,
+				     aobj, (jint) port);
+    (*env)->DeleteLocalRef(env, aobj);
     if ((*env)->ExceptionCheck(env)) return NULL;
 
     return insa;
@@ -217,12 +299,10 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_getSocketAddress
     if ((*env)->ExceptionCheck(env)) return NULL;
 
     /* Create a UnixDomainSocketAddress from the path. */
-    jclass insat = (*env)->FindClass(env, "java/net/UnixDomainSocketAddress");
-    jmethodID ctr =
-      (*env)->GetStaticMethodID(env, insat, "of",
-				"(Ljava/lang/String;)"
-				"Ljava/net/UnixDomainSocketAddress;");
-    jobject insa = (*env)->CallStaticObjectMethod(env, insat, ctr, path);
+    jobject insa =
+      (*env)->CallStaticObjectMethod(env, ids.unixSocketAddress,
+				     ids.unixSocketAddressOf, path);
+    (*env)->DeleteLocalRef(env, path);
     if ((*env)->ExceptionCheck(env)) return NULL;
 
     return insa;
@@ -258,6 +338,197 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_acceptConnection
   return rc;
 }
 
+/* Determine whether the leading bits of two addresses match. */
+static int prefix_match(const unsigned char *addr,
+			const unsigned char *prefix, unsigned bits)
+{
+  const unsigned whole = bits / 8;
+  if (memcmp(addr, prefix, whole) != 0) return 0;
+  const unsigned rem = bits % 8;
+  if (rem == 0) return 1;
+  const unsigned char mask = 0xff << (8 - rem);
+  return (addr[whole] & mask) == (prefix[whole] & mask);
+}
+
+/* Get the credentials of the process at the other end of a Unix-domain
+   socket.  0 is returned on success. */
+static int get_peer_creds(int sock, uid_t *uid, gid_t *gid)
+{
+#ifdef SO_PEERCRED
+  struct ucred cr;
+  socklen_t len = sizeof cr;
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cr, &len) < 0) return -1;
+  *uid = cr.uid;
+  *gid = cr.gid;
+  return 0;
+#else
+  return getpeereid(sock, uid, gid);
+#endif
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+    ((uint32_t) p[2] << 8) | p[3];
+}
+
+/* Determine whether a peer is permitted by an allowlist.  A peer is
+   permitted if any rule of its kind matches, or if there are no rules
+   of its kind.  IPv4-mapped IPv6 peers are also matched against IPv4
+   rules.  A malformed list rejects everything. */
+static int permit_peer(int sock, const struct sockaddr *sa,
+		       const unsigned char *rules, size_t len)
+{
+  const unsigned char *a4 = NULL, *a6 = NULL;
+  switch (sa->sa_family) {
+  case AF_INET:
+    a4 = (const void *) &((const struct sockaddr_in *) sa)->sin_addr;
+    break;
+
+  case AF_INET6:
+    a6 = (const void *) &((const struct sockaddr_in6 *) sa)->sin6_addr;
+    if (IN6_IS_ADDR_V4MAPPED((const struct in6_addr *) a6)) a4 = a6 + 12;
+    break;
+  }
+
+  int ip_rules = 0, cred_rules = 0, creds = 0;
+  uid_t uid;
+  gid_t gid;
+  for (size_t i = 0; i < len; ) {
+    switch (rules[i]) {
+    case RULE_INET4:
+      if (len - i < 6) return 0;
+      ip_rules = 1;
+      if (a4 != NULL &&
+	  prefix_match(a4, rules + i + 2, rules[i + 1] > 32 ?
+		       32 : rules[i + 1]))
+	return 1;
+      i += 6;
+      break;
+
+    case RULE_INET6:
+      if (len - i < 18) return 0;
+      ip_rules = 1;
+      if (a6 != NULL &&
+	  prefix_match(a6, rules + i + 2, rules[i + 1] > 128 ?
+		       128 : rules[i + 1]))
+	return 1;
+      i += 18;
+      break;
+
+    case RULE_UID:
+    case RULE_GID:
+      if (len - i < 5) return 0;
+      cred_rules = 1;
+      if (sa->sa_family == AF_UNIX) {
+	/* Fetch the credentials only once, and only if needed. */
+	if (creds == 0) creds = get_peer_creds(sock, &uid, &gid) == 0 ? 1 : -1;
+	if (creds > 0) {
+	  const uint32_t id = get_u32(rules + i + 1);
+	  if (rules[i] == RULE_UID ? id == (uint32_t) uid :
+	      id == (uint32_t) gid)
+	    return 1;
+	}
+      }
+      i += 5;
+      break;
+
+    default:
+      return 0;
+    }
+  }
+
+  switch (sa->sa_family) {
+  case AF_INET:
+  case AF_INET6:
+    return !ip_rules;
+
+  case AF_UNIX:
+    return !cred_rules;
+
+  default:
+    return 1;
+  }
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    acceptPermitted
+ * Signature: (IILjava/nio/ByteBuffer;I[I[B)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_acceptPermitted
+(JNIEnv *env, jclass jc, jint fd, jint wake, jobject rules, jint rlen,
+ jintArray info, jbyteArray ubuf)
+{
+  const unsigned char *rp = NULL;
+  if (rlen > 0) {
+    rp = (*env)->GetDirectBufferAddress(env, rules);
+    if (rp == NULL) {
+      throwErrno(env, EINVAL);
+      return -1;
+    }
+  }
+
+  /* Silently close connections from unwelcome peers, and count
+     them. */
+  jint rejected = 0;
+  for ( ; ; ) {
+    /* If we can be woken, the listening socket is non-blocking and
+       may be shared with another process, so wait for either to
+       become ready, and go back to waiting if the other process took
+       the connection. */
+    if (wake >= 0) {
+      struct pollfd pfds[2] = {
+	{ .fd = fd, .events = POLLIN },
+	{ .fd = wake, .events = POLLIN },
+      };
+      int prc = poll(pfds, 2, -1);
+      if (prc < 0) {
+	if (errno == EINTR) continue;
+	throwErrno(env, errno);
+	return -1;
+      }
+      if (pfds[1].revents != 0) {
+	const jint out[2] = { 0, rejected };
+	(*env)->SetIntArrayRegion(env, info, 0, 2, out);
+	return -1;
+      }
+      if (pfds[0].revents == 0) continue;
+    }
+
+    union {
+      struct sockaddr addr;
+      char buf[MAX_SOCKADDR_LEN];
+    } u;
+    socklen_t addrlen = sizeof u.buf;
+    int rc = accept(fd, &u.addr, &addrlen);
+    if (rc < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (wake >= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+      throwErrno(env, errno);
+      return -1;
+    }
+
+    /* Some systems let the connection inherit non-blocking mode from
+       the listening socket. */
+    if (wake >= 0) {
+      int fl = fcntl(rc, F_GETFL);
+      if (fl >= 0 && (fl & O_NONBLOCK)) fcntl(rc, F_SETFL, fl & ~O_NONBLOCK);
+    }
+
+    if (permit_peer(rc, &u.addr, rp, rlen)) {
+      (*env)->SetByteArrayRegion(env, ubuf, 0, addrlen,
+				 (const jbyte *) u.buf);
+      const jint out[2] = { addrlen, rejected };
+      (*env)->SetIntArrayRegion(env, info, 0, 2, out);
+      return rc;
+    }
+    close(rc);
+    rejected++;
+  }
+}
+
 /*
  * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
  * Method:    getAddressSize
@@ -270,6 +541,36 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_getAddressSize
   return MAX_SOCKADDR_LEN;
 }
 
+/* Send all bytes from a native buffer, restarting after signals. */
+static int send_all(JNIEnv *env, int fd, const char *ptr, size_t len)
+{
+  while (len > 0) {
+    ssize_t got = send(fd, ptr, len, 0);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      throwErrno(env, errno);
+      return -1;
+    }
+    ptr += got;
+    len -= got;
+  }
+  return 0;
+}
+
+/* Receive at most the requested number of bytes into a native buffer,
+   restarting after signals.  0 indicates end-of-file; -1 indicates an
+   exception has been thrown. */
+static ssize_t recv_some(JNIEnv *env, int fd, char *ptr, size_t len)
+{
+  for ( ; ; ) {
+    ssize_t rc = recv(fd, ptr, len, 0);
+    if (rc >= 0) return rc;
+    if (errno == EINTR) continue;
+    throwErrno(env, errno);
+    return -1;
+  }
+}
+
 /*
  * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
  * Method:    writeSocket
@@ -280,11 +581,7 @@ Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_writeSocket__II
 (JNIEnv *env, jclass jc, jint fd, jint b)
 {
   char nb = b;
-  for ( ; ; ) {
-    ssize_t rc = send(fd, &nb, 1, 0);
-    if (rc < 0)
-      throwErrno(env, errno);
-  }
+  send_all(env, fd, &nb, 1);
 }
 
 /*
@@ -296,23 +593,147 @@ JNIEXPORT void JNICALL
 Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_writeSocket__I_3BII
 (JNIEnv *env, jclass jc, jint fd, jbyteArray b, jint off, jint len)
 {
-  char buf[len];
-  jbyte *src = (*env)->GetByteArrayElements(env, b, NULL);
-  for (jint i = 0; i < len; i++)
-    buf[i] = src[i + off];
-  (*env)->ReleaseByteArrayElements(env, b, src, 0);
-  char *ptr = buf;
+  /* Copy through a bounded buffer, rather than pinning the array
+     across a potentially blocking call. */
+  char buf[IO_CHUNK];
   while (len > 0) {
-    ssize_t got = send(fd, ptr, len, 0);
+    jint amount = len < IO_CHUNK ? len : IO_CHUNK;
+    (*env)->GetByteArrayRegion(env, b, off, amount, (jbyte *) buf);
+    if ((*env)->ExceptionCheck(env)) return;
+    if (send_all(env, fd, buf, amount) < 0) return;
+    off += amount;
+    len -= amount;
+  }
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    writeSocket
+ * Signature: (ILjava/nio/ByteBuffer;II)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_writeSocket__ILjava_nio_ByteBuffer_2II
+(JNIEnv *env, jclass jc, jint fd, jobject b, jint pos, jint len)
+{
+  char *base = (*env)->GetDirectBufferAddress(env, b);
+  if (base == NULL) {
+    throwErrno(env, EINVAL);
+    return;
+  }
+  send_all(env, fd, base + pos, len);
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    writevSocket
+ * Signature: (I[Ljava/nio/ByteBuffer;[I[II)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_writevSocket
+(JNIEnv *env, jclass jc, jint fd, jobjectArray bufs,
+ jintArray poss, jintArray lens, jint count)
+{
+  if (count <= 0) return;
+  if (count > MAX_IOV) {
+    throwErrno(env, EINVAL);
+    return;
+  }
+
+  /* Build the I/O vector from the buffers' addresses. */
+  jint pos[MAX_IOV], len[MAX_IOV];
+  (*env)->GetIntArrayRegion(env, poss, 0, count, pos);
+  (*env)->GetIntArrayRegion(env, lens, 0, count, len);
+  if ((*env)->ExceptionCheck(env)) return;
+  struct iovec iov[MAX_IOV];
+  for (jint i = 0; i < count; i++) {
+    jobject b = (*env)->GetObjectArrayElement(env, bufs, i);
+    char *base = (*env)->GetDirectBufferAddress(env, b);
+    (*env)->DeleteLocalRef(env, b);
+    if (base == NULL) {
+      throwErrno(env, EINVAL);
+      return;
+    }
+    iov[i].iov_base = base + pos[i];
+    iov[i].iov_len = len[i];
+  }
+
+  /* Keep writing until the vector is exhausted, skipping over
+     completed elements and trimming a partially written one. */
+  struct iovec *cur = iov;
+  int rem = count;
+  while (rem > 0) {
+    ssize_t got = writev(fd, cur, rem);
     if (got < 0) {
+      if (errno == EINTR) continue;
       throwErrno(env, errno);
       return;
     }
-    ptr += got;
-    len -= got;
+    while (rem > 0 && (size_t) got >= cur->iov_len) {
+      got -= cur->iov_len;
+      cur++;
+      rem--;
+    }
+    if (rem > 0) {
+      cur->iov_base = (char *) cur->iov_base + got;
+      cur->iov_len -= got;
+    }
   }
 }
 
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    sendFile
+ * Signature: (ILjava/io/FileDescriptor;JJ)J
+ */
+JNIEXPORT jlong JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_sendFile
+(JNIEnv *env, jclass jc, jint fd, jobject file, jlong pos, jlong len)
+{
+  /* Get the source descriptor out of the Java object. */
+  int src = (*env)->GetIntField(env, file, ids.fileDescriptorFd);
+
+  off_t off = pos;
+  jlong done = 0;
+  while (done < len) {
+#ifdef __linux__
+    /* The kernel moves the bytes without them entering user space. */
+    ssize_t got = sendfile(fd, src, &off, len - done);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      throwErrno(env, errno);
+      return -1;
+    }
+    if (got == 0) break;
+    done += got;
+#else
+    /* Copy through the stack instead. */
+    char buf[IO_CHUNK];
+    size_t want = len - done < IO_CHUNK ? len - done : IO_CHUNK;
+    ssize_t got = pread(src, buf, want, off);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      throwErrno(env, errno);
+      return -1;
+    }
+    if (got == 0) break;
+    for (ssize_t rc, sent = 0; sent < got; sent += rc) {
+      rc = write(fd, buf + sent, got - sent);
+      if (rc < 0) {
+	if (errno == EINTR) {
+	  rc = 0;
+	  continue;
+	}
+	throwErrno(env, errno);
+	return -1;
+      }
+    }
+    off += got;
+    done += got;
+#endif
+  }
+  return done;
+}
+
 /*
  * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
  * Method:    readSocket
@@ -322,18 +743,29 @@ JNIEXPORT jint JNICALL
 Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_readSocket__I_3BII
 (JNIEnv *env, jclass jc, jint fd, jbyteArray b, jint off, jint len)
 {
-  char buf[len];
-  ssize_t rc = recv(fd, buf, len, 0);
-  if (rc < 0) {
-    throwErrno(env, errno);
+  char buf[IO_CHUNK];
+  ssize_t rc = recv_some(env, fd, buf, len < IO_CHUNK ? len : IO_CHUNK);
+  if (rc <= 0) return -1;
+  (*env)->SetByteArrayRegion(env, b, off, rc, (const jbyte *) buf);
+  return rc;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    readSocket
+ * Signature: (ILjava/nio/ByteBuffer;II)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_readSocket__ILjava_nio_ByteBuffer_2II
+(JNIEnv *env, jclass jc, jint fd, jobject b, jint pos, jint len)
+{
+  char *base = (*env)->GetDirectBufferAddress(env, b);
+  if (base == NULL) {
+    throwErrno(env, EINVAL);
     return -1;
   }
-  if (rc == 0) return -1;
-
-  jbyte *dst = (*env)->GetByteArrayElements(env, b, NULL);
-  for (jint i = 0; i < rc; i++)
-    dst[i + off] = buf[i];
-  (*env)->ReleaseByteArrayElements(env, b, dst, 0);
+  ssize_t rc = recv_some(env, fd, base + pos, len);
+  if (rc <= 0) return -1;
   return rc;
 }
 
@@ -346,12 +778,402 @@ JNIEXPORT jint JNICALL
 Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_readSocket__I
 (JNIEnv *env, jclass jc, jint fd)
 {
-  char b;
-  ssize_t rc = recv(fd, &b, 1, 0);
+  unsigned char b;
+  ssize_t rc = recv_some(env, fd, (char *) &b, 1);
+  if (rc <= 0) return -1;
+  return b;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    readSocketNow
+ * Signature: (ILjava/nio/ByteBuffer;II)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_readSocketNow
+(JNIEnv *env, jclass jc, jint fd, jobject b, jint pos, jint len)
+{
+  char *base = (*env)->GetDirectBufferAddress(env, b);
+  if (base == NULL) {
+    throwErrno(env, EINVAL);
+    return -1;
+  }
+  for ( ; ; ) {
+    ssize_t rc = recv(fd, base + pos, len, MSG_DONTWAIT);
+    if (rc > 0) return rc;
+    if (rc == 0) return -1;
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    throwErrno(env, errno);
+    return -1;
+  }
+}
+
+#ifdef __linux__
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    epollCreate
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_epollCreate
+(JNIEnv *env, jclass jc)
+{
+  int rc = epoll_create1(EPOLL_CLOEXEC);
+  if (rc < 0) throwErrno(env, errno);
+  return rc;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    epollArm
+ * Signature: (II)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_epollArm
+(JNIEnv *env, jclass jc, jint epfd, jint fd)
+{
+  /* Re-arm an existing registration, or create one if this is the
+     first time. */
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof ev);
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0) return;
+  if (errno == ENOENT && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0) return;
+  throwErrno(env, errno);
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    epollWait
+ * Signature: (I[I)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_epollWait
+(JNIEnv *env, jclass jc, jint epfd, jintArray fds)
+{
+#define MAX_EVENTS 64
+  struct epoll_event evs[MAX_EVENTS];
+  jint ready[MAX_EVENTS];
+  jsize max = (*env)->GetArrayLength(env, fds);
+  if (max < 1) {
+    /* epoll_wait would only fail with EINVAL. */
+    jclass iae =
+      (*env)->FindClass(env, "java/lang/IllegalArgumentException");
+    if (iae != NULL) (*env)->ThrowNew(env, iae, "empty descriptor array");
+    return -1;
+  }
+  if (max > MAX_EVENTS) max = MAX_EVENTS;
+  int rc = epoll_wait(epfd, evs, max, -1);
+  if (rc < 0) {
+    if (errno == EINTR) return 0;
+    throwErrno(env, errno);
+    return -1;
+  }
+  for (int i = 0; i < rc; i++)
+    ready[i] = evs[i].data.fd;
+  (*env)->SetIntArrayRegion(env, fds, 0, rc, ready);
+  return rc;
+#undef MAX_EVENTS
+}
+#endif
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    shutdownSocket
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_shutdownSocket
+(JNIEnv *env, jclass jc, jint fd)
+{
+  if (shutdown(fd, SHUT_RD) < 0 && errno != ENOTCONN)
+    throwErrno(env, errno);
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    socketPair
+ * Signature: ([I)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_socketPair
+(JNIEnv *env, jclass jc, jintArray ufds)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    throwErrno(env, errno);
+    return;
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  const jint out[2] = { fds[0], fds[1] };
+  (*env)->SetIntArrayRegion(env, ufds, 0, 2, out);
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    makeNonBlocking
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_makeNonBlocking
+(JNIEnv *env, jclass jc, jint fd)
+{
+  int fl = fcntl(fd, F_GETFL);
+  if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)
+    throwErrno(env, errno);
+}
+
+/* Fill in a Unix-domain address from a Java byte array.  0 is
+   returned on success; -1 indicates an exception has been thrown. */
+static int get_unix_addr(JNIEnv *env, jbyteArray upath,
+			 struct sockaddr_un *sun)
+{
+  jsize len = (*env)->GetArrayLength(env, upath);
+  if ((size_t) len >= sizeof sun->sun_path) {
+    throwErrno(env, ENAMETOOLONG);
+    return -1;
+  }
+  memset(sun, 0, sizeof *sun);
+  sun->sun_family = AF_UNIX;
+  (*env)->GetByteArrayRegion(env, upath, 0, len, (jbyte *) sun->sun_path);
+  return 0;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    bindControl
+ * Signature: ([B)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_bindControl
+(JNIEnv *env, jclass jc, jbyteArray upath)
+{
+  struct sockaddr_un sun;
+  if (get_unix_addr(env, upath, &sun) < 0) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throwErrno(env, errno);
+    return -1;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  /* Replace any socket left by a predecessor, but nothing else, and
+     nothing belonging to another user. */
+  struct stat st;
+  if (lstat(sun.sun_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != geteuid()) {
+      close(fd);
+      throwErrno(env, EEXIST);
+      return -1;
+    }
+    if (unlink(sun.sun_path) < 0 && errno != ENOENT) {
+      int ec = errno;
+      close(fd);
+      throwErrno(env, ec);
+      return -1;
+    }
+  } else if (errno != ENOENT) {
+    int ec = errno;
+    close(fd);
+    throwErrno(env, ec);
+    return -1;
+  }
+
+  /* Let only our own user connect.  The umask is process-wide, so
+     the permissions are set on the path instead.  This is done before
+     listening, so no-one else can connect in between. */
+  if (bind(fd, (struct sockaddr *) &sun, sizeof sun) < 0) {
+    int ec = errno;
+    close(fd);
+    throwErrno(env, ec);
+    return -1;
+  }
+  if (chmod(sun.sun_path, S_IRUSR | S_IWUSR) < 0 || listen(fd, 1) < 0) {
+    int ec = errno;
+    unlink(sun.sun_path);
+    close(fd);
+    throwErrno(env, ec);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    connectControl
+ * Signature: ([B)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_connectControl
+(JNIEnv *env, jclass jc, jbyteArray upath)
+{
+  struct sockaddr_un sun;
+  if (get_unix_addr(env, upath, &sun) < 0) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throwErrno(env, errno);
+    return -1;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  int ec = 0;
+  if (connect(fd, (struct sockaddr *) &sun, sizeof sun) < 0) {
+    ec = errno;
+    if (ec == EINTR) {
+      /* The connection proceeds in the background, and may not be
+         restarted.  Wait for it to complete, and get its outcome. */
+      struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+      int rc;
+      while ((rc = poll(&pfd, 1, -1)) < 0 && errno == EINTR)
+	;
+      socklen_t len = sizeof ec;
+      if (rc < 0)
+	ec = errno;
+      else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &ec, &len) < 0)
+	ec = errno;
+    }
+  }
+  if (ec == 0) return fd;
+  close(fd);
+
+  /* Having no predecessor is not an error. */
+  if (ec == ENOENT || ec == ECONNREFUSED) return -1;
+  throwErrno(env, ec);
+  return -1;
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    acceptControl
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_acceptControl
+(JNIEnv *env, jclass jc, jint fd)
+{
+  /* Only a process of our own user may take our socket, whatever
+     the permissions on the rendezvous. */
+  const uid_t self = geteuid();
+  for ( ; ; ) {
+    int rc = accept(fd, NULL, NULL);
+    if (rc < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      throwErrno(env, errno);
+      return -1;
+    }
+    uid_t uid;
+    gid_t gid;
+    if (get_peer_creds(rc, &uid, &gid) == 0 && uid == self) {
+      fcntl(rc, F_SETFD, FD_CLOEXEC);
+      return rc;
+    }
+    close(rc);
+  }
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    sendDescriptor
+ * Signature: (II)V
+ */
+JNIEXPORT void JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_sendDescriptor
+(JNIEnv *env, jclass jc, jint fd, jint passed)
+{
+  /* At least one byte of ordinary data must accompany the
+     descriptor. */
+  char tag = 'F';
+  struct iovec iov = { .iov_base = &tag, .iov_len = 1 };
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } ctl;
+  memset(&ctl, 0, sizeof ctl);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof ctl.buf;
+  struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cm), &passed, sizeof(int));
+
+  for ( ; ; ) {
+    if (sendmsg(fd, &msg, 0) >= 0) return;
+    if (errno == EINTR) continue;
+    throwErrno(env, errno);
+    return;
+  }
+}
+
+/*
+ * Class:     uk_ac_lancs_fastcgi_transport_native_unix_Descriptor
+ * Method:    receiveDescriptor
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL
+Java_uk_ac_lancs_fastcgi_transport_fork_Descriptor_receiveDescriptor
+(JNIEnv *env, jclass jc, jint fd)
+{
+#define MAX_PASSED 8
+  char tag;
+  struct iovec iov = { .iov_base = &tag, .iov_len = 1 };
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED)];
+  } ctl;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof ctl.buf;
+
+  ssize_t rc;
+  do {
+    rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC_FLAG);
+  } while (rc < 0 && errno == EINTR);
   if (rc < 0) {
     throwErrno(env, errno);
     return -1;
   }
   if (rc == 0) return -1;
-  return (unsigned) b;
+
+  /* Keep only the first descriptor passed, and close any others, so
+     that a misbehaving peer can't leak them into this process. */
+  int result = -1;
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+       cm = CMSG_NXTHDR(&msg, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+      continue;
+    size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < count; i++) {
+      int passed;
+      memcpy(&passed, CMSG_DATA(cm) + i * sizeof passed, sizeof passed);
+      if (result < 0) {
+	fcntl(passed, F_SETFD, FD_CLOEXEC);
+	result = passed;
+      } else {
+	close(passed);
+      }
+    }
+  }
+
+  /* Some descriptors were discarded by the kernel, so what we have
+     might not be what the peer meant. */
+  if (msg.msg_flags & MSG_CTRUNC) {
+    if (result >= 0) close(result);
+    (*env)->ThrowNew(env, ids.ioException, "descriptor control truncated");
+    return -1;
+  }
+  return result;
+#undef MAX_PASSED
 }